@@ -23,6 +23,8 @@ HEADERS  += ../../../include/ma/detail/binder.hpp \
             ../../../include/ma/cyclic_buffer.hpp \
             ../../../include/ma/handler_alloc_helpers.hpp \
             ../../../include/ma/handler_allocator.hpp \
+            ../../../include/ma/io_service_loop.hpp \
+            ../../../include/ma/io_service_loop_stats.hpp \
             ../../../include/ma/handler_invoke_helpers.hpp \
             ../../../include/ma/handler_cont_helpers.hpp \
             ../../../include/ma/limited_int.hpp \
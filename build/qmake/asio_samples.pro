@@ -13,8 +13,11 @@ SUBDIRS  = asio_performance_test_client\
            async_connect \
            handler_storage_test \
            echo_server \
+           event_trace_converter \
            nmea_client \
+           parser_test \
            qt_echo_server \
+           session_test \
            shared_ptr_factory_test \
            windows_console_signal_test
 
@@ -0,0 +1,24 @@
+#
+# Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+#
+# Distributed under the Boost Software License, Version 1.0. (See accompanying
+# file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#
+
+TEMPLATE  = app
+QT       -= core gui
+TARGET    = event_trace_converter
+CONFIG   += console
+CONFIG   -= app_bundle
+
+# Common project configuration
+include(../config.pri)
+
+HEADERS  += ../../../include/ma/config.hpp \
+            ../../../include/ma/event_trace.hpp \
+            ../../../include/ma/echo/server/trace_event_type.hpp
+
+SOURCES  += ../../../src/event_trace_converter/main.cpp
+
+INCLUDEPATH += $${BOOST_INCLUDE} \
+               ../../../include
@@ -0,0 +1,34 @@
+#
+# Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+#
+# Distributed under the Boost Software License, Version 1.0. (See accompanying
+# file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#
+
+TEMPLATE  = app
+QT       -= core gui
+TARGET    = parser_test
+CONFIG   += console thread
+CONFIG   -= app_bundle
+
+# Common project configuration
+include(../config.pri)
+
+HEADERS  += ../../../include/ma/detail/buffer_blocks.hpp \
+            ../../../include/ma/config.hpp \
+            ../../../include/ma/cyclic_buffer.hpp \
+            ../../../include/ma/frame_parser.hpp \
+            ../../../include/ma/http_request_parser.hpp \
+            ../../../include/ma/line_parser.hpp \
+            ../../../include/ma/open_hash_map.hpp
+
+SOURCES  += ../../../src/parser_test/main.cpp
+
+INCLUDEPATH += $${BOOST_INCLUDE} \
+               ../../../include
+
+LIBS       += -L$${BOOST_LIB}
+unix:LIBS  += $${BOOST_LIB}/libboost_system.a
+
+win32:DEFINES += WINVER=0x0500 \
+                 _WIN32_WINNT=0x0500
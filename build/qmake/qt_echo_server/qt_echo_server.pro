@@ -34,22 +34,41 @@ HEADERS  += ../../../include/ma/echo/server/qt/custommetatypes.h \
             ../../../include/ma/echo/server/session_config_fwd.hpp \
             ../../../include/ma/echo/server/session_manager_config_fwd.hpp \
             ../../../include/ma/echo/server/session_manager_stats.hpp \
+            ../../../include/ma/echo/server/session_stats.hpp \
             ../../../include/ma/echo/server/session_manager_stats_fwd.hpp \
+            ../../../include/ma/echo/server/handler_timing_tag.hpp \
+            ../../../include/ma/echo/server/trace_event_type.hpp \
             ../../../include/ma/echo/server/session_config.hpp \
             ../../../include/ma/echo/server/session_manager_config.hpp \
             ../../../include/ma/echo/server/session_fwd.hpp \
+            ../../../include/ma/echo/server/managed_session_fwd.hpp \
             ../../../include/ma/echo/server/session_manager_fwd.hpp \
             ../../../include/ma/echo/server/error.hpp \
             ../../../include/ma/echo/server/session.hpp \
+            ../../../include/ma/echo/server/managed_session.hpp \
             ../../../include/ma/echo/server/session_manager.hpp \
             ../../../include/ma/echo/server/session_manager_fwd.hpp \
             ../../../include/ma/echo/server/pooled_session_factory.hpp \
             ../../../include/ma/echo/server/session_factory.hpp \
             ../../../include/ma/echo/server/session_factory_fwd.hpp \
             ../../../include/ma/echo/server/simple_session_factory.hpp \
+            ../../../include/ma/echo/server/broadcast_session.hpp \
+            ../../../include/ma/echo/server/feed_session.hpp \
+            ../../../include/ma/echo/server/http_session.hpp \
+            ../../../include/ma/echo/server/kv_session.hpp \
+            ../../../include/ma/echo/server/chargen_session.hpp \
+            ../../../include/ma/echo/server/discard_session.hpp \
+            ../../../include/ma/echo/server/detail/session_handler_binder.hpp \
+            ../../../include/ma/echo/server/session_type.hpp \
+            ../../../include/ma/echo/server/relay_session.hpp \
+            ../../../include/ma/echo/server/udp_echo_config.hpp \
+            ../../../include/ma/echo/server/udp_echo_service.hpp \
+            ../../../include/ma/echo/server/udp_echo_service_fwd.hpp \
+            ../../../include/ma/echo/server/udp_echo_stats.hpp \
             ../../../include/ma/detail/binder.hpp \
             ../../../include/ma/detail/handler_ptr.hpp \
             ../../../include/ma/detail/intrusive_list.hpp \
+            ../../../include/ma/detail/buffer_blocks.hpp \
             ../../../include/ma/detail/service_base.hpp \
             ../../../include/ma/bind_handler.hpp \
             ../../../include/ma/config.hpp \
@@ -57,15 +76,31 @@ HEADERS  += ../../../include/ma/echo/server/qt/custommetatypes.h \
             ../../../include/ma/context_wrapped_handler.hpp \
             ../../../include/ma/custom_alloc_handler.hpp \
             ../../../include/ma/cyclic_buffer.hpp \
+            ../../../include/ma/memory_budget.hpp \
+            ../../../include/ma/memory_budget_stats.hpp \
+            ../../../include/ma/http_request_parser.hpp \
+            ../../../include/ma/line_parser.hpp \
+            ../../../include/ma/open_hash_map.hpp \
+            ../../../include/ma/kv_store.hpp \
+            ../../../include/ma/kv_store_stats.hpp \
+            ../../../include/ma/frame_parser.hpp \
+            ../../../include/ma/broadcast_hub.hpp \
+            ../../../include/ma/broadcast_hub_stats.hpp \
+            ../../../include/ma/token_bucket.hpp \
             ../../../include/ma/handler_alloc_helpers.hpp \
             ../../../include/ma/handler_allocator.hpp \
             ../../../include/ma/handler_cont_helpers.hpp \
             ../../../include/ma/handler_invoke_helpers.hpp \
             ../../../include/ma/handler_storage.hpp \
             ../../../include/ma/handler_storage_service.hpp \
+            ../../../include/ma/io_service_loop.hpp \
+            ../../../include/ma/io_service_loop_stats.hpp \
+            ../../../include/ma/handler_timing.hpp \
+            ../../../include/ma/event_trace.hpp \
             ../../../include/ma/limited_int.hpp \
             ../../../include/ma/shared_ptr_factory.hpp \
             ../../../include/ma/sp_intrusive_list.hpp \
+            ../../../include/ma/slab_allocator.hpp \
             ../../../include/ma/steady_deadline_timer.hpp \
             ../../../include/ma/strand_wrapped_handler.hpp \
             ../../../include/ma/type_traits.hpp
@@ -78,6 +113,15 @@ SOURCES  += ../../../src/ma/echo/server/qt/custommetatypes.cpp \
             ../../../src/ma/echo/server/session_manager.cpp \
             ../../../src/ma/echo/server/pooled_session_factory.cpp \
             ../../../src/ma/echo/server/simple_session_factory.cpp \
+            ../../../src/ma/echo/server/broadcast_session.cpp \
+            ../../../src/ma/echo/server/feed_session.cpp \
+            ../../../src/ma/echo/server/http_session.cpp \
+            ../../../src/ma/echo/server/kv_session.cpp \
+            ../../../src/ma/echo/server/chargen_session.cpp \
+            ../../../src/ma/echo/server/discard_session.cpp \
+            ../../../src/ma/echo/server/relay_session.cpp \
+            ../../../src/ma/handler_timing.cpp \
+            ../../../src/ma/event_trace.cpp \
             ../../../src/qt_echo_server/main.cpp
 
 FORMS    += ../../../src/ma/echo/server/qt/mainform.ui
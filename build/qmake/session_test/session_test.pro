@@ -0,0 +1,56 @@
+#
+# Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+#
+# Distributed under the Boost Software License, Version 1.0. (See accompanying
+# file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#
+
+TEMPLATE  = app
+QT       -= core gui
+TARGET    = session_test
+CONFIG   += console thread
+CONFIG   -= app_bundle
+
+# Common project configuration
+include(../config.pri)
+
+HEADERS  += ../../../include/ma/echo/server/session_config_fwd.hpp \
+            ../../../include/ma/echo/server/session_config.hpp \
+            ../../../include/ma/echo/server/session_stats.hpp \
+            ../../../include/ma/echo/server/session_fwd.hpp \
+            ../../../include/ma/echo/server/session.hpp \
+            ../../../include/ma/echo/server/error.hpp \
+            ../../../include/ma/echo/server/handler_timing_tag.hpp \
+            ../../../include/ma/echo/server/trace_event_type.hpp \
+            ../../../include/ma/echo/server/detail/session_handler_binder.hpp \
+            ../../../include/ma/config.hpp \
+            ../../../include/ma/cyclic_buffer.hpp \
+            ../../../include/ma/memory_budget.hpp \
+            ../../../include/ma/handler_allocator.hpp \
+            ../../../include/ma/handler_storage.hpp \
+            ../../../include/ma/handler_storage_service.hpp \
+            ../../../include/ma/handler_timing.hpp \
+            ../../../include/ma/event_trace.hpp \
+            ../../../include/ma/steady_deadline_timer.hpp \
+            ../../../include/ma/strand_wrapped_handler.hpp
+
+SOURCES  += ../../../src/ma/echo/server/error.cpp \
+            ../../../src/ma/echo/server/session.cpp \
+            ../../../src/ma/handler_timing.cpp \
+            ../../../src/ma/event_trace.cpp \
+            ../../../src/session_test/main.cpp
+
+INCLUDEPATH += $${BOOST_INCLUDE} \
+               ../../../include
+
+LIBS       += -L$${BOOST_LIB}
+unix:LIBS  += $${BOOST_LIB}/libboost_system.a \
+              $${BOOST_LIB}/libboost_thread.a \
+              $${BOOST_LIB}/libboost_date_time.a
+exists($${BOOST_INCLUDE}/boost/chrono.hpp) {
+  unix:LIBS += $${BOOST_LIB}/libboost_chrono.a \
+               -lrt
+}
+
+win32:DEFINES += WINVER=0x0500 \
+                 _WIN32_WINNT=0x0500
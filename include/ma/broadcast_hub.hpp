@@ -0,0 +1,261 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_BROADCAST_HUB_HPP
+#define MA_BROADCAST_HUB_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include <boost/assert.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <ma/sp_intrusive_list.hpp>
+#include <ma/broadcast_hub_stats.hpp>
+
+namespace ma {
+
+/// Thread-safe fan-out of the messages published by one consumer to all the
+/// other subscribed consumers, e.g. to the other sessions of server.
+/**
+ * Message is reference counted and is shared by all subscribers, so it
+ * isn't copied per subscriber. Each subscriber has its own queue limited by
+ * the total size of queued messages. If message doesn't fit the queue of
+ * slow subscriber then either the oldest queued messages are dropped or the
+ * subscriber is overflowed (it gets no more messages and has to go away)
+ * depending on the overflow policy of hub. Message is always queued to the
+ * empty queue, so message greater than limit isn't lost.
+ */
+class broadcast_hub : private boost::noncopyable
+{
+public:
+  typedef std::vector<char>                message;
+  typedef boost::shared_ptr<const message> message_ptr;
+  typedef std::deque<message_ptr>          message_queue;
+
+  struct overflow_policy
+  {
+    enum value_t {drop_oldest, disconnect};
+  };
+
+  /// Is called when message is queued to the subscriber which found its
+  /// queue empty last time or when subscriber overflows. Handler is called
+  /// within publish so it has to be short and mustn't call broadcast_hub.
+  typedef boost::function<void (void)> notify_handler;
+
+  class subscriber;
+  typedef boost::shared_ptr<subscriber> subscriber_ptr;
+
+  broadcast_hub(std::size_t queue_limit, overflow_policy::value_t policy);
+
+  /// Handler is converted to notify_handler.
+  template <typename Handler>
+  subscriber_ptr subscribe(const Handler& handler);
+
+  /// Subscriber gets no more messages. Can be called more than once.
+  void unsubscribe(const subscriber_ptr& subscriber);
+
+  /// Queues message to all subscribers except publisher (can be null).
+  void publish(const message_ptr& message, const subscriber_ptr& publisher);
+
+  /// Moves messages queued to subscriber to the end of messages. Returns
+  /// false if subscriber is overflowed. If nothing was queued then
+  /// subscriber is notified about the next message.
+  bool take(const subscriber_ptr& subscriber, message_queue& messages);
+
+  broadcast_hub_stats stats() const;
+
+private:
+  typedef boost::mutex                  mutex_type;
+  typedef boost::lock_guard<mutex_type> lock_guard_type;
+  typedef sp_intrusive_list<subscriber> subscriber_list;
+  typedef std::vector<subscriber_ptr>   subscriber_vector;
+
+  // Returns true if subscriber has to be notified
+  bool push(subscriber& subscriber, const message_ptr& message);
+
+  mutable mutex_type  mutex_;
+  const overflow_policy::value_t policy_;
+  broadcast_hub_stats stats_;
+  subscriber_list     subscribers_;
+}; // class broadcast_hub
+
+/// Queue of messages of single consumer. State is guarded by broadcast_hub.
+class broadcast_hub::subscriber
+  : public sp_intrusive_list<subscriber>::base_hook
+  , private boost::noncopyable
+{
+private:
+  friend class broadcast_hub;
+
+  explicit subscriber(const notify_handler& handler);
+
+  // Isn't changed till destruction, so it is called without lock
+  const notify_handler handler_;
+  message_queue        queue_;
+  std::size_t          queued_size_;
+  bool                 subscribed_;
+  bool                 waiting_;
+  bool                 overflowed_;
+}; // class broadcast_hub::subscriber
+
+inline broadcast_hub::subscriber::subscriber(const notify_handler& handler)
+  : handler_(handler)
+  , queue_()
+  , queued_size_(0)
+  , subscribed_(true)
+  , waiting_(true)
+  , overflowed_(false)
+{
+}
+
+inline broadcast_hub::broadcast_hub(std::size_t queue_limit,
+    overflow_policy::value_t policy)
+  : mutex_()
+  , policy_(policy)
+  , stats_()
+  , subscribers_()
+{
+  BOOST_ASSERT_MSG(queue_limit, "Queue limit must be > 0");
+  stats_.queue_limit = queue_limit;
+}
+
+template <typename Handler>
+broadcast_hub::subscriber_ptr broadcast_hub::subscribe(const Handler& handler)
+{
+  subscriber_ptr subscriber(new broadcast_hub::subscriber(
+      notify_handler(handler)));
+  lock_guard_type lock_guard(mutex_);
+  subscribers_.push_front(subscriber);
+  stats_.subscribers = subscribers_.size();
+  return subscriber;
+}
+
+inline void broadcast_hub::unsubscribe(const subscriber_ptr& subscriber)
+{
+  BOOST_ASSERT_MSG(subscriber, "Subscriber must be not null");
+
+  lock_guard_type lock_guard(mutex_);
+  if (subscriber->subscribed_)
+  {
+    subscriber->subscribed_ = false;
+    subscriber->queue_.clear();
+    subscriber->queued_size_ = 0;
+    subscribers_.erase(subscriber);
+    stats_.subscribers = subscribers_.size();
+  }
+}
+
+inline void broadcast_hub::publish(const message_ptr& message,
+    const subscriber_ptr& publisher)
+{
+  BOOST_ASSERT_MSG(message, "Message must be not null");
+
+  subscriber_vector notified;
+  {
+    lock_guard_type lock_guard(mutex_);
+    ++stats_.published;
+    for (subscriber_ptr i = subscribers_.front(); i;
+        i = subscriber_list::next(i))
+    {
+      if ((i != publisher) && push(*i, message))
+      {
+        notified.push_back(i);
+      }
+    }
+  }
+
+  // Handlers are called without lock
+  for (subscriber_vector::const_iterator i = notified.begin(),
+      end = notified.end(); i != end; ++i)
+  {
+    (*i)->handler_();
+  }
+}
+
+inline bool broadcast_hub::take(const subscriber_ptr& subscriber,
+    message_queue& messages)
+{
+  BOOST_ASSERT_MSG(subscriber, "Subscriber must be not null");
+
+  lock_guard_type lock_guard(mutex_);
+  if (subscriber->overflowed_)
+  {
+    return false;
+  }
+  subscriber->waiting_ = subscriber->queue_.empty();
+  if (messages.empty())
+  {
+    messages.swap(subscriber->queue_);
+  }
+  else
+  {
+    messages.insert(messages.end(),
+        subscriber->queue_.begin(), subscriber->queue_.end());
+    subscriber->queue_.clear();
+  }
+  subscriber->queued_size_ = 0;
+  return true;
+}
+
+inline broadcast_hub_stats broadcast_hub::stats() const
+{
+  lock_guard_type lock_guard(mutex_);
+  return stats_;
+}
+
+inline bool broadcast_hub::push(subscriber& subscriber,
+    const message_ptr& message)
+{
+  if (subscriber.overflowed_)
+  {
+    return false;
+  }
+
+  const std::size_t size = message->size();
+  if (!subscriber.queue_.empty()
+      && (subscriber.queued_size_ + size > stats_.queue_limit))
+  {
+    if (overflow_policy::disconnect == policy_)
+    {
+      subscriber.overflowed_ = true;
+      subscriber.queue_.clear();
+      subscriber.queued_size_ = 0;
+      ++stats_.overflowed;
+      // Subscriber is notified even if it is busy, so it can go away
+      // without waiting for the end of its (maybe stuck) write
+      return true;
+    }
+    while (!subscriber.queue_.empty()
+        && (subscriber.queued_size_ + size > stats_.queue_limit))
+    {
+      subscriber.queued_size_ -= subscriber.queue_.front()->size();
+      subscriber.queue_.pop_front();
+      ++stats_.dropped;
+    }
+  }
+
+  subscriber.queue_.push_back(message);
+  subscriber.queued_size_ += size;
+  if (subscriber.waiting_)
+  {
+    subscriber.waiting_ = false;
+    return true;
+  }
+  return false;
+}
+
+} // namespace ma
+
+#endif // MA_BROADCAST_HUB_HPP
@@ -0,0 +1,49 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_BROADCAST_HUB_STATS_HPP
+#define MA_BROADCAST_HUB_STATS_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+namespace ma {
+
+/// Statistics of broadcast_hub.
+struct broadcast_hub_stats
+{
+public:
+  broadcast_hub_stats();
+
+  /// Limit of the size of messages (bytes) queued to single subscriber.
+  std::size_t queue_limit;
+  /// Number of subscribers at the moment.
+  std::size_t subscribers;
+  /// Number of published messages.
+  boost::uint64_t published;
+  /// Number of messages dropped from the queues of slow subscribers.
+  boost::uint64_t dropped;
+  /// Number of slow subscribers which overflowed and had to disconnect.
+  boost::uint64_t overflowed;
+}; // struct broadcast_hub_stats
+
+inline broadcast_hub_stats::broadcast_hub_stats()
+  : queue_limit(0)
+  , subscribers(0)
+  , published(0)
+  , dropped(0)
+  , overflowed(0)
+{
+}
+
+} // namespace ma
+
+#endif // MA_BROADCAST_HUB_STATS_HPP
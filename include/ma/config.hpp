@@ -154,6 +154,36 @@
 
 #endif
 
+// Measurement of handlers' timings is a diagnostic tool with some overhead.
+// Add #define MA_ENABLE_HANDLER_TIMING to the compiler options to turn it on.
+#if defined(MA_ENABLE_HANDLER_TIMING)
+
+/// Turns on measurement of handlers' timings (see ma/handler_timing.hpp).
+#define MA_HAS_HANDLER_TIMING
+
+#else
+
+/// Turns off measurement of handlers' timings (all related code is
+/// compiled out).
+#undef MA_HAS_HANDLER_TIMING
+
+#endif
+
+// Event trace is a diagnostic tool with (small) overhead which requires
+// Boost.Atomic. Add #define MA_ENABLE_EVENT_TRACE to the compiler options
+// to turn it on.
+#if defined(MA_ENABLE_EVENT_TRACE) && (BOOST_VERSION >= 105300)
+
+/// Turns on event trace (see ma/event_trace.hpp).
+#define MA_HAS_EVENT_TRACE
+
+#else
+
+/// Turns off event trace (all related code is compiled out).
+#undef MA_HAS_EVENT_TRACE
+
+#endif
+
 #if defined(BOOST_NOEXCEPT)
 #define MA_NOEXCEPT BOOST_NOEXCEPT
 #else
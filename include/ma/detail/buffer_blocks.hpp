@@ -0,0 +1,129 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_DETAIL_BUFFER_BLOCKS_HPP
+#define MA_DETAIL_BUFFER_BLOCKS_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <cstring>
+#include <boost/asio.hpp>
+#include <ma/cyclic_buffer.hpp>
+
+namespace ma {
+namespace detail {
+
+/// Random access to the filled sequence of cyclic_buffer, i.e. to the data
+/// made of (at most) two continuous blocks. Used by in place parsers.
+class buffer_blocks
+{
+public:
+  typedef cyclic_buffer::const_buffers_type buffers_type;
+
+  explicit buffer_blocks(const buffers_type& data);
+
+  std::size_t size() const;
+  unsigned char at(std::size_t offset) const;
+  /// Returns offset of the first found value or size() if it isn't found.
+  std::size_t find(unsigned char value, std::size_t offset) const;
+  buffers_type sub(std::size_t offset, std::size_t size) const;
+
+private:
+  const unsigned char* first_;
+  std::size_t          first_size_;
+  const unsigned char* second_;
+  std::size_t          second_size_;
+}; // class buffer_blocks
+
+inline buffer_blocks::buffer_blocks(const buffers_type& data)
+  : first_(0)
+  , first_size_(0)
+  , second_(0)
+  , second_size_(0)
+{
+  buffers_type::const_iterator i = data.begin();
+  const buffers_type::const_iterator end = data.end();
+  if (i != end)
+  {
+    first_ = boost::asio::buffer_cast<const unsigned char*>(*i);
+    first_size_ = boost::asio::buffer_size(*i);
+    ++i;
+  }
+  if (i != end)
+  {
+    second_ = boost::asio::buffer_cast<const unsigned char*>(*i);
+    second_size_ = boost::asio::buffer_size(*i);
+  }
+}
+
+inline std::size_t buffer_blocks::size() const
+{
+  return first_size_ + second_size_;
+}
+
+inline unsigned char buffer_blocks::at(std::size_t offset) const
+{
+  if (offset < first_size_)
+  {
+    return first_[offset];
+  }
+  return second_[offset - first_size_];
+}
+
+inline std::size_t buffer_blocks::find(unsigned char value,
+    std::size_t offset) const
+{
+  if (offset < first_size_)
+  {
+    if (const void* found = std::memchr(first_ + offset, value,
+        first_size_ - offset))
+    {
+      return static_cast<const unsigned char*>(found) - first_;
+    }
+    offset = first_size_;
+  }
+  const std::size_t second_offset = offset - first_size_;
+  if (second_offset < second_size_)
+  {
+    if (const void* found = std::memchr(second_ + second_offset, value,
+        second_size_ - second_offset))
+    {
+      return first_size_ + (static_cast<const unsigned char*>(found) - second_);
+    }
+  }
+  return size();
+}
+
+inline buffer_blocks::buffers_type buffer_blocks::sub(std::size_t offset,
+    std::size_t size) const
+{
+  typedef buffers_type::value_type buffer_type;
+
+  if (!size)
+  {
+    return buffers_type();
+  }
+  if (offset >= first_size_)
+  {
+    return buffers_type(buffer_type(second_ + (offset - first_size_), size));
+  }
+  const std::size_t first_part = first_size_ - offset;
+  if (size <= first_part)
+  {
+    return buffers_type(buffer_type(first_ + offset, size));
+  }
+  return buffers_type(buffer_type(first_ + offset, first_part),
+      buffer_type(second_, size - first_part));
+}
+
+} // namespace detail
+} // namespace ma
+
+#endif // MA_DETAIL_BUFFER_BLOCKS_HPP
@@ -0,0 +1,77 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_BROADCAST_SESSION_HPP
+#define MA_ECHO_SERVER_BROADCAST_SESSION_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/asio.hpp>
+#include <boost/system/error_code.hpp>
+#include <ma/config.hpp>
+#include <ma/cyclic_buffer.hpp>
+#include <ma/broadcast_hub.hpp>
+#include <ma/echo/server/session_config.hpp>
+#include <ma/echo/server/feed_session.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+/// Session publishing read data to the other sessions of broadcast_hub.
+/**
+ * Data read from client is published (instead of echo) and the data
+ * published by the other sessions is written to client by feed.
+ */
+class broadcast_session : public feed_session
+{
+private:
+  typedef broadcast_session this_type;
+
+public:
+  void reset();
+
+protected:
+  broadcast_session(boost::asio::io_service& io_service,
+      const session_config& config);
+  ~broadcast_session();
+
+  void start_extra_io();
+  boost::system::error_code stop_extra_io();
+  void start_socket_write(const cyclic_buffer::const_buffers_type&);
+  boost::system::error_code shutdown_socket();
+
+  boost::system::error_code update_feed();
+  bool has_feed() const;
+  void gather_feed(std::size_t offset);
+  void consume_feed(std::size_t& offset);
+
+private:
+  void post_notify();
+  void handle_notify();
+  void unsubscribe();
+
+  broadcast_hub* const          hub_;
+  broadcast_hub::subscriber_ptr subscription_;
+  // Is set by notification of hub, messages have to be taken
+  bool                          feed_notified_;
+  // Messages taken from hub, the first one can be partially written
+  broadcast_hub::message_queue  feed_messages_;
+}; // class broadcast_session
+
+inline broadcast_session::~broadcast_session()
+{
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_BROADCAST_SESSION_HPP
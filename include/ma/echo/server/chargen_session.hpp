@@ -0,0 +1,69 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_CHARGEN_SESSION_HPP
+#define MA_ECHO_SERVER_CHARGEN_SESSION_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/asio.hpp>
+#include <boost/system/error_code.hpp>
+#include <ma/config.hpp>
+#include <ma/cyclic_buffer.hpp>
+#include <ma/echo/server/session_config.hpp>
+#include <ma/echo/server/discard_session.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+/// Session of character generator service (RFC 864).
+/**
+ * The same pre-filled data is written while connection is open (till
+ * shutdown), read data is dropped.
+ */
+class chargen_session : public discard_session
+{
+private:
+  typedef chargen_session this_type;
+
+public:
+  void reset();
+  boost::system::error_code adopt(session& other);
+
+protected:
+  chargen_session(boost::asio::io_service& io_service,
+      const session_config& config);
+  ~chargen_session();
+
+  cyclic_buffer::const_buffers_type write_data() const;
+  void complete_write_data(std::size_t bytes_transferred);
+
+private:
+  // Offset of the next written data in the pattern
+  std::size_t chargen_offset_;
+}; // class chargen_session
+
+inline chargen_session::chargen_session(boost::asio::io_service& io_service,
+    const session_config& config)
+  : discard_session(io_service, config)
+  , chargen_offset_(0)
+{
+}
+
+inline chargen_session::~chargen_session()
+{
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_CHARGEN_SESSION_HPP
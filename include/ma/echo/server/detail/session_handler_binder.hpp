@@ -0,0 +1,136 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_DETAIL_SESSION_HANDLER_BINDER_HPP
+#define MA_ECHO_SERVER_DETAIL_SESSION_HANDLER_BINDER_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/error_code.hpp>
+#include <ma/config.hpp>
+
+#if defined(MA_HAS_RVALUE_REFS)
+#include <utility>
+#endif // defined(MA_HAS_RVALUE_REFS)
+
+namespace ma {
+namespace echo {
+namespace server {
+namespace detail {
+
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR) \
+    && !(defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
+
+// Home-grown binders to support move semantic. Session is session or one of
+// the session types derived from it.
+
+template <typename Session>
+class io_handler_binder
+{
+private:
+  typedef io_handler_binder this_type;
+
+public:
+  typedef void result_type;
+
+  typedef void (Session::*func_type)(const boost::system::error_code&,
+      const std::size_t);
+
+  template <typename SessionPtr>
+  io_handler_binder(func_type func, SessionPtr&& session)
+    : func_(func)
+    , session_(std::forward<SessionPtr>(session))
+  {
+  }
+
+#if defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR) || !defined(NDEBUG)
+
+  io_handler_binder(this_type&& other)
+    : func_(other.func_)
+    , session_(std::move(other.session_))
+  {
+  }
+
+  io_handler_binder(const this_type& other)
+    : func_(other.func_)
+    , session_(other.session_)
+  {
+  }
+
+#endif
+
+  void operator()(const boost::system::error_code& error,
+      const std::size_t bytes_transferred)
+  {
+    ((*session_).*func_)(error, bytes_transferred);
+  }
+
+private:
+  func_type                  func_;
+  boost::shared_ptr<Session> session_;
+}; // class io_handler_binder
+
+template <typename Session>
+class timer_handler_binder
+{
+private:
+  typedef timer_handler_binder this_type;
+
+public:
+  typedef void result_type;
+
+  typedef void (Session::*func_type)(const boost::system::error_code&);
+
+  template <typename SessionPtr>
+  timer_handler_binder(func_type func, SessionPtr&& session)
+    : func_(func)
+    , session_(std::forward<SessionPtr>(session))
+  {
+  }
+
+#if defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR) || !defined(NDEBUG)
+
+  timer_handler_binder(this_type&& other)
+    : func_(other.func_)
+    , session_(std::move(other.session_))
+  {
+  }
+
+  timer_handler_binder(const this_type& other)
+    : func_(other.func_)
+    , session_(other.session_)
+  {
+  }
+
+#endif
+
+  void operator()(const boost::system::error_code& error)
+  {
+    ((*session_).*func_)(error);
+  }
+
+private:
+  func_type                  func_;
+  boost::shared_ptr<Session> session_;
+}; // class timer_handler_binder
+
+#endif // defined(MA_HAS_RVALUE_REFS)
+       //     && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+       //     && !(defined(MA_HAS_LAMBDA)
+       //         && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
+
+} // namespace detail
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_DETAIL_SESSION_HANDLER_BINDER_HPP
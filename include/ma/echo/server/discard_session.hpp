@@ -0,0 +1,56 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_DISCARD_SESSION_HPP
+#define MA_ECHO_SERVER_DISCARD_SESSION_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <boost/asio.hpp>
+#include <boost/system/error_code.hpp>
+#include <ma/config.hpp>
+#include <ma/echo/server/session_config.hpp>
+#include <ma/echo/server/managed_session.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+/// Session of discard service (RFC 863).
+/**
+ * Read data is dropped right after read, nothing is written.
+ */
+class discard_session : public managed_session
+{
+private:
+  typedef discard_session this_type;
+
+protected:
+  discard_session(boost::asio::io_service& io_service,
+      const session_config& config);
+  ~discard_session();
+
+  boost::system::error_code parse_messages();
+}; // class discard_session
+
+inline discard_session::discard_session(boost::asio::io_service& io_service,
+    const session_config& config)
+  : managed_session(io_service, config)
+{
+}
+
+inline discard_session::~discard_session()
+{
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_DISCARD_SESSION_HPP
@@ -36,7 +36,8 @@ enum error_t
 {
   invalid_state      = 100,
   operation_aborted  = 200,
-  inactivity_timeout = 300
+  inactivity_timeout = 300,
+  subscriber_overflow = 400
 }; // enum error_t
 
 inline boost::system::error_code 
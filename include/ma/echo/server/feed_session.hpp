@@ -0,0 +1,101 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_FEED_SESSION_HPP
+#define MA_ECHO_SERVER_FEED_SESSION_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/error_code.hpp>
+#include <ma/config.hpp>
+#include <ma/handler_allocator.hpp>
+#include <ma/echo/server/session_config.hpp>
+#include <ma/echo/server/session_stats.hpp>
+#include <ma/echo/server/managed_session.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+/// Base of the sessions writing to client the data other than read data.
+/**
+ * Feed is the queue of data (messages of the other sessions, responses)
+ * written to client by its own write (feed write). Write of read data
+ * consumes read data without writing it to client. Outgoing part of
+ * connection is shut down when feed is drained.
+ */
+class feed_session : public managed_session
+{
+private:
+  typedef feed_session this_type;
+
+public:
+  void reset();
+  // Queued feed isn't moved
+  boost::system::error_code adopt(session& other);
+
+protected:
+  feed_session(boost::asio::io_service& io_service,
+      const session_config& config);
+  ~feed_session();
+
+  boost::system::error_code continue_extra_io();
+  boost::system::error_code stop_extra_io();
+  bool is_extra_io_stopped() const;
+  bool has_extra_io_activity() const;
+  boost::system::error_code shutdown_socket();
+  session_stats stats() const;
+
+  // Takes data queued to feed by the others
+  virtual boost::system::error_code update_feed();
+  // Feed has data ready to be written
+  virtual bool has_feed() const = 0;
+  // Feed has no data which is or will be ready to be written
+  virtual bool is_feed_drained() const;
+  // Gathers the ready data of feed (by means of gather_feed_buffer)
+  // starting at the given offset of the first part of feed
+  virtual void gather_feed(std::size_t offset) = 0;
+  // Drops the written parts of feed and updates offset of the first part
+  virtual void consume_feed(std::size_t& offset) = 0;
+
+  // Returns false if feed write can't take more data
+  bool gather_feed_buffer(const void* data, std::size_t size);
+
+private:
+  typedef boost::shared_ptr<this_type> this_ptr;
+
+  void start_feed_write();
+  void handle_feed_write(const boost::system::error_code&, std::size_t);
+
+  write_state::value_t feed_write_state_;
+  // Outgoing part of connection is shut down when feed is drained
+  bool                 feed_shutdown_;
+  // Offset of not yet written data in the first part of feed
+  std::size_t          feed_offset_;
+  std::size_t          feed_write_size_;
+  boost::uint64_t      feed_bytes_written_;
+  std::vector<boost::asio::const_buffer> feed_buffers_;
+
+  in_place_handler_allocator<640> feed_write_allocator_;
+}; // class feed_session
+
+inline feed_session::~feed_session()
+{
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_FEED_SESSION_HPP
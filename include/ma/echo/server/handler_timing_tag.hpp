@@ -0,0 +1,38 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_HANDLER_TIMING_TAG_HPP
+#define MA_ECHO_SERVER_HANDLER_TIMING_TAG_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+namespace ma {
+namespace echo {
+namespace server {
+
+/// Tags of the handlers measured by means of MA_TIME_IO_HANDLER and
+/// MA_TIME_HANDLER_AT (see ma/handler_timing.hpp).
+struct handler_timing_tag
+{
+  enum value_t
+  {
+    session_read,
+    session_write,
+    session_timer,
+    manager_accept,
+    session_throttle,
+    count
+  }; // enum value_t
+}; // struct handler_timing_tag
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_HANDLER_TIMING_TAG_HPP
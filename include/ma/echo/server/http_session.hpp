@@ -0,0 +1,71 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_HTTP_SESSION_HPP
+#define MA_ECHO_SERVER_HTTP_SESSION_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/asio.hpp>
+#include <boost/system/error_code.hpp>
+#include <ma/config.hpp>
+#include <ma/cyclic_buffer.hpp>
+#include <ma/http_request_parser.hpp>
+#include <ma/echo/server/session_config.hpp>
+#include <ma/echo/server/feed_session.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+/// Session answering every HTTP GET request with the same response.
+/**
+ * Requests are parsed in place (see ma::http_request_parser) and consumed
+ * at once by the write of read data. Pre-serialized response is written
+ * to client by feed once per request.
+ */
+class http_session : public feed_session
+{
+private:
+  typedef http_session this_type;
+
+public:
+  void reset();
+
+protected:
+  http_session(boost::asio::io_service& io_service,
+      const session_config& config);
+  ~http_session();
+
+  boost::system::error_code parse_messages();
+  cyclic_buffer::const_buffers_type write_data() const;
+  void start_socket_write(const cyclic_buffer::const_buffers_type&);
+
+  bool has_feed() const;
+  void gather_feed(std::size_t offset);
+  void consume_feed(std::size_t& offset);
+
+private:
+  const http_request_parser parser_;
+  // Number of the parsed requests and number of responses (the first one
+  // can be partially written) queued to feed
+  std::size_t requests_;
+  std::size_t responses_;
+}; // class http_session
+
+inline http_session::~http_session()
+{
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_HTTP_SESSION_HPP
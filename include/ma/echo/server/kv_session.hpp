@@ -0,0 +1,116 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_KV_SESSION_HPP
+#define MA_ECHO_SERVER_KV_SESSION_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/system/error_code.hpp>
+#include <ma/config.hpp>
+#include <ma/cyclic_buffer.hpp>
+#include <ma/line_parser.hpp>
+#include <ma/kv_store.hpp>
+#include <ma/echo/server/session_config.hpp>
+#include <ma/echo/server/feed_session.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+/// Session executing the commands of client on kv_store.
+/**
+ * GET, SET and DEL commands (lines) are staged per shard of store while
+ * being parsed, keys and values of commands refer to buffer_. Staged
+ * commands are executed by the write of read data, which completes (and
+ * releases read data) when all shards have executed their commands.
+ * Responses are written into reply buffer in the order of commands and
+ * are written to client by feed. Read waits while replies not yet written
+ * exceed the buffer size, replies are accounted in memory budget (if any).
+ */
+class kv_session : public feed_session
+{
+private:
+  typedef kv_session this_type;
+
+public:
+  void reset();
+
+protected:
+  kv_session(boost::asio::io_service& io_service,
+      const session_config& config);
+  ~kv_session();
+
+  boost::system::error_code parse_messages();
+  cyclic_buffer::const_buffers_type write_data() const;
+  void discard_read_data();
+  bool is_read_paused() const;
+  void start_socket_write(const cyclic_buffer::const_buffers_type&);
+
+  bool has_feed() const;
+  void gather_feed(std::size_t offset);
+  void consume_feed(std::size_t& offset);
+
+private:
+  typedef std::vector<kv_store::batch> batch_vector;
+
+  // Command is the operation of the batch of shard or an invalid command
+  struct command
+  {
+    std::size_t shard;
+    std::size_t index;
+  }; // struct command
+
+  typedef std::vector<command> command_vector;
+
+  // Commands in the order of parsing and their batches per shard of store_
+  struct command_window
+  {
+    void clear();
+    void swap(command_window& other);
+
+    batch_vector   batches;
+    command_vector commands;
+  }; // struct command_window
+
+  void stage_command(const line_parser::buffers_type& line);
+  void start_forward(std::size_t shard);
+  void post_forward_complete();
+  void handle_forward();
+  void write_replies();
+
+  kv_store* const   store_;
+  const line_parser parser_;
+  // Limit of the size of replies not yet written, read waits when it's
+  // reached
+  const std::size_t max_replies_size_;
+  // Commands being parsed and commands being executed
+  command_window    staged_;
+  command_window    executed_;
+  // Number of the batches of executed_ forwarded to shards
+  std::size_t       forwards_;
+  // Size of read data of executed_
+  std::size_t       executed_size_;
+  // Replies are added to replies_ while feed writes feed_replies_
+  std::vector<char> replies_;
+  std::vector<char> feed_replies_;
+}; // class kv_session
+
+inline kv_session::~kv_session()
+{
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_KV_SESSION_HPP
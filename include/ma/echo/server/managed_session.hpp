@@ -0,0 +1,237 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_MANAGED_SESSION_HPP
+#define MA_ECHO_SERVER_MANAGED_SESSION_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/assert.hpp>
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <ma/config.hpp>
+#include <ma/handler_allocator.hpp>
+#include <ma/sp_intrusive_list.hpp>
+#include <ma/echo/server/session.hpp>
+#include <ma/echo/server/session_config.hpp>
+#include <ma/echo/server/session_manager_fwd.hpp>
+#include <ma/echo/server/managed_session_fwd.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+/// Session with the bookkeeping of session_manager placed in the same object.
+/**
+ * session_factory creates (and recycles) instances of managed_session, so
+ * session_manager needs no separate allocation to keep track of the session.
+ */
+class managed_session
+  : public sp_intrusive_list<managed_session>::base_hook
+  , public session
+{
+private:
+  typedef managed_session this_type;
+
+protected:
+  managed_session(boost::asio::io_service& io_service,
+      const session_config& config);
+  ~managed_session();
+
+private:
+  friend class session_manager;
+
+  struct state_type
+  {
+    enum value_t {ready, start, work, stop, migrate, stopped};
+  };
+
+  typedef in_place_handler_allocator<144> start_wait_allocator_type;
+
+  typedef protocol_type::endpoint   endpoint_type;
+  typedef start_wait_allocator_type start_allocator_type;
+  typedef start_wait_allocator_type wait_allocator_type;
+  typedef in_place_handler_allocator<144> stop_allocator_type;
+
+  endpoint_type& remote_endpoint();
+  const endpoint_type& remote_endpoint() const;
+  boost::posix_time::ptime& accept_time();
+
+  start_allocator_type& start_allocator();
+  wait_allocator_type&  wait_allocator();
+  stop_allocator_type&  stop_allocator();
+
+  bool has_pending_operations() const;
+  bool starting() const;
+  bool stopping() const;
+  bool working() const;
+  bool migrating() const;
+
+  // Returns number of the writes completed since the previous call
+  long update_activity();
+  managed_session_ptr release_migration_target();
+
+  void operation_completed();
+  void mark_ready();
+  void mark_stopped();
+  void mark_working();
+  void start_started();
+  void stop_started();
+  void wait_started();
+  void migrate_started(const managed_session_ptr& target);
+
+  endpoint_type            remote_endpoint_;
+  boost::posix_time::ptime accept_time_;
+  state_type::value_t      state_;
+  std::size_t              pending_operations_;
+  long                     reported_writes_;
+  managed_session_ptr      migration_target_;
+
+  start_wait_allocator_type start_wait_allocator_;
+  stop_allocator_type       stop_allocator_;
+}; // class managed_session
+
+inline managed_session::managed_session(boost::asio::io_service& io_service,
+    const session_config& config)
+  : session(io_service, config)
+  , state_(state_type::ready)
+  , pending_operations_(0)
+  , reported_writes_(0)
+{
+}
+
+inline managed_session::~managed_session()
+{
+}
+
+inline managed_session::endpoint_type& managed_session::remote_endpoint()
+{
+  return remote_endpoint_;
+}
+
+inline const managed_session::endpoint_type&
+managed_session::remote_endpoint() const
+{
+  return remote_endpoint_;
+}
+
+inline boost::posix_time::ptime& managed_session::accept_time()
+{
+  return accept_time_;
+}
+
+inline managed_session::start_allocator_type&
+managed_session::start_allocator()
+{
+  return start_wait_allocator_;
+}
+
+inline managed_session::wait_allocator_type& managed_session::wait_allocator()
+{
+  return start_wait_allocator_;
+}
+
+inline managed_session::stop_allocator_type& managed_session::stop_allocator()
+{
+  return stop_allocator_;
+}
+
+inline bool managed_session::has_pending_operations() const
+{
+  return 0 != pending_operations_;
+}
+
+inline bool managed_session::starting() const
+{
+  return state_type::start == state_;
+}
+
+inline bool managed_session::stopping() const
+{
+  return state_type::stop == state_;
+}
+
+inline bool managed_session::working() const
+{
+  return state_type::work == state_;
+}
+
+inline bool managed_session::migrating() const
+{
+  return state_type::migrate == state_;
+}
+
+inline long managed_session::update_activity()
+{
+  const long writes = completed_writes();
+  const long activity = writes - reported_writes_;
+  reported_writes_ = writes;
+  return activity;
+}
+
+inline managed_session_ptr managed_session::release_migration_target()
+{
+  managed_session_ptr target;
+  target.swap(migration_target_);
+  return target;
+}
+
+inline void managed_session::operation_completed()
+{
+  --pending_operations_;
+}
+
+inline void managed_session::mark_ready()
+{
+  BOOST_ASSERT_MSG(!pending_operations_, "There are pending operations");
+  state_ = state_type::ready;
+  reported_writes_ = completed_writes();
+}
+
+inline void managed_session::mark_stopped()
+{
+  state_ = state_type::stopped;
+}
+
+inline void managed_session::mark_working()
+{
+  state_ = state_type::work;
+}
+
+inline void managed_session::start_started()
+{
+  state_ = state_type::start;
+  ++pending_operations_;
+}
+
+inline void managed_session::stop_started()
+{
+  state_ = state_type::stop;
+  ++pending_operations_;
+}
+
+inline void managed_session::wait_started()
+{
+  ++pending_operations_;
+}
+
+inline void managed_session::migrate_started(
+    const managed_session_ptr& target)
+{
+  state_ = state_type::migrate;
+  migration_target_ = target;
+  ++pending_operations_;
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_MANAGED_SESSION_HPP
@@ -17,8 +17,9 @@
 #include <boost/asio.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/random/linear_congruential.hpp>
 #include <ma/sp_intrusive_list.hpp>
-#include <ma/echo/server/session.hpp>
+#include <ma/echo/server/managed_session.hpp>
 #include <ma/echo/server/session_factory.hpp>
 
 namespace ma {
@@ -36,37 +37,83 @@ public:
   typedef std::vector<boost::shared_ptr<boost::asio::io_service> >
       io_service_vector;
 
+  // Rule of io_service selection for the new session
+  struct balancing_policy
+  {
+    enum value_t
+    {
+      // The least number of active sessions (full scan)
+      least_sessions,
+      // The least number of write operations in progress (full scan)
+      least_load,
+      // Next io_service in turn
+      round_robin,
+      // The least loaded of two randomly chosen io_services
+      two_choices
+    };
+  };
+
+  // Number of writes in progress is tracked only if policy uses it.
+  // Migration of sessions uses the smoothed rate of completed writes.
   pooled_session_factory(const io_service_vector& io_services,
-      std::size_t max_recycled);
+      std::size_t max_recycled, balancing_policy::value_t policy);
 
 #if !defined(NDEBUG)
   ~pooled_session_factory();
 #endif
 
-  session_ptr create(const session_config& config,
+  managed_session_ptr create(const session_config& config,
+      boost::system::error_code& error);
+  void release(const managed_session_ptr& session);
+  std::size_t recycled_count() const;
+  void add_activity(const managed_session_ptr& session, long activity);
+  void update_load();
+  managed_session_ptr create_migration_target(
+      const managed_session_ptr& session, long activity,
+      const session_config& config, boost::system::error_code& error);
+
+  // Creates (in advance) count sessions for each io_service and keeps them
+  // as recycled ones. Returns approximate size (in bytes) of memory
+  // allocated for the created sessions.
+  std::size_t prewarm(const session_config& config, std::size_t count,
+      boost::system::error_code& error);
+
+  // Same as above but for the given io_service only. Being called by
+  // the thread bound to the CPU of that io_service it places the memory of
+  // the sessions at the NUMA node of that CPU (in case of first-touch
+  // memory placement). Calls for different io_services may be concurrent.
+  std::size_t prewarm(boost::asio::io_service& io_service,
+      const session_config& config, std::size_t count,
       boost::system::error_code& error);
-  void release(const session_ptr& session);
 
 private:
-  class session_wrapper_base
-    : public sp_intrusive_list<session_wrapper_base>::base_hook
-  {
-  }; // class session_wrapper_base
+  class pool_item;
+  typedef boost::shared_ptr<pool_item> pool_item_ptr;
+  typedef std::vector<pool_item_ptr>   pool;
+  typedef pool::const_iterator         pool_link;
 
+  class session_wrapper_base;
+  typedef boost::shared_ptr<session_wrapper_base> session_wrapper_base_ptr;
   typedef sp_intrusive_list<session_wrapper_base> session_list;
 
+  template <typename Session>
   class session_wrapper;
-  typedef boost::shared_ptr<session_wrapper> session_wrapper_ptr;
 
-  class pool_item;
-  typedef boost::shared_ptr<pool_item> pool_item_ptr;
-  typedef std::vector<pool_item_ptr>   pool;
-  typedef pool::const_iterator         pool_link;
+  class session_creator;
+  class session_sizer;
+
+  static const pool_link& back_link(const managed_session_ptr& session);
 
+  static bool uses_load(balancing_policy::value_t policy);
   static pool create_pool(const io_service_vector& io_services,
-      std::size_t max_recycled);
+      std::size_t max_recycled, bool load_tracking);
+
+  pool_link select_pool_item();
 
-  const pool pool_;
+  const pool                      pool_;
+  const balancing_policy::value_t balancing_policy_;
+  std::size_t                     next_pool_item_;
+  boost::minstd_rand              random_generator_;
 }; // class pooled_session_factory
 
 #if !defined(NDEBUG)
@@ -70,6 +70,7 @@ private:
   void showConfigError(const QString& message, QWidget* widget = 0);
   void showStats(const session_manager_stats& stats);
   void writeLog(const QString& message);
+  void writeThreadStats();
   void updateWidgetsStates(bool ignorePrevServiceState = false);
   static QString buildServiceStateWindowTitle(ServiceState::State state);
 
@@ -12,10 +12,12 @@
 #pragma once
 #endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
 
+#include <vector>
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/system/error_code.hpp>
 #include <QObject>
+#include <ma/io_service_loop_stats.hpp>
 #include <ma/echo/server/session_manager_config_fwd.hpp>
 #include <ma/echo/server/session_manager_stats.hpp>
 #include <ma/echo/server/qt/servicestate.h>
@@ -39,6 +41,7 @@ public:
 
   ServiceState::State state() const;
   session_manager_stats stats() const;
+  std::vector<io_service_loop_stats> threadStats() const;
 
   void asyncStart(const execution_config&, const session_manager_config&);
 
@@ -69,6 +72,7 @@ private:
   ServiceState::State   state_;
   ServiceForwardSignal* forwardSignal_;
   session_manager_stats stats_;
+  std::vector<io_service_loop_stats> threadStats_;
   boost::scoped_ptr<server> server_;
   boost::shared_ptr<ServiceServantSignal> servantSignal_;
 }; // class Service
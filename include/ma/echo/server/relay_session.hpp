@@ -0,0 +1,96 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_RELAY_SESSION_HPP
+#define MA_ECHO_SERVER_RELAY_SESSION_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/error_code.hpp>
+#include <ma/config.hpp>
+#include <ma/cyclic_buffer.hpp>
+#include <ma/handler_allocator.hpp>
+#include <ma/echo/server/session_config.hpp>
+#include <ma/echo/server/session_stats.hpp>
+#include <ma/echo/server/managed_session.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+/// Session passing data of client to upstream and reply of upstream to client.
+/**
+ * Each connection of client has its own connection to upstream. Data read
+ * from client is written to upstream (instead of echo) and data read from
+ * upstream is written to client.
+ */
+class relay_session : public managed_session
+{
+private:
+  typedef relay_session this_type;
+
+public:
+  void reset();
+  // Connection to upstream isn't moved
+  boost::system::error_code adopt(session& other);
+
+protected:
+  relay_session(boost::asio::io_service& io_service,
+      const session_config& config);
+  ~relay_session();
+
+  void start_extra_io();
+  boost::system::error_code continue_extra_io();
+  boost::system::error_code stop_extra_io();
+  bool is_extra_io_stopped() const;
+  bool has_extra_io_activity() const;
+  void start_socket_write(const cyclic_buffer::const_buffers_type&);
+  boost::system::error_code shutdown_socket();
+  session_stats stats() const;
+
+private:
+  typedef boost::shared_ptr<this_type> this_ptr;
+
+  // Connect is counted as the first write of client data
+  void start_upstream_connect();
+  void handle_upstream_connect(const boost::system::error_code&);
+  // Reply of upstream is read to reply_buffer_ and written to client
+  void start_reply_read(const cyclic_buffer::mutable_buffers_type&);
+  void handle_reply_read(const boost::system::error_code&, std::size_t);
+  void start_reply_write(const cyclic_buffer::const_buffers_type&);
+  void handle_reply_write(const boost::system::error_code&, std::size_t);
+
+  const protocol_type::endpoint relay_endpoint_;
+
+  read_state::value_t   reply_read_state_;
+  write_state::value_t  reply_write_state_;
+  bool                  upstream_connected_;
+  boost::uint64_t       reply_bytes_read_;
+  boost::uint64_t       reply_bytes_written_;
+
+  protocol_type::socket upstream_socket_;
+  cyclic_buffer         reply_buffer_;
+
+  in_place_handler_allocator<256> reply_read_allocator_;
+  in_place_handler_allocator<640> reply_write_allocator_;
+}; // class relay_session
+
+inline relay_session::~relay_session()
+{
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_RELAY_SESSION_HPP
@@ -13,18 +13,25 @@
 #endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
 
 #include <cstddef>
+#include <boost/array.hpp>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/optional.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/smart_ptr/detail/atomic_count.hpp>
 #include <ma/config.hpp>
 #include <ma/cyclic_buffer.hpp>
+#include <ma/frame_parser.hpp>
+#include <ma/memory_budget.hpp>
+#include <ma/token_bucket.hpp>
 #include <ma/handler_storage.hpp>
 #include <ma/handler_allocator.hpp>
 #include <ma/bind_handler.hpp>
 #include <ma/context_alloc_handler.hpp>
 #include <ma/echo/server/session_config.hpp>
+#include <ma/echo/server/session_stats.hpp>
 #include <ma/echo/server/session_fwd.hpp>
 #include <ma/steady_deadline_timer.hpp>
 
@@ -47,12 +54,32 @@ private:
 public:
   typedef boost::asio::ip::tcp protocol_type;
 
+  // Thread-safe counter of the write operations in progress.
+  // May be shared by the sessions running on the same io_service.
+  typedef boost::detail::atomic_count load_counter;
+
   static session_ptr create(boost::asio::io_service& io_service,
       const session_config& config);
 
   protocol_type::socket& socket();
 
-  void reset();
+  virtual void reset();
+
+  // Touches memory of the buffer to make it resident.
+  // Can be called only right after construction or reset.
+  void prewarm();
+
+  // Takes connection (socket and not yet echoed data) from the other session
+  // stopped by async_detach. Can be called only right after construction or
+  // reset. The other session has to be stopped and it has to be of the same
+  // type.
+  virtual boost::system::error_code adopt(session& other);
+
+  // Budget isn't owned by session and has to outlive it. Read data is
+  // accounted in budget until it is echoed. Reads wait for memory when
+  // budget is exhausted. Can be called only right after construction or
+  // reset.
+  void set_memory_budget(memory_budget* budget);
 
 #if defined(MA_HAS_RVALUE_REFS)
 
@@ -65,6 +92,11 @@ public:
   template <typename Handler>
   void async_wait(Handler&& handler);
 
+  // Stops session as async_stop does but keeps connection opened
+  // to be adopted by another session.
+  template <typename Handler>
+  void async_detach(Handler&& handler);
+
 #else // defined(MA_HAS_RVALUE_REFS)
 
   template <typename Handler>
@@ -76,12 +108,116 @@ public:
   template <typename Handler>
   void async_wait(const Handler& handler);
 
+  // Stops session as async_stop does but keeps connection opened
+  // to be adopted by another session.
+  template <typename Handler>
+  void async_detach(const Handler& handler);
+
 #endif // defined(MA_HAS_RVALUE_REFS)
 
+  // Calls handler with the statistics of session (const session_stats&).
+  // Handler is called within the strand of session so it has to be short.
+  template <typename Handler>
+  void async_stats(const Handler& handler);
+
 protected:
+  struct intern_state
+  {
+    enum value_t {work, shutdown, stop, stopped};
+  };
+
+  struct read_state
+  {
+    enum value_t {wait, in_progress, stopped};
+  };
+
+  struct write_state
+  {
+    enum value_t {wait, in_progress, stopped};
+  };
+
   session(boost::asio::io_service&, const session_config&);
   ~session();
 
+  // Counter isn't owned by session and has to outlive it.
+  // Can be called only right after construction.
+  void attach_load_counter(load_counter* counter);
+
+  // Number of the completed socket writes. Can be called from any thread.
+  long completed_writes() const;
+
+  // Extension points of the session types derived from session (see
+  // relay_session, feed_session). Default implementation echoes read data.
+
+  // Extra I/O is the I/O other than the read and the write of buffer_
+  // (e.g. I/O of upstream). It starts with session, it's continued at work
+  // and at shutdown and it's stopped by the stop of session.
+  virtual void start_extra_io();
+  virtual boost::system::error_code continue_extra_io();
+  // Returns error of the cancellation
+  virtual boost::system::error_code stop_extra_io();
+  // Shutdown completes only after extra I/O is stopped
+  virtual bool is_extra_io_stopped() const;
+  virtual bool has_extra_io_activity() const;
+  // Read waits while it returns true (e.g. while the data made of read data
+  // is too big), session is continued by continue_after_io then
+  virtual bool is_read_paused() const;
+  // Message (HTTP, key-value) mode: parses the frames (requests, commands)
+  // read since the last call, data of buffer_ is written only up to the end
+  // of the last complete frame (request, command).
+  virtual boost::system::error_code parse_messages();
+  virtual cyclic_buffer::const_buffers_type write_data() const;
+  virtual void complete_write_data(std::size_t bytes_transferred);
+  // Drops read data (and whatever is made of it) which won't be written
+  // because the outgoing part of connection is shut down
+  virtual void discard_read_data();
+  virtual void start_socket_write(const cyclic_buffer::const_buffers_type&);
+  // Shuts down outgoing part of connection when all read data is written
+  virtual boost::system::error_code shutdown_socket();
+  virtual session_stats stats() const;
+
+  // Operations other than the ones of session (e.g. extra I/O) are counted
+  // as pending too
+  void add_pending_operation();
+  void remove_pending_operation();
+  void start_stop(boost::system::error_code);
+  void continue_stop();
+  // Continues work (shutdown) after the operations other than the read
+  // and write of buffer_
+  void continue_after_io();
+  boost::system::error_code cancel_timer_wait();
+  // Asynchronous write to the given socket is the socket write of session
+  void start_socket_write_to(protocol_type::socket& socket,
+      const cyclic_buffer::const_buffers_type& buffers);
+  void begin_socket_write();
+  void complete_write(const boost::system::error_code&, std::size_t);
+  // Completes the write done without asynchronous operation
+  void post_complete_write(std::size_t);
+  // Read data stays accounted in memory budget until it is written
+  void release_written_memory(std::size_t bytes_transferred);
+  // Data made of read data (e.g. responses) is accounted in memory budget
+  // without wait until it is released
+  void acquire_made_memory(std::size_t size);
+  void release_made_memory(std::size_t size);
+
+  const std::size_t                   max_transfer_size_;
+  const session_config::optional_bool no_delay_;
+
+  intern_state::value_t intern_state_;
+  read_state::value_t   read_state_;
+  write_state::value_t  write_state_;
+
+  boost::asio::io_service&        io_service_;
+  boost::asio::io_service::strand strand_;
+  protocol_type::socket           socket_;
+  cyclic_buffer                   buffer_;
+  // Size of the complete frames (requests, commands) at the start of the
+  // filled part of buffer_
+  std::size_t                     framed_size_;
+  boost::uint64_t                 messages_;
+
+  in_place_handler_allocator<640> write_allocator_;
+
 private:
 
 #if defined(MA_HAS_RVALUE_REFS) \
@@ -99,30 +235,46 @@ private:
     enum value_t {ready, work, stop, stopped};
   };
 
-  struct intern_state
+  struct timer_state
   {
-    enum value_t {work, shutdown, stop, stopped};
+    enum value_t {ready, in_progress, stopped};
   };
 
-  struct read_state
+  struct throttle_state
   {
-    enum value_t {wait, in_progress, stopped};
+    enum value_t {ready, in_progress, stopped};
   };
 
-  struct write_state
+  struct yield_state
   {
-    enum value_t {wait, in_progress, stopped};
+    enum value_t {ready, in_progress, stopped};
   };
 
-  struct timer_state
+  // Wait for the notifications of socket error queue
+  struct zerocopy_wait_state
   {
     enum value_t {ready, in_progress, stopped};
   };
 
+  // Zerocopy send which data kernel can still use
+  struct zerocopy_send
+  {
+    // Position of the sent data in the data written by session
+    boost::uint64_t start;
+    bool            released;
+  }; // struct zerocopy_send
+
+  // Limit of the number of zerocopy sends not released by kernel
+  typedef boost::array<zerocopy_send, 16> zerocopy_send_array;
+
   typedef boost::optional<boost::system::error_code> optional_error_code;
   typedef steady_deadline_timer          deadline_timer;
   typedef deadline_timer::duration_type  duration_type;
   typedef boost::optional<duration_type> optional_duration;
+  typedef token_bucket::duration_type    throttle_duration;
+  typedef boost::optional<throttle_duration> optional_throttle_duration;
+  typedef boost::optional<token_bucket>  optional_token_bucket;
+  typedef boost::optional<frame_parser>  optional_frame_parser;
 
 #if !(defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
@@ -136,17 +288,27 @@ private:
   template <typename Handler>
   void start_extern_wait(const Handler&);
 
+  template <typename Handler>
+  void start_extern_detach(const Handler&);
+
   void handle_read(const boost::system::error_code&, std::size_t);
   void handle_write(const boost::system::error_code&, std::size_t);
   void handle_timer(const boost::system::error_code&);
+  void handle_throttle_timer(const boost::system::error_code&);
+  void handle_yield();
 
 #endif // !(defined(MA_HAS_RVALUE_REFS)
        //     && defined(MA_HAS_LAMBDA)
        //     && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
 
+  // Calls handler with the statistics of session
+  template <typename Handler>
+  class stats_handler_binder;
+
   boost::system::error_code do_start_extern_start();
   optional_error_code do_start_extern_stop();
   optional_error_code do_start_extern_wait();
+  optional_error_code do_start_extern_detach();
   void complete_extern_stop(const boost::system::error_code&);
   void complete_extern_wait(const boost::system::error_code&);
 
@@ -161,57 +323,178 @@ private:
   void handle_timer_at_work(const boost::system::error_code&);
   void handle_timer_at_stop(const boost::system::error_code&);
 
+  void handle_throttle_timer_at_work(const boost::system::error_code&);
+  void handle_throttle_timer_at_stop(const boost::system::error_code&);
+
+  void handle_yield_at_work();
+  void handle_yield_at_stop();
+
   void continue_work();
   void continue_timer_wait();
+  // Timer of rate limits is also used for write coalescing window
+  void continue_throttle_wait(const throttle_duration& wait_time);
   void continue_shutdown(bool need_timer_restart);
   void continue_shutdown_at_read_wait(bool need_timer_restart);
   void continue_shutdown_at_read_in_progress(bool need_timer_restart);
   void continue_shutdown_at_read_stopped(bool need_timer_restart);
-  void continue_stop();
 
   void start_shutdown(const boost::system::error_code& error,
       bool need_timer_restart);
-  void start_stop(boost::system::error_code);
 
   void start_socket_read(const cyclic_buffer::mutable_buffers_type&);
-  void start_socket_write(const cyclic_buffer::const_buffers_type&);
+  void complete_socket_write();
+
+  // Zerocopy write completes with send, but the written data stays in
+  // buffer_ till kernel notifies that it doesn't use the data any more.
+  // Notifications are waited for while there are zerocopy sends not
+  // released by kernel.
+  void start_zerocopy_send(const cyclic_buffer::const_buffers_type&);
+  void handle_zerocopy_send(const boost::system::error_code&, std::size_t);
+  boost::system::error_code continue_zerocopy_wait();
+  void start_zerocopy_wait();
+  void handle_zerocopy_wait(const boost::system::error_code&);
+  boost::system::error_code receive_zerocopy_notifications();
+  void release_zerocopy_sends(boost::uint32_t first, boost::uint32_t last);
+  // Written data (not used by kernel) is removed from buffer_
+  void release_written_data();
+  std::size_t written_data_size() const;
+
+  // Splice read (write) waits for readiness of socket and moves data from
+  // socket to pipe (from pipe to socket). Pipe holds the data accounted
+  // by buffer_ (buffer_ memory isn't used).
+  // Splice is tried before the wait because socket is usually ready.
+  void start_splice_read(std::size_t size);
+  void start_splice_read_wait();
+  void handle_splice_read_wait(const boost::system::error_code&, std::size_t);
+  // Returns false if read has to wait for readiness of socket
+  bool try_splice_read(boost::system::error_code&, std::size_t&);
+  void complete_splice_read(const boost::system::error_code&, std::size_t);
+  void start_splice_write(std::size_t size);
+  void start_splice_write_wait();
+  void handle_splice_write_wait(const boost::system::error_code&,
+      std::size_t);
+  // Returns false if write has to wait for readiness of socket
+  bool try_splice_write(boost::system::error_code&, std::size_t&);
+  std::size_t splice_from_socket(std::size_t size,
+      boost::system::error_code& error);
+  std::size_t splice_to_socket(std::size_t size,
+      boost::system::error_code& error);
+  bool is_pipe_opened() const;
+  bool is_pipe_full() const;
+  boost::system::error_code open_pipe();
+  void close_pipe();
+
+  std::size_t reserve_read_memory(std::size_t size);
+  void complete_read_memory(std::size_t bytes_transferred);
+  void release_memory(std::size_t size);
+  void post_memory_grant(memory_budget* budget, std::size_t size);
+  void handle_memory_grant(memory_budget* budget, std::size_t size);
   void start_timer_wait();
-  boost::system::error_code cancel_timer_wait();
-  boost::system::error_code shutdown_socket();
+  void start_throttle_wait();
+  boost::system::error_code cancel_throttle_wait();
+  void start_yield();
+  boost::system::error_code cancel_socket();
   boost::system::error_code close_socket();
+  // Kernel drops connection which doesn't deliver the data of zerocopy
+  // sends in time, so it releases the sends
+  boost::system::error_code limit_zerocopy_wait();
   boost::system::error_code apply_socket_options();
 
   static optional_duration to_optional_duration(
       const session_config::optional_time_duration& duration);
 
-  const std::size_t                   max_transfer_size_;
+  // Returns true if operation of the given size has to wait for the tokens
+  // of bucket (if any), wait_time is updated then.
+  static bool is_throttled(optional_token_bucket& bucket, std::size_t size,
+      optional_throttle_duration& wait_time);
+  // Returns true if write of the given size has to wait for more data,
+  // wait_time is updated then.
+  bool is_write_coalesced(std::size_t size,
+      optional_throttle_duration& wait_time);
+  static optional_token_bucket create_token_bucket(
+      const session_config::optional_size& rate_limit,
+      std::size_t max_transfer_size);
+  static throttle_duration steady_now();
+  static optional_frame_parser create_frame_parser(
+      const session_config::optional_size& max_message_size);
+
   const session_config::optional_int  socket_recv_buffer_size_;
   const session_config::optional_int  socket_send_buffer_size_;
-  const session_config::optional_bool no_delay_;
+  const session_config::optional_int  socket_busy_poll_;
   const optional_duration             inactivity_timeout_;
+  const session_config::optional_size read_rate_limit_;
+  const session_config::optional_size write_rate_limit_;
+  const session_config::optional_size fairness_quantum_;
+  const session_config::optional_size write_coalescing_size_;
+  const session_config::optional_time_duration write_coalescing_delay_;
+  const session_config::optional_size zerocopy_threshold_;
+  const bool                          splice_;
+  const optional_frame_parser         frame_parser_;
 
   extern_state::value_t extern_state_;
-  intern_state::value_t intern_state_;
-  read_state::value_t   read_state_;
-  write_state::value_t  write_state_;
   timer_state::value_t  timer_state_;
+  throttle_state::value_t throttle_state_;
+  yield_state::value_t  yield_state_;
+  zerocopy_wait_state::value_t zerocopy_wait_state_;
   bool                  timer_wait_cancelled_;
   bool                  timer_turned_;
+  bool                  keep_connection_;
   std::size_t           pending_operations_;
+  load_counter*         load_counter_;
+  load_counter          completed_writes_;
+  boost::uint64_t       bytes_read_;
+  boost::uint64_t       bytes_written_;
+  memory_budget*        memory_budget_;
+  std::size_t           memory_held_;
+  std::size_t           memory_reserved_;
+  // Part of memory_held_ acquired by acquire_made_memory
+  std::size_t           memory_made_;
+  bool                  memory_wait_;
+  optional_token_bucket read_bucket_;
+  optional_token_bucket write_bucket_;
+  throttle_duration     throttle_expiry_;
+  std::size_t           deficit_;
+  bool                  write_coalescing_;
+  throttle_duration     write_coalescing_end_;
+  boost::uint64_t       socket_writes_;
+  boost::uint64_t       coalesced_writes_;
+  // Is set if socket supports zerocopy writes
+  bool                  zerocopy_;
+  // Write in progress is zerocopy one
+  bool                  zerocopy_send_;
+  // Positions of the end of the data written by session and of the end of
+  // the written data removed from buffer_
+  boost::uint64_t       written_position_;
+  boost::uint64_t       released_position_;
+  // Ring of the zerocopy sends not released by kernel, the first one has
+  // the number zerocopy_first_number_ (kernel numbers zerocopy sends)
+  zerocopy_send_array   zerocopy_sends_;
+  std::size_t           zerocopy_first_;
+  std::size_t           zerocopy_pending_;
+  boost::uint32_t       zerocopy_first_number_;
+  boost::uint64_t       zerocopy_writes_;
+  boost::uint64_t       zerocopy_copied_;
+  // Pipe used by splice (-1 if it isn't opened)
+  int                   pipe_read_end_;
+  int                   pipe_write_end_;
+  // Is set if read can't move data because pipe is full, so it waits
+  // for write
+  bool                  pipe_full_;
+  std::size_t           splice_read_size_;
+  std::size_t           splice_write_size_;
 
-  boost::asio::io_service&        io_service_;
-  boost::asio::io_service::strand strand_;
-  protocol_type::socket           socket_;
   deadline_timer                  timer_;
-  cyclic_buffer                   buffer_;
+  deadline_timer                  throttle_timer_;
   boost::system::error_code       extern_wait_error_;
 
   handler_storage<boost::system::error_code> extern_wait_handler_;
   handler_storage<boost::system::error_code> extern_stop_handler_;
 
-  in_place_handler_allocator<640> write_allocator_;
   in_place_handler_allocator<256> read_allocator_;
   in_place_handler_allocator<256> timer_allocator_;
+  in_place_handler_allocator<256> throttle_allocator_;
+  in_place_handler_allocator<256> yield_allocator_;
+  in_place_handler_allocator<256> zerocopy_allocator_;
 }; // class session
 
 inline session::protocol_type::socket& session::socket()
@@ -219,6 +502,25 @@ inline session::protocol_type::socket& session::socket()
   return socket_;
 }
 
+inline void session::attach_load_counter(load_counter* counter)
+{
+  BOOST_ASSERT_MSG(extern_state::ready == extern_state_,
+      "Invalid external state");
+  load_counter_ = counter;
+}
+
+inline void session::set_memory_budget(memory_budget* budget)
+{
+  BOOST_ASSERT_MSG(extern_state::ready == extern_state_,
+      "Invalid external state");
+  memory_budget_ = budget;
+}
+
+inline long session::completed_writes() const
+{
+  return completed_writes_;
+}
+
 #if defined(MA_HAS_RVALUE_REFS)
 
 #if defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR) \
@@ -384,6 +686,51 @@ void session::async_wait(Handler&& handler)
 #endif // defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
 }
 
+template <typename Handler>
+void session::async_detach(Handler&& handler)
+{
+  typedef typename remove_cv_reference<Handler>::type handler_type;
+
+#if defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+  session_ptr shared_this = shared_from_this();
+
+  strand_.post(make_explicit_context_alloc_handler(
+      std::forward<Handler>(handler),
+      [shared_this](const handler_type& handler)
+  {
+    if (optional_error_code result = shared_this->do_start_extern_detach())
+    {
+      shared_this->io_service_.post(bind_handler(handler, *result));
+    }
+    else
+    {
+      shared_this->extern_stop_handler_.store(handler);
+    }
+  }));
+
+#else  // defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+  typedef void (this_type::*func_type)(const handler_type&);
+  func_type func = &this_type::start_extern_detach<handler_type>;
+
+#if defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+
+  strand_.post(make_explicit_context_alloc_handler(
+      std::forward<Handler>(handler),
+      forward_handler_binder<handler_type>(func, shared_from_this())));
+
+#else  // defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+
+  strand_.post(make_explicit_context_alloc_handler(
+      std::forward<Handler>(handler),
+      boost::bind(func, shared_from_this(), _1)));
+
+#endif // defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+
+#endif // defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+}
+
 #else  // defined(MA_HAS_RVALUE_REFS)
 
 template <typename Handler>
@@ -422,10 +769,51 @@ void session::async_wait(const Handler& handler)
       boost::bind(func, shared_from_this(), _1)));
 }
 
+template <typename Handler>
+void session::async_detach(const Handler& handler)
+{
+  typedef Handler handler_type;
+  typedef void (this_type::*func_type)(const handler_type&);
+
+  func_type func = &this_type::start_extern_detach<handler_type>;
+
+  strand_.post(make_explicit_context_alloc_handler(handler,
+      boost::bind(func, shared_from_this(), _1)));
+}
+
 #endif // defined(MA_HAS_RVALUE_REFS)
 
 inline session::~session()
 {
+  close_pipe();
+}
+
+template <typename Handler>
+class session::stats_handler_binder
+{
+public:
+  typedef void result_type;
+
+  stats_handler_binder(const session_ptr& session, const Handler& handler)
+    : session_(session)
+    , handler_(handler)
+  {
+  }
+
+  void operator()()
+  {
+    handler_(session_->stats());
+  }
+
+private:
+  session_ptr session_;
+  Handler     handler_;
+}; // class session::stats_handler_binder
+
+template <typename Handler>
+void session::async_stats(const Handler& handler)
+{
+  strand_.post(stats_handler_binder<Handler>(shared_from_this(), handler));
 }
 
 #if !(defined(MA_HAS_RVALUE_REFS) \
@@ -464,6 +852,19 @@ void session::start_extern_wait(const Handler& handler)
   }
 }
 
+template <typename Handler>
+void session::start_extern_detach(const Handler& handler)
+{
+  if (optional_error_code result = do_start_extern_detach())
+  {
+    io_service_.post(bind_handler(handler, *result));
+  }
+  else
+  {
+    extern_stop_handler_.store(handler);
+  }
+}
+
 #endif // !(defined(MA_HAS_RVALUE_REFS)
        //     && defined(MA_HAS_LAMBDA)
        //     && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
@@ -15,10 +15,15 @@
 #include <cstddef>
 #include <boost/assert.hpp>
 #include <boost/optional.hpp>
+#include <boost/asio/ip/tcp.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <ma/echo/server/session_config_fwd.hpp>
 
 namespace ma {
+
+class broadcast_hub;
+class kv_store;
+
 namespace echo {
 namespace server {
 
@@ -29,6 +34,9 @@ public:
   typedef boost::optional<bool>            optional_bool;
   typedef boost::posix_time::time_duration time_duration;
   typedef boost::optional<time_duration>   optional_time_duration;
+  typedef boost::optional<std::size_t>     optional_size;
+  typedef boost::asio::ip::tcp::endpoint   endpoint_type;
+  typedef boost::optional<endpoint_type>   optional_endpoint;
 
   explicit session_config(
       std::size_t buffer_size,
@@ -37,7 +45,23 @@ public:
       const optional_int& socket_send_buffer_size = optional_int(),
       const optional_bool& no_delay = optional_bool(),
       const optional_time_duration& inactivity_timeout =
-          optional_time_duration());
+          optional_time_duration(),
+      const optional_int& socket_busy_poll = optional_int(),
+      const optional_size& read_rate_limit = optional_size(),
+      const optional_size& write_rate_limit = optional_size(),
+      const optional_size& fairness_quantum = optional_size(),
+      const optional_size& write_coalescing_size = optional_size(),
+      const optional_time_duration& write_coalescing_delay =
+          optional_time_duration(),
+      const optional_size& zerocopy_threshold = optional_size(),
+      bool splice = false,
+      const optional_endpoint& relay_endpoint = optional_endpoint(),
+      const optional_size& max_message_size = optional_size(),
+      bool http = false,
+      bool discard = false,
+      bool chargen = false,
+      ma::broadcast_hub* broadcast_hub = 0,
+      ma::kv_store* kv_store = 0);
 
   optional_bool no_delay;
   optional_int  socket_recv_buffer_size;
@@ -45,6 +69,49 @@ public:
   std::size_t   buffer_size;
   std::size_t   max_transfer_size;
   optional_time_duration inactivity_timeout;
+  // SO_BUSY_POLL socket option (microseconds)
+  optional_int  socket_busy_poll;
+  // Limits of average rate (bytes per second) of socket read and write.
+  // Bursts are limited by max(max_transfer_size, limit / 10).
+  optional_size read_rate_limit;
+  optional_size write_rate_limit;
+  // Number of bytes (read and written) session transfers before it lets
+  // other sessions sharing the same io_service run (deficit round-robin)
+  optional_size fairness_quantum;
+  // Write of less than write_coalescing_size bytes waits for more data
+  // during write_coalescing_delay (both have to be defined)
+  optional_size write_coalescing_size;
+  optional_time_duration write_coalescing_delay;
+  // Writes of at least this size (bytes) are done with MSG_ZEROCOPY
+  // if it's supported
+  optional_size zerocopy_threshold;
+  // Data is echoed through pipe by means of splice (if it's supported)
+  // without copying it to the buffer
+  bool          splice;
+  // Data of client is relayed to this endpoint and data of this endpoint
+  // is relayed back to client instead of echo. Limits of session apply to
+  // the data of client. Splice and zerocopy writes can't be used then.
+  optional_endpoint relay_endpoint;
+  // Message mode: data is a stream of length-prefixed frames (see
+  // ma::frame_parser) and only complete frames are echoed (relayed,
+  // published). Frame of greater payload stops session.
+  optional_size max_message_size;
+  // HTTP mode: every (pipelined) GET request of client is answered with
+  // the same pre-serialized response (see ma::http_request_parser)
+  bool          http;
+  // Discard mode (RFC 863): read data is dropped, nothing is written
+  // (see discard_session)
+  bool          discard;
+  // Chargen mode (RFC 864): the same pre-filled data is written while
+  // connection is open, read data is dropped (see chargen_session)
+  bool          chargen;
+  // Broadcast mode: read data is published to the other sessions of hub
+  // instead of echo (see broadcast_session). Hub isn't owned by session
+  // and has to outlive it.
+  ma::broadcast_hub* broadcast_hub;
+  // Key-value mode: commands (lines) read from client are executed on store
+  // (see kv_session). Store isn't owned by session and has to outlive it.
+  ma::kv_store* kv_store;
 }; // struct session_config
 
 inline session_config::session_config(
@@ -53,13 +120,43 @@ inline session_config::session_config(
     const optional_int& the_socket_recv_buffer_size,
     const optional_int& the_socket_send_buffer_size,
     const optional_bool& the_no_delay,
-    const optional_time_duration& the_inactivity_timeout)
+    const optional_time_duration& the_inactivity_timeout,
+    const optional_int& the_socket_busy_poll,
+    const optional_size& the_read_rate_limit,
+    const optional_size& the_write_rate_limit,
+    const optional_size& the_fairness_quantum,
+    const optional_size& the_write_coalescing_size,
+    const optional_time_duration& the_write_coalescing_delay,
+    const optional_size& the_zerocopy_threshold,
+    bool the_splice,
+    const optional_endpoint& the_relay_endpoint,
+    const optional_size& the_max_message_size,
+    bool the_http,
+    bool the_discard,
+    bool the_chargen,
+    ma::broadcast_hub* the_broadcast_hub,
+    ma::kv_store* the_kv_store)
   : no_delay(the_no_delay)
   , socket_recv_buffer_size(the_socket_recv_buffer_size)
   , socket_send_buffer_size(the_socket_send_buffer_size)
   , buffer_size(the_buffer_size)
   , max_transfer_size(the_max_transfer_size)
   , inactivity_timeout(the_inactivity_timeout)
+  , socket_busy_poll(the_socket_busy_poll)
+  , read_rate_limit(the_read_rate_limit)
+  , write_rate_limit(the_write_rate_limit)
+  , fairness_quantum(the_fairness_quantum)
+  , write_coalescing_size(the_write_coalescing_size)
+  , write_coalescing_delay(the_write_coalescing_delay)
+  , zerocopy_threshold(the_zerocopy_threshold)
+  , splice(the_splice)
+  , relay_endpoint(the_relay_endpoint)
+  , max_message_size(the_max_message_size)
+  , http(the_http)
+  , discard(the_discard)
+  , chargen(the_chargen)
+  , broadcast_hub(the_broadcast_hub)
+  , kv_store(the_kv_store)
 {
   BOOST_ASSERT_MSG(the_buffer_size > 0, "buffer_size must be > 0");
 
@@ -70,6 +167,44 @@ inline session_config::session_config(
   BOOST_ASSERT_MSG(
       !the_socket_send_buffer_size || (*the_socket_send_buffer_size) >= 0,
       "Defined socket_send_buffer_size must be >= 0");
+
+  BOOST_ASSERT_MSG(!the_socket_busy_poll || (*the_socket_busy_poll) >= 0,
+      "Defined socket_busy_poll must be >= 0");
+
+  BOOST_ASSERT_MSG(!the_read_rate_limit || (*the_read_rate_limit) > 0,
+      "Defined read_rate_limit must be > 0");
+
+  BOOST_ASSERT_MSG(!the_write_rate_limit || (*the_write_rate_limit) > 0,
+      "Defined write_rate_limit must be > 0");
+
+  BOOST_ASSERT_MSG(!the_fairness_quantum || (*the_fairness_quantum) > 0,
+      "Defined fairness_quantum must be > 0");
+
+  BOOST_ASSERT_MSG(!the_write_coalescing_size || the_write_coalescing_delay,
+      "write_coalescing_delay must be defined with write_coalescing_size");
+
+  BOOST_ASSERT_MSG(!the_zerocopy_threshold || (*the_zerocopy_threshold) > 0,
+      "Defined zerocopy_threshold must be > 0");
+
+  BOOST_ASSERT_MSG(!the_max_message_size
+      || (*the_max_message_size) < the_buffer_size,
+      "Defined max_message_size must be < buffer_size");
+
+  BOOST_ASSERT_MSG(!(the_discard && the_chargen),
+      "Only one of discard and chargen can be set");
+
+  BOOST_ASSERT_MSG(!the_relay_endpoint
+      || (!the_splice && !the_zerocopy_threshold),
+      "Splice and zerocopy_threshold can't be set with relay_endpoint");
+
+  BOOST_ASSERT_MSG(!(the_discard || the_chargen)
+      || (!the_splice && !the_zerocopy_threshold),
+      "Splice and zerocopy_threshold can't be set with discard or chargen");
+
+  BOOST_ASSERT_MSG(!(the_http || the_broadcast_hub || the_kv_store)
+      || (!the_splice && !the_zerocopy_threshold),
+      "Splice and zerocopy_threshold can't be set with http, broadcast_hub "
+      "or kv_store");
 }
 
 } // namespace server
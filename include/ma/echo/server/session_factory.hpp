@@ -12,8 +12,9 @@
 #pragma once
 #endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
 
+#include <cstddef>
 #include <boost/system/error_code.hpp>
-#include <ma/echo/server/session_fwd.hpp>
+#include <ma/echo/server/managed_session_fwd.hpp>
 #include <ma/echo/server/session_config_fwd.hpp>
 #include <ma/echo/server/session_factory_fwd.hpp>
 
@@ -27,9 +28,24 @@ private:
   typedef session_factory this_type;
 
 public:
-  virtual session_ptr create(const session_config& config,
+  virtual managed_session_ptr create(const session_config& config,
       boost::system::error_code& error) = 0;
-  virtual void release(const session_ptr& session) = 0;
+  virtual void release(const managed_session_ptr& session) = 0;
+  virtual std::size_t recycled_count() const = 0;
+  // Accounts the writes completed by the given session since the previous
+  // rebalancing.
+  virtual void add_activity(const managed_session_ptr& session,
+      long activity) = 0;
+  // Updates the (smoothed) load of io_services by the activity added since
+  // the previous call.
+  virtual void update_load() = 0;
+  // Creates session bound to the less loaded io_service than the one of
+  // the given (working) session having the given activity. Returns null
+  // pointer (and no error) if the given session is better to keep at its
+  // io_service.
+  virtual managed_session_ptr create_migration_target(
+      const managed_session_ptr& session, long activity,
+      const session_config& config, boost::system::error_code& error) = 0;
 
 protected:
   session_factory()
@@ -15,23 +15,28 @@
 #include <cstddef>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
+#include <boost/function.hpp>
 #include <boost/optional.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/thread/mutex.hpp>
 #include <ma/config.hpp>
 #include <ma/handler_storage.hpp>
 #include <ma/handler_allocator.hpp>
+#include <ma/memory_budget.hpp>
 #include <ma/bind_handler.hpp>
 #include <ma/context_alloc_handler.hpp>
 #include <ma/sp_intrusive_list.hpp>
-#include <ma/echo/server/session_fwd.hpp>
+#include <ma/steady_deadline_timer.hpp>
+#include <ma/echo/server/managed_session_fwd.hpp>
 #include <ma/echo/server/session_factory_fwd.hpp>
 #include <ma/echo/server/session_config.hpp>
 #include <ma/echo/server/session_manager_config.hpp>
 #include <ma/echo/server/session_manager_stats.hpp>
 #include <ma/echo/server/session_manager_fwd.hpp>
+#include <ma/echo/server/session_stats.hpp>
 
 #if defined(MA_HAS_RVALUE_REFS)
 #include <utility>
@@ -53,12 +58,12 @@ private:
 public:
   typedef boost::asio::ip::tcp protocol_type;
 
-  // Note that session_io_service has to outlive io_service
+  // Note that session_io_service has to outlive io_service.
   static session_manager_ptr create(boost::asio::io_service& io_service,
       session_factory& managed_session_factory,
       const session_manager_config& config);
 
-  void reset(bool free_recycled_sessions = true);
+  void reset();
 
   session_manager_stats stats();
 
@@ -86,6 +91,13 @@ public:
 
 #endif // defined(MA_HAS_RVALUE_REFS)
 
+  // Makes snapshot of active sessions and posts handler with it
+  // (const session_snapshot_vector&) to io_service of session_manager.
+  // The strand of session_manager is held only to copy the list of active
+  // sessions. Statistics of each session are collected within its strand.
+  template <typename Handler>
+  void async_snapshot(const Handler& handler);
+
 protected:
   // Note that session_io_service has to outlive io_service
   session_manager(boost::asio::io_service&, session_factory&,
@@ -107,6 +119,7 @@ private:
     void set_recycled_session_count(std::size_t);
     void session_accepted(const boost::system::error_code&);
     void session_stopped(const boost::system::error_code&);
+    void session_migrated();
     void reset();
 
   private:
@@ -114,14 +127,11 @@ private:
     session_manager_stats stats_;
   }; // class stats_collector
 
-  class session_wrapper_base
-    : public sp_intrusive_list<session_wrapper_base>::base_hook
-  {
-  }; // class session_wrapper_base
+  class snapshot_collector;
 
-  class session_wrapper;
-  typedef boost::shared_ptr<session_wrapper> session_wrapper_ptr;
-  typedef sp_intrusive_list<session_wrapper_base> session_list;
+  typedef sp_intrusive_list<managed_session> session_list;
+  typedef boost::function<void (const session_snapshot_vector&)>
+      snapshot_handler;
 
 #if defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR) \
@@ -152,7 +162,15 @@ private:
     enum value_t {ready, in_progress, stopped};
   };
 
+  struct rebalance_state
+  {
+    enum value_t {ready, in_progress, stopped};
+  };
+
   typedef boost::optional<boost::system::error_code> optional_error_code;
+  typedef steady_deadline_timer          deadline_timer;
+  typedef deadline_timer::duration_type  duration_type;
+  typedef boost::optional<duration_type> optional_duration;
 
 #if !(defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
@@ -166,19 +184,24 @@ private:
   template <typename Handler>
   void start_extern_wait(const Handler&);
 
-  void handle_accept(const session_wrapper_ptr&,
+  void handle_accept(const managed_session_ptr&,
+      const boost::system::error_code&);
+  void handle_session_start(const managed_session_ptr&,
       const boost::system::error_code&);
-  void handle_session_start(const session_wrapper_ptr&,
+  void handle_session_wait(const managed_session_ptr&,
       const boost::system::error_code&);
-  void handle_session_wait(const session_wrapper_ptr&,
+  void handle_session_stop(const managed_session_ptr&,
       const boost::system::error_code&);
-  void handle_session_stop(const session_wrapper_ptr&,
+  void handle_session_detach(const managed_session_ptr&,
       const boost::system::error_code&);
+  void handle_rebalance_timer(const boost::system::error_code&);
 
 #endif // !(defined(MA_HAS_RVALUE_REFS)
        //     && defined(MA_HAS_LAMBDA)
        //     && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
 
+  void start_snapshot(const snapshot_handler&);
+
   boost::system::error_code do_start_extern_start();
   optional_error_code do_start_extern_stop();
   optional_error_code do_start_extern_wait();
@@ -187,31 +210,39 @@ private:
 
   void continue_work();
 
-  void handle_accept_at_work(const session_wrapper_ptr&,
+  void handle_accept_at_work(const managed_session_ptr&,
+      const boost::system::error_code&);
+  void handle_accept_at_stop(const managed_session_ptr&,
+      const boost::system::error_code&);
+
+  void handle_session_start_at_work(const managed_session_ptr&,
       const boost::system::error_code&);
-  void handle_accept_at_stop(const session_wrapper_ptr&,
+  void handle_session_start_at_stop(const managed_session_ptr&,
       const boost::system::error_code&);
 
-  void handle_session_start_at_work(const session_wrapper_ptr&,
+  void handle_session_wait_at_work(const managed_session_ptr&,
       const boost::system::error_code&);
-  void handle_session_start_at_stop(const session_wrapper_ptr&,
+  void handle_session_wait_at_stop(const managed_session_ptr&,
       const boost::system::error_code&);
 
-  void handle_session_wait_at_work(const session_wrapper_ptr&,
+  void handle_session_stop_at_work(const managed_session_ptr&,
       const boost::system::error_code&);
-  void handle_session_wait_at_stop(const session_wrapper_ptr&,
+  void handle_session_stop_at_stop(const managed_session_ptr&,
       const boost::system::error_code&);
 
-  void handle_session_stop_at_work(const session_wrapper_ptr&,
+  void handle_session_detach_at_work(const managed_session_ptr&,
       const boost::system::error_code&);
-  void handle_session_stop_at_stop(const session_wrapper_ptr&,
+  void handle_session_detach_at_stop(const managed_session_ptr&,
       const boost::system::error_code&);
 
+  void handle_rebalance_timer_at_work(const boost::system::error_code&);
+  void handle_rebalance_timer_at_stop(const boost::system::error_code&);
+
   void start_stop(const boost::system::error_code&);
   void continue_stop();
 
-  session_wrapper_ptr start_active_session_stop(
-      session_wrapper_ptr begin, std::size_t max_count);
+  managed_session_ptr start_active_session_stop(
+      managed_session_ptr begin, std::size_t max_count);
   void schedule_active_session_stop();
 
 #if !(defined(MA_HAS_RVALUE_REFS) \
@@ -219,18 +250,22 @@ private:
   void handle_scheduled_active_session_stop();
 #endif
 
-  void start_accept_session(const session_wrapper_ptr&);
-  void start_session_start(const session_wrapper_ptr&);
-  void start_session_stop(const session_wrapper_ptr&);
-  void start_session_wait(const session_wrapper_ptr&);
+  void start_accept_session(const managed_session_ptr&);
+  void start_session_start(const managed_session_ptr&);
+  void start_session_stop(const managed_session_ptr&);
+  void start_session_wait(const managed_session_ptr&);
+  void start_session_migration(const managed_session_ptr&,
+      const managed_session_ptr&);
+
+  void start_rebalance_timer();
+  boost::system::error_code cancel_rebalance_timer();
+  void rebalance();
 
-  void recycle(const session_wrapper_ptr&);
-  session_wrapper_ptr create_session(boost::system::error_code& error);
+  void recycle(const managed_session_ptr&);
+  managed_session_ptr create_session(boost::system::error_code& error);
 
-  void add_to_active(const session_wrapper_ptr&);
-  void add_to_recycled(const session_wrapper_ptr&);
-  void remove_from_active(const session_wrapper_ptr&);
-  void remove_from_recycled(const session_wrapper_ptr&);
+  void add_to_active(const managed_session_ptr&);
+  void remove_from_active(const managed_session_ptr&);
 
   boost::system::error_code open_acceptor();
   boost::system::error_code close_acceptor();
@@ -239,11 +274,13 @@ private:
     && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
 
   static void dispatch_handle_session_start(const session_manager_weak_ptr&,
-      const session_wrapper_ptr&, const boost::system::error_code&);
+      const managed_session_ptr&, const boost::system::error_code&);
   static void dispatch_handle_session_wait(const session_manager_weak_ptr&,
-      const session_wrapper_ptr&, const boost::system::error_code&);
+      const managed_session_ptr&, const boost::system::error_code&);
   static void dispatch_handle_session_stop(const session_manager_weak_ptr&,
-      const session_wrapper_ptr&, const boost::system::error_code&);
+      const managed_session_ptr&, const boost::system::error_code&);
+  static void dispatch_handle_session_detach(const session_manager_weak_ptr&,
+      const managed_session_ptr&, const boost::system::error_code&);
 
 #endif
 
@@ -251,34 +288,40 @@ private:
       const protocol_type::endpoint& endpoint, int backlog,
       boost::system::error_code& error);
 
+  static optional_duration to_optional_duration(
+      const session_manager_config::optional_time_duration& duration);
+
   const protocol_type::endpoint accepting_endpoint_;
   const int                     listen_backlog_;
   const std::size_t             max_session_count_;
-  const std::size_t             recycled_session_count_;
   const std::size_t             max_stopping_sessions_;
   const session_config          managed_session_config_;
+  const optional_duration       rebalance_period_;
 
-  extern_state::value_t extern_state_;
-  intern_state::value_t intern_state_;
-  accept_state::value_t accept_state_;
-  std::size_t           pending_operations_;
+  extern_state::value_t    extern_state_;
+  intern_state::value_t    intern_state_;
+  accept_state::value_t    accept_state_;
+  rebalance_state::value_t rebalance_state_;
+  std::size_t              pending_operations_;
 
   boost::asio::io_service&        io_service_;
   session_factory&                session_factory_;
   boost::asio::io_service::strand strand_;
   protocol_type::acceptor         acceptor_;
+  deadline_timer                  rebalance_timer_;
   session_list                    active_sessions_;
-  session_list                    recycled_sessions_;
-  session_wrapper_ptr             stopping_sessions_end_;
+  managed_session_ptr             stopping_sessions_end_;
   boost::system::error_code       accept_error_;
   boost::system::error_code       extern_wait_error_;
   stats_collector                 stats_collector_;
+  boost::scoped_ptr<memory_budget> memory_budget_;
 
   handler_storage<boost::system::error_code> extern_wait_handler_;
   handler_storage<boost::system::error_code> extern_stop_handler_;
 
   in_place_handler_allocator<512> accept_allocator_;
   in_place_handler_allocator<256> session_stop_allocator_;
+  in_place_handler_allocator<256> rebalance_allocator_;
 }; // class session_manager
 
 #if defined(MA_HAS_RVALUE_REFS)
@@ -486,8 +529,11 @@ void session_manager::async_wait(const Handler& handler)
 
 #endif // defined(MA_HAS_RVALUE_REFS)
 
-inline session_manager::~session_manager()
+template <typename Handler>
+void session_manager::async_snapshot(const Handler& handler)
 {
+  strand_.post(boost::bind(&this_type::start_snapshot, shared_from_this(),
+      snapshot_handler(handler)));
 }
 
 #if !(defined(MA_HAS_RVALUE_REFS) \
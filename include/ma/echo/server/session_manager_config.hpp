@@ -15,6 +15,7 @@
 #include <cstddef>
 #include <boost/asio.hpp>
 #include <boost/assert.hpp>
+#include <boost/optional.hpp>
 #include <ma/echo/server/session_config.hpp>
 #include <ma/echo/server/session_manager_config_fwd.hpp>
 
@@ -26,6 +27,8 @@ struct session_manager_config
 {
 public:
   typedef boost::asio::ip::tcp::endpoint endpoint_type;
+  typedef session_config::optional_time_duration optional_time_duration;
+  typedef boost::optional<std::size_t> optional_size;
 
   session_manager_config(
       const endpoint_type& accepting_endpoint,
@@ -33,7 +36,10 @@ public:
       std::size_t recycled_session_count,
       std::size_t max_stopping_sessions,
       int listen_backlog,
-      const session_config& managed_session_config);
+      const session_config& managed_session_config,
+      const optional_time_duration& rebalance_period =
+          optional_time_duration(),
+      const optional_size& memory_budget = optional_size());
 
   int            listen_backlog;
   std::size_t    max_session_count;
@@ -41,6 +47,13 @@ public:
   std::size_t    max_stopping_sessions;
   endpoint_type  accepting_endpoint;
   session_config managed_session_config;
+  // Period of moving of sessions from the busy io_services to the idle ones.
+  // No rebalancing if not set.
+  optional_time_duration rebalance_period;
+  // Limit of the total size (bytes) of data read but not yet echoed (and of
+  // key-value replies not yet written) by all sessions. Reads of sessions
+  // wait when it is reached. No limit if not set.
+  optional_size memory_budget;
 }; // struct session_manager_config
 
 inline session_manager_config::session_manager_config(
@@ -49,16 +62,23 @@ inline session_manager_config::session_manager_config(
     std::size_t the_recycled_session_count,
     std::size_t the_max_stopping_sessions,
     int the_listen_backlog,
-    const session_config& the_managed_session_config)
+    const session_config& the_managed_session_config,
+    const optional_time_duration& the_rebalance_period,
+    const optional_size& the_memory_budget)
   : listen_backlog(the_listen_backlog)
   , max_session_count(the_max_session_count)
   , recycled_session_count(the_recycled_session_count)
   , max_stopping_sessions(the_max_stopping_sessions)
   , accepting_endpoint(the_accepting_endpoint)
   , managed_session_config(the_managed_session_config)
+  , rebalance_period(the_rebalance_period)
+  , memory_budget(the_memory_budget)
 {
   BOOST_ASSERT_MSG(the_max_session_count > 0,
       "max_session_count must be > 0");
+
+  BOOST_ASSERT_MSG(!the_memory_budget || (*the_memory_budget > 0),
+      "memory_budget must be > 0");
 }
 
 } // namespace server
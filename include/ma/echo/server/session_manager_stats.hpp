@@ -15,6 +15,9 @@
 #include <cstddef>
 #include <boost/cstdint.hpp>
 #include <ma/limited_int.hpp>
+#include <ma/memory_budget_stats.hpp>
+#include <ma/broadcast_hub_stats.hpp>
+#include <ma/echo/server/udp_echo_stats.hpp>
 #include <ma/echo/server/session_manager_stats_fwd.hpp>
 
 namespace ma {
@@ -36,7 +39,8 @@ public:
       const limited_counter& active_shutdowned,
       const limited_counter& out_of_work,
       const limited_counter& timed_out,
-      const limited_counter& error_stopped);
+      const limited_counter& error_stopped,
+      const limited_counter& migrated);
 
   std::size_t     active;
   std::size_t     max_active;
@@ -46,6 +50,13 @@ public:
   limited_counter out_of_work;
   limited_counter timed_out;
   limited_counter error_stopped;
+  limited_counter migrated;
+  // Is zeroed if there is no memory budget
+  memory_budget_stats memory_budget;
+  // Is zeroed if broadcast mode is off
+  broadcast_hub_stats broadcast_hub;
+  // Is zeroed if UDP echo is off (is filled by the owner of UDP echo)
+  udp_echo_stats      udp_echo;
 }; // struct session_manager_stats
 
 inline session_manager_stats::session_manager_stats()
@@ -57,6 +68,10 @@ inline session_manager_stats::session_manager_stats()
   , out_of_work()
   , timed_out()
   , error_stopped()
+  , migrated()
+  , memory_budget()
+  , broadcast_hub()
+  , udp_echo()
 {
 }
 
@@ -68,7 +83,8 @@ inline session_manager_stats::session_manager_stats(
     const limited_counter& the_active_shutdowned,
     const limited_counter& the_out_of_work,
     const limited_counter& the_timed_out,
-    const limited_counter& the_error_stopped)
+    const limited_counter& the_error_stopped,
+    const limited_counter& the_migrated)
   : active(the_active)
   , max_active(the_max_active)
   , recycled(the_recycled)
@@ -77,6 +93,10 @@ inline session_manager_stats::session_manager_stats(
   , out_of_work(the_out_of_work)
   , timed_out(the_timed_out)
   , error_stopped(the_error_stopped)
+  , migrated(the_migrated)
+  , memory_budget()
+  , broadcast_hub()
+  , udp_echo()
 {
 }
 
@@ -0,0 +1,112 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_SESSION_STATS_HPP
+#define MA_ECHO_SERVER_SESSION_STATS_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+struct session_stats
+{
+public:
+  struct operation_state
+  {
+    enum value_t {wait, in_progress, stopped};
+  };
+
+  session_stats();
+
+  boost::uint64_t          bytes_read;
+  boost::uint64_t          bytes_written;
+  std::size_t              buffer_size;
+  // Size of read but not yet echoed data
+  std::size_t              buffer_filled;
+  operation_state::value_t read_state;
+  operation_state::value_t write_state;
+  operation_state::value_t timer_state;
+  // Time socket operations waited due to rate limits
+  boost::posix_time::time_duration read_throttled_time;
+  boost::posix_time::time_duration write_throttled_time;
+  boost::uint64_t          socket_writes;
+  // Number of socket writes saved by write coalescing
+  boost::uint64_t          coalesced_writes;
+  boost::uint64_t          zerocopy_writes;
+  // Number of zerocopy writes kernel did by copying
+  boost::uint64_t          zerocopy_copied;
+  // Data read from upstream and written to client by relay session
+  // (bytes_read and bytes_written are the data of client then)
+  boost::uint64_t          reply_bytes_read;
+  boost::uint64_t          reply_bytes_written;
+  // Data published by the other sessions (responses) and written to client
+  // by broadcast (HTTP) session
+  boost::uint64_t          feed_bytes_written;
+  // Number of the complete messages (requests) read in message (HTTP) mode
+  boost::uint64_t          messages;
+}; // struct session_stats
+
+// Entry of the snapshot of active sessions made by session_manager
+struct session_snapshot
+{
+public:
+  typedef boost::asio::ip::tcp::endpoint   endpoint_type;
+  typedef boost::posix_time::time_duration time_duration_type;
+
+  session_snapshot();
+
+  endpoint_type      remote_endpoint;
+  // Time since the connection was accepted
+  time_duration_type age;
+  session_stats      stats;
+}; // struct session_snapshot
+
+typedef std::vector<session_snapshot> session_snapshot_vector;
+
+inline session_stats::session_stats()
+  : bytes_read(0)
+  , bytes_written(0)
+  , buffer_size(0)
+  , buffer_filled(0)
+  , read_state(operation_state::wait)
+  , write_state(operation_state::wait)
+  , timer_state(operation_state::wait)
+  , read_throttled_time()
+  , write_throttled_time()
+  , socket_writes(0)
+  , coalesced_writes(0)
+  , zerocopy_writes(0)
+  , zerocopy_copied(0)
+  , reply_bytes_read(0)
+  , reply_bytes_written(0)
+  , feed_bytes_written(0)
+  , messages(0)
+{
+}
+
+inline session_snapshot::session_snapshot()
+  : remote_endpoint()
+  , age()
+  , stats()
+{
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_SESSION_STATS_HPP
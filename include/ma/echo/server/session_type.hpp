@@ -0,0 +1,69 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_SESSION_TYPE_HPP
+#define MA_ECHO_SERVER_SESSION_TYPE_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <ma/echo/server/session_config.hpp>
+#include <ma/echo/server/managed_session.hpp>
+#include <ma/echo/server/relay_session.hpp>
+#include <ma/echo/server/discard_session.hpp>
+#include <ma/echo/server/chargen_session.hpp>
+#include <ma/echo/server/http_session.hpp>
+#include <ma/echo/server/broadcast_session.hpp>
+#include <ma/echo/server/kv_session.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+/// Calls creator.template create<Session>() with the type of session
+/// serving the given configuration.
+/**
+ * Session is managed_session (echo) or one of the types derived from it.
+ * The modes served by the derived types are mutually exclusive.
+ */
+template <typename Creator>
+typename Creator::result_type dispatch_session_type(Creator& creator,
+    const session_config& config)
+{
+  if (config.relay_endpoint)
+  {
+    return creator.template create<relay_session>();
+  }
+  if (config.discard)
+  {
+    return creator.template create<discard_session>();
+  }
+  if (config.chargen)
+  {
+    return creator.template create<chargen_session>();
+  }
+  if (config.http)
+  {
+    return creator.template create<http_session>();
+  }
+  if (config.broadcast_hub)
+  {
+    return creator.template create<broadcast_session>();
+  }
+  if (config.kv_store)
+  {
+    return creator.template create<kv_session>();
+  }
+  return creator.template create<managed_session>();
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_SESSION_TYPE_HPP
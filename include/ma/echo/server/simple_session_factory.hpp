@@ -17,7 +17,8 @@
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <ma/sp_intrusive_list.hpp>
-#include <ma/echo/server/session.hpp>
+#include <ma/slab_allocator.hpp>
+#include <ma/echo/server/managed_session.hpp>
 #include <ma/echo/server/session_factory.hpp>
 
 namespace ma {
@@ -39,33 +40,52 @@ public:
   ~simple_session_factory();
 #endif
 
-  session_ptr create(const session_config& config,
+  managed_session_ptr create(const session_config& config,
+      boost::system::error_code& error);
+  void release(const managed_session_ptr& session);
+  std::size_t recycled_count() const;
+  void add_activity(const managed_session_ptr& session, long activity);
+  void update_load();
+  managed_session_ptr create_migration_target(
+      const managed_session_ptr& session, long activity,
+      const session_config& config, boost::system::error_code& error);
+
+  // Creates (in advance) count sessions and keeps them as recycled ones.
+  // Returns approximate size (in bytes) of memory allocated for the created
+  // sessions.
+  std::size_t prewarm(const session_config& config, std::size_t count,
       boost::system::error_code& error);
-  void release(const session_ptr& session);
 
 private:
+  // Sessions of different types (see dispatch_session_type) share the list
+  // of recycled sessions
   class session_wrapper_base
     : public sp_intrusive_list<session_wrapper_base>::base_hook
   {
+  protected:
+    virtual ~session_wrapper_base()
+    {
+    }
   }; // class session_wrapper_base
 
   typedef sp_intrusive_list<session_wrapper_base> session_list;
+  typedef boost::shared_ptr<session_wrapper_base> session_wrapper_base_ptr;
 
+  template <typename Session>
   class session_wrapper;
-  typedef boost::shared_ptr<session_wrapper> session_wrapper_ptr;
 
-  const std::size_t        max_recycled_;
+  class session_creator;
+  class session_sizer;
+
+  managed_session_ptr create_session(const session_config& config);
+
+  std::size_t              max_recycled_;
   boost::asio::io_service& io_service_;
   session_list             recycled_;
+  // All sessions (and their reference counters) are allocated from the slab
+  slab_allocator<session_wrapper_base> session_allocator_;
 }; // class simple_session_factory
 
-inline simple_session_factory::simple_session_factory(
-    boost::asio::io_service& io_service, std::size_t max_recycled)
-  : max_recycled_(max_recycled)
-  , io_service_(io_service)
-{
-}
-
 #if !defined(NDEBUG)
 inline simple_session_factory::~simple_session_factory()
 {
@@ -0,0 +1,45 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_TRACE_EVENT_TYPE_HPP
+#define MA_ECHO_SERVER_TRACE_EVENT_TYPE_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+namespace ma {
+namespace echo {
+namespace server {
+
+/// Types of the events traced by means of MA_TRACE_EVENT
+/// (see ma/event_trace.hpp).
+struct trace_event_type
+{
+  enum value_t
+  {
+    // Traced object is session_manager, value is the address of session
+    session_accept,
+    // Traced object is session
+    session_start,
+    // Value is the number of transferred bytes
+    session_read,
+    session_write,
+    session_timer,
+    session_shutdown,
+    session_stop,
+    // Value is the delay (microseconds) of the throttled socket operation
+    session_throttle,
+    count
+  }; // enum value_t
+}; // struct trace_event_type
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_TRACE_EVENT_TYPE_HPP
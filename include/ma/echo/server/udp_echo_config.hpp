@@ -0,0 +1,74 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_UDP_ECHO_CONFIG_HPP
+#define MA_ECHO_SERVER_UDP_ECHO_CONFIG_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/asio.hpp>
+#include <boost/assert.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+struct udp_echo_config
+{
+public:
+  typedef boost::asio::ip::udp::endpoint endpoint_type;
+
+  udp_echo_config(
+      const endpoint_type& endpoint,
+      std::size_t batch_size,
+      std::size_t max_datagram_size,
+      std::size_t shard_count,
+      bool reuse_port);
+
+  endpoint_type endpoint;
+  // Maximum number of datagrams read (and echoed) by single system call
+  std::size_t   batch_size;
+  // Longer datagrams are dropped (not echoed)
+  std::size_t   max_datagram_size;
+  // Number of sockets bound to the endpoint, each one is served by own
+  // udp_echo_service. Requires reuse_port if > 1.
+  std::size_t   shard_count;
+  // Sockets are bound with SO_REUSEPORT, so OS spreads datagrams between
+  // them (by the hash of the source address)
+  bool          reuse_port;
+}; // struct udp_echo_config
+
+inline udp_echo_config::udp_echo_config(
+    const endpoint_type& the_endpoint,
+    std::size_t the_batch_size,
+    std::size_t the_max_datagram_size,
+    std::size_t the_shard_count,
+    bool the_reuse_port)
+  : endpoint(the_endpoint)
+  , batch_size(the_batch_size)
+  , max_datagram_size(the_max_datagram_size)
+  , shard_count(the_shard_count)
+  , reuse_port(the_reuse_port)
+{
+  BOOST_ASSERT_MSG(the_batch_size > 0, "batch_size must be > 0");
+
+  BOOST_ASSERT_MSG(the_max_datagram_size > 0,
+      "max_datagram_size must be > 0");
+
+  BOOST_ASSERT_MSG((the_shard_count == 1)
+      || (the_shard_count > 1 && the_reuse_port),
+      "shard_count must be 1 or reuse_port must be set");
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_UDP_ECHO_CONFIG_HPP
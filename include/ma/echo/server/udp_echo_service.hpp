@@ -0,0 +1,125 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_UDP_ECHO_SERVICE_HPP
+#define MA_ECHO_SERVER_UDP_ECHO_SERVICE_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/system/error_code.hpp>
+#include <ma/handler_allocator.hpp>
+#include <ma/echo/server/udp_echo_config.hpp>
+#include <ma/echo/server/udp_echo_stats.hpp>
+#include <ma/echo/server/udp_echo_service_fwd.hpp>
+
+#if defined(__linux__) && defined(_GNU_SOURCE) && defined(MSG_WAITFORONE) \
+    && !defined(BOOST_ASIO_HAS_IOCP)
+#define MA_ECHO_SERVER_UDP_ECHO_HAS_MMSG
+#endif
+
+namespace ma {
+namespace echo {
+namespace server {
+
+/// Echoes datagrams received by single UDP socket.
+/**
+ * Datagrams are read into the slab of buffers allocated at construction
+ * and are echoed by batches: one recvmmsg / sendmmsg system call per batch
+ * (one datagram per call if these calls aren't available). The socket is
+ * non-blocking and io_service is used only to wait for its readiness, so
+ * the socket is read until it is drained.
+ *
+ * Handlers are never executed concurrently, so udp_echo_service can be
+ * used with io_service run by multiple threads. Sockets bound with
+ * SO_REUSEPORT (one per io_service) let OS spread datagrams between
+ * threads.
+ *
+ * Work lasts until io_service is stopped, so there is no need to stop
+ * udp_echo_service explicitly.
+ */
+class udp_echo_service
+  : public boost::enable_shared_from_this<udp_echo_service>
+  , private boost::noncopyable
+{
+private:
+  typedef udp_echo_service this_type;
+
+public:
+  typedef boost::asio::ip::udp protocol_type;
+
+  udp_echo_service(boost::asio::io_service& io_service,
+      const udp_echo_config& config);
+
+  /// Opens and binds socket and starts echo. Isn't thread-safe, has to be
+  /// called only once.
+  boost::system::error_code start();
+
+  /// Thread-safe.
+  udp_echo_stats stats() const;
+
+private:
+  typedef boost::mutex mutex_type;
+  typedef boost::lock_guard<mutex_type> lock_guard_type;
+
+  void start_wait_read();
+  void start_wait_write();
+  void handle_wait_read(const boost::system::error_code&);
+  void handle_wait_write(const boost::system::error_code&);
+  void handle_yield();
+  void echo();
+  // Reads datagrams into slab and makes them pending,
+  // error is would_block if socket is drained
+  void read_batch(boost::system::error_code&);
+  // Returns false if socket isn't ready to send all pending datagrams
+  bool write_batch();
+  void update_stats();
+
+  boost::asio::io_service&      io_service_;
+  protocol_type::socket         socket_;
+  const protocol_type::endpoint endpoint_;
+  const bool                    reuse_port_;
+  const std::size_t             batch_size_;
+  const std::size_t             max_datagram_size_;
+  // Slab of batch_size_ buffers, max_datagram_size_ bytes each
+  boost::scoped_array<char>     slab_;
+  // Datagrams [first_pending_, last_pending_) are read but not echoed yet
+  std::size_t                   first_pending_;
+  std::size_t                   last_pending_;
+
+#if defined(MA_ECHO_SERVER_UDP_ECHO_HAS_MMSG)
+  std::vector<mmsghdr>          headers_;
+  std::vector<iovec>            iovecs_;
+  std::vector<sockaddr_storage> addresses_;
+#else
+  std::vector<protocol_type::endpoint> endpoints_;
+  std::vector<std::size_t>             sizes_;
+#endif
+
+  // Is updated by handlers and is copied into stats_ once per handler
+  udp_echo_stats                local_stats_;
+  mutable mutex_type            stats_mutex_;
+  udp_echo_stats                stats_;
+
+  in_place_handler_allocator<128> read_allocator_;
+  in_place_handler_allocator<128> write_allocator_;
+}; // class udp_echo_service
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_UDP_ECHO_SERVICE_HPP
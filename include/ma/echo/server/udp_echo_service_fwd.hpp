@@ -0,0 +1,28 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_UDP_ECHO_SERVICE_FWD_HPP
+#define MA_ECHO_SERVER_UDP_ECHO_SERVICE_FWD_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <boost/shared_ptr.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+class udp_echo_service;
+typedef boost::shared_ptr<udp_echo_service> udp_echo_service_ptr;
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_UDP_ECHO_SERVICE_FWD_HPP
@@ -0,0 +1,59 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_ECHO_SERVER_UDP_ECHO_STATS_HPP
+#define MA_ECHO_SERVER_UDP_ECHO_STATS_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+/// Statistics of udp_echo_service (summed up for all shards).
+struct udp_echo_stats
+{
+public:
+  udp_echo_stats();
+
+  /// Number of sockets receiving datagrams.
+  std::size_t shards;
+  /// Number of received datagrams.
+  boost::uint64_t received;
+  /// Total size (bytes) of received datagrams.
+  boost::uint64_t received_bytes;
+  /// Number of echoed datagrams.
+  boost::uint64_t echoed;
+  /// Number of datagrams which were truncated or failed to be echoed.
+  boost::uint64_t dropped;
+  /// Number of reads (system calls) which got datagrams.
+  boost::uint64_t batches;
+  /// Maximum number of datagrams got by single read.
+  std::size_t max_batch;
+}; // struct udp_echo_stats
+
+inline udp_echo_stats::udp_echo_stats()
+  : shards(0)
+  , received(0)
+  , received_bytes(0)
+  , echoed(0)
+  , dropped(0)
+  , batches(0)
+  , max_batch(0)
+{
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
+
+#endif // MA_ECHO_SERVER_UDP_ECHO_STATS_HPP
@@ -0,0 +1,143 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_EVENT_TRACE_HPP
+#define MA_EVENT_TRACE_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <boost/cstdint.hpp>
+#include <ma/config.hpp>
+
+#if defined(MA_HAS_EVENT_TRACE)
+
+#include <cstddef>
+#include <string>
+#include <boost/system/error_code.hpp>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#elif !((defined(__GNUC__) || defined(__clang__)) \
+    && (defined(__i386__) || defined(__x86_64__)))
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#endif
+
+#endif // defined(MA_HAS_EVENT_TRACE)
+
+namespace ma {
+
+/// Record of event trace. It's written into trace file as is (with native
+/// byte order).
+struct event_trace_record
+{
+  /// Value of timestamp counter - see read_timestamp_counter.
+  boost::uint64_t timestamp;
+  /// Identity of traced object, e.g. address of session.
+  boost::uint64_t object;
+  /// Event specific value, e.g. number of transferred bytes.
+  boost::uint64_t value;
+  boost::uint32_t type;
+  /// Value of error code or zero if there is no error.
+  boost::int32_t  error;
+}; // struct event_trace_record
+
+/// Header of event trace file.
+/**
+ * Trace file consists of the header followed by thread_count blocks. Each
+ * block is event_trace_thread_header followed by record_count instances of
+ * event_trace_record ordered by time.
+ *
+ * Pairs of timestamp counter and system time (microseconds since
+ * 1970-01-01 UTC) taken at the start of trace and at the dump of trace
+ * allow to convert timestamps into time.
+ */
+struct event_trace_file_header
+{
+  char            magic[8];
+  boost::uint64_t start_timestamp;
+  boost::uint64_t start_microseconds;
+  boost::uint64_t dump_timestamp;
+  boost::uint64_t dump_microseconds;
+  boost::uint32_t thread_count;
+  boost::uint32_t reserved;
+}; // struct event_trace_file_header
+
+struct event_trace_thread_header
+{
+  /// Threads are numbered in the order of their first traced event.
+  boost::uint32_t thread_index;
+  boost::uint32_t record_count;
+}; // struct event_trace_thread_header
+
+const char event_trace_file_magic[8] = {'M', 'A', 'T', 'R', 'A', 'C', 'E', '1'};
+
+#if defined(MA_HAS_EVENT_TRACE)
+
+/// Maximum number of the latest events kept for each thread.
+const std::size_t event_trace_capacity = 8192;
+
+/// Reads CPU timestamp counter (TSC) if it's available or system time
+/// (microseconds) otherwise.
+/**
+ * It's assumed that TSC is invariant and synchronized between CPUs, like
+ * modern x86 CPUs provide.
+ */
+boost::uint64_t read_timestamp_counter();
+
+/// Adds event to the trace of the calling thread.
+/**
+ * Each thread writes its own ring buffer without locks and waits. The oldest
+ * events are overwritten when ring buffer is full.
+ */
+void trace_event(boost::uint32_t type, const void* object, int error,
+    boost::uint64_t value);
+
+/// Writes traces of all threads into the file with the given name.
+/**
+ * Can be called by any thread at any time. Events being traced during the
+ * dump may be missed.
+ */
+boost::system::error_code dump_event_trace(const std::string& file_name);
+
+inline boost::uint64_t read_timestamp_counter()
+{
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+  return __rdtsc();
+#elif (defined(__GNUC__) || defined(__clang__)) \
+    && (defined(__i386__) || defined(__x86_64__))
+  boost::uint32_t low;
+  boost::uint32_t high;
+  __asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+  return (static_cast<boost::uint64_t>(high) << 32) | low;
+#else
+  const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+  return static_cast<boost::uint64_t>((
+      boost::posix_time::microsec_clock::universal_time() - epoch)
+          .total_microseconds());
+#endif
+}
+
+#endif // defined(MA_HAS_EVENT_TRACE)
+
+} // namespace ma
+
+#if defined(MA_HAS_EVENT_TRACE)
+
+/// Adds event to the trace if event trace is turned on. Arguments aren't
+/// evaluated otherwise.
+#define MA_TRACE_EVENT(type, object, error, value) \
+    (::ma::trace_event((type), (object), (error), (value)))
+
+#else  // defined(MA_HAS_EVENT_TRACE)
+
+#define MA_TRACE_EVENT(type, object, error, value) ((void) 0)
+
+#endif // defined(MA_HAS_EVENT_TRACE)
+
+#endif // MA_EVENT_TRACE_HPP
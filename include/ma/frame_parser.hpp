@@ -0,0 +1,143 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_FRAME_PARSER_HPP
+#define MA_FRAME_PARSER_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/asio.hpp>
+#include <boost/assert.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/system/error_code.hpp>
+#include <ma/cyclic_buffer.hpp>
+#include <ma/detail/buffer_blocks.hpp>
+
+namespace ma {
+
+/// Parser of the stream of length-prefixed frames (messages).
+/**
+ * Frame is header (size of payload - 4 bytes in network byte order)
+ * followed by payload. Parser works in place on the filled sequence of
+ * cyclic_buffer, so frames (and their headers) can wrap the end of buffer
+ * and nothing is copied. All complete frames are parsed in one pass.
+ *
+ * Parser keeps no state between the calls, the caller keeps the offset of
+ * the first not parsed frame.
+ */
+class frame_parser
+{
+public:
+  typedef cyclic_buffer::const_buffers_type buffers_type;
+
+  /// Size of frame header (bytes).
+  static const std::size_t header_size = 4;
+
+  /// Frames parsed in one pass.
+  struct batch
+  {
+    batch();
+
+    /// Size of the complete frames including headers (bytes).
+    std::size_t size;
+    /// Number of the complete frames.
+    std::size_t count;
+  }; // struct batch
+
+  explicit frame_parser(std::size_t max_payload_size);
+
+  std::size_t max_payload_size() const;
+
+  /// Parses the complete frames of data starting at offset (which has to be
+  /// the start of frame) and calls handler(const buffers_type&) with the
+  /// payload of each frame. Sets error (boost::asio::error::message_size)
+  /// at the frame greater than max_payload_size, the returned batch contains
+  /// the preceding frames then.
+  template <typename Handler>
+  batch parse(const buffers_type& data, std::size_t offset, Handler handler,
+      boost::system::error_code& error) const;
+
+  /// Same as above but frames are only counted.
+  batch parse(const buffers_type& data, std::size_t offset,
+      boost::system::error_code& error) const;
+
+private:
+  struct null_handler
+  {
+    void operator()(const buffers_type&) const
+    {
+    }
+  }; // struct null_handler
+
+  std::size_t max_payload_size_;
+}; // class frame_parser
+
+inline frame_parser::batch::batch()
+  : size(0)
+  , count(0)
+{
+}
+
+inline frame_parser::frame_parser(std::size_t max_payload_size)
+  : max_payload_size_(max_payload_size)
+{
+}
+
+inline std::size_t frame_parser::max_payload_size() const
+{
+  return max_payload_size_;
+}
+
+template <typename Handler>
+frame_parser::batch frame_parser::parse(const buffers_type& data,
+    std::size_t offset, Handler handler,
+    boost::system::error_code& error) const
+{
+  const detail::buffer_blocks data_blocks(data);
+  const std::size_t size = data_blocks.size();
+  BOOST_ASSERT_MSG(offset <= size, "Invalid offset");
+
+  error = boost::system::error_code();
+  batch result;
+  std::size_t start = offset;
+  while (size - start >= header_size)
+  {
+    const boost::uint32_t payload_size =
+        (static_cast<boost::uint32_t>(data_blocks.at(start)) << 24)
+        | (static_cast<boost::uint32_t>(data_blocks.at(start + 1)) << 16)
+        | (static_cast<boost::uint32_t>(data_blocks.at(start + 2)) << 8)
+        | static_cast<boost::uint32_t>(data_blocks.at(start + 3));
+    if (payload_size > max_payload_size_)
+    {
+      error = boost::asio::error::message_size;
+      break;
+    }
+    // Incomplete frame is parsed again when the rest of it is read
+    if (size - start - header_size < payload_size)
+    {
+      break;
+    }
+    handler(data_blocks.sub(start + header_size, payload_size));
+    start += header_size + payload_size;
+    ++result.count;
+  }
+  result.size = start - offset;
+  return result;
+}
+
+inline frame_parser::batch frame_parser::parse(const buffers_type& data,
+    std::size_t offset, boost::system::error_code& error) const
+{
+  return parse(data, offset, null_handler(), error);
+}
+
+} // namespace ma
+
+#endif // MA_FRAME_PARSER_HPP
@@ -0,0 +1,475 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_HANDLER_TIMING_HPP
+#define MA_HANDLER_TIMING_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <ma/config.hpp>
+
+#if defined(MA_HAS_HANDLER_TIMING)
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <ma/handler_alloc_helpers.hpp>
+#include <ma/handler_invoke_helpers.hpp>
+#include <ma/handler_cont_helpers.hpp>
+
+#if defined(MA_HAS_RVALUE_REFS)
+#include <utility>
+#include <ma/type_traits.hpp>
+#endif // defined(MA_HAS_RVALUE_REFS)
+
+namespace ma {
+
+/// Histogram of durations with buckets of exponentially growing size.
+/**
+ * Bucket 0 counts durations shorter than 1 microsecond, bucket i (i > 0)
+ * counts durations in range [2^(i-1), 2^i) microseconds. The last bucket
+ * counts all the longer durations.
+ */
+class duration_histogram
+{
+public:
+  typedef boost::posix_time::time_duration duration_type;
+
+  static const std::size_t bucket_count = 32;
+
+  duration_histogram();
+
+  void add(const duration_type& duration);
+  void merge(const duration_histogram& other);
+
+  boost::uint64_t count() const;
+  boost::uint64_t bucket(std::size_t index) const;
+  /// Sum of added durations (in microseconds).
+  boost::uint64_t sum_microseconds() const;
+  /// Maximum added duration (in microseconds).
+  boost::uint64_t max_microseconds() const;
+  /// Upper bound (in microseconds) of the bucket holding given percentile.
+  /**
+   * Is limited by max_microseconds(). Returns zero for an empty histogram.
+   */
+  boost::uint64_t percentile_microseconds(double percentile) const;
+
+private:
+  boost::uint64_t buckets_[bucket_count];
+  boost::uint64_t count_;
+  boost::uint64_t sum_microseconds_;
+  boost::uint64_t max_microseconds_;
+}; // class duration_histogram
+
+/// Timings of the handlers having the same tag.
+struct handler_timing_stats
+{
+  /// Delay between creation (post) of handler and the start of its execution.
+  /**
+   * Isn't measured for the handlers of I/O operations (see
+   * MA_TIME_IO_HANDLER).
+   */
+  duration_histogram delay;
+  /// Execution time of handler.
+  duration_histogram run_time;
+}; // struct handler_timing_stats
+
+/// Handler timing statistics of single thread indexed by handler tag.
+typedef std::vector<handler_timing_stats> handler_timing_stats_vector;
+
+/// Maximum number of different handler tags (tag must be less than that).
+const std::size_t max_handler_timing_tag_count = 16;
+
+/// Adds timings of the handler to the statistics of the calling thread.
+/**
+ * Each thread has its own statistics so the calling thread never waits for
+ * other threads. Delay isn't added if post_time is not_a_date_time.
+ */
+void record_handler_timing(std::size_t tag,
+    const boost::posix_time::ptime& post_time,
+    const boost::posix_time::ptime& start_time,
+    const boost::posix_time::ptime& end_time);
+
+/// Returns statistics of all threads that have recorded handler timings
+/// (in the order of their first record).
+/**
+ * Can be called by any thread.
+ */
+std::vector<handler_timing_stats_vector> collect_handler_timing();
+
+/// Wrapper that measures the delay between the post time (by default - the
+/// time of its creation) and the execution of the source handler and the
+/// execution time of the source handler.
+/**
+ * Functors created by timed_handler:
+ *
+ * @li forward Asio alloctaion strategy to the one provided by handler
+ * parameter.
+ * @li forward Asio execution strategy to the one provided by handler
+ * parameter and record the timings of execution by means of
+ * record_handler_timing.
+ * @li forward operator() to to the ones provided by handler parameter.
+ *
+ * For the handler of asynchronous operation the delay includes the time of
+ * operation itself unless the time when operation completes is known and is
+ * given as the post time (like the expiration time of timer). The time when
+ * socket operation completes isn't known so only the execution time of its
+ * handler is recorded (post time is not_a_date_time).
+ * Place timed_handler inside of strand-wrapped handler to take into account
+ * the time spent in the queue of strand.
+ *
+ * Use MA_TIME_HANDLER, MA_TIME_HANDLER_AT and MA_TIME_IO_HANDLER macros
+ * to wrap handler only if
+ * MA_HAS_HANDLER_TIMING is defined, i.e. to have no overhead when handler
+ * timing is turned off.
+ *
+ * Move semantic supported.
+ * Move constructor is explicitly defined to support MSVC 2010.
+ */
+
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable: 4512)
+#endif // #if defined(_MSC_VER)
+
+template <typename Handler>
+class timed_handler
+{
+private:
+  typedef timed_handler<Handler> this_type;
+
+public:
+  typedef void result_type;
+
+#if defined(MA_HAS_RVALUE_REFS)
+
+  template <typename H>
+  timed_handler(std::size_t tag, const boost::posix_time::ptime& post_time,
+      H&& handler)
+    : tag_(tag)
+    , post_time_(post_time)
+    , handler_(std::forward<H>(handler))
+  {
+  }
+
+#if defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR) || !defined(NDEBUG)
+
+  timed_handler(this_type&& other)
+    : tag_(other.tag_)
+    , post_time_(other.post_time_)
+    , handler_(std::move(other.handler_))
+  {
+  }
+
+  timed_handler(const this_type& other)
+    : tag_(other.tag_)
+    , post_time_(other.post_time_)
+    , handler_(other.handler_)
+  {
+  }
+
+#endif
+
+#else // defined(MA_HAS_RVALUE_REFS)
+
+  timed_handler(std::size_t tag, const boost::posix_time::ptime& post_time,
+      const Handler& handler)
+    : tag_(tag)
+    , post_time_(post_time)
+    , handler_(handler)
+  {
+  }
+
+#endif // defined(MA_HAS_RVALUE_REFS)
+
+#if !defined(NDEBUG)
+  ~timed_handler()
+  {
+  }
+#endif
+
+  friend void* asio_handler_allocate(std::size_t size, this_type* context)
+  {
+    return ma_handler_alloc_helpers::allocate(size, context->handler_);
+  }
+
+  friend void asio_handler_deallocate(void* pointer, std::size_t size,
+      this_type* context)
+  {
+    ma_handler_alloc_helpers::deallocate(pointer, size, context->handler_);
+  }
+
+#if defined(MA_HAS_RVALUE_REFS)
+
+  template <typename Function>
+  friend void asio_handler_invoke(Function&& function, this_type* context)
+  {
+    // Copy of context is made because context can be destroyed by the
+    // execution of function
+    const std::size_t tag = context->tag_;
+    const boost::posix_time::ptime post_time = context->post_time_;
+    const boost::posix_time::ptime start_time =
+        boost::posix_time::microsec_clock::universal_time();
+    ma_handler_invoke_helpers::invoke(
+        std::forward<Function>(function), context->handler_);
+    record_handler_timing(tag, post_time, start_time,
+        boost::posix_time::microsec_clock::universal_time());
+  }
+
+#else // defined(MA_HAS_RVALUE_REFS)
+
+  template <typename Function>
+  friend void asio_handler_invoke(const Function& function, this_type* context)
+  {
+    // Copy of context is made because context can be destroyed by the
+    // execution of function
+    const std::size_t tag = context->tag_;
+    const boost::posix_time::ptime post_time = context->post_time_;
+    const boost::posix_time::ptime start_time =
+        boost::posix_time::microsec_clock::universal_time();
+    ma_handler_invoke_helpers::invoke(function, context->handler_);
+    record_handler_timing(tag, post_time, start_time,
+        boost::posix_time::microsec_clock::universal_time());
+  }
+
+#endif // defined(MA_HAS_RVALUE_REFS)
+
+  friend bool asio_handler_is_continuation(this_type* context)
+  {
+    return ma_handler_cont_helpers::is_continuation(context->handler_);
+  }
+
+  void operator()()
+  {
+    handler_();
+  }
+
+  template <typename Arg1>
+  void operator()(const Arg1& arg1)
+  {
+    handler_(arg1);
+  }
+
+  template <typename Arg1, typename Arg2>
+  void operator()(const Arg1& arg1, const Arg2& arg2)
+  {
+    handler_(arg1, arg2);
+  }
+
+  template <typename Arg1, typename Arg2, typename Arg3>
+  void operator()(const Arg1& arg1, const Arg2& arg2, const Arg3& arg3)
+  {
+    handler_(arg1, arg2, arg3);
+  }
+
+  template <typename Arg1, typename Arg2, typename Arg3, typename Arg4>
+  void operator()(const Arg1& arg1, const Arg2& arg2, const Arg3& arg3,
+      const Arg4& arg4)
+  {
+    handler_(arg1, arg2, arg3, arg4);
+  }
+
+  template <typename Arg1, typename Arg2, typename Arg3, typename Arg4,
+      typename Arg5>
+  void operator()(const Arg1& arg1, const Arg2& arg2, const Arg3& arg3,
+      const Arg4& arg4, const Arg5& arg5)
+  {
+    handler_(arg1, arg2, arg3, arg4, arg5);
+  }
+
+  void operator()() const
+  {
+    handler_();
+  }
+
+  template <typename Arg1>
+  void operator()(const Arg1& arg1) const
+  {
+    handler_(arg1);
+  }
+
+  template <typename Arg1, typename Arg2>
+  void operator()(const Arg1& arg1, const Arg2& arg2) const
+  {
+    handler_(arg1, arg2);
+  }
+
+  template <typename Arg1, typename Arg2, typename Arg3>
+  void operator()(const Arg1& arg1, const Arg2& arg2, const Arg3& arg3) const
+  {
+    handler_(arg1, arg2, arg3);
+  }
+
+  template <typename Arg1, typename Arg2, typename Arg3, typename Arg4>
+  void operator()(const Arg1& arg1, const Arg2& arg2, const Arg3& arg3,
+      const Arg4& arg4) const
+  {
+    handler_(arg1, arg2, arg3, arg4);
+  }
+
+  template <typename Arg1, typename Arg2, typename Arg3, typename Arg4,
+      typename Arg5>
+  void operator()(const Arg1& arg1, const Arg2& arg2, const Arg3& arg3,
+      const Arg4& arg4, const Arg5& arg5) const
+  {
+    handler_(arg1, arg2, arg3, arg4, arg5);
+  }
+
+private:
+  std::size_t              tag_;
+  boost::posix_time::ptime post_time_;
+  Handler                  handler_;
+}; // class timed_handler
+
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif // #if defined(_MSC_VER)
+
+#if defined(MA_HAS_RVALUE_REFS)
+
+template <typename Handler>
+inline timed_handler<typename remove_cv_reference<Handler>::type>
+make_timed_handler(std::size_t tag, const boost::posix_time::ptime& post_time,
+    Handler&& handler)
+{
+  typedef typename remove_cv_reference<Handler>::type handler_type;
+  return timed_handler<handler_type>(
+      tag, post_time, std::forward<Handler>(handler));
+}
+
+template <typename Handler>
+inline timed_handler<typename remove_cv_reference<Handler>::type>
+make_timed_handler(std::size_t tag, Handler&& handler)
+{
+  typedef typename remove_cv_reference<Handler>::type handler_type;
+  return timed_handler<handler_type>(tag,
+      boost::posix_time::microsec_clock::universal_time(),
+      std::forward<Handler>(handler));
+}
+
+#else // defined(MA_HAS_RVALUE_REFS)
+
+template <typename Handler>
+inline timed_handler<Handler>
+make_timed_handler(std::size_t tag, const boost::posix_time::ptime& post_time,
+    const Handler& handler)
+{
+  return timed_handler<Handler>(tag, post_time, handler);
+}
+
+template <typename Handler>
+inline timed_handler<Handler>
+make_timed_handler(std::size_t tag, const Handler& handler)
+{
+  return timed_handler<Handler>(tag,
+      boost::posix_time::microsec_clock::universal_time(), handler);
+}
+
+#endif // defined(MA_HAS_RVALUE_REFS)
+
+inline duration_histogram::duration_histogram()
+  : count_(0)
+  , sum_microseconds_(0)
+  , max_microseconds_(0)
+{
+  std::fill(buckets_, buckets_ + bucket_count, boost::uint64_t(0));
+}
+
+inline void duration_histogram::add(const duration_type& duration)
+{
+  const boost::uint64_t microseconds = duration.is_negative()
+      ? 0 : static_cast<boost::uint64_t>(duration.total_microseconds());
+  std::size_t index = 0;
+  for (boost::uint64_t i = microseconds; i && (index + 1 < bucket_count);
+      i >>= 1)
+  {
+    ++index;
+  }
+  ++buckets_[index];
+  ++count_;
+  sum_microseconds_ += microseconds;
+  max_microseconds_ = (std::max)(max_microseconds_, microseconds);
+}
+
+inline void duration_histogram::merge(const duration_histogram& other)
+{
+  for (std::size_t i = 0; i != bucket_count; ++i)
+  {
+    buckets_[i] += other.buckets_[i];
+  }
+  count_ += other.count_;
+  sum_microseconds_ += other.sum_microseconds_;
+  max_microseconds_ = (std::max)(max_microseconds_, other.max_microseconds_);
+}
+
+inline boost::uint64_t duration_histogram::count() const
+{
+  return count_;
+}
+
+inline boost::uint64_t duration_histogram::bucket(std::size_t index) const
+{
+  return buckets_[index];
+}
+
+inline boost::uint64_t duration_histogram::sum_microseconds() const
+{
+  return sum_microseconds_;
+}
+
+inline boost::uint64_t duration_histogram::max_microseconds() const
+{
+  return max_microseconds_;
+}
+
+inline boost::uint64_t duration_histogram::percentile_microseconds(
+    double percentile) const
+{
+  const boost::uint64_t rank = static_cast<boost::uint64_t>(
+      static_cast<double>(count_) * percentile / 100);
+  boost::uint64_t accumulated = 0;
+  for (std::size_t i = 0; i != bucket_count; ++i)
+  {
+    accumulated += buckets_[i];
+    if (accumulated > rank)
+    {
+      const boost::uint64_t upper_bound = boost::uint64_t(1) << i;
+      return (std::min)(upper_bound, max_microseconds_);
+    }
+  }
+  return max_microseconds_;
+}
+
+} // namespace ma
+
+/// Wraps handler with ma::timed_handler if handler timing is turned on.
+#define MA_TIME_HANDLER(tag, handler) \
+    (::ma::make_timed_handler((tag), (handler)))
+
+/// Wraps handler with ma::timed_handler having explicitly specified post time
+/// if handler timing is turned on. post_time isn't evaluated otherwise.
+#define MA_TIME_HANDLER_AT(tag, post_time, handler) \
+    (::ma::make_timed_handler((tag), (post_time), (handler)))
+
+/// Wraps handler of I/O operation with ma::timed_handler recording only
+/// the execution time of handler if handler timing is turned on.
+#define MA_TIME_IO_HANDLER(tag, handler) \
+    (::ma::make_timed_handler((tag), ::boost::posix_time::ptime(), (handler)))
+
+#else  // defined(MA_HAS_HANDLER_TIMING)
+
+#define MA_TIME_HANDLER(tag, handler) (handler)
+#define MA_TIME_HANDLER_AT(tag, post_time, handler) (handler)
+#define MA_TIME_IO_HANDLER(tag, handler) (handler)
+
+#endif // defined(MA_HAS_HANDLER_TIMING)
+
+#endif // MA_HANDLER_TIMING_HPP
@@ -0,0 +1,134 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_HTTP_REQUEST_PARSER_HPP
+#define MA_HTTP_REQUEST_PARSER_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/asio.hpp>
+#include <boost/assert.hpp>
+#include <boost/system/error_code.hpp>
+#include <ma/cyclic_buffer.hpp>
+#include <ma/detail/buffer_blocks.hpp>
+
+namespace ma {
+
+/// Finder of the (pipelined) HTTP/1.1 GET requests.
+/**
+ * Request ends with the empty line (CRLF CRLF). Requests with body aren't
+ * supported, so only GET requests are accepted. Parser works in place on
+ * the filled sequence of cyclic_buffer (requests can wrap the end of
+ * buffer) and finds all complete requests in one pass. Neither request
+ * line nor headers are validated.
+ *
+ * Parser keeps no state between the calls, the caller keeps the offset of
+ * the first not parsed request.
+ */
+class http_request_parser
+{
+public:
+  typedef cyclic_buffer::const_buffers_type buffers_type;
+
+  /// Requests parsed in one pass.
+  struct batch
+  {
+    batch();
+
+    /// Size of the complete requests (bytes).
+    std::size_t size;
+    /// Number of the complete requests.
+    std::size_t count;
+  }; // struct batch
+
+  explicit http_request_parser(std::size_t max_request_size);
+
+  std::size_t max_request_size() const;
+
+  /// Parses the complete requests of data starting at offset (which has to
+  /// be the start of request). Sets error at the request which isn't GET
+  /// (boost::asio::error::operation_not_supported) or if incomplete request
+  /// isn't less than max_request_size (boost::asio::error::message_size),
+  /// the returned batch contains the preceding requests then.
+  batch parse(const buffers_type& data, std::size_t offset,
+      boost::system::error_code& error) const;
+
+private:
+  static bool is_get(const detail::buffer_blocks& data, std::size_t offset);
+
+  std::size_t max_request_size_;
+}; // class http_request_parser
+
+inline http_request_parser::batch::batch()
+  : size(0)
+  , count(0)
+{
+}
+
+inline http_request_parser::http_request_parser(std::size_t max_request_size)
+  : max_request_size_(max_request_size)
+{
+}
+
+inline std::size_t http_request_parser::max_request_size() const
+{
+  return max_request_size_;
+}
+
+inline http_request_parser::batch http_request_parser::parse(
+    const buffers_type& data, std::size_t offset,
+    boost::system::error_code& error) const
+{
+  const detail::buffer_blocks data_blocks(data);
+  const std::size_t size = data_blocks.size();
+  BOOST_ASSERT_MSG(offset <= size, "Invalid offset");
+
+  error = boost::system::error_code();
+  batch result;
+  std::size_t start = offset;
+  std::size_t line_end = data_blocks.find('\n', start);
+  while (line_end != size)
+  {
+    // Line feed ends CRLF CRLF sequence
+    if ((line_end - start >= 3)
+        && ('\r' == data_blocks.at(line_end - 1))
+        && ('\n' == data_blocks.at(line_end - 2))
+        && ('\r' == data_blocks.at(line_end - 3)))
+    {
+      if (!is_get(data_blocks, start))
+      {
+        error = boost::asio::error::operation_not_supported;
+        break;
+      }
+      start = line_end + 1;
+      ++result.count;
+    }
+    line_end = data_blocks.find('\n', line_end + 1);
+  }
+  result.size = start - offset;
+
+  // Incomplete request which can't fit into buffer
+  if (!error && (size - start >= max_request_size_))
+  {
+    error = boost::asio::error::message_size;
+  }
+  return result;
+}
+
+inline bool http_request_parser::is_get(const detail::buffer_blocks& data,
+    std::size_t offset)
+{
+  return ('G' == data.at(offset)) && ('E' == data.at(offset + 1))
+      && ('T' == data.at(offset + 2)) && (' ' == data.at(offset + 3));
+}
+
+} // namespace ma
+
+#endif // MA_HTTP_REQUEST_PARSER_HPP
@@ -0,0 +1,182 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_IO_SERVICE_LOOP_HPP
+#define MA_IO_SERVICE_LOOP_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <ma/config.hpp>
+#include <ma/io_service_loop_stats.hpp>
+
+#if defined(MA_HAS_BOOST_CHRONO)
+#include <boost/chrono/thread_clock.hpp>
+#if defined(BOOST_CHRONO_HAS_THREAD_CLOCK)
+#define MA_IO_SERVICE_LOOP_HAS_THREAD_CLOCK
+#endif
+#endif // defined(MA_HAS_BOOST_CHRONO)
+
+namespace ma {
+
+/// Event loop of the thread running io_service - instrumented replacement of
+/// io_service::run with optional busy polling.
+/**
+ * With non-zero spin duration the thread doesn't block (in OS demultiplexer)
+ * as soon as there are no ready handlers but keeps polling io_service
+ * (io_service::poll) until spin duration expires. It reduces the latency
+ * of handlers at the expense of CPU time.
+ *
+ * Each instance has to be run by the single thread. Statistics can be read
+ * by any thread, they are updated at every blocking wait and periodically
+ * while the thread is busy.
+ *
+ * Blocking wait (io_service::run_one) returns only after execution of the
+ * first ready handler. Execution time of that handler is the CPU time of
+ * the thread spent by run_one (thread consumes no CPU while it waits).
+ * If there is no CPU clock of thread then the handler is accounted as
+ * idle time.
+ */
+class io_service_loop : private boost::noncopyable
+{
+public:
+  typedef boost::posix_time::time_duration duration_type;
+
+  io_service_loop(boost::asio::io_service& io_service,
+      const duration_type& spin_duration);
+
+  /// Runs until io_service is stopped or runs out of work.
+  /**
+   * Exceptions thrown by handlers are propagated like io_service::run does.
+   */
+  void run();
+
+  io_service_loop_stats stats() const;
+
+private:
+  typedef boost::mutex                  mutex_type;
+  typedef boost::lock_guard<mutex_type> lock_guard_type;
+  typedef boost::posix_time::microsec_clock clock_type;
+#if defined(MA_IO_SERVICE_LOOP_HAS_THREAD_CLOCK)
+  typedef boost::chrono::thread_clock cpu_clock_type;
+#endif
+
+  // Number of polls between updates of statistics of the busy thread
+  static const std::size_t stats_update_period = 256;
+
+  void add_stats(const io_service_loop_stats& stats);
+
+  boost::asio::io_service& io_service_;
+  const duration_type      spin_duration_;
+  mutable mutex_type       mutex_;
+  io_service_loop_stats    stats_;
+}; // class io_service_loop
+
+inline io_service_loop::io_service_loop(boost::asio::io_service& io_service,
+    const duration_type& spin_duration)
+  : io_service_(io_service)
+  , spin_duration_(spin_duration)
+  , mutex_()
+  , stats_()
+{
+}
+
+inline void io_service_loop::run()
+{
+  // Statistics are collected locally and published from time to time,
+  // so the thread doesn't lock mutex at every poll
+  io_service_loop_stats stats;
+  std::size_t polls_since_update = 0;
+  boost::posix_time::ptime spin_start = clock_type::universal_time();
+  for (;;)
+  {
+    const boost::posix_time::ptime poll_start = clock_type::universal_time();
+    const std::size_t handler_count = io_service_.poll();
+    const boost::posix_time::ptime poll_end = clock_type::universal_time();
+    if (handler_count)
+    {
+      stats.handler_count += handler_count;
+      ++stats.batch_count;
+      stats.max_batch_size = (std::max)(stats.max_batch_size, handler_count);
+      stats.handler_time += poll_end - poll_start;
+      spin_start = poll_end;
+      if (stats_update_period == ++polls_since_update)
+      {
+        add_stats(stats);
+        stats = io_service_loop_stats();
+        polls_since_update = 0;
+      }
+      continue;
+    }
+
+    stats.spin_time += poll_end - poll_start;
+    if (poll_end - spin_start < spin_duration_)
+    {
+      continue;
+    }
+
+    add_stats(stats);
+    stats = io_service_loop_stats();
+    polls_since_update = 0;
+
+    // Block until the next ready handler
+#if defined(MA_IO_SERVICE_LOOP_HAS_THREAD_CLOCK)
+    const cpu_clock_type::time_point wait_cpu_start = cpu_clock_type::now();
+#endif
+    if (!io_service_.run_one())
+    {
+      // io_service is stopped or has run out of work
+      break;
+    }
+    spin_start = clock_type::universal_time();
+    ++stats.handler_count;
+    ++stats.wait_count;
+    const duration_type wait_time = spin_start - poll_end;
+#if defined(MA_IO_SERVICE_LOOP_HAS_THREAD_CLOCK)
+    const duration_type handler_time = (std::min)(wait_time,
+        duration_type(boost::posix_time::microseconds(
+            boost::chrono::duration_cast<boost::chrono::microseconds>(
+                cpu_clock_type::now() - wait_cpu_start).count())));
+    stats.handler_time += handler_time;
+    stats.idle_time += wait_time - handler_time;
+#else
+    stats.idle_time += wait_time;
+#endif
+  }
+  add_stats(stats);
+}
+
+inline io_service_loop_stats io_service_loop::stats() const
+{
+  lock_guard_type lock_guard(mutex_);
+  return stats_;
+}
+
+inline void io_service_loop::add_stats(const io_service_loop_stats& stats)
+{
+  lock_guard_type lock_guard(mutex_);
+  stats_.handler_count += stats.handler_count;
+  stats_.wait_count    += stats.wait_count;
+  stats_.batch_count   += stats.batch_count;
+  stats_.max_batch_size = (std::max)(stats_.max_batch_size,
+      stats.max_batch_size);
+  stats_.handler_time  += stats.handler_time;
+  stats_.spin_time     += stats.spin_time;
+  stats_.idle_time     += stats.idle_time;
+}
+
+} // namespace ma
+
+#endif // MA_IO_SERVICE_LOOP_HPP
@@ -0,0 +1,61 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_IO_SERVICE_LOOP_STATS_HPP
+#define MA_IO_SERVICE_LOOP_STATS_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace ma {
+
+/// Statistics of the thread running io_service by means of io_service_loop.
+struct io_service_loop_stats
+{
+public:
+  typedef boost::posix_time::time_duration duration_type;
+
+  io_service_loop_stats();
+
+  /// Number of executed handlers.
+  boost::uint64_t handler_count;
+  /// Number of blocking waits for the ready handlers.
+  boost::uint64_t wait_count;
+  /// Number of polls of io_service which executed at least one handler.
+  boost::uint64_t batch_count;
+  /// Maximum number of handlers executed by the single poll of io_service,
+  /// i.e. (approximate) maximum depth of the queue of ready handlers.
+  std::size_t max_batch_size;
+  /// Time spent in execution of handlers.
+  duration_type handler_time;
+  /// Time spent in polling of io_service having no ready handlers.
+  duration_type spin_time;
+  /// Time spent in blocking wait for the ready handlers. Includes execution
+  /// of the first handler after wait only if there is no CPU clock of thread
+  /// (see io_service_loop).
+  duration_type idle_time;
+}; // struct io_service_loop_stats
+
+inline io_service_loop_stats::io_service_loop_stats()
+  : handler_count(0)
+  , wait_count(0)
+  , batch_count(0)
+  , max_batch_size(0)
+  , handler_time()
+  , spin_time()
+  , idle_time()
+{
+}
+
+} // namespace ma
+
+#endif // MA_IO_SERVICE_LOOP_STATS_HPP
@@ -0,0 +1,318 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_KV_STORE_HPP
+#define MA_KV_STORE_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/ref.hpp>
+#include <boost/assert.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/noncopyable.hpp>
+#include <ma/cyclic_buffer.hpp>
+#include <ma/open_hash_map.hpp>
+#include <ma/kv_store_stats.hpp>
+
+namespace ma {
+
+/// In-memory key-value store sharded per io_service.
+/**
+ * Each shard (open_hash_map) belongs to one io_service and is accessed only
+ * from the handlers of that io_service (within the strand of shard), so
+ * shard needs no locking. Operations are executed by batches. The batch of
+ * operations of the other io_service is forwarded to the io_service of
+ * shard. If each io_service is run by single thread then the batch of the
+ * same io_service is executed right away.
+ *
+ * Keys and values of operations refer to the data of caller (e.g. to read
+ * data of session), they are copied only into shard by set. Set of new key
+ * fails when shard is full: each shard holds at most max_size / shard_count
+ * keys (rounded up).
+ */
+class kv_store : private boost::noncopyable
+{
+public:
+  typedef std::vector<boost::shared_ptr<boost::asio::io_service> >
+      io_service_vector;
+
+  typedef cyclic_buffer::const_buffers_type buffers_type;
+
+  struct operation
+  {
+    enum type_t {get, set, erase};
+
+    operation();
+
+    type_t       type;
+    buffers_type key;
+    /// Value to set.
+    buffers_type value;
+    /// Is set if the key was found (get and erase) or if the value was
+    /// stored (set).
+    bool         found;
+    /// Is set by shard_of.
+    open_hash_map::hash_type key_hash;
+    /// Got value is at this offset of batch::values.
+    std::size_t  value_offset;
+    std::size_t  value_size;
+  }; // struct operation
+
+  typedef std::vector<operation> operation_vector;
+
+  /// Operations executed at once. Got values are appended to values.
+  struct batch
+  {
+    void clear();
+
+    operation_vector  operations;
+    std::vector<char> values;
+  }; // struct batch
+
+  /// If single_threaded_io_services is set then each io_service has to be
+  /// run by single thread.
+  kv_store(const io_service_vector& io_services,
+      bool single_threaded_io_services, std::size_t shard_capacity,
+      std::size_t max_size);
+
+  std::size_t shard_count() const;
+
+  /// Returns shard of the key of operation.
+  std::size_t shard_of(operation& op) const;
+
+  /// Returns true if the operations of shard can be executed right away
+  /// by the handler of the given io_service.
+  bool is_local(std::size_t shard,
+      const boost::asio::io_service& io_service) const;
+
+  /// Executes operations on shard. Has to be called only if is_local.
+  void execute(std::size_t shard, batch& operations);
+
+  /// Forwards operations to the io_service of shard. Operations (and
+  /// the data they refer to) have to be valid till handler (void (void)) is
+  /// called. Handler is called by the thread of shard, so it usually has
+  /// to be wrapped by strand.
+  template <typename Handler>
+  void async_execute(std::size_t shard, batch& operations,
+      const Handler& handler);
+
+  /// Can be called only when no operation is executed, e.g. after all
+  /// threads running the io_services of shards have stopped.
+  kv_store_stats stats() const;
+
+private:
+  class shard_data;
+  typedef boost::shared_ptr<shard_data> shard_ptr;
+  typedef std::vector<shard_ptr> shard_vector;
+
+  // Posted to the strand of shard, handler of any kind (including
+  // the bind expressions) is kept as is
+  template <typename Handler>
+  class execute_binder
+  {
+  public:
+    typedef void result_type;
+
+    execute_binder(const shard_ptr& shard, batch& operations,
+        const Handler& handler);
+
+    void operator()();
+
+  private:
+    shard_ptr shard_;
+    batch*    operations_;
+    Handler   handler_;
+  }; // class execute_binder
+
+  static void execute(shard_data& shard, batch& operations);
+
+  const bool   single_threaded_io_services_;
+  shard_vector shards_;
+}; // class kv_store
+
+class kv_store::shard_data : private boost::noncopyable
+{
+public:
+  shard_data(boost::asio::io_service& the_io_service,
+      std::size_t capacity, std::size_t max_size);
+
+  boost::asio::io_service&        io_service;
+  boost::asio::io_service::strand strand;
+  open_hash_map                   map;
+  // Are changed only within strand
+  boost::uint64_t                 local_operations;
+  boost::uint64_t                 forwarded_operations;
+  boost::uint64_t                 forwarded_batches;
+  boost::uint64_t                 rejected_sets;
+}; // class kv_store::shard_data
+
+inline kv_store::operation::operation()
+  : type(get)
+  , key()
+  , value()
+  , found(false)
+  , key_hash(0)
+  , value_offset(0)
+  , value_size(0)
+{
+}
+
+inline void kv_store::batch::clear()
+{
+  operations.clear();
+  values.clear();
+}
+
+inline kv_store::shard_data::shard_data(
+    boost::asio::io_service& the_io_service, std::size_t capacity,
+    std::size_t max_size)
+  : io_service(the_io_service)
+  , strand(the_io_service)
+  , map(capacity, max_size)
+  , local_operations(0)
+  , forwarded_operations(0)
+  , forwarded_batches(0)
+  , rejected_sets(0)
+{
+}
+
+inline kv_store::kv_store(const io_service_vector& io_services,
+    bool single_threaded_io_services, std::size_t shard_capacity,
+    std::size_t max_size)
+  : single_threaded_io_services_(single_threaded_io_services)
+  , shards_()
+{
+  BOOST_ASSERT_MSG(!io_services.empty(), "io_services must be not empty");
+
+  const std::size_t count = io_services.size();
+  const std::size_t shard_max_size =
+      max_size / count + ((max_size % count) ? 1 : 0);
+  for (io_service_vector::const_iterator i = io_services.begin(),
+      end = io_services.end(); i != end; ++i)
+  {
+    shards_.push_back(boost::make_shared<shard_data>(
+        boost::ref(**i), shard_capacity, shard_max_size));
+  }
+}
+
+inline std::size_t kv_store::shard_count() const
+{
+  return shards_.size();
+}
+
+inline std::size_t kv_store::shard_of(operation& op) const
+{
+  op.key_hash = open_hash_map::hash(op.key);
+  // Low bits of hash select slot of shard's map
+  return static_cast<std::size_t>((op.key_hash >> 32) % shards_.size());
+}
+
+inline bool kv_store::is_local(std::size_t shard,
+    const boost::asio::io_service& io_service) const
+{
+  return single_threaded_io_services_
+      && (&shards_[shard]->io_service == &io_service);
+}
+
+inline void kv_store::execute(std::size_t shard, batch& operations)
+{
+  shard_data& data = *shards_[shard];
+  data.local_operations += operations.operations.size();
+  execute(data, operations);
+}
+
+template <typename Handler>
+void kv_store::async_execute(std::size_t shard, batch& operations,
+    const Handler& handler)
+{
+  const shard_ptr& data = shards_[shard];
+  data->strand.post(execute_binder<Handler>(data, operations, handler));
+}
+
+inline kv_store_stats kv_store::stats() const
+{
+  kv_store_stats stats;
+  stats.shards = shards_.size();
+  for (shard_vector::const_iterator i = shards_.begin(), end = shards_.end();
+      i != end; ++i)
+  {
+    const shard_data& data = **i;
+    stats.keys                 += data.map.size();
+    stats.local_operations     += data.local_operations;
+    stats.forwarded_operations += data.forwarded_operations;
+    stats.forwarded_batches    += data.forwarded_batches;
+    stats.rejected_sets        += data.rejected_sets;
+  }
+  return stats;
+}
+
+template <typename Handler>
+kv_store::execute_binder<Handler>::execute_binder(const shard_ptr& shard,
+    batch& operations, const Handler& handler)
+  : shard_(shard)
+  , operations_(&operations)
+  , handler_(handler)
+{
+}
+
+template <typename Handler>
+void kv_store::execute_binder<Handler>::operator()()
+{
+  shard_->forwarded_operations += operations_->operations.size();
+  ++shard_->forwarded_batches;
+  kv_store::execute(*shard_, *operations_);
+  handler_();
+}
+
+inline void kv_store::execute(shard_data& shard, batch& operations)
+{
+  std::vector<char>& values = operations.values;
+  for (operation_vector::iterator i = operations.operations.begin(),
+      end = operations.operations.end(); i != end; ++i)
+  {
+    switch (i->type)
+    {
+    case operation::get:
+      if (const std::string* value = shard.map.find(i->key, i->key_hash))
+      {
+        // Shard can change once batch is executed, so value is copied
+        i->value_offset = values.size();
+        i->value_size   = value->size();
+        values.insert(values.end(), value->begin(), value->end());
+        i->found = true;
+      }
+      break;
+
+    case operation::set:
+      i->found = shard.map.insert(i->key, i->value, i->key_hash);
+      if (!i->found)
+      {
+        ++shard.rejected_sets;
+      }
+      break;
+
+    case operation::erase:
+      i->found = shard.map.erase(i->key, i->key_hash);
+      break;
+
+    default:
+      BOOST_ASSERT_MSG(false, "Invalid operation type");
+      break;
+    }
+  }
+}
+
+} // namespace ma
+
+#endif // MA_KV_STORE_HPP
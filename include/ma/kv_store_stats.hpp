@@ -0,0 +1,52 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_KV_STORE_STATS_HPP
+#define MA_KV_STORE_STATS_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+namespace ma {
+
+/// Statistics of kv_store.
+struct kv_store_stats
+{
+public:
+  kv_store_stats();
+
+  /// Number of shards.
+  std::size_t shards;
+  /// Number of keys in all shards.
+  std::size_t keys;
+  /// Number of operations executed by the thread owning shard.
+  boost::uint64_t local_operations;
+  /// Number of operations forwarded to the thread owning shard.
+  boost::uint64_t forwarded_operations;
+  /// Number of forwarded batches of operations.
+  boost::uint64_t forwarded_batches;
+  /// Number of set operations rejected because shard was full.
+  boost::uint64_t rejected_sets;
+}; // struct kv_store_stats
+
+inline kv_store_stats::kv_store_stats()
+  : shards(0)
+  , keys(0)
+  , local_operations(0)
+  , forwarded_operations(0)
+  , forwarded_batches(0)
+  , rejected_sets(0)
+{
+}
+
+} // namespace ma
+
+#endif // MA_KV_STORE_STATS_HPP
@@ -0,0 +1,118 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_LINE_PARSER_HPP
+#define MA_LINE_PARSER_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/asio.hpp>
+#include <boost/assert.hpp>
+#include <boost/system/error_code.hpp>
+#include <ma/cyclic_buffer.hpp>
+#include <ma/detail/buffer_blocks.hpp>
+
+namespace ma {
+
+/// Parser of the stream of text lines (commands).
+/**
+ * Line ends with LF or CR LF. Parser works in place on the filled sequence
+ * of cyclic_buffer (lines can wrap the end of buffer) and parses all
+ * complete lines in one pass.
+ *
+ * Parser keeps no state between the calls, the caller keeps the offset of
+ * the first not parsed line.
+ */
+class line_parser
+{
+public:
+  typedef cyclic_buffer::const_buffers_type buffers_type;
+
+  /// Lines parsed in one pass.
+  struct batch
+  {
+    batch();
+
+    /// Size of the complete lines including line ends (bytes).
+    std::size_t size;
+    /// Number of the complete lines.
+    std::size_t count;
+  }; // struct batch
+
+  explicit line_parser(std::size_t max_line_size);
+
+  std::size_t max_line_size() const;
+
+  /// Parses the complete lines of data starting at offset (which has to be
+  /// the start of line) and calls handler(const buffers_type&) with each
+  /// line (without line end). Sets error (boost::asio::error::message_size)
+  /// if incomplete line isn't less than max_line_size, the returned batch
+  /// contains the complete lines then.
+  template <typename Handler>
+  batch parse(const buffers_type& data, std::size_t offset, Handler handler,
+      boost::system::error_code& error) const;
+
+private:
+  std::size_t max_line_size_;
+}; // class line_parser
+
+inline line_parser::batch::batch()
+  : size(0)
+  , count(0)
+{
+}
+
+inline line_parser::line_parser(std::size_t max_line_size)
+  : max_line_size_(max_line_size)
+{
+}
+
+inline std::size_t line_parser::max_line_size() const
+{
+  return max_line_size_;
+}
+
+template <typename Handler>
+line_parser::batch line_parser::parse(const buffers_type& data,
+    std::size_t offset, Handler handler,
+    boost::system::error_code& error) const
+{
+  const detail::buffer_blocks data_blocks(data);
+  const std::size_t size = data_blocks.size();
+  BOOST_ASSERT_MSG(offset <= size, "Invalid offset");
+
+  error = boost::system::error_code();
+  batch result;
+  std::size_t start = offset;
+  for (std::size_t line_end = data_blocks.find('\n', start);
+      line_end != size; line_end = data_blocks.find('\n', start))
+  {
+    std::size_t line_size = line_end - start;
+    if (line_size && ('\r' == data_blocks.at(line_end - 1)))
+    {
+      --line_size;
+    }
+    handler(data_blocks.sub(start, line_size));
+    start = line_end + 1;
+    ++result.count;
+  }
+  result.size = start - offset;
+
+  // Incomplete line which can't fit into buffer
+  if (size - start >= max_line_size_)
+  {
+    error = boost::asio::error::message_size;
+  }
+  return result;
+}
+
+} // namespace ma
+
+#endif // MA_LINE_PARSER_HPP
@@ -0,0 +1,156 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_MEMORY_BUDGET_HPP
+#define MA_MEMORY_BUDGET_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <boost/assert.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <ma/memory_budget_stats.hpp>
+
+namespace ma {
+
+/// Thread-safe limit of the total size of memory (bytes) shared by many
+/// consumers, e.g. by all sessions of server.
+/**
+ * Consumer acquires memory before the use and releases it after. Memory is
+ * acquired partially if the budget doesn't have the requested size. If the
+ * budget is exhausted then the consumer is queued and the memory released
+ * later is passed to the queued consumers in FIFO order, so the waiting
+ * consumers are neither starved nor woken for nothing.
+ */
+class memory_budget : private boost::noncopyable
+{
+public:
+  /// Is called with the (non zero) size of memory acquired on behalf of the
+  /// waiting consumer. Consumer has to release it. Handler is called within
+  /// release so it has to be short and mustn't call memory_budget.
+  typedef boost::function<void (std::size_t)> wait_handler;
+
+  explicit memory_budget(std::size_t limit);
+
+  /// Acquires up to max_size bytes. Returns the size of acquired memory.
+  /// If nothing can be acquired then returns zero and queues handler
+  /// (converted to wait_handler only in this case).
+  template <typename Handler>
+  std::size_t acquire(std::size_t max_size, const Handler& handler);
+
+  /// Acquires size bytes even if the budget doesn't have them, e.g. for the
+  /// data made of the data which memory is acquired already. Consumers wait
+  /// until the used memory returns under the limit.
+  void force_acquire(std::size_t size);
+
+  void release(std::size_t size);
+
+  memory_budget_stats stats() const;
+
+private:
+  typedef boost::mutex                  mutex_type;
+  typedef boost::lock_guard<mutex_type> lock_guard_type;
+  typedef std::pair<std::size_t, wait_handler> waiter;
+  typedef std::deque<waiter>  waiter_queue;
+  typedef std::vector<waiter> waiter_vector;
+
+  std::size_t take(std::size_t max_size);
+
+  mutable mutex_type  mutex_;
+  memory_budget_stats stats_;
+  waiter_queue        waiters_;
+}; // class memory_budget
+
+inline memory_budget::memory_budget(std::size_t limit)
+  : mutex_()
+  , stats_()
+  , waiters_()
+{
+  stats_.limit = limit;
+}
+
+template <typename Handler>
+std::size_t memory_budget::acquire(std::size_t max_size,
+    const Handler& handler)
+{
+  BOOST_ASSERT_MSG(max_size, "Size must be > 0");
+
+  lock_guard_type lock_guard(mutex_);
+  // Waiting consumers are served first
+  if (waiters_.empty())
+  {
+    if (std::size_t size = take(max_size))
+    {
+      return size;
+    }
+  }
+  waiters_.push_back(waiter(max_size, wait_handler(handler)));
+  ++stats_.denied;
+  stats_.waiting = waiters_.size();
+  return 0;
+}
+
+inline void memory_budget::force_acquire(std::size_t size)
+{
+  lock_guard_type lock_guard(mutex_);
+  stats_.used += size;
+  stats_.max_used = (std::max)(stats_.max_used, stats_.used);
+}
+
+inline void memory_budget::release(std::size_t size)
+{
+  waiter_vector granted;
+  {
+    lock_guard_type lock_guard(mutex_);
+    BOOST_ASSERT_MSG(size <= stats_.used, "Invalid size");
+    stats_.used -= size;
+    while (!waiters_.empty() && (stats_.used < stats_.limit))
+    {
+      waiter& front = waiters_.front();
+      granted.push_back(waiter(take(front.first), wait_handler()));
+      granted.back().second.swap(front.second);
+      waiters_.pop_front();
+    }
+    stats_.waiting = waiters_.size();
+  }
+
+  // Handlers are called without lock
+  for (waiter_vector::const_iterator i = granted.begin(), end = granted.end();
+      i != end; ++i)
+  {
+    i->second(i->first);
+  }
+}
+
+inline memory_budget_stats memory_budget::stats() const
+{
+  lock_guard_type lock_guard(mutex_);
+  return stats_;
+}
+
+inline std::size_t memory_budget::take(std::size_t max_size)
+{
+  // Used memory can exceed limit (see force_acquire)
+  const std::size_t size = (stats_.used < stats_.limit)
+      ? (std::min)(max_size, stats_.limit - stats_.used) : 0;
+  stats_.used += size;
+  stats_.max_used = (std::max)(stats_.max_used, stats_.used);
+  return size;
+}
+
+} // namespace ma
+
+#endif // MA_MEMORY_BUDGET_HPP
@@ -0,0 +1,49 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_MEMORY_BUDGET_STATS_HPP
+#define MA_MEMORY_BUDGET_STATS_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+namespace ma {
+
+/// Statistics of memory_budget.
+struct memory_budget_stats
+{
+public:
+  memory_budget_stats();
+
+  /// Total size of budget (bytes).
+  std::size_t limit;
+  /// Size of the memory (bytes) acquired at the moment.
+  std::size_t used;
+  /// Maximum of used.
+  std::size_t max_used;
+  /// Number of the acquisitions which were denied and had to wait.
+  boost::uint64_t denied;
+  /// Number of the acquisitions waiting for memory at the moment.
+  std::size_t waiting;
+}; // struct memory_budget_stats
+
+inline memory_budget_stats::memory_budget_stats()
+  : limit(0)
+  , used(0)
+  , max_used(0)
+  , denied(0)
+  , waiting(0)
+{
+}
+
+} // namespace ma
+
+#endif // MA_MEMORY_BUDGET_STATS_HPP
@@ -0,0 +1,312 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_OPEN_HASH_MAP_HPP
+#define MA_OPEN_HASH_MAP_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/assert.hpp>
+#include <boost/cstdint.hpp>
+
+namespace ma {
+
+/// Hash map of strings with open addressing (linear probing).
+/**
+ * Capacity is a power of 2, map grows twice when it is filled by 3/4.
+ * Erase shifts the following entries back, so there are no tombstones and
+ * lookup stops at the first free slot.
+ *
+ * Hash of key is given by the caller (see hash()), so the caller can use
+ * the other bits of the same hash (e.g. to select shard).
+ *
+ * Keys and values are given as the sequences of constant buffers (e.g. the
+ * data of cyclic_buffer), they are copied only by insert. Map holds at most
+ * max_size keys.
+ *
+ * Isn't thread-safe.
+ */
+class open_hash_map
+{
+public:
+  typedef boost::uint64_t hash_type;
+
+  /// Capacity is rounded up to a power of 2.
+  open_hash_map(std::size_t initial_capacity, std::size_t max_size);
+
+  /// FNV-1a hash of key.
+  template <typename ConstBufferSequence>
+  static hash_type hash(const ConstBufferSequence& key);
+
+  std::size_t size() const;
+  std::size_t max_size() const;
+  std::size_t capacity() const;
+
+  /// Returns null pointer if there is no such key.
+  template <typename ConstBufferSequence>
+  const std::string* find(const ConstBufferSequence& key,
+      hash_type key_hash) const;
+
+  /// Returns false if there is no such key and map holds max_size keys,
+  /// nothing is inserted then. Value of existing key is replaced.
+  template <typename KeyBufferSequence, typename ValueBufferSequence>
+  bool insert(const KeyBufferSequence& key, const ValueBufferSequence& value,
+      hash_type key_hash);
+
+  /// Returns false if there is no such key.
+  template <typename ConstBufferSequence>
+  bool erase(const ConstBufferSequence& key, hash_type key_hash);
+
+private:
+  struct slot
+  {
+    slot();
+
+    bool        used;
+    hash_type   key_hash;
+    std::string key;
+    std::string value;
+  }; // struct slot
+
+  typedef std::vector<slot> slot_vector;
+
+  // Returns index of the slot of key or of the free slot to insert key to
+  template <typename ConstBufferSequence>
+  std::size_t lookup(const ConstBufferSequence& key,
+      hash_type key_hash) const;
+  void grow();
+
+  template <typename ConstBufferSequence>
+  static bool equal(const std::string& value,
+      const ConstBufferSequence& buffers);
+  template <typename ConstBufferSequence>
+  static void assign(std::string& value, const ConstBufferSequence& buffers);
+
+  const std::size_t max_size_;
+  std::size_t       size_;
+  slot_vector       slots_;
+}; // class open_hash_map
+
+inline open_hash_map::slot::slot()
+  : used(false)
+  , key_hash(0)
+  , key()
+  , value()
+{
+}
+
+inline open_hash_map::open_hash_map(std::size_t initial_capacity,
+    std::size_t max_size)
+  : max_size_(max_size)
+  , size_(0)
+  , slots_()
+{
+  std::size_t capacity = 8;
+  while (capacity < initial_capacity)
+  {
+    capacity *= 2;
+  }
+  slots_.resize(capacity);
+}
+
+template <typename ConstBufferSequence>
+open_hash_map::hash_type open_hash_map::hash(const ConstBufferSequence& key)
+{
+  hash_type value = UINT64_C(14695981039346656037);
+  for (typename ConstBufferSequence::const_iterator i = key.begin(),
+      end = key.end(); i != end; ++i)
+  {
+    const unsigned char* data =
+        boost::asio::buffer_cast<const unsigned char*>(*i);
+    for (const unsigned char* data_end = data + boost::asio::buffer_size(*i);
+        data != data_end; ++data)
+    {
+      value ^= *data;
+      value *= UINT64_C(1099511628211);
+    }
+  }
+  return value;
+}
+
+inline std::size_t open_hash_map::size() const
+{
+  return size_;
+}
+
+inline std::size_t open_hash_map::max_size() const
+{
+  return max_size_;
+}
+
+inline std::size_t open_hash_map::capacity() const
+{
+  return slots_.size();
+}
+
+template <typename ConstBufferSequence>
+const std::string* open_hash_map::find(const ConstBufferSequence& key,
+    hash_type key_hash) const
+{
+  const slot& found = slots_[lookup(key, key_hash)];
+  return found.used ? &found.value : 0;
+}
+
+template <typename KeyBufferSequence, typename ValueBufferSequence>
+bool open_hash_map::insert(const KeyBufferSequence& key,
+    const ValueBufferSequence& value, hash_type key_hash)
+{
+  std::size_t index = lookup(key, key_hash);
+  if (slots_[index].used)
+  {
+    assign(slots_[index].value, value);
+    return true;
+  }
+  if (size_ >= max_size_)
+  {
+    return false;
+  }
+
+  // At least one slot stays free, so lookup always stops
+  if ((size_ + 1) * 4 > slots_.size() * 3)
+  {
+    grow();
+    index = lookup(key, key_hash);
+  }
+  slot& inserted = slots_[index];
+  inserted.used     = true;
+  inserted.key_hash = key_hash;
+  assign(inserted.key, key);
+  assign(inserted.value, value);
+  ++size_;
+  return true;
+}
+
+template <typename ConstBufferSequence>
+bool open_hash_map::erase(const ConstBufferSequence& key, hash_type key_hash)
+{
+  std::size_t free_index = lookup(key, key_hash);
+  if (!slots_[free_index].used)
+  {
+    return false;
+  }
+
+  // Entries of the same probe sequence can't stay behind free slot
+  const std::size_t mask = slots_.size() - 1;
+  for (std::size_t index = (free_index + 1) & mask; slots_[index].used;
+      index = (index + 1) & mask)
+  {
+    const std::size_t home =
+        static_cast<std::size_t>(slots_[index].key_hash) & mask;
+    const bool stays = (free_index <= index)
+        ? ((free_index < home) && (home <= index))
+        : ((free_index < home) || (home <= index));
+    if (!stays)
+    {
+      slot& target = slots_[free_index];
+      slot& source = slots_[index];
+      target.key_hash = source.key_hash;
+      target.key.swap(source.key);
+      target.value.swap(source.value);
+      free_index = index;
+    }
+  }
+
+  slot& erased = slots_[free_index];
+  erased.used = false;
+  std::string().swap(erased.key);
+  std::string().swap(erased.value);
+  --size_;
+  return true;
+}
+
+template <typename ConstBufferSequence>
+std::size_t open_hash_map::lookup(const ConstBufferSequence& key,
+    hash_type key_hash) const
+{
+  const std::size_t mask = slots_.size() - 1;
+  std::size_t index = static_cast<std::size_t>(key_hash) & mask;
+  while (slots_[index].used)
+  {
+    const slot& current = slots_[index];
+    if ((current.key_hash == key_hash) && equal(current.key, key))
+    {
+      break;
+    }
+    index = (index + 1) & mask;
+  }
+  return index;
+}
+
+inline void open_hash_map::grow()
+{
+  slot_vector slots(slots_.size() * 2);
+  slots.swap(slots_);
+  const std::size_t mask = slots_.size() - 1;
+  for (slot_vector::iterator i = slots.begin(), end = slots.end();
+      i != end; ++i)
+  {
+    if (i->used)
+    {
+      std::size_t index = static_cast<std::size_t>(i->key_hash) & mask;
+      while (slots_[index].used)
+      {
+        index = (index + 1) & mask;
+      }
+      slot& moved = slots_[index];
+      moved.used     = true;
+      moved.key_hash = i->key_hash;
+      moved.key.swap(i->key);
+      moved.value.swap(i->value);
+    }
+  }
+}
+
+template <typename ConstBufferSequence>
+bool open_hash_map::equal(const std::string& value,
+    const ConstBufferSequence& buffers)
+{
+  if (value.size() != boost::asio::buffer_size(buffers))
+  {
+    return false;
+  }
+  std::size_t offset = 0;
+  for (typename ConstBufferSequence::const_iterator i = buffers.begin(),
+      end = buffers.end(); i != end; ++i)
+  {
+    const std::size_t size = boost::asio::buffer_size(*i);
+    if (size && std::memcmp(value.data() + offset,
+        boost::asio::buffer_cast<const void*>(*i), size))
+    {
+      return false;
+    }
+    offset += size;
+  }
+  return true;
+}
+
+template <typename ConstBufferSequence>
+void open_hash_map::assign(std::string& value,
+    const ConstBufferSequence& buffers)
+{
+  value.resize(boost::asio::buffer_size(buffers));
+  if (!value.empty())
+  {
+    boost::asio::buffer_copy(boost::asio::buffer(&value[0], value.size()),
+        buffers);
+  }
+}
+
+} // namespace ma
+
+#endif // MA_OPEN_HASH_MAP_HPP
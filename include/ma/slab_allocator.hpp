@@ -0,0 +1,379 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_SLAB_ALLOCATOR_HPP
+#define MA_SLAB_ALLOCATOR_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <new>
+#include <limits>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+#include <boost/assert.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/throw_exception.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+
+namespace ma {
+
+/// Storage of the equally sized memory blocks allocated by chunks.
+/**
+ * The size of block is defined by the first allocation. Requests for memory
+ * of other size are forwarded to global operator new.
+ * Blocks are allocated from the most recently used chunk having free blocks.
+ * Chunk is returned to global operator delete when all its blocks are free
+ * unless it is the only such chunk (it's kept for the next allocations).
+ * Thread-safe: blocks can be allocated and deallocated by different threads.
+ */
+class slab_storage : private boost::noncopyable
+{
+public:
+  /// chunk_size is the number of blocks allocated at once.
+  explicit slab_storage(std::size_t chunk_size);
+
+  ~slab_storage();
+
+  void* allocate(std::size_t size);
+
+  void deallocate(void* pointer, std::size_t size);
+
+private:
+  typedef slab_storage this_type;
+  typedef boost::mutex mutex_type;
+  typedef boost::lock_guard<mutex_type> lock_guard_type;
+  typedef char byte_type;
+
+  struct free_block
+  {
+    free_block* next;
+  }; // struct free_block
+
+  struct chunk
+  {
+    byte_type*  blocks;
+    free_block* free_blocks;
+    std::size_t free_count;
+  }; // struct chunk
+
+  // Chunks are sorted by address to find the chunk of block
+  typedef std::vector<chunk> chunk_vector;
+
+  static bool less_address(const byte_type* address, const chunk& value);
+
+  chunk_vector::iterator find_free_chunk();
+  chunk_vector::iterator add_chunk();
+
+  const std::size_t chunk_size_;
+  mutex_type        mutex_;
+  std::size_t       block_size_;
+  chunk_vector      chunks_;
+  // Index of the chunk used by the latest allocation
+  std::size_t       current_chunk_;
+  // Number of chunks having all blocks free
+  std::size_t       free_chunks_;
+}; // class slab_storage
+
+/// Standard allocator using (shared) slab_storage.
+/**
+ * Intended for usage with boost::allocate_shared to place all objects of the
+ * same type (and their reference counters) into the same slab_storage.
+ */
+template <typename T>
+class slab_allocator
+{
+private:
+  typedef slab_allocator<T> this_type;
+
+public:
+  typedef T              value_type;
+  typedef T*             pointer;
+  typedef const T*       const_pointer;
+  typedef T&             reference;
+  typedef const T&       const_reference;
+  typedef std::size_t    size_type;
+  typedef std::ptrdiff_t difference_type;
+
+  template <typename U>
+  struct rebind
+  {
+    typedef slab_allocator<U> other;
+  }; // struct rebind
+
+  explicit slab_allocator(const boost::shared_ptr<slab_storage>& storage);
+
+  template <typename U>
+  slab_allocator(const slab_allocator<U>& other);
+
+  pointer address(reference value) const;
+  const_pointer address(const_reference value) const;
+
+  pointer allocate(size_type n, const void* hint = 0);
+  void deallocate(pointer p, size_type n);
+
+  size_type max_size() const;
+
+  void construct(pointer p, const_reference value);
+  void destroy(pointer p);
+
+  const boost::shared_ptr<slab_storage>& storage() const;
+
+private:
+  static std::size_t block_size(size_type n);
+
+  boost::shared_ptr<slab_storage> storage_;
+}; // class slab_allocator
+
+template <typename T, typename U>
+bool operator==(const slab_allocator<T>& left, const slab_allocator<U>& right);
+
+template <typename T, typename U>
+bool operator!=(const slab_allocator<T>& left, const slab_allocator<U>& right);
+
+inline slab_storage::slab_storage(std::size_t chunk_size)
+  : chunk_size_(chunk_size)
+  , block_size_(0)
+  , current_chunk_(0)
+  , free_chunks_(0)
+{
+  BOOST_ASSERT_MSG(chunk_size > 0, "chunk_size must be > 0");
+}
+
+inline slab_storage::~slab_storage()
+{
+  for (chunk_vector::const_iterator i = chunks_.begin(), end = chunks_.end();
+      i != end; ++i)
+  {
+    ::operator delete(i->blocks);
+  }
+}
+
+inline void* slab_storage::allocate(std::size_t size)
+{
+  {
+    lock_guard_type lock_guard(mutex_);
+
+    if (!block_size_)
+    {
+      block_size_ = (std::max)(size, sizeof(free_block));
+    }
+
+    if (size == block_size_)
+    {
+      chunk_vector::iterator i = find_free_chunk();
+      if (chunks_.end() == i)
+      {
+        i = add_chunk();
+      }
+      if (chunk_size_ == i->free_count)
+      {
+        --free_chunks_;
+      }
+      current_chunk_ = i - chunks_.begin();
+      free_block* block = i->free_blocks;
+      i->free_blocks = block->next;
+      --i->free_count;
+      return block;
+    }
+  }
+  return ::operator new(size);
+}
+
+inline void slab_storage::deallocate(void* pointer, std::size_t size)
+{
+  {
+    lock_guard_type lock_guard(mutex_);
+
+    if (size == block_size_)
+    {
+      // The chunk of block is the last one starting not after the block
+      byte_type* address = static_cast<byte_type*>(pointer);
+      chunk_vector::iterator i = std::upper_bound(
+          chunks_.begin(), chunks_.end(), address, &this_type::less_address);
+      BOOST_ASSERT_MSG(chunks_.begin() != i, "Block doesn't belong to slab");
+      --i;
+
+      free_block* block = static_cast<free_block*>(pointer);
+      block->next = i->free_blocks;
+      i->free_blocks = block;
+      if (chunk_size_ != ++i->free_count)
+      {
+        return;
+      }
+
+      // One free chunk is kept for the next allocations
+      if (!free_chunks_)
+      {
+        ++free_chunks_;
+        return;
+      }
+      ::operator delete(i->blocks);
+      const std::size_t index = i - chunks_.begin();
+      chunks_.erase(i);
+      if (current_chunk_ > index)
+      {
+        --current_chunk_;
+      }
+      return;
+    }
+  }
+  ::operator delete(pointer);
+}
+
+inline bool slab_storage::less_address(const byte_type* address,
+    const chunk& value)
+{
+  return address < value.blocks;
+}
+
+inline slab_storage::chunk_vector::iterator slab_storage::find_free_chunk()
+{
+  if ((current_chunk_ < chunks_.size())
+      && chunks_[current_chunk_].free_count)
+  {
+    return chunks_.begin() + current_chunk_;
+  }
+  // Partially used chunks are filled first so free chunks can be returned
+  chunk_vector::iterator free_chunk = chunks_.end();
+  for (chunk_vector::iterator i = chunks_.begin(), end = chunks_.end();
+      i != end; ++i)
+  {
+    if (chunk_size_ == i->free_count)
+    {
+      free_chunk = i;
+    }
+    else if (i->free_count)
+    {
+      return i;
+    }
+  }
+  return free_chunk;
+}
+
+inline slab_storage::chunk_vector::iterator slab_storage::add_chunk()
+{
+  chunks_.reserve(chunks_.size() + 1);
+  chunk new_chunk;
+  new_chunk.blocks =
+      static_cast<byte_type*>(::operator new(block_size_ * chunk_size_));
+  new_chunk.free_blocks = 0;
+  new_chunk.free_count  = chunk_size_;
+
+  // Link all blocks of the new chunk to the list of its free blocks
+  for (std::size_t i = chunk_size_; i != 0; --i)
+  {
+    free_block* block = reinterpret_cast<free_block*>(
+        new_chunk.blocks + block_size_ * (i - 1));
+    block->next = new_chunk.free_blocks;
+    new_chunk.free_blocks = block;
+  }
+
+  ++free_chunks_;
+  return chunks_.insert(std::upper_bound(chunks_.begin(), chunks_.end(),
+      new_chunk.blocks, &this_type::less_address), new_chunk);
+}
+
+template <typename T>
+slab_allocator<T>::slab_allocator(
+    const boost::shared_ptr<slab_storage>& storage)
+  : storage_(storage)
+{
+  BOOST_ASSERT_MSG(storage, "storage must be not null");
+}
+
+template <typename T>
+template <typename U>
+slab_allocator<T>::slab_allocator(const slab_allocator<U>& other)
+  : storage_(other.storage())
+{
+}
+
+template <typename T>
+typename slab_allocator<T>::pointer
+slab_allocator<T>::address(reference value) const
+{
+  return &value;
+}
+
+template <typename T>
+typename slab_allocator<T>::const_pointer
+slab_allocator<T>::address(const_reference value) const
+{
+  return &value;
+}
+
+template <typename T>
+typename slab_allocator<T>::pointer
+slab_allocator<T>::allocate(size_type n, const void* /*hint*/)
+{
+  if (n > max_size())
+  {
+    boost::throw_exception(std::bad_alloc());
+  }
+  return static_cast<pointer>(storage_->allocate(block_size(n)));
+}
+
+template <typename T>
+void slab_allocator<T>::deallocate(pointer p, size_type n)
+{
+  storage_->deallocate(p, block_size(n));
+}
+
+template <typename T>
+typename slab_allocator<T>::size_type slab_allocator<T>::max_size() const
+{
+  return (std::numeric_limits<size_type>::max)() / sizeof(T);
+}
+
+template <typename T>
+void slab_allocator<T>::construct(pointer p, const_reference value)
+{
+  ::new (static_cast<void*>(p)) T(value);
+}
+
+template <typename T>
+void slab_allocator<T>::destroy(pointer p)
+{
+  p->~T();
+}
+
+template <typename T>
+const boost::shared_ptr<slab_storage>& slab_allocator<T>::storage() const
+{
+  return storage_;
+}
+
+template <typename T>
+std::size_t slab_allocator<T>::block_size(size_type n)
+{
+  // Keep all blocks of the slab_storage aligned as T requires
+  const std::size_t alignment = boost::alignment_of<T>::value;
+  const std::size_t size = n * sizeof(T);
+  return ((size + alignment - 1) / alignment) * alignment;
+}
+
+template <typename T, typename U>
+bool operator==(const slab_allocator<T>& left, const slab_allocator<U>& right)
+{
+  return left.storage() == right.storage();
+}
+
+template <typename T, typename U>
+bool operator!=(const slab_allocator<T>& left, const slab_allocator<U>& right)
+{
+  return left.storage() != right.storage();
+}
+
+} // namespace ma
+
+#endif // MA_SLAB_ALLOCATOR_HPP
@@ -0,0 +1,88 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_THREAD_AFFINITY_HPP
+#define MA_THREAD_AFFINITY_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <boost/config.hpp>
+#include <boost/system/error_code.hpp>
+
+#if defined(BOOST_WINDOWS)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace ma {
+
+/// Binds the calling thread to the single CPU with the given (zero-based)
+/// index.
+/**
+ * Memory allocated (and first touched) by the bound thread is usually placed
+ * by OS at the NUMA node of that CPU.
+ * Supported OS: MS Windows family, Linux. Returns operation_not_supported
+ * error at the other OS.
+ */
+boost::system::error_code bind_this_thread_to_cpu(std::size_t cpu);
+
+#if defined(BOOST_WINDOWS)
+
+inline boost::system::error_code bind_this_thread_to_cpu(std::size_t cpu)
+{
+  if (cpu >= sizeof(DWORD_PTR) * 8)
+  {
+    return boost::system::errc::make_error_code(
+        boost::system::errc::invalid_argument);
+  }
+  const DWORD_PTR mask = static_cast<DWORD_PTR>(1) << cpu;
+  if (!::SetThreadAffinityMask(::GetCurrentThread(), mask))
+  {
+    return boost::system::error_code(static_cast<int>(::GetLastError()),
+        boost::system::system_category());
+  }
+  return boost::system::error_code();
+}
+
+#elif defined(__linux__)
+
+inline boost::system::error_code bind_this_thread_to_cpu(std::size_t cpu)
+{
+  if (cpu >= CPU_SETSIZE)
+  {
+    return boost::system::errc::make_error_code(
+        boost::system::errc::invalid_argument);
+  }
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  if (int error = ::pthread_setaffinity_np(
+      ::pthread_self(), sizeof(cpu_set), &cpu_set))
+  {
+    return boost::system::error_code(error, boost::system::system_category());
+  }
+  return boost::system::error_code();
+}
+
+#else
+
+inline boost::system::error_code bind_this_thread_to_cpu(std::size_t /*cpu*/)
+{
+  return boost::system::errc::make_error_code(
+      boost::system::errc::operation_not_supported);
+}
+
+#endif
+
+} // namespace ma
+
+#endif // MA_THREAD_AFFINITY_HPP
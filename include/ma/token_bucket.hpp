@@ -0,0 +1,150 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MA_TOKEN_BUCKET_HPP
+#define MA_TOKEN_BUCKET_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstddef>
+#include <algorithm>
+#include <boost/assert.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace ma {
+
+/// Token bucket limiting the average rate of some transfer (e.g. bytes per
+/// second) and allowing bursts up to the bucket capacity.
+/**
+ * Time is given by the caller as the time passed since any fixed moment,
+ * i.e. it has to be taken from monotonic clock. Bucket also accounts time
+ * the caller was throttled, i.e. the time since the first wait_time returned
+ * non zero duration till the next wait_time returned zero one.
+ *
+ * Isn't thread-safe.
+ */
+class token_bucket
+{
+public:
+  typedef boost::posix_time::time_duration duration_type;
+
+  /// Bucket is full initially.
+  token_bucket(std::size_t rate, std::size_t capacity,
+      const duration_type& now);
+
+  /// Returns zero duration if there are tokens for the transfer of the given
+  /// size (size greater than capacity is considered to be equal to capacity)
+  /// or the time remaining till they are.
+  duration_type wait_time(std::size_t size, const duration_type& now);
+
+  /// Takes tokens for the completed transfer.
+  void consume(std::size_t size);
+
+  /// Total time of throttling including current one (if any).
+  duration_type throttled_time(const duration_type& now) const;
+
+private:
+  static const boost::uint64_t microseconds_per_second = 1000000;
+
+  void refill(const duration_type& now);
+
+  std::size_t   rate_;
+  std::size_t   capacity_;
+  std::size_t   tokens_;
+  duration_type update_time_;
+  bool          throttled_;
+  duration_type throttle_start_;
+  duration_type throttled_time_;
+}; // class token_bucket
+
+inline token_bucket::token_bucket(std::size_t rate, std::size_t capacity,
+    const duration_type& now)
+  : rate_(rate)
+  , capacity_(capacity)
+  , tokens_(capacity)
+  , update_time_(now)
+  , throttled_(false)
+  , throttle_start_()
+  , throttled_time_()
+{
+  BOOST_ASSERT_MSG(rate > 0, "rate must be > 0");
+  BOOST_ASSERT_MSG(capacity > 0, "capacity must be > 0");
+}
+
+inline token_bucket::duration_type token_bucket::wait_time(std::size_t size,
+    const duration_type& now)
+{
+  refill(now);
+  const std::size_t required = (std::min)(size, capacity_);
+  if (tokens_ >= required)
+  {
+    if (throttled_)
+    {
+      throttled_ = false;
+      throttled_time_ += now - throttle_start_;
+    }
+    return duration_type();
+  }
+
+  if (!throttled_)
+  {
+    throttled_ = true;
+    throttle_start_ = now;
+  }
+  const boost::uint64_t missing = required - tokens_;
+  return boost::posix_time::microseconds(static_cast<boost::int64_t>(
+      (missing * microseconds_per_second + rate_ - 1) / rate_));
+}
+
+inline void token_bucket::consume(std::size_t size)
+{
+  tokens_ -= (std::min)(tokens_, size);
+}
+
+inline token_bucket::duration_type token_bucket::throttled_time(
+    const duration_type& now) const
+{
+  if (throttled_)
+  {
+    return throttled_time_ + (now - throttle_start_);
+  }
+  return throttled_time_;
+}
+
+inline void token_bucket::refill(const duration_type& now)
+{
+  const boost::int64_t elapsed = (now - update_time_).total_microseconds();
+  if (elapsed <= 0)
+  {
+    return;
+  }
+
+  // Check for fullness first to avoid overflow of the long idle bucket
+  const boost::uint64_t missing = capacity_ - tokens_;
+  const boost::uint64_t fill_time =
+      (missing * microseconds_per_second + rate_ - 1) / rate_;
+  if (static_cast<boost::uint64_t>(elapsed) >= fill_time)
+  {
+    tokens_ = capacity_;
+    update_time_ = now;
+    return;
+  }
+
+  // Fraction of token is kept by means of the partial update of time
+  const boost::uint64_t added =
+      static_cast<boost::uint64_t>(elapsed) * rate_ / microseconds_per_second;
+  tokens_ += static_cast<std::size_t>(added);
+  update_time_ += boost::posix_time::microseconds(static_cast<boost::int64_t>(
+      added * microseconds_per_second / rate_));
+}
+
+} // namespace ma
+
+#endif // MA_TOKEN_BUCKET_HPP
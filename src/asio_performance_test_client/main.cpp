@@ -31,10 +31,12 @@
 #include <boost/make_shared.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/program_options.hpp>
+#include <boost/throw_exception.hpp>
 #include <boost/optional.hpp>
 #include <ma/config.hpp>
 #include <ma/cyclic_buffer.hpp>
 #include <ma/async_connect.hpp>
+#include <ma/io_service_loop.hpp>
 #include <ma/steady_deadline_timer.hpp>
 #include <ma/handler_allocator.hpp>
 #include <ma/custom_alloc_handler.hpp>
@@ -87,6 +89,8 @@ std::string integer_to_string(Integer value)
 }
 
 typedef ma::limited_int<boost::uintmax_t> limited_counter;
+// Round trip times (microseconds)
+typedef std::vector<boost::uint64_t> latency_vector;
 
 template <typename Integer>
 std::string to_string(const ma::limited_int<Integer>& limited_value)
@@ -108,15 +112,22 @@ public:
     : total_sessions_connected_()
     , total_bytes_written_()
     , total_bytes_read_()
+    , total_datagrams_written_()
+    , total_datagrams_read_()
   {
   }
 
   void add(const limited_counter& bytes_written,
-      const limited_counter& bytes_read)
+      const limited_counter& bytes_read,
+      const limited_counter& datagrams_written,
+      const limited_counter& datagrams_read, const latency_vector& latencies)
   {
     ++total_sessions_connected_;
     total_bytes_written_ += bytes_written;
     total_bytes_read_    += bytes_read;
+    total_datagrams_written_ += datagrams_written;
+    total_datagrams_read_    += datagrams_read;
+    latencies_.insert(latencies_.end(), latencies.begin(), latencies.end());
   }
 
   void print()
@@ -130,16 +141,87 @@ public:
               << "Total bytes read        : "
               << to_string(total_bytes_read_)
               << std::endl;
+
+    if (total_datagrams_written_.value())
+    {
+      std::cout << "Total datagrams written : "
+                << to_string(total_datagrams_written_)
+                << std::endl
+                << "Total datagrams read    : "
+                << to_string(total_datagrams_read_)
+                << std::endl;
+    }
+
+    if (latencies_.empty())
+    {
+      return;
+    }
+    std::sort(latencies_.begin(), latencies_.end());
+    std::cout << "Total round trips       : "
+              << latencies_.size()
+              << std::endl
+              << "Round trip time (microseconds) p50: "
+              << percentile(50)
+              << ", p90: "
+              << percentile(90)
+              << ", p99: "
+              << percentile(99)
+              << ", p99.9: "
+              << percentile(99.9)
+              << ", max: "
+              << latencies_.back()
+              << std::endl;
   }
 
 private:
+  // Latencies have to be sorted
+  boost::uint64_t percentile(double value) const
+  {
+    const std::size_t index = static_cast<std::size_t>(
+        static_cast<double>(latencies_.size()) * value / 100);
+    return latencies_[(std::min)(index, latencies_.size() - 1)];
+  }
+
   limited_counter total_sessions_connected_;
   limited_counter total_bytes_written_;
   limited_counter total_bytes_read_;
+  limited_counter total_datagrams_written_;
+  limited_counter total_datagrams_read_;
+  latency_vector  latencies_;
 }; // class stats
 
 typedef boost::optional<bool> optional_bool;
 typedef boost::optional<int>  optional_int;
+typedef ma::steady_deadline_timer      deadline_timer;
+typedef deadline_timer::duration_type  duration_type;
+typedef boost::optional<duration_type> optional_duration;
+
+#if defined(MA_HAS_STEADY_DEADLINE_TIMER)
+
+boost::posix_time::time_duration to_posix_duration(
+    const duration_type& duration)
+{
+  return deadline_timer::traits_type::to_posix_duration(duration);
+}
+
+#else // defined(MA_HAS_STEADY_DEADLINE_TIMER)
+
+boost::posix_time::time_duration to_posix_duration(
+    const duration_type& duration)
+{
+  return duration;
+}
+
+#endif // defined(MA_HAS_STEADY_DEADLINE_TIMER)
+
+// Traffic of session: echo (data is written and its echo is read), send
+// (data is written again and again, read data is dropped, e.g. for discard
+// server) and sink (nothing is written, read data is dropped, e.g. for
+// chargen server)
+struct traffic_mode
+{
+  enum value_t {echo, send, sink};
+}; // struct traffic_mode
 
 struct session_config
 {
@@ -148,15 +230,37 @@ public:
       std::size_t the_max_connect_attempts,
       const optional_int& the_socket_recv_buffer_size,
       const optional_int& the_socket_send_buffer_size,
-      const optional_bool& the_no_delay)
+      const optional_bool& the_no_delay,
+      std::size_t the_message_size = 0,
+      const optional_duration& the_message_pause = optional_duration(),
+      traffic_mode::value_t the_traffic = traffic_mode::echo,
+      std::size_t the_udp_datagram_size = 0,
+      std::size_t the_udp_window = 0)
     : buffer_size(the_buffer_size)
     , max_connect_attempts(the_max_connect_attempts)
     , socket_recv_buffer_size(the_socket_recv_buffer_size)
     , socket_send_buffer_size(the_socket_send_buffer_size)
     , no_delay(the_no_delay)
+    , message_size(the_message_size)
+    , message_pause(the_message_pause)
+    , traffic(the_traffic)
+    , udp_datagram_size(the_udp_datagram_size)
+    , udp_window(the_udp_window)
   {
     BOOST_ASSERT_MSG(the_buffer_size > 0, "buffer_size must be > 0");
 
+    BOOST_ASSERT_MSG(the_message_size <= the_buffer_size,
+        "message_size must be <= buffer_size");
+
+    BOOST_ASSERT_MSG(!the_message_size || (traffic_mode::echo == the_traffic),
+        "message_size can be used only with echo traffic");
+
+    BOOST_ASSERT_MSG(!the_udp_datagram_size
+        || ((the_udp_datagram_size <= the_buffer_size) && !the_message_size
+            && (traffic_mode::echo == the_traffic) && (the_udp_window > 0)),
+        "udp_datagram_size must be <= buffer_size and can be used only with" \
+        " echo traffic without message_size and with udp_window > 0");
+
     BOOST_ASSERT_MSG(
         !the_socket_recv_buffer_size || (*the_socket_recv_buffer_size) >= 0,
         "Defined socket_recv_buffer_size must be >= 0");
@@ -171,6 +275,17 @@ public:
   optional_int  socket_recv_buffer_size;
   optional_int  socket_send_buffer_size;
   optional_bool no_delay;
+  // If isn't zero then session sends message of this size, waits for its
+  // echo, measures round trip time and sends the next one after the pause.
+  // Otherwise session keeps half of buffer in flight.
+  std::size_t       message_size;
+  optional_duration message_pause;
+  traffic_mode::value_t traffic;
+  // If isn't zero then session sends datagrams of this size to the same
+  // port over UDP instead of TCP, keeps udp_window datagrams in flight and
+  // reads their echo.
+  std::size_t udp_datagram_size;
+  std::size_t udp_window;
 }; // struct session_config
 
 class session : private boost::noncopyable
@@ -179,6 +294,7 @@ class session : private boost::noncopyable
 
 public:
   typedef boost::asio::ip::tcp protocol;
+  typedef boost::asio::ip::udp udp_protocol;
 
   session(boost::asio::io_service& io_service, const session_config& config,
       work_state& work_state)
@@ -186,21 +302,45 @@ public:
     , socket_recv_buffer_size_(config.socket_recv_buffer_size)
     , socket_send_buffer_size_(config.socket_send_buffer_size)
     , no_delay_(config.no_delay)
+    , message_size_(config.message_size)
+    , message_pause_(config.message_pause)
+    , traffic_(config.traffic)
+    , udp_datagram_size_(config.udp_datagram_size)
+    , udp_window_(config.udp_window)
     , strand_(io_service)
     , socket_(io_service)
+    , udp_socket_(io_service)
+    , timer_(io_service)
     , buffer_(config.buffer_size)
+    , udp_write_data_(config.udp_datagram_size,
+          static_cast<char>(config.buffer_size % 128))
+    , udp_read_data_(config.udp_datagram_size ? config.buffer_size : 0)
     , bytes_written_()
     , bytes_read_()
+    , datagrams_written_()
+    , datagrams_read_()
+    , udp_in_flight_(0)
+    , udp_read_since_timer_(false)
+    , write_left_(0)
+    , read_left_(0)
+    , message_start_()
+    , latencies_()
     , connected_(false)
     , write_in_progress_(false)
     , read_in_progress_(false)
+    , timer_in_progress_(false)
     , started_(false)
     , stopped_(false)
     , was_connected_(false)
     , work_state_(work_state)
   {
     typedef ma::cyclic_buffer::mutable_buffers_type buffers_type;
-    std::size_t filled_size = config.buffer_size / 2;
+    std::size_t filled_size =
+        message_size_ ? message_size_ : config.buffer_size / 2;
+    if (traffic_mode::sink == traffic_)
+    {
+      filled_size = 0;
+    }
     const buffers_type data = buffer_.prepared();
     std::size_t size_to_fill = filled_size;
     for (buffers_type::const_iterator i = data.begin(), end = data.end();
@@ -221,6 +361,7 @@ public:
     BOOST_ASSERT_MSG(!connected_, "Invalid connect state");
     BOOST_ASSERT_MSG(!read_in_progress_, "Invalid read state");
     BOOST_ASSERT_MSG(!write_in_progress_, "Invalid write state");
+    BOOST_ASSERT_MSG(!timer_in_progress_, "Invalid timer state");
     BOOST_ASSERT_MSG(!started_ || (started_ && stopped_),
         "Session was not stopped");
   }
@@ -252,6 +393,26 @@ public:
     return bytes_read_;
   }
 
+  limited_counter datagrams_written() const
+  {
+    return datagrams_written_;
+  }
+
+  limited_counter datagrams_read() const
+  {
+    return datagrams_read_;
+  }
+
+  bool measures_latency() const
+  {
+    return 0 != message_size_;
+  }
+
+  const latency_vector& latencies() const
+  {
+    return latencies_;
+  }
+
 private:
   void do_start(const protocol::resolver::iterator& initial_endpoint_iterator)
   {
@@ -261,9 +422,44 @@ private:
     }
 
     started_ = true;
+    if (udp_datagram_size_)
+    {
+      start_udp(*initial_endpoint_iterator);
+      return;
+    }
     start_connect(0, initial_endpoint_iterator, initial_endpoint_iterator);
   }
 
+  void start_udp(const protocol::endpoint& endpoint)
+  {
+    const udp_protocol::endpoint udp_endpoint(endpoint.address(),
+        endpoint.port());
+
+    // UDP socket is connected to get only the datagrams of remote peer
+    boost::system::error_code error;
+    udp_socket_.open(udp_endpoint.protocol(), error);
+    if (!error)
+    {
+      error = apply_udp_socket_options();
+    }
+    if (!error)
+    {
+      udp_socket_.connect(udp_endpoint, error);
+    }
+
+    was_connected_ = !error;
+    if (error)
+    {
+      stop();
+      return;
+    }
+
+    connected_ = true;
+    start_udp_write();
+    start_udp_read();
+    start_udp_timer();
+  }
+
   void do_stop()
   {
     if (stopped_)
@@ -337,7 +533,14 @@ private:
       return;
     }
 
-    start_write_some();
+    if (message_size_)
+    {
+      start_message();
+    }
+    else if (traffic_mode::sink != traffic_)
+    {
+      start_write_some();
+    }
     start_read_some();
   }
 
@@ -349,6 +552,11 @@ private:
     // Collect statistics at first step
     bytes_read_ += bytes_transferred;
     buffer_.consume(bytes_transferred);
+    if (traffic_mode::echo != traffic_)
+    {
+      // Read data isn't written
+      buffer_.commit(bytes_transferred);
+    }
 
     if (stopped_)
     {
@@ -368,6 +576,15 @@ private:
       return;
     }
 
+    if (read_left_)
+    {
+      read_left_ -= (std::min)(read_left_, bytes_transferred);
+      if (!read_left_)
+      {
+        complete_message();
+      }
+    }
+
     if (!write_in_progress_)
     {
       start_write_some();
@@ -382,7 +599,12 @@ private:
 
     // Collect statistics at first step
     bytes_written_ += bytes_transferred;
-    buffer_.commit(bytes_transferred);
+    if (traffic_mode::send != traffic_)
+    {
+      // Send session writes the same data again
+      buffer_.commit(bytes_transferred);
+    }
+    write_left_ -= (std::min)(write_left_, bytes_transferred);
 
     if (stopped_)
     {
@@ -402,8 +624,147 @@ private:
     start_write_some();
   }
 
+  void handle_timer(const boost::system::error_code& error)
+  {
+    timer_in_progress_ = false;
+
+    if (stopped_)
+    {
+      return;
+    }
+
+    if (error && error != boost::asio::error::operation_aborted)
+    {
+      stop();
+      return;
+    }
+
+    start_message();
+  }
+
+  void handle_udp_write(const boost::system::error_code& error,
+      std::size_t bytes_transferred)
+  {
+    write_in_progress_ = false;
+
+    // Collect statistics at first step
+    bytes_written_ += bytes_transferred;
+    if (!error)
+    {
+      ++datagrams_written_;
+    }
+
+    if (stopped_)
+    {
+      return;
+    }
+
+    if (error)
+    {
+      stop();
+      return;
+    }
+
+    start_udp_write();
+  }
+
+  void handle_udp_read(const boost::system::error_code& error,
+      std::size_t bytes_transferred)
+  {
+    read_in_progress_ = false;
+
+    // Collect statistics at first step
+    bytes_read_ += bytes_transferred;
+    if (!error)
+    {
+      ++datagrams_read_;
+      udp_read_since_timer_ = true;
+      if (udp_in_flight_)
+      {
+        --udp_in_flight_;
+      }
+    }
+
+    if (stopped_)
+    {
+      return;
+    }
+
+    if (error)
+    {
+      stop();
+      return;
+    }
+
+    start_udp_write();
+    start_udp_read();
+  }
+
+  void handle_udp_timer(const boost::system::error_code& error)
+  {
+    timer_in_progress_ = false;
+
+    if (stopped_)
+    {
+      return;
+    }
+
+    if (error && error != boost::asio::error::operation_aborted)
+    {
+      stop();
+      return;
+    }
+
+    // Datagrams in flight are considered lost if there was no echo during
+    // the whole period
+    if (!udp_read_since_timer_)
+    {
+      udp_in_flight_ = 0;
+      start_udp_write();
+    }
+    udp_read_since_timer_ = false;
+    start_udp_timer();
+  }
+
+  void start_message()
+  {
+    write_left_    = message_size_;
+    read_left_     = message_size_;
+    message_start_ = deadline_timer::traits_type::now();
+    if (!write_in_progress_)
+    {
+      start_write_some();
+    }
+  }
+
+  void complete_message()
+  {
+    typedef deadline_timer::traits_type traits_type;
+    const duration_type round_trip_time =
+        traits_type::subtract(traits_type::now(), message_start_);
+    latencies_.push_back(static_cast<boost::uint64_t>(
+        to_posix_duration(round_trip_time).total_microseconds()));
+
+    if (!message_pause_)
+    {
+      start_message();
+      return;
+    }
+
+    timer_.expires_from_now(*message_pause_);
+    timer_.async_wait(MA_STRAND_WRAP(strand_,
+        ma::make_custom_alloc_handler(timer_allocator_,
+            boost::bind(&this_type::handle_timer, this, _1))));
+    timer_in_progress_ = true;
+  }
+
   void stop()
   {
+    if (timer_in_progress_)
+    {
+      boost::system::error_code ignored;
+      timer_.cancel(ignored);
+    }
     close_socket();
     connected_ = false;
     stopped_   = true;
@@ -412,7 +773,13 @@ private:
 
   void start_write_some()
   {
-    ma::cyclic_buffer::const_buffers_type write_data = buffer_.data();
+    // Echo of the message mustn't be sent again
+    if (message_size_ && !write_left_)
+    {
+      return;
+    }
+    ma::cyclic_buffer::const_buffers_type write_data =
+        message_size_ ? buffer_.data(write_left_) : buffer_.data();
     if (!write_data.empty())
     {
       socket_.async_write_some(write_data, MA_STRAND_WRAP(strand_,
@@ -434,6 +801,71 @@ private:
     }
   }
 
+  void start_udp_write()
+  {
+    if (write_in_progress_ || (udp_in_flight_ == udp_window_))
+    {
+      return;
+    }
+    udp_socket_.async_send(boost::asio::buffer(udp_write_data_),
+        MA_STRAND_WRAP(strand_, ma::make_custom_alloc_handler(
+            write_allocator_, boost::bind(&this_type::handle_udp_write, this,
+                _1, _2))));
+    write_in_progress_ = true;
+    ++udp_in_flight_;
+  }
+
+  void start_udp_read()
+  {
+    udp_socket_.async_receive(boost::asio::buffer(udp_read_data_),
+        MA_STRAND_WRAP(strand_, ma::make_custom_alloc_handler(
+            read_allocator_, boost::bind(&this_type::handle_udp_read, this,
+                _1, _2))));
+    read_in_progress_ = true;
+  }
+
+  void start_udp_timer()
+  {
+    // Period of check for lost datagrams
+    const long loss_timeout_millis = 200;
+
+    timer_.expires_from_now(ma::to_steady_deadline_timer_duration(
+        boost::posix_time::milliseconds(loss_timeout_millis)));
+    timer_.async_wait(MA_STRAND_WRAP(strand_,
+        ma::make_custom_alloc_handler(timer_allocator_,
+            boost::bind(&this_type::handle_udp_timer, this, _1))));
+    timer_in_progress_ = true;
+  }
+
+  boost::system::error_code apply_udp_socket_options()
+  {
+    typedef udp_protocol::socket socket_type;
+
+    if (socket_recv_buffer_size_)
+    {
+      boost::system::error_code error;
+      socket_type::receive_buffer_size opt(*socket_recv_buffer_size_);
+      udp_socket_.set_option(opt, error);
+      if (error)
+      {
+        return error;
+      }
+    }
+
+    if (socket_send_buffer_size_)
+    {
+      boost::system::error_code error;
+      socket_type::send_buffer_size opt(*socket_send_buffer_size_);
+      udp_socket_.set_option(opt, error);
+      if (error)
+      {
+        return error;
+      }
+    }
+
+    return boost::system::error_code();
+  }
+
   boost::system::error_code apply_socket_options()
   {
     typedef protocol::socket socket_type;
@@ -497,20 +929,39 @@ private:
   {
     boost::system::error_code ignored;
     socket_.close(ignored);
+    udp_socket_.close(ignored);
   }
 
   const std::size_t   max_connect_attempts_;
   const optional_int  socket_recv_buffer_size_;
   const optional_int  socket_send_buffer_size_;
   const optional_bool no_delay_;
+  const std::size_t       message_size_;
+  const optional_duration message_pause_;
+  const traffic_mode::value_t traffic_;
+  const std::size_t udp_datagram_size_;
+  const std::size_t udp_window_;
   boost::asio::io_service::strand strand_;
   protocol::socket socket_;
+  udp_protocol::socket udp_socket_;
+  deadline_timer   timer_;
   ma::cyclic_buffer buffer_;
+  std::vector<char> udp_write_data_;
+  std::vector<char> udp_read_data_;
   limited_counter bytes_written_;
   limited_counter bytes_read_;
+  limited_counter datagrams_written_;
+  limited_counter datagrams_read_;
+  std::size_t udp_in_flight_;
+  bool udp_read_since_timer_;
+  std::size_t write_left_;
+  std::size_t read_left_;
+  deadline_timer::time_type message_start_;
+  latency_vector latencies_;
   bool connected_;
   bool write_in_progress_;
   bool read_in_progress_;
+  bool timer_in_progress_;
   bool started_;
   bool stopped_;
   bool was_connected_;
@@ -518,12 +969,10 @@ private:
   ma::in_place_handler_allocator<256> stop_allocator_;
   ma::in_place_handler_allocator<512> read_allocator_;
   ma::in_place_handler_allocator<512> write_allocator_;
+  ma::in_place_handler_allocator<256> timer_allocator_;
 }; // class session
 
-typedef boost::shared_ptr<session>     session_ptr;
-typedef ma::steady_deadline_timer      deadline_timer;
-typedef deadline_timer::duration_type  duration_type;
-typedef boost::optional<duration_type> optional_duration;
+typedef boost::shared_ptr<session> session_ptr;
 
 struct session_manager_config
 {
@@ -531,11 +980,15 @@ public:
   session_manager_config(std::size_t the_session_count,
       std::size_t the_block_size,
       const optional_duration& the_block_pause,
-      const session_config& the_managed_session_config)
+      const session_config& the_managed_session_config,
+      std::size_t the_light_session_count,
+      const session_config& the_light_session_config)
     : session_count(the_session_count)
     , block_size(the_block_size)
     , block_pause(the_block_pause)
     , managed_session_config(the_managed_session_config)
+    , light_session_count(the_light_session_count)
+    , light_session_config(the_light_session_config)
   {
   }
 
@@ -543,12 +996,18 @@ public:
   std::size_t       block_size;
   optional_duration block_pause;
   session_config    managed_session_config;
+  // Sessions measuring round trip time of small messages while
+  // the rest of sessions load server
+  std::size_t       light_session_count;
+  session_config    light_session_config;
 }; // struct session_manager_config
 
 typedef boost::shared_ptr<boost::asio::io_service> io_service_ptr;
 typedef std::vector<io_service_ptr> io_service_vector;
 typedef boost::shared_ptr<boost::asio::io_service::work> io_service_work_ptr;
 typedef std::vector<io_service_work_ptr> io_service_work_vector;
+typedef boost::shared_ptr<ma::io_service_loop> io_service_loop_ptr;
+typedef std::vector<io_service_loop_ptr> io_service_loop_vector;
 
 class session_manager : private boost::noncopyable
 {
@@ -563,27 +1022,19 @@ public:
       const session_manager_config& config)
     : block_size_(config.block_size)
     , block_pause_(config.block_pause)
+    , light_session_count_(config.light_session_count)
     , io_service_(session_manager_io_service)
     , strand_(session_manager_io_service)
     , timer_(session_manager_io_service)
     , stopped_(false)
     , timer_in_progess_(false)
-    , work_state_(config.session_count)
+    , work_state_(config.session_count + config.light_session_count)
   {
-    typedef io_service_vector::const_iterator iterator;
-
-    sessions_.reserve(config.session_count);
-    const iterator sbegin = session_io_services.begin();
-    const iterator send   = session_io_services.end();
-    for (std::size_t i = 0; i != config.session_count;)
-    {
-      for (iterator j = sbegin; (j != send) && (i != config.session_count);
-          ++j, ++i)
-      {
-        sessions_.push_back(boost::make_shared<session>(boost::ref(**j),
-            config.managed_session_config, boost::ref(work_state_)));
-      }
-    }
+    sessions_.reserve(config.session_count + config.light_session_count);
+    create_sessions(session_io_services, config.session_count,
+        config.managed_session_config);
+    create_sessions(session_io_services, config.light_session_count,
+        config.light_session_config);
     started_sessions_end_ = sessions_.begin();
   }
 
@@ -595,6 +1046,11 @@ public:
         started_sessions_end_,
         boost::bind(&this_type::register_stats, this, _1));
     stats_.print();
+    if (light_session_count_)
+    {
+      std::cout << "Light sessions:" << std::endl;
+      light_stats_.print();
+    }
   }
 
   void async_start(const protocol::resolver::iterator& endpoint_iterator)
@@ -617,6 +1073,23 @@ public:
 private:
   typedef std::vector<session_ptr> session_vector;
 
+  void create_sessions(const io_service_vector& session_io_services,
+      std::size_t count, const session_config& config)
+  {
+    typedef io_service_vector::const_iterator iterator;
+
+    const iterator sbegin = session_io_services.begin();
+    const iterator send   = session_io_services.end();
+    for (std::size_t i = 0; i != count;)
+    {
+      for (iterator j = sbegin; (j != send) && (i != count); ++j, ++i)
+      {
+        sessions_.push_back(boost::make_shared<session>(boost::ref(**j),
+            config, boost::ref(work_state_)));
+      }
+    }
+  }
+
   static session_vector::const_iterator start_sessions(
       const protocol::resolver::iterator& endpoint_iterator,
       const session_vector::const_iterator& begin,
@@ -719,12 +1192,17 @@ private:
   {
     if (session->was_connected())
     {
-      stats_.add(session->bytes_written(), session->bytes_read());
+      stats& session_stats =
+          session->measures_latency() ? light_stats_ : stats_;
+      session_stats.add(session->bytes_written(), session->bytes_read(),
+          session->datagrams_written(), session->datagrams_read(),
+          session->latencies());
     }
   }
 
   const std::size_t        block_size_;
   const optional_duration  block_pause_;
+  const std::size_t        light_session_count_;
   boost::asio::io_service& io_service_;
   boost::asio::io_service::strand strand_;
   deadline_timer timer_;
@@ -733,6 +1211,7 @@ private:
   bool  stopped_;
   bool  timer_in_progess_;
   stats stats_;
+  stats light_stats_;
   work_state work_state_;
   ma::in_place_handler_allocator<256> start_allocator_;
   ma::in_place_handler_allocator<256> stop_allocator_;
@@ -758,12 +1237,15 @@ public:
       const std::string& the_port,
       std::size_t the_thread_count,
       const boost::posix_time::time_duration& the_test_duration,
+      const boost::optional<boost::posix_time::time_duration>&
+          the_busy_poll_duration,
       const session_manager_config& the_session_manager_config)
     : ios_per_work_thread(the_ios_per_work_thread)
     , host(the_host)
     , port(the_port)
     , thread_count(the_thread_count)
     , test_duration(the_test_duration)
+    , busy_poll_duration(the_busy_poll_duration)
     , client_session_manager_config(the_session_manager_config)
   {
   }
@@ -773,6 +1255,7 @@ public:
   std::string port;
   std::size_t thread_count;
   boost::posix_time::time_duration test_duration;
+  boost::optional<boost::posix_time::time_duration> busy_poll_duration;
   session_manager_config client_session_manager_config;
 }; // struct client_config
 
@@ -784,12 +1267,19 @@ const char* threads_option_name                 = "threads";
 const char* sessions_option_name                = "sessions";
 const char* block_size_option_name              = "block_size";
 const char* block_pause_option_name             = "block_pause";
+const char* light_sessions_option_name          = "light_sessions";
+const char* light_message_option_name           = "light_message";
+const char* light_pause_option_name             = "light_pause";
 const char* buffer_option_name                  = "buffer";
 const char* connect_attempts_option_name        = "connect_attempts";
 const char* socket_recv_buffer_size_option_name = "sock_recv_buffer";
 const char* socket_send_buffer_size_option_name = "sock_send_buffer";
 const char* no_delay_option_name                = "no_delay";
 const char* time_option_name                    = "time";
+const char* busy_poll_option_name               = "busy_poll";
+const char* traffic_option_name                 = "traffic";
+const char* udp_datagram_option_name            = "udp_datagram";
+const char* udp_window_option_name              = "udp_window";
 const std::string default_system_value          = "system default";
 
 std::size_t calc_thread_count(std::size_t hardware_concurrency)
@@ -855,6 +1345,23 @@ boost::program_options::options_description build_cmd_options_description(
       "set the pause betweeen simultaneous running" \
           "  connect operations (milliseconds)"
     )
+    (
+      light_sessions_option_name,
+      boost::program_options::value<std::size_t>()->default_value(0),
+      "set the number of additional TCP connections measuring round trip" \
+          " time of small messages"
+    )
+    (
+      light_message_option_name,
+      boost::program_options::value<std::size_t>()->default_value(64),
+      "set the size of message sent by light connection (bytes)"
+    )
+    (
+      light_pause_option_name,
+      boost::program_options::value<long>()->default_value(10),
+      "set the pause between the echo of message and the next message" \
+          " of light connection (milliseconds)"
+    )
     (
       buffer_option_name,
       boost::program_options::value<std::size_t>()->default_value(4096),
@@ -885,6 +1392,29 @@ boost::program_options::options_description build_cmd_options_description(
       time_option_name,
       boost::program_options::value<long>()->default_value(600),
       "set the duration of test (seconds)"
+    )
+    (
+      busy_poll_option_name,
+      boost::program_options::value<long>(),
+      "set the time of work thread's polling of demultiplexer before" \
+          " blocking wait (microseconds)"
+    )
+    (
+      traffic_option_name,
+      boost::program_options::value<std::string>()->default_value("echo"),
+      "set the traffic of sessions (echo, send - write only, e.g. to" \
+          " discard server, sink - read only, e.g. from chargen server)"
+    )
+    (
+      udp_datagram_option_name,
+      boost::program_options::value<std::size_t>(),
+      "set the size of datagram (bytes), UDP mode (sessions send datagrams" \
+          " to the same port over UDP and read their echo) is turned on"
+    )
+    (
+      udp_window_option_name,
+      boost::program_options::value<std::size_t>()->default_value(16),
+      "set the number of datagrams kept in flight by session in UDP mode"
     );
 
   return description;
@@ -919,6 +1449,30 @@ bool is_required_specified(
       && (0 != options_values.count(host_option_name));
 }
 
+traffic_mode::value_t build_traffic_mode(
+    const boost::program_options::variables_map& options_values)
+{
+  const std::string value =
+      options_values[traffic_option_name].as<std::string>();
+  if ("echo" == value)
+  {
+    return traffic_mode::echo;
+  }
+  if ("send" == value)
+  {
+    return traffic_mode::send;
+  }
+  if ("sink" == value)
+  {
+    return traffic_mode::sink;
+  }
+  using boost::program_options::validation_error;
+  boost::throw_exception(validation_error(
+      validation_error::invalid_option_value, std::string(),
+      traffic_option_name));
+  return traffic_mode::echo;
+}
+
 optional_int build_optional_int(
     const boost::program_options::variables_map& options_values,
     const std::string& option_name)
@@ -945,6 +1499,12 @@ client_config build_client_config(
       options_values[block_size_option_name].as<std::size_t>();
   const long block_pause_millis =
       options_values[block_pause_option_name].as<long>();
+  const std::size_t light_session_count =
+      options_values[light_sessions_option_name].as<std::size_t>();
+  const std::size_t light_message_size = (std::max)(std::size_t(1),
+      options_values[light_message_option_name].as<std::size_t>());
+  const long light_pause_millis =
+      options_values[light_pause_option_name].as<long>();
 
   const std::size_t buffer_size =
       options_values[buffer_option_name].as<std::size_t>();
@@ -962,18 +1522,71 @@ client_config build_client_config(
     no_delay = options_values[no_delay_option_name].as<bool>();
   }
 
+  const traffic_mode::value_t traffic = build_traffic_mode(options_values);
+
+  std::size_t udp_datagram_size = 0;
+  const std::size_t udp_window =
+      options_values[udp_window_option_name].as<std::size_t>();
+  if (0 != options_values.count(udp_datagram_option_name))
+  {
+    udp_datagram_size =
+        options_values[udp_datagram_option_name].as<std::size_t>();
+    // Echo of datagram has to fit into buffer
+    if (!udp_datagram_size || (udp_datagram_size > buffer_size)
+        || (traffic_mode::echo != traffic))
+    {
+      using boost::program_options::validation_error;
+      boost::throw_exception(validation_error(
+          validation_error::invalid_option_value, std::string(),
+          udp_datagram_option_name));
+    }
+    if (!udp_window)
+    {
+      using boost::program_options::validation_error;
+      boost::throw_exception(validation_error(
+          validation_error::invalid_option_value, std::string(),
+          udp_window_option_name));
+    }
+  }
+
   session_config client_session_config(buffer_size, max_connect_attempts,
-      socket_recv_buffer_size, socket_send_buffer_size, no_delay);
+      socket_recv_buffer_size, socket_send_buffer_size, no_delay, 0,
+      optional_duration(), traffic, udp_datagram_size, udp_window);
+
+  // Buffer of light session holds exactly one message (light session always
+  // measures round trip time of echo)
+  session_config light_session_config(light_message_size, max_connect_attempts,
+      socket_recv_buffer_size, socket_send_buffer_size, no_delay,
+      light_message_size, to_optional_duration(light_pause_millis));
 
   session_manager_config client_session_manager_config(session_count,
       block_size, to_optional_duration(block_pause_millis),
-      client_session_config);
+      client_session_config, light_session_count, light_session_config);
 
   bool ios_per_work_thread =
       options_values[demux_option_name].as<bool>();
 
+  // Value is initialized explicitly (even if it's not set) to keep
+  // -Wmaybe-uninitialized quiet
+  boost::optional<boost::posix_time::time_duration> busy_poll_duration =
+      boost::make_optional(false, boost::posix_time::time_duration());
+  if (0 != options_values.count(busy_poll_option_name))
+  {
+    const long busy_poll_micros =
+        options_values[busy_poll_option_name].as<long>();
+    if (busy_poll_micros < 0)
+    {
+      using boost::program_options::validation_error;
+      boost::throw_exception(validation_error(
+          validation_error::invalid_option_value, std::string(),
+          busy_poll_option_name));
+    }
+    busy_poll_duration = boost::posix_time::microseconds(busy_poll_micros);
+  }
+
   return client_config(ios_per_work_thread, host, port, thread_count,
-      boost::posix_time::seconds(time_seconds), client_session_manager_config);
+      boost::posix_time::seconds(time_seconds), busy_poll_duration,
+      client_session_manager_config);
 }
 
 std::string to_seconds_string(const boost::posix_time::time_duration& duration)
@@ -1026,6 +1639,21 @@ std::string to_string(bool value)
   return value ? "on" : "off";
 }
 
+std::string to_string(traffic_mode::value_t value)
+{
+  switch (value)
+  {
+  case traffic_mode::echo:
+    return "echo";
+  case traffic_mode::send:
+    return "send";
+  case traffic_mode::sink:
+    return "sink";
+  default:
+    return "unknown";
+  }
+}
+
 std::string to_string(const optional_bool& value)
 {
   if (value)
@@ -1044,6 +1672,8 @@ void print(const client_config& config)
       config.client_session_manager_config;
   const session_config& managed_session_config =
       client_session_manager_config.managed_session_config;
+  const session_config& light_session_config =
+      client_session_manager_config.light_session_config;
 
   std::cout << "Host      : "
             << config.host
@@ -1064,12 +1694,39 @@ void print(const client_config& config)
             << to_milliseconds_string(
                   client_session_manager_config.block_pause)
             << std::endl
+            << "Light sessions                    : "
+            << client_session_manager_config.light_session_count
+            << std::endl
+            << "Light message size (bytes)        : "
+            << light_session_config.message_size
+            << std::endl
+            << "Light message pause (milliseconds): "
+            << to_milliseconds_string(light_session_config.message_pause)
+            << std::endl
             << "Demultiplexer-per-work-thread mode: "
             << (to_string)(config.ios_per_work_thread)
             << std::endl
+            << "Busy poll (microseconds)          : "
+            << (config.busy_poll_duration
+                  ? boost::lexical_cast<std::string>(
+                        config.busy_poll_duration->total_microseconds())
+                  : std::string("n/a"))
+            << std::endl
             << "Session's buffer size (bytes)     : "
             << managed_session_config.buffer_size
             << std::endl
+            << "Session's traffic                 : "
+            << (to_string)(managed_session_config.traffic)
+            << std::endl
+            << "Session's UDP datagram (bytes)    : "
+            << (managed_session_config.udp_datagram_size
+                  ? boost::lexical_cast<std::string>(
+                        managed_session_config.udp_datagram_size)
+                  : std::string("n/a"))
+            << std::endl
+            << "Session's UDP window (datagrams)  : "
+            << managed_session_config.udp_window
+            << std::endl
             << "Maximum number of connect attempts per session : "
             << managed_session_config.max_connect_attempts
             << std::endl
@@ -1117,10 +1774,38 @@ io_service_work_vector create_works(const io_service_vector& io_services)
   return works;
 }
 
+// Returns event loops of the threads (empty if busy polling is off)
+io_service_loop_vector create_session_loops(const client_config& config,
+    const io_service_vector& io_services)
+{
+  io_service_loop_vector loops;
+  if (!config.busy_poll_duration)
+  {
+    return loops;
+  }
+  for (std::size_t i = 0; i != config.thread_count; ++i)
+  {
+    boost::asio::io_service& io_service = config.ios_per_work_thread
+        ? *io_services[i] : *io_services.front();
+    loops.push_back(boost::make_shared<ma::io_service_loop>(
+        boost::ref(io_service), *config.busy_poll_duration));
+  }
+  return loops;
+}
+
 void create_session_threads(boost::thread_group& threads,
-    const client_config& config, const io_service_vector& io_services)
+    const client_config& config, const io_service_vector& io_services,
+    const io_service_loop_vector& loops)
 {
-  if (config.ios_per_work_thread)
+  if (!loops.empty())
+  {
+    for (io_service_loop_vector::const_iterator i = loops.begin(),
+        end = loops.end(); i != end; ++i)
+    {
+      threads.create_thread(boost::bind(&ma::io_service_loop::run, i->get()));
+    }
+  }
+  else if (config.ios_per_work_thread)
   {
     for (io_service_vector::const_iterator i = io_services.begin(),
         end = io_services.end(); i != end; ++i)
@@ -1140,6 +1825,20 @@ void create_session_threads(boost::thread_group& threads,
   }
 }
 
+void print(const io_service_loop_vector& loops)
+{
+  for (std::size_t i = 0, size = loops.size(); i != size; ++i)
+  {
+    const ma::io_service_loop_stats stats = loops[i]->stats();
+    std::cout << "Thread #" << i
+              << " spin time (milliseconds): "
+              << to_milliseconds_string(stats.spin_time)
+              << ", idle time (milliseconds): "
+              << to_milliseconds_string(stats.idle_time)
+              << std::endl;
+  }
+}
+
 } // anonymous namespace
 
 #if defined(WIN32)
@@ -1188,7 +1887,10 @@ int main(int argc, char* argv[])
     boost::thread_group session_threads;
     io_service_work_vector session_work_guards =
         create_works(session_io_services);
-    create_session_threads(session_threads, config, session_io_services);
+    const io_service_loop_vector session_loops =
+        create_session_loops(config, session_io_services);
+    create_session_threads(session_threads, config, session_io_services,
+        session_loops);
 
     boost::optional<boost::asio::io_service::work> session_manager_work_guard(
         boost::in_place(boost::ref(session_manager_io_service)));
@@ -1210,6 +1912,8 @@ int main(int argc, char* argv[])
     session_work_guards.clear();
     session_threads.join_all();
 
+    print(session_loops);
+
 #if defined(MA_HAS_BOOST_TIMER)
     timer.stop();
     std::cout << "Test duration :" << timer.format();
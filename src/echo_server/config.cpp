@@ -10,6 +10,7 @@
 #include <boost/optional.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/throw_exception.hpp>
+#include <ma/frame_parser.hpp>
 #include "config.hpp"
 
 namespace echo_server {
@@ -31,6 +32,40 @@ const char* socket_recv_buffer_size_option_name = "sock_recv_buffer";
 const char* socket_send_buffer_size_option_name = "sock_send_buffer";
 const char* socket_no_delay_option_name         = "sock_no_delay";
 const char* demux_option_name                   = "demux_per_work_thread";
+const char* prewarmed_sessions_option_name      = "prewarmed_sessions";
+const char* balancing_option_name               = "balancing";
+const char* rebalance_period_option_name        = "rebalance_period";
+const char* memory_budget_option_name           = "memory_budget";
+const char* broadcast_queue_size_option_name    = "broadcast_queue_size";
+const char* broadcast_disconnect_slow_option_name =
+    "broadcast_disconnect_slow";
+const char* first_session_cpu_option_name       = "first_session_cpu";
+const char* session_manager_cpu_option_name     = "session_manager_cpu";
+const char* busy_poll_option_name               = "busy_poll";
+const char* socket_busy_poll_option_name        = "sock_busy_poll";
+const char* read_rate_limit_option_name         = "read_rate_limit";
+const char* write_rate_limit_option_name        = "write_rate_limit";
+const char* fairness_quantum_option_name        = "fairness_quantum";
+const char* write_coalescing_size_option_name   = "write_coalescing_size";
+const char* write_coalescing_delay_option_name  = "write_coalescing_delay";
+const char* zerocopy_threshold_option_name      = "zerocopy_threshold";
+const char* splice_option_name                  = "splice";
+const char* relay_address_option_name           = "relay_address";
+const char* relay_port_option_name              = "relay_port";
+const char* max_message_size_option_name        = "max_message";
+const char* http_option_name                    = "http";
+const char* kv_option_name                      = "kv";
+const char* kv_max_keys_option_name             = "kv_max_keys";
+const char* discard_option_name                 = "discard";
+const char* chargen_option_name                 = "chargen";
+const char* udp_option_name                     = "udp";
+const char* udp_batch_option_name               = "udp_batch";
+const char* udp_max_datagram_option_name        = "udp_max_datagram";
+const char* udp_reuse_port_option_name          = "udp_reuse_port";
+const char* metrics_port_option_name            = "metrics_port";
+#if defined(MA_HAS_EVENT_TRACE)
+const char* trace_file_option_name              = "trace_file";
+#endif
 const std::string default_system_value          = "system default";
 
 template <typename Value>
@@ -85,7 +120,7 @@ std::string to_string<bool>(const boost::optional<bool>& value,
   }
 }
 
-boost::optional<int> read_socket_buffer_size(
+boost::optional<int> read_socket_option(
     const boost::program_options::variables_map& options_values,
     const std::string& option_name)
 {
@@ -98,6 +133,82 @@ boost::optional<int> read_socket_buffer_size(
   return buffer_size;
 }
 
+ma::echo::server::session_config::optional_size read_positive_size_option(
+    const boost::program_options::variables_map& options_values,
+    const std::string& option_name)
+{
+  if (!options_values.count(option_name))
+  {
+    return ma::echo::server::session_config::optional_size();
+  }
+  std::size_t size = options_values[option_name].as<std::size_t>();
+  validate_option<std::size_t>(option_name, size, 1);
+  return size;
+}
+
+execution_config::optional_cpu read_cpu(
+    const boost::program_options::variables_map& options_values,
+    const std::string& option_name, std::size_t cpu_count)
+{
+  if (!options_values.count(option_name))
+  {
+    return execution_config::optional_cpu();
+  }
+  std::size_t cpu = options_values[option_name].as<std::size_t>();
+  if (cpu_count)
+  {
+    validate_option<std::size_t>(option_name, cpu, 0, cpu_count - 1);
+  }
+  return cpu;
+}
+
+typedef execution_config::balancing_policy_type balancing_policy_type;
+
+balancing_policy_type::value_t read_balancing_policy(
+    const boost::program_options::variables_map& options_values)
+{
+  const std::string policy =
+      options_values[balancing_option_name].as<std::string>();
+  if ("sessions" == policy)
+  {
+    return balancing_policy_type::least_sessions;
+  }
+  if ("load" == policy)
+  {
+    return balancing_policy_type::least_load;
+  }
+  if ("round_robin" == policy)
+  {
+    return balancing_policy_type::round_robin;
+  }
+  if ("two_choices" == policy)
+  {
+    return balancing_policy_type::two_choices;
+  }
+  using boost::program_options::validation_error;
+  boost::throw_exception(validation_error(
+      validation_error::invalid_option_value, std::string(),
+      balancing_option_name));
+  return balancing_policy_type::least_sessions;
+}
+
+std::string to_string(balancing_policy_type::value_t value)
+{
+  switch (value)
+  {
+  case balancing_policy_type::least_sessions:
+    return "sessions";
+  case balancing_policy_type::least_load:
+    return "load";
+  case balancing_policy_type::round_robin:
+    return "round_robin";
+  case balancing_policy_type::two_choices:
+    return "two_choices";
+  default:
+    return "unknown";
+  }
+}
+
 std::size_t calc_session_manager_thread_count(
     std::size_t /*hardware_concurrency*/)
 {
@@ -210,8 +321,202 @@ boost::program_options::options_description build_cmd_options_description(
       boost::program_options::value<bool>()->default_value(
           default_ios_per_work_thread),
       "set demultiplexer-per-work-thread mode on"
+    )
+    (
+      prewarmed_sessions_option_name,
+      boost::program_options::value<std::size_t>()->default_value(0),
+      "set the number of sessions created at startup" \
+          " (per sessions' demultiplexer). With bound sessions' threads" \
+          " they are created at the CPUs of those threads, the sessions" \
+          " created later are created by session manager's thread"
+    )
+    (
+      balancing_option_name,
+      boost::program_options::value<std::string>()->default_value("sessions"),
+      "set the rule of demultiplexer selection for the new session" \
+          " (sessions, load, round_robin, two_choices)"
+    )
+    (
+      rebalance_period_option_name,
+      boost::program_options::value<long>(),
+      "set the period of sessions' moving from the busy demultiplexers" \
+          " to the idle ones (milliseconds)"
+    )
+    (
+      memory_budget_option_name,
+      boost::program_options::value<std::size_t>(),
+      "set the limit of total size of data read but not yet echoed (and of" \
+          " key-value replies not yet written) by all sessions, sessions'" \
+          " reads wait when it is reached (bytes)"
+    )
+    (
+      broadcast_queue_size_option_name,
+      boost::program_options::value<std::size_t>(),
+      "set the limit of size of data queued to single session in broadcast" \
+          " mode (bytes), broadcast mode (data read by session is sent to" \
+          " all the other sessions) is turned on"
+    )
+    (
+      broadcast_disconnect_slow_option_name,
+      boost::program_options::value<bool>()->default_value(false),
+      "set disconnection of the slow session in broadcast mode on (session" \
+          " loses the oldest queued data otherwise)"
+    )
+    (
+      first_session_cpu_option_name,
+      boost::program_options::value<std::size_t>(),
+      "set the CPU the first sessions' thread is bound to, the next" \
+          " sessions' threads are bound to the next CPUs"
+    )
+    (
+      session_manager_cpu_option_name,
+      boost::program_options::value<std::size_t>(),
+      "set the CPU session manager's threads are bound to"
+    )
+    (
+      busy_poll_option_name,
+      boost::program_options::value<long>(),
+      "set the time of work thread's polling of demultiplexer before" \
+          " blocking wait (microseconds, turns on statistics of work" \
+          " threads)"
+    )
+    (
+      socket_busy_poll_option_name,
+      boost::program_options::value<int>(),
+      "set SO_BUSY_POLL option of session's socket (microseconds)"
+    )
+    (
+      read_rate_limit_option_name,
+      boost::program_options::value<std::size_t>(),
+      "set the limit of session's average read rate (bytes per second)"
+    )
+    (
+      write_rate_limit_option_name,
+      boost::program_options::value<std::size_t>(),
+      "set the limit of session's average write rate (bytes per second)"
+    )
+    (
+      fairness_quantum_option_name,
+      boost::program_options::value<std::size_t>(),
+      "set the number of bytes session transfers before it lets other" \
+          " sessions of the same demultiplexer run (bytes, off by default" \
+          " - session yields even if no other session is ready)"
+    )
+    (
+      write_coalescing_size_option_name,
+      boost::program_options::value<std::size_t>(),
+      "set the size of data session's write waits for (bytes)"
+    )
+    (
+      write_coalescing_delay_option_name,
+      boost::program_options::value<long>()->default_value(200),
+      "set the maximum time session's write waits for more data" \
+          " (microseconds)"
+    )
+    (
+      zerocopy_threshold_option_name,
+      boost::program_options::value<std::size_t>(),
+      "set the minimal size of session's write done with MSG_ZEROCOPY" \
+          " (bytes)"
+    )
+    (
+      splice_option_name,
+      boost::program_options::value<bool>()->default_value(false),
+      "set splice-based echo mode on (data isn't copied to session's buffer)"
+    )
+    (
+      relay_address_option_name,
+      boost::program_options::value<std::string>()->default_value(
+          "127.0.0.1"),
+      "set the IP address of upstream which sessions relay data to"
+    )
+    (
+      relay_port_option_name,
+      boost::program_options::value<unsigned short>(),
+      "set the TCP port of upstream which sessions relay data to" \
+          " (relay mode is turned on)"
+    )
+    (
+      max_message_size_option_name,
+      boost::program_options::value<std::size_t>(),
+      "set the maximum size of message's payload (bytes), message mode" \
+          " (data is a stream of messages prefixed with 4 bytes size in" \
+          " network byte order and only complete messages are echoed) is" \
+          " turned on"
+    )
+    (
+      http_option_name,
+      boost::program_options::value<bool>()->default_value(false),
+      "set HTTP mode on (each pipelined HTTP/1.1 GET request is answered" \
+          " with the same fixed response)"
+    )
+    (
+      discard_option_name,
+      boost::program_options::value<bool>()->default_value(false),
+      "set discard mode on (RFC 863, read data is dropped, nothing is" \
+          " written)"
+    )
+    (
+      chargen_option_name,
+      boost::program_options::value<bool>()->default_value(false),
+      "set chargen mode on (RFC 864, the same pre-filled data is written" \
+          " continuously, read data is dropped)"
+    )
+    (
+      kv_option_name,
+      boost::program_options::value<bool>()->default_value(false),
+      "set key-value mode on (sessions execute GET key, SET key value and" \
+          " DEL key lines on in-memory store sharded per demultiplexer)"
+    )
+    (
+      kv_max_keys_option_name,
+      boost::program_options::value<std::size_t>(),
+      "set the limit of number of keys of key-value store, SET of new key" \
+          " is answered with NOT_STORED when it is reached (the limit is" \
+          " split evenly between shards)"
+    )
+    (
+      udp_option_name,
+      boost::program_options::value<bool>()->default_value(false),
+      "set UDP echo on (datagrams sent to the same port are echoed)"
+    )
+    (
+      udp_batch_option_name,
+      boost::program_options::value<std::size_t>()->default_value(32),
+      "set the maximum number of datagrams read (and echoed) by single" \
+          " system call"
+    )
+    (
+      udp_max_datagram_option_name,
+      boost::program_options::value<std::size_t>()->default_value(2048),
+      "set the maximum size of echoed datagram (bytes), longer datagrams" \
+          " are dropped"
+    )
+    (
+      udp_reuse_port_option_name,
+      boost::program_options::value<bool>()->default_value(false),
+      "set UDP sharding on (one socket bound with SO_REUSEPORT per" \
+          " sessions' thread)"
+    )
+    (
+      metrics_port_option_name,
+      boost::program_options::value<unsigned short>(),
+      "set the TCP port number of admin listener serving metrics" \
+          " in Prometheus text format (and snapshot of active sessions" \
+          " at /sessions path), turns on statistics of work threads"
     );
 
+#if defined(MA_HAS_EVENT_TRACE)
+  description.add_options()
+    (
+      trace_file_option_name,
+      boost::program_options::value<std::string>(),
+      "set the file event trace is written into at server stop" \
+          " (and by SIGUSR1 signal)"
+    );
+#endif
+
+
   return description;
 }
 
@@ -234,11 +539,26 @@ boost::program_options::variables_map parse_cmd_line(
 
 void print_config(std::ostream& stream, std::size_t cpu_count,
     const execution_config& exec_config,
-    const ma::echo::server::session_manager_config& session_manager_config)
+    const ma::echo::server::session_manager_config& session_manager_config,
+    const optional_udp_echo_config& udp_echo_config)
 {
   const ma::echo::server::session_config& session_config =
       session_manager_config.managed_session_config;
 
+  boost::optional<long> rebalance_period_millis;
+  if (ma::echo::server::session_config::optional_time_duration period =
+      session_manager_config.rebalance_period)
+  {
+    rebalance_period_millis = period->total_milliseconds();
+  }
+
+  boost::optional<long> busy_poll_micros;
+  if (execution_config::optional_time_duration duration =
+      exec_config.busy_poll_duration)
+  {
+    busy_poll_micros = duration->total_microseconds();
+  }
+
   boost::optional<long> session_inactivity_timeout_sec;
   if (ma::echo::server::session_config::optional_time_duration timeout =
       session_config.inactivity_timeout)
@@ -246,6 +566,23 @@ void print_config(std::ostream& stream, std::size_t cpu_count,
     session_inactivity_timeout_sec = timeout->total_seconds();
   }
 
+  boost::optional<long> write_coalescing_delay_micros;
+  if (ma::echo::server::session_config::optional_time_duration delay =
+      session_config.write_coalescing_delay)
+  {
+    write_coalescing_delay_micros = delay->total_microseconds();
+  }
+
+  boost::optional<std::size_t> udp_batch_size;
+  boost::optional<std::size_t> udp_max_datagram_size;
+  boost::optional<std::size_t> udp_shard_count;
+  if (udp_echo_config)
+  {
+    udp_batch_size = udp_echo_config->batch_size;
+    udp_max_datagram_size = udp_echo_config->max_datagram_size;
+    udp_shard_count = udp_echo_config->shard_count;
+  }
+
   stream << "Number of found CPU(s)                : " //-V128
          << cpu_count
          << std::endl
@@ -262,9 +599,42 @@ void print_config(std::ostream& stream, std::size_t cpu_count,
          << "Demultiplexer-per-work-thread mode    : "
          << to_string(exec_config.ios_per_work_thread)
          << std::endl
+         << "Prewarmed sessions per demultiplexer  : "
+         << exec_config.prewarmed_session_count
+         << std::endl
+         << "Demultiplexer balancing policy        : "
+         << to_string(exec_config.balancing_policy)
+         << std::endl
+         << "Key-value mode                        : "
+         << to_string(exec_config.kv)
+         << std::endl
+         << "Key-value store max keys              : "
+         << to_string(exec_config.kv_max_keys, "unlimited")
+         << std::endl
+         << "Sessions' broadcast queue size (bytes): "
+         << to_string(exec_config.broadcast_queue_size, "none")
+         << std::endl
+         << "Disconnect of slow broadcast sessions : "
+         << to_string(exec_config.broadcast_disconnect_slow)
+         << std::endl
+         << "First CPU of sessions' threads        : "
+         << to_string(exec_config.first_session_cpu, "not bound")
+         << std::endl
+         << "CPU of session manager's threads      : "
+         << to_string(exec_config.session_manager_cpu, "not bound")
+         << std::endl
+         << "Work threads' busy poll (microseconds): "
+         << to_string(busy_poll_micros, "none")
+         << std::endl
+         << "Event trace file                      : "
+         << to_string(exec_config.trace_file, "none")
+         << std::endl
          << "Server listen port                    : "
          << session_manager_config.accepting_endpoint.port()
          << std::endl
+         << "Metrics listen port                   : "
+         << to_string(exec_config.metrics_port, "none")
+         << std::endl
          << "Server stop timeout (seconds)         : "
          << exec_config.stop_timeout.total_seconds()
          << std::endl
@@ -277,6 +647,12 @@ void print_config(std::ostream& stream, std::size_t cpu_count,
          << "TCP listen backlog size               : "
          << session_manager_config.listen_backlog
          << std::endl
+         << "Sessions' rebalance period (milliseconds) : "
+         << to_string(rebalance_period_millis, "none")
+         << std::endl
+         << "Sessions' memory budget (bytes)       : "
+         << to_string(session_manager_config.memory_budget, "none")
+         << std::endl
          << "Size of session's buffer (bytes)      : "
          << session_config.buffer_size
          << std::endl
@@ -296,6 +672,54 @@ void print_config(std::ostream& stream, std::size_t cpu_count,
          << std::endl
          << "Session's socket Nagle algorithm is            : "
          << to_string(session_config.no_delay, default_system_value)
+         << std::endl
+         << "Session's socket busy poll (microseconds)      : "
+         << to_string(session_config.socket_busy_poll, default_system_value)
+         << std::endl
+         << "Session's read rate limit (bytes per second)   : "
+         << to_string(session_config.read_rate_limit, "none")
+         << std::endl
+         << "Session's write rate limit (bytes per second)  : "
+         << to_string(session_config.write_rate_limit, "none")
+         << std::endl
+         << "Session's fairness quantum (bytes)             : "
+         << to_string(session_config.fairness_quantum, "none")
+         << std::endl
+         << "Session's write coalescing size (bytes)        : "
+         << to_string(session_config.write_coalescing_size, "none")
+         << std::endl
+         << "Session's write coalescing delay (microseconds): "
+         << to_string(write_coalescing_delay_micros, "none")
+         << std::endl
+         << "Session's zerocopy write threshold (bytes)     : "
+         << to_string(session_config.zerocopy_threshold, "none")
+         << std::endl
+         << "Session's splice-based echo mode               : "
+         << to_string(session_config.splice)
+         << std::endl
+         << "Session's relay endpoint                       : "
+         << to_string(session_config.relay_endpoint, "none")
+         << std::endl
+         << "Session's max size of message (bytes)          : "
+         << to_string(session_config.max_message_size, "none")
+         << std::endl
+         << "Session's HTTP mode                            : "
+         << to_string(session_config.http)
+         << std::endl
+         << "Session's discard mode                         : "
+         << to_string(session_config.discard)
+         << std::endl
+         << "Session's chargen mode                         : "
+         << to_string(session_config.chargen)
+         << std::endl
+         << "UDP echo batch size (datagrams)                : "
+         << to_string(udp_batch_size, "none")
+         << std::endl
+         << "UDP echo max size of datagram (bytes)          : "
+         << to_string(udp_max_datagram_size, "none")
+         << std::endl
+         << "UDP echo sockets                               : "
+         << to_string(udp_shard_count, "none")
          << std::endl;
 }
 
@@ -311,7 +735,8 @@ bool required_options_specified(
 }
 
 execution_config build_execution_config(
-    const boost::program_options::variables_map& options_values)
+    const boost::program_options::variables_map& options_values,
+    std::size_t cpu_count)
 {
   std::size_t session_manager_thread_count =
       options_values[session_manager_threads_option_name].as<std::size_t>();
@@ -332,8 +757,65 @@ execution_config build_execution_config(
   bool ios_per_work_thread =
       options_values[demux_option_name].as<bool>();
 
+  std::size_t prewarmed_session_count =
+      options_values[prewarmed_sessions_option_name].as<std::size_t>();
+
+  balancing_policy_type::value_t balancing_policy =
+      read_balancing_policy(options_values);
+
+  execution_config::optional_cpu first_session_cpu =
+      read_cpu(options_values, first_session_cpu_option_name, cpu_count);
+
+  execution_config::optional_cpu session_manager_cpu =
+      read_cpu(options_values, session_manager_cpu_option_name, cpu_count);
+
+  execution_config::optional_time_duration busy_poll_duration;
+  if (options_values.count(busy_poll_option_name))
+  {
+    long busy_poll_micros = options_values[busy_poll_option_name].as<long>();
+    validate_option<long>(busy_poll_option_name, busy_poll_micros, 0);
+    busy_poll_duration = boost::posix_time::microseconds(busy_poll_micros);
+  }
+
+  execution_config::optional_string trace_file;
+#if defined(MA_HAS_EVENT_TRACE)
+  if (options_values.count(trace_file_option_name))
+  {
+    trace_file = options_values[trace_file_option_name].as<std::string>();
+  }
+#endif
+
+  execution_config::optional_port metrics_port;
+  if (options_values.count(metrics_port_option_name))
+  {
+    metrics_port = options_values[metrics_port_option_name]
+        .as<unsigned short>();
+  }
+
+  bool kv = options_values[kv_option_name].as<bool>();
+
+  execution_config::optional_size kv_max_keys = read_positive_size_option(
+      options_values, kv_max_keys_option_name);
+
+  execution_config::optional_size broadcast_queue_size;
+  if (options_values.count(broadcast_queue_size_option_name))
+  {
+    std::size_t queue_size =
+        options_values[broadcast_queue_size_option_name].as<std::size_t>();
+    validate_option<std::size_t>(broadcast_queue_size_option_name,
+        queue_size, 1);
+    broadcast_queue_size = queue_size;
+  }
+
+  bool broadcast_disconnect_slow =
+      options_values[broadcast_disconnect_slow_option_name].as<bool>();
+
   return execution_config(ios_per_work_thread, session_manager_thread_count,
-      session_thread_count, boost::posix_time::seconds(stop_timeout_sec));
+      session_thread_count, prewarmed_session_count, balancing_policy,
+      first_session_cpu, session_manager_cpu, busy_poll_duration, trace_file,
+      metrics_port, kv, kv_max_keys, broadcast_queue_size,
+      broadcast_disconnect_slow,
+      boost::posix_time::seconds(stop_timeout_sec));
 }
 
 ma::echo::server::session_config build_session_config(
@@ -365,15 +847,151 @@ ma::echo::server::session_config build_session_config(
   validate_option<std::size_t>(
       max_transfer_size_option_name, max_transfer_size, 1);
 
-  boost::optional<int> socket_recv_buffer_size = read_socket_buffer_size(
+  boost::optional<int> socket_recv_buffer_size = read_socket_option(
       options_values, socket_recv_buffer_size_option_name);
 
-  boost::optional<int> socket_send_buffer_size = read_socket_buffer_size(
+  boost::optional<int> socket_send_buffer_size = read_socket_option(
       options_values, socket_send_buffer_size_option_name);
 
+  boost::optional<int> socket_busy_poll = read_socket_option(
+      options_values, socket_busy_poll_option_name);
+
+  session_config::optional_size read_rate_limit = read_positive_size_option(
+      options_values, read_rate_limit_option_name);
+
+  session_config::optional_size write_rate_limit = read_positive_size_option(
+      options_values, write_rate_limit_option_name);
+
+  session_config::optional_size fairness_quantum = read_positive_size_option(
+      options_values, fairness_quantum_option_name);
+
+  session_config::optional_size write_coalescing_size =
+      read_positive_size_option(options_values,
+          write_coalescing_size_option_name);
+
+  session_config::optional_time_duration write_coalescing_delay;
+  if (write_coalescing_size)
+  {
+    long delay_micros =
+        options_values[write_coalescing_delay_option_name].as<long>();
+    validate_option<long>(write_coalescing_delay_option_name,
+        delay_micros, 1);
+    write_coalescing_delay = boost::posix_time::microseconds(delay_micros);
+  }
+
+  session_config::optional_size zerocopy_threshold = read_positive_size_option(
+      options_values, zerocopy_threshold_option_name);
+
+  bool splice = options_values[splice_option_name].as<bool>();
+
+  session_config::optional_endpoint relay_endpoint;
+  if (options_values.count(relay_port_option_name))
+  {
+    boost::system::error_code error;
+    boost::asio::ip::address relay_address =
+        boost::asio::ip::address::from_string(
+            options_values[relay_address_option_name].as<std::string>(),
+            error);
+    if (error)
+    {
+      using boost::program_options::validation_error;
+      boost::throw_exception(validation_error(
+          validation_error::invalid_option_value, std::string(),
+          relay_address_option_name));
+    }
+    relay_endpoint = session_config::endpoint_type(relay_address,
+        options_values[relay_port_option_name].as<unsigned short>());
+  }
+  if (relay_endpoint && (splice || zerocopy_threshold))
+  {
+    // Relay session copies data between client and upstream
+    using boost::program_options::validation_error;
+    boost::throw_exception(validation_error(
+        validation_error::invalid_option_value, std::string(),
+        relay_port_option_name));
+  }
+
+  session_config::optional_size max_message_size;
+  if (options_values.count(max_message_size_option_name))
+  {
+    std::size_t message_size =
+        options_values[max_message_size_option_name].as<std::size_t>();
+    // Buffer has to hold the whole frame to echo it
+    const std::size_t header_size = ma::frame_parser::header_size;
+    if (buffer_size < header_size)
+    {
+      using boost::program_options::validation_error;
+      boost::throw_exception(validation_error(
+          validation_error::invalid_option_value, std::string(),
+          max_message_size_option_name));
+    }
+    validate_option<std::size_t>(max_message_size_option_name,
+        message_size, 0, buffer_size - header_size);
+    max_message_size = message_size;
+  }
+
+  bool http = options_values[http_option_name].as<bool>();
+  if (http && (relay_endpoint || max_message_size || splice
+      || zerocopy_threshold))
+  {
+    // HTTP session answers client itself and parses requests, not messages
+    using boost::program_options::validation_error;
+    boost::throw_exception(validation_error(
+        validation_error::invalid_option_value, std::string(),
+        http_option_name));
+  }
+
+  bool discard = options_values[discard_option_name].as<bool>();
+  bool chargen = options_values[chargen_option_name].as<bool>();
+  if (discard && (chargen || relay_endpoint || max_message_size || http
+      || splice || zerocopy_threshold))
+  {
+    // Discard session doesn't write anything
+    using boost::program_options::validation_error;
+    boost::throw_exception(validation_error(
+        validation_error::invalid_option_value, std::string(),
+        discard_option_name));
+  }
+  if (chargen && (relay_endpoint || max_message_size || http || splice
+      || zerocopy_threshold))
+  {
+    // Chargen session writes its own data only
+    using boost::program_options::validation_error;
+    boost::throw_exception(validation_error(
+        validation_error::invalid_option_value, std::string(),
+        chargen_option_name));
+  }
+
+  if (options_values.count(broadcast_queue_size_option_name)
+      && (relay_endpoint || http || discard || chargen || splice
+          || zerocopy_threshold))
+  {
+    // Relay (HTTP, discard, chargen) session doesn't publish data,
+    // broadcast session copies data to publish it
+    using boost::program_options::validation_error;
+    boost::throw_exception(validation_error(
+        validation_error::invalid_option_value, std::string(),
+        broadcast_queue_size_option_name));
+  }
+
+  bool kv = options_values[kv_option_name].as<bool>();
+  if (kv && (relay_endpoint || max_message_size || http || discard
+      || chargen || options_values.count(broadcast_queue_size_option_name)
+      || splice || zerocopy_threshold))
+  {
+    // Key-value session answers client itself and parses commands
+    using boost::program_options::validation_error;
+    boost::throw_exception(validation_error(
+        validation_error::invalid_option_value, std::string(),
+        kv_option_name));
+  }
+
   return session_config(buffer_size, max_transfer_size,
       socket_recv_buffer_size, socket_send_buffer_size, no_delay,
-      inactivity_timeout);
+      inactivity_timeout, socket_busy_poll, read_rate_limit,
+      write_rate_limit, fairness_quantum, write_coalescing_size,
+      write_coalescing_delay, zerocopy_threshold, splice, relay_endpoint,
+      max_message_size, http, discard, chargen);
 }
 
 ma::echo::server::session_manager_config build_session_manager_config(
@@ -395,11 +1013,61 @@ ma::echo::server::session_manager_config build_session_manager_config(
 
   int listen_backlog = options_values[listen_backlog_option_name].as<int>();
 
+  ma::echo::server::session_config::optional_time_duration rebalance_period;
+  if (options_values.count(rebalance_period_option_name))
+  {
+    long period_millis =
+        options_values[rebalance_period_option_name].as<long>();
+    validate_option<long>(rebalance_period_option_name, period_millis, 1);
+    rebalance_period = boost::posix_time::milliseconds(period_millis);
+  }
+
+  ma::echo::server::session_manager_config::optional_size memory_budget;
+  if (options_values.count(memory_budget_option_name))
+  {
+    std::size_t budget =
+        options_values[memory_budget_option_name].as<std::size_t>();
+    validate_option<std::size_t>(memory_budget_option_name, budget, 1);
+    memory_budget = budget;
+  }
+
   using boost::asio::ip::tcp;
 
   return ma::echo::server::session_manager_config(
       tcp::endpoint(tcp::v4(), port), max_sessions, recycled_sessions, 
-      max_stopping_sessions, listen_backlog, session_config);
+      max_stopping_sessions, listen_backlog, session_config,
+      rebalance_period, memory_budget);
+}
+
+optional_udp_echo_config build_udp_echo_config(
+    const boost::program_options::variables_map& options_values,
+    const execution_config& exec_config,
+    const ma::echo::server::session_manager_config& session_manager_config)
+{
+  if (!options_values[udp_option_name].as<bool>())
+  {
+    return optional_udp_echo_config();
+  }
+
+  std::size_t batch_size =
+      options_values[udp_batch_option_name].as<std::size_t>();
+  validate_option<std::size_t>(udp_batch_option_name, batch_size, 1);
+
+  // Size of datagram is limited by 16 bits length field of UDP header
+  std::size_t max_datagram_size =
+      options_values[udp_max_datagram_option_name].as<std::size_t>();
+  validate_option<std::size_t>(udp_max_datagram_option_name,
+      max_datagram_size, 1, 65535);
+
+  bool reuse_port = options_values[udp_reuse_port_option_name].as<bool>();
+  std::size_t shard_count =
+      reuse_port ? exec_config.session_thread_count : 1;
+
+  using boost::asio::ip::udp;
+
+  const unsigned short port = session_manager_config.accepting_endpoint.port();
+  return ma::echo::server::udp_echo_config(udp::endpoint(udp::v4(), port),
+      batch_size, max_datagram_size, shard_count, reuse_port);
 }
 
 } // namespace echo_server
@@ -17,30 +17,77 @@
 #endif
 
 #include <cstddef>
+#include <string>
 #include <ostream>
 #include <boost/assert.hpp>
+#include <boost/optional.hpp>
 #include <boost/program_options.hpp>
 #include <boost/date_time/posix_time/ptime.hpp>
 #include <ma/echo/server/session_config.hpp>
 #include <ma/echo/server/session_manager_config.hpp>
+#include <ma/echo/server/udp_echo_config.hpp>
+#include <ma/echo/server/pooled_session_factory.hpp>
 
 namespace echo_server {
 
+typedef boost::optional<ma::echo::server::udp_echo_config>
+    optional_udp_echo_config;
+
 struct execution_config
 {
 public:
   typedef boost::posix_time::time_duration time_duration_type;
+  typedef ma::echo::server::pooled_session_factory::balancing_policy
+      balancing_policy_type;
+  typedef boost::optional<std::size_t> optional_cpu;
+  typedef boost::optional<time_duration_type> optional_time_duration;
+  typedef boost::optional<std::string> optional_string;
+  typedef boost::optional<unsigned short> optional_port;
+  typedef boost::optional<std::size_t> optional_size;
 
   execution_config(
       bool ios_per_work_thread,
       std::size_t session_manager_thread_count,
       std::size_t session_thread_count,
+      std::size_t prewarmed_session_count,
+      balancing_policy_type::value_t balancing_policy,
+      const optional_cpu& first_session_cpu,
+      const optional_cpu& session_manager_cpu,
+      const optional_time_duration& busy_poll_duration,
+      const optional_string& trace_file,
+      const optional_port& metrics_port,
+      bool kv,
+      const optional_size& kv_max_keys,
+      const optional_size& broadcast_queue_size,
+      bool broadcast_disconnect_slow,
       const time_duration_type& stop_timeout);
 
-  bool               ios_per_work_thread;
-  std::size_t        session_manager_thread_count;
-  std::size_t        session_thread_count;
-  time_duration_type stop_timeout;
+  bool                           ios_per_work_thread;
+  std::size_t                    session_manager_thread_count;
+  std::size_t                    session_thread_count;
+  std::size_t                    prewarmed_session_count;
+  balancing_policy_type::value_t balancing_policy;
+  // Sessions' threads are bound to the sequential CPUs starting from this one
+  optional_cpu                   first_session_cpu;
+  optional_cpu                   session_manager_cpu;
+  // Work threads poll their io_services during this time before blocking
+  optional_time_duration         busy_poll_duration;
+  // Event trace is written into this file (if event trace is turned on)
+  optional_string                trace_file;
+  // Admin listener serving metrics in Prometheus text format
+  optional_port                  metrics_port;
+  // Sessions work as key-value service with store sharded per io_service
+  bool                           kv;
+  // Limit of number of keys of key-value store
+  optional_size                  kv_max_keys;
+  // Turns broadcast mode on: data read by a session is sent to all the other
+  // sessions instead of echo. Limits the size (bytes) of data queued to
+  // single session.
+  optional_size                  broadcast_queue_size;
+  // Session is disconnected (instead of losing the oldest queued data) when
+  // the queued data exceeds broadcast_queue_size.
+  bool                           broadcast_disconnect_slow;
+  time_duration_type             stop_timeout;
 }; // struct execution_config
 
 boost::program_options::options_description build_cmd_options_description(
@@ -62,7 +109,8 @@ boost::program_options::variables_map parse_cmd_line(
 
 void print_config(std::ostream& stream, std::size_t cpu_count,
     const execution_config& the_execution_config,
-    const ma::echo::server::session_manager_config& session_manager_config);
+    const ma::echo::server::session_manager_config& session_manager_config,
+    const optional_udp_echo_config& udp_echo_config);
 
 bool help_requested(
     const boost::program_options::variables_map& options_values);
@@ -71,7 +119,8 @@ bool required_options_specified(
     const boost::program_options::variables_map& options_values);
 
 execution_config build_execution_config(
-    const boost::program_options::variables_map& options_values);
+    const boost::program_options::variables_map& options_values,
+    std::size_t cpu_count);
 
 ma::echo::server::session_config build_session_config(
     const boost::program_options::variables_map& options_values);
@@ -80,14 +129,42 @@ ma::echo::server::session_manager_config build_session_manager_config(
     const boost::program_options::variables_map& options_values,
     const ma::echo::server::session_config& session_config);
 
+// Returns empty config if UDP echo is off
+optional_udp_echo_config build_udp_echo_config(
+    const boost::program_options::variables_map& options_values,
+    const execution_config& the_execution_config,
+    const ma::echo::server::session_manager_config& session_manager_config);
+
 inline execution_config::execution_config(
     bool the_ios_per_work_thread,
     std::size_t the_session_manager_thread_count,
     std::size_t the_session_thread_count,
+    std::size_t the_prewarmed_session_count,
+    balancing_policy_type::value_t the_balancing_policy,
+    const optional_cpu& the_first_session_cpu,
+    const optional_cpu& the_session_manager_cpu,
+    const optional_time_duration& the_busy_poll_duration,
+    const optional_string& the_trace_file,
+    const optional_port& the_metrics_port,
+    bool the_kv,
+    const optional_size& the_kv_max_keys,
+    const optional_size& the_broadcast_queue_size,
+    bool the_broadcast_disconnect_slow,
     const time_duration_type& the_stop_timeout)
   : ios_per_work_thread(the_ios_per_work_thread)
   , session_manager_thread_count(the_session_manager_thread_count)
   , session_thread_count(the_session_thread_count)
+  , prewarmed_session_count(the_prewarmed_session_count)
+  , balancing_policy(the_balancing_policy)
+  , first_session_cpu(the_first_session_cpu)
+  , session_manager_cpu(the_session_manager_cpu)
+  , busy_poll_duration(the_busy_poll_duration)
+  , trace_file(the_trace_file)
+  , metrics_port(the_metrics_port)
+  , kv(the_kv)
+  , kv_max_keys(the_kv_max_keys)
+  , broadcast_queue_size(the_broadcast_queue_size)
+  , broadcast_disconnect_slow(the_broadcast_disconnect_slow)
   , stop_timeout(the_stop_timeout)
 {
   BOOST_ASSERT_MSG(the_session_manager_thread_count > 0,
@@ -95,6 +172,13 @@ inline execution_config::execution_config(
 
   BOOST_ASSERT_MSG(the_session_thread_count > 0,
       "session_thread_count must be > 0");
+
+  BOOST_ASSERT_MSG(!the_kv_max_keys || (*the_kv_max_keys > 0),
+      "kv_max_keys must be > 0");
+
+  BOOST_ASSERT_MSG(!the_broadcast_queue_size
+      || (*the_broadcast_queue_size > 0),
+      "broadcast_queue_size must be > 0");
 }
 
 } // namespace echo_server
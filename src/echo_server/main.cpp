@@ -13,7 +13,11 @@
 #include <cstddef>
 #include <vector>
 #include <string>
+#include <limits>
+#include <utility>
+#include <sstream>
 #include <iostream>
+#include <algorithm>
 #include <exception>
 #include <boost/ref.hpp>
 #include <boost/asio.hpp>
@@ -21,25 +25,40 @@
 #include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/optional.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/program_options.hpp>
+#include <boost/throw_exception.hpp>
+#include <boost/system/system_error.hpp>
 #include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <ma/handler_allocator.hpp>
+#include <ma/kv_store.hpp>
+#include <ma/broadcast_hub.hpp>
 #include <ma/custom_alloc_handler.hpp>
 #include <ma/console_close_guard.hpp>
+#include <ma/event_trace.hpp>
+#include <ma/io_service_loop.hpp>
+#include <ma/handler_timing.hpp>
+#include <ma/thread_affinity.hpp>
+#include <ma/echo/server/handler_timing_tag.hpp>
 #include <ma/echo/server/simple_session_factory.hpp>
 #include <ma/echo/server/pooled_session_factory.hpp>
 #include <ma/echo/server/session_manager.hpp>
+#include <ma/echo/server/udp_echo_service.hpp>
 #include "config.hpp"
+#include "metrics_server.hpp"
 
 namespace echo_server {
 
 int run_server(const execution_config&,
-    const ma::echo::server::session_manager_config&);
+    const ma::echo::server::session_manager_config&,
+    const optional_udp_echo_config&);
 
 } // namespace echo_server
 
@@ -77,17 +96,21 @@ int main(int argc, char* argv[])
     }
 
     // Parse configuration
-    const execution_config exec_config = build_execution_config(cmd_options);
+    const execution_config exec_config =
+        build_execution_config(cmd_options, cpu_count);
     const ma::echo::server::session_config session_config =
         build_session_config(cmd_options);
     const ma::echo::server::session_manager_config session_manager_config =
         build_session_manager_config(cmd_options, session_config);
+    const optional_udp_echo_config udp_echo_config = build_udp_echo_config(
+        cmd_options, exec_config, session_manager_config);
 
     // Show actual server configuration
-    print_config(std::cout, cpu_count, exec_config, session_manager_config);
+    print_config(std::cout, cpu_count, exec_config, session_manager_config,
+        udp_echo_config);
 
     // Do the work
-    return run_server(exec_config, session_manager_config);
+    return run_server(exec_config, session_manager_config, udp_echo_config);
   }
   catch (const boost::program_options::error& e)
   {
@@ -110,8 +133,139 @@ typedef boost::shared_ptr<boost::asio::io_service> io_service_ptr;
 typedef std::vector<io_service_ptr>                io_service_vector;
 typedef boost::shared_ptr<ma::echo::server::session_factory>
     session_factory_ptr;
+typedef boost::shared_ptr<ma::kv_store> kv_store_ptr;
+typedef boost::shared_ptr<ma::broadcast_hub> broadcast_hub_ptr;
+typedef std::vector<ma::echo::server::udp_echo_service_ptr>
+    udp_echo_service_vector;
 typedef boost::shared_ptr<boost::asio::io_service::work> io_service_work_ptr;
 typedef std::vector<io_service_work_ptr> io_service_work_vector;
+typedef echo_server::execution_config::optional_cpu optional_cpu;
+typedef boost::shared_ptr<ma::io_service_loop> io_service_loop_ptr;
+typedef std::vector<io_service_loop_ptr>       io_service_loop_vector;
+
+optional_cpu session_thread_cpu(const optional_cpu& first_session_cpu,
+    std::size_t thread_index)
+{
+  if (!first_session_cpu)
+  {
+    return optional_cpu();
+  }
+  const std::size_t cpu = *first_session_cpu + thread_index;
+  if (const std::size_t cpu_count = boost::thread::hardware_concurrency())
+  {
+    return cpu % cpu_count;
+  }
+  return cpu;
+}
+
+void bind_this_thread(const optional_cpu& cpu)
+{
+  if (cpu)
+  {
+    boost::system::error_code error = ma::bind_this_thread_to_cpu(*cpu);
+    if (error)
+    {
+      boost::throw_exception(boost::system::system_error(error));
+    }
+  }
+}
+
+void prewarm_sessions_at_cpu(
+    ma::echo::server::pooled_session_factory& session_factory,
+    boost::asio::io_service& io_service,
+    const ma::echo::server::session_config& session_config,
+    std::size_t count, std::size_t cpu, std::size_t& memory_size,
+    boost::system::error_code& error)
+{
+  error = ma::bind_this_thread_to_cpu(cpu);
+  if (!error)
+  {
+    memory_size += session_factory.prewarm(
+        io_service, session_config, count, error);
+  }
+}
+
+std::size_t prewarm(ma::echo::server::simple_session_factory& session_factory,
+    const echo_server::execution_config& exec_config,
+    const io_service_vector& /*io_services*/,
+    const ma::echo::server::session_config& session_config,
+    boost::system::error_code& error)
+{
+  return session_factory.prewarm(session_config,
+      exec_config.prewarmed_session_count, error);
+}
+
+std::size_t prewarm(ma::echo::server::pooled_session_factory& session_factory,
+    const echo_server::execution_config& exec_config,
+    const io_service_vector& io_services,
+    const ma::echo::server::session_config& session_config,
+    boost::system::error_code& error)
+{
+  const std::size_t count = exec_config.prewarmed_session_count;
+  if (!exec_config.first_session_cpu)
+  {
+    return session_factory.prewarm(session_config, count, error);
+  }
+
+  // Sessions are created by the threads bound to the same CPUs as
+  // the threads of their io_services, so (first-touch) memory of sessions
+  // is placed at the NUMA nodes of those CPUs. Sessions created when pool
+  // has no recycled ones are created by session manager's thread, so only
+  // prewarmed sessions are placed this way.
+  std::size_t memory_size = 0;
+  for (std::size_t i = 0, size = io_services.size(); i != size; ++i)
+  {
+    boost::thread thread(boost::bind(prewarm_sessions_at_cpu,
+        boost::ref(session_factory), boost::ref(*io_services[i]),
+        boost::cref(session_config), count,
+        *session_thread_cpu(exec_config.first_session_cpu, i),
+        boost::ref(memory_size), boost::ref(error)));
+    thread.join();
+    if (error)
+    {
+      break;
+    }
+  }
+  return memory_size;
+}
+
+template <typename SessionFactory>
+void prewarm_sessions(SessionFactory& session_factory,
+    const echo_server::execution_config& exec_config,
+    const io_service_vector& io_services,
+    const ma::echo::server::session_config& session_config)
+{
+  if (!exec_config.prewarmed_session_count)
+  {
+    return;
+  }
+
+  std::cout << "Prewarming sessions." << std::endl;
+
+  const boost::posix_time::ptime start_time =
+      boost::posix_time::microsec_clock::universal_time();
+
+  boost::system::error_code error;
+  const std::size_t memory_size = prewarm(session_factory, exec_config,
+      io_services, session_config, error);
+  if (error)
+  {
+    boost::throw_exception(boost::system::system_error(error));
+  }
+
+  const boost::posix_time::time_duration duration =
+      boost::posix_time::microsec_clock::universal_time() - start_time;
+
+  std::cout << "Prewarmed sessions                    : "
+            << session_factory.recycled_count()
+            << std::endl
+            << "Prewarming time (milliseconds)        : "
+            << duration.total_milliseconds()
+            << std::endl
+            << "Prewarmed sessions' memory (bytes)    : "
+            << memory_size
+            << std::endl;
+}
 
 class server_base_0 : private boost::noncopyable
 {
@@ -120,6 +274,10 @@ public:
     : ios_per_work_thread_(config.ios_per_work_thread)
     , session_manager_thread_count_(config.session_manager_thread_count)
     , session_thread_count_(config.session_thread_count)
+    , first_session_cpu_(config.first_session_cpu)
+    , session_manager_cpu_(config.session_manager_cpu)
+    , busy_poll_duration_(config.busy_poll_duration)
+    , loop_stats_(!!config.metrics_port)
     , session_io_services_(create_session_io_services(config))
   {
   }
@@ -137,6 +295,12 @@ protected:
   const bool ios_per_work_thread_;
   const std::size_t session_manager_thread_count_;
   const std::size_t session_thread_count_;
+  const optional_cpu first_session_cpu_;
+  const optional_cpu session_manager_cpu_;
+  const echo_server::execution_config::optional_time_duration
+      busy_poll_duration_;
+  // Statistics of work threads are served as metrics
+  const bool loop_stats_;
   const io_service_vector session_io_services_;
 
 private:
@@ -167,8 +331,12 @@ public:
   server_base_1(const echo_server::execution_config& execution_config,
       const ma::echo::server::session_manager_config& session_manager_config)
     : server_base_0(execution_config)
+    , broadcast_hub_(create_broadcast_hub(execution_config))
+    , kv_store_(create_kv_store(execution_config, session_io_services_))
+    , session_manager_config_(bind_session_config(session_manager_config,
+          broadcast_hub_.get(), kv_store_.get()))
     , session_factory_(create_session_factory(execution_config,
-          session_manager_config, session_io_services_))
+          session_manager_config_, session_io_services_))
   {
   }
 
@@ -177,14 +345,69 @@ public:
     return *session_factory_;
   }
 
+  // Returns null if key-value mode is off
+  ma::kv_store* kv_store() const
+  {
+    return kv_store_.get();
+  }
+
 protected:
   ~server_base_1()
   {
   }
 
+  // Hub and store have to outlive sessions
+  const broadcast_hub_ptr   broadcast_hub_;
+  const kv_store_ptr        kv_store_;
+  // Configuration of sessions refers to hub and store
+  const ma::echo::server::session_manager_config session_manager_config_;
   const session_factory_ptr session_factory_;
 
 private:
+  static broadcast_hub_ptr create_broadcast_hub(
+      const echo_server::execution_config& exec_config)
+  {
+    if (!exec_config.broadcast_queue_size)
+    {
+      return broadcast_hub_ptr();
+    }
+    return boost::make_shared<ma::broadcast_hub>(
+        *exec_config.broadcast_queue_size,
+        exec_config.broadcast_disconnect_slow
+            ? ma::broadcast_hub::overflow_policy::disconnect
+            : ma::broadcast_hub::overflow_policy::drop_oldest);
+  }
+
+  static kv_store_ptr create_kv_store(
+      const echo_server::execution_config& exec_config,
+      const io_service_vector& session_io_services)
+  {
+    // Initial capacity of each shard (number of keys)
+    const std::size_t shard_capacity = 1024;
+
+    if (!exec_config.kv)
+    {
+      return kv_store_ptr();
+    }
+    // Shards are accessed without strand if each io_service has one thread
+    return boost::make_shared<ma::kv_store>(session_io_services,
+        exec_config.ios_per_work_thread, shard_capacity,
+        exec_config.kv_max_keys ? *exec_config.kv_max_keys
+            : (std::numeric_limits<std::size_t>::max)());
+  }
+
+  static ma::echo::server::session_manager_config bind_session_config(
+      const ma::echo::server::session_manager_config& session_manager_config,
+      ma::broadcast_hub* hub, ma::kv_store* store)
+  {
+    ma::echo::server::session_manager_config bound_config =
+        session_manager_config;
+    bound_config.managed_session_config.broadcast_hub = hub;
+    bound_config.managed_session_config.kv_store      = store;
+    return bound_config;
+  }
+
+
   static session_factory_ptr create_session_factory(
       const echo_server::execution_config& exec_config,
       const ma::echo::server::session_manager_config& session_manager_config,
@@ -192,15 +415,25 @@ private:
   {
     if (exec_config.ios_per_work_thread)
     {
-      return boost::make_shared<ma::echo::server::pooled_session_factory>(
-          session_io_services, session_manager_config.recycled_session_count);
+      boost::shared_ptr<ma::echo::server::pooled_session_factory> factory =
+          boost::make_shared<ma::echo::server::pooled_session_factory>(
+              session_io_services,
+              session_manager_config.recycled_session_count,
+              exec_config.balancing_policy);
+      prewarm_sessions(*factory, exec_config, session_io_services,
+          session_manager_config.managed_session_config);
+      return factory;
     }
     else
     {
       boost::asio::io_service& io_service = *session_io_services.front();
-      return boost::make_shared<ma::echo::server::simple_session_factory>(
-          boost::ref(io_service),
-          session_manager_config.recycled_session_count);
+      boost::shared_ptr<ma::echo::server::simple_session_factory> factory =
+          boost::make_shared<ma::echo::server::simple_session_factory>(
+              boost::ref(io_service),
+              session_manager_config.recycled_session_count);
+      prewarm_sessions(*factory, exec_config, session_io_services,
+          session_manager_config.managed_session_config);
+      return factory;
     }
   }
 }; // class server_base_1
@@ -244,6 +477,8 @@ public:
     , session_work_(create_works(session_io_services_))
     , session_manager_work_(session_manager_io_service_)
     , threads_()
+    , session_loops_()
+    , session_manager_loops_()
   {
     create_threads(exception_handler);
   }
@@ -264,24 +499,36 @@ public:
     }
   }
 
+  const io_service_loop_vector& session_loops() const
+  {
+    return session_loops_;
+  }
+
+  const io_service_loop_vector& session_manager_loops() const
+  {
+    return session_manager_loops_;
+  }
+
 private:
   template <typename Handler>
   void create_threads(const Handler& handler)
   {
     typedef boost::tuple<Handler> wrapped_handler_type;
     typedef void (*thread_func_type)(boost::asio::io_service&,
-        wrapped_handler_type);
+        const io_service_loop_ptr&, const optional_cpu&, wrapped_handler_type);
 
     wrapped_handler_type wrapped_handler = boost::make_tuple(handler);
     thread_func_type func = &this_type::thread_func<Handler>;
 
     if (ios_per_work_thread_)
     {
-      for (io_service_vector::const_iterator i = session_io_services_.begin(),
-          end = session_io_services_.end(); i != end; ++i)
+      for (std::size_t i = 0, size = session_io_services_.size();
+          i != size; ++i)
       {
-        threads_.create_thread(
-            boost::bind(func, boost::ref(**i), wrapped_handler));
+        threads_.create_thread(boost::bind(func,
+            boost::ref(*session_io_services_[i]),
+            create_loop(*session_io_services_[i], session_loops_),
+            session_thread_cpu(first_session_cpu_, i), wrapped_handler));
       }
     }
     else
@@ -289,25 +536,55 @@ private:
       boost::asio::io_service& io_service = *session_io_services_.front();
       for (std::size_t i = 0; i != session_thread_count_; ++i)
       {
-        threads_.create_thread(
-            boost::bind(func, boost::ref(io_service), wrapped_handler));
+        threads_.create_thread(boost::bind(func, boost::ref(io_service),
+            create_loop(io_service, session_loops_),
+            session_thread_cpu(first_session_cpu_, i), wrapped_handler));
       }
     }
 
     for (std::size_t i = 0; i != session_manager_thread_count_; ++i)
     {
       threads_.create_thread(boost::bind(func,
-          boost::ref(session_manager_io_service_), wrapped_handler));
+          boost::ref(session_manager_io_service_),
+          create_loop(session_manager_io_service_, session_manager_loops_),
+          session_manager_cpu_, wrapped_handler));
     }
   }
 
+  // Thread runs io_service::run (with no clock reads per handler) if it
+  // neither polls nor is measured
+  io_service_loop_ptr create_loop(boost::asio::io_service& io_service,
+      io_service_loop_vector& loops)
+  {
+    if (!busy_poll_duration_ && !loop_stats_)
+    {
+      return io_service_loop_ptr();
+    }
+    const ma::io_service_loop::duration_type spin_duration =
+        busy_poll_duration_ ? *busy_poll_duration_
+            : ma::io_service_loop::duration_type();
+    io_service_loop_ptr loop = boost::make_shared<ma::io_service_loop>(
+        boost::ref(io_service), spin_duration);
+    loops.push_back(loop);
+    return loop;
+  }
+
   template <typename Handler>
   static void thread_func(boost::asio::io_service& io_service,
+      const io_service_loop_ptr& loop, const optional_cpu& cpu,
       boost::tuple<Handler> handler)
   {
     try
     {
-      io_service.run();
+      bind_this_thread(cpu);
+      if (loop)
+      {
+        loop->run();
+      }
+      else
+      {
+        io_service.run();
+      }
     }
     catch (...)
     {
@@ -341,6 +618,8 @@ private:
   const io_service_work_vector session_work_;
   const boost::asio::io_service::work session_manager_work_;
   boost::thread_group threads_;
+  io_service_loop_vector session_loops_;
+  io_service_loop_vector session_manager_loops_;
 }; // class server_base_3
 
 class server : public server_base_3
@@ -352,12 +631,15 @@ public:
   template <typename Handler>
   server(const echo_server::execution_config& execution_config,
       const ma::echo::server::session_manager_config& session_manager_config,
+      const echo_server::optional_udp_echo_config& udp_echo_config,
       const Handler& exception_handler)
     : server_base_3(execution_config, session_manager_config,
           exception_handler)
     , session_manager_(ma::echo::server::session_manager::create(
           session_manager_io_service_, *session_factory_,
-          session_manager_config))
+          session_manager_config_))
+    , udp_echo_services_(create_udp_echo_services(udp_echo_config,
+          session_io_services_))
   {
   }
 
@@ -383,13 +665,73 @@ public:
     session_manager_->async_stop(handler);
   }
 
+  // Starts all shards of UDP echo (if any). Isn't thread-safe.
+  boost::system::error_code start_udp_echo()
+  {
+    for (udp_echo_service_vector::const_iterator i =
+        udp_echo_services_.begin(), end = udp_echo_services_.end();
+        i != end; ++i)
+    {
+      if (boost::system::error_code error = (*i)->start())
+      {
+        return error;
+      }
+    }
+    return boost::system::error_code();
+  }
+
   ma::echo::server::session_manager_stats stats() const
   {
-    return session_manager_->stats();
+    ma::echo::server::session_manager_stats stats = session_manager_->stats();
+    ma::echo::server::udp_echo_stats& udp_stats = stats.udp_echo;
+    for (udp_echo_service_vector::const_iterator i =
+        udp_echo_services_.begin(), end = udp_echo_services_.end();
+        i != end; ++i)
+    {
+      const ma::echo::server::udp_echo_stats shard_stats = (*i)->stats();
+      udp_stats.shards         += shard_stats.shards;
+      udp_stats.received       += shard_stats.received;
+      udp_stats.received_bytes += shard_stats.received_bytes;
+      udp_stats.echoed         += shard_stats.echoed;
+      udp_stats.dropped        += shard_stats.dropped;
+      udp_stats.batches        += shard_stats.batches;
+      udp_stats.max_batch = (std::max)(udp_stats.max_batch,
+          shard_stats.max_batch);
+    }
+    return stats;
+  }
+
+  template <typename Handler>
+  void async_snapshot(const Handler& handler)
+  {
+    session_manager_->async_snapshot(handler);
   }
 
 private:
+  // Shards are spread between io_services of sessions
+  static udp_echo_service_vector create_udp_echo_services(
+      const echo_server::optional_udp_echo_config& config,
+      const io_service_vector& session_io_services)
+  {
+    typedef ma::echo::server::udp_echo_service service_type;
+
+    udp_echo_service_vector services;
+    if (!config)
+    {
+      return services;
+    }
+    for (std::size_t i = 0; i != config->shard_count; ++i)
+    {
+      boost::asio::io_service& io_service =
+          *session_io_services[i % session_io_services.size()];
+      services.push_back(boost::make_shared<service_type>(
+          boost::ref(io_service), *config));
+    }
+    return services;
+  }
+
   const ma::echo::server::session_manager_ptr session_manager_;
+  const udp_echo_service_vector udp_echo_services_;
 }; // class server
 
 struct server_state : private boost::noncopyable
@@ -608,28 +950,680 @@ void print_stats(const ma::echo::server::session_manager_stats& stats)
             << std::endl
             << "Error stopped sessions     : "
             << to_string(stats.error_stopped)
+            << std::endl
+            << "Migrated sessions          : "
+            << to_string(stats.migrated)
+            << std::endl;
+
+  const ma::broadcast_hub_stats& broadcast = stats.broadcast_hub;
+  if (broadcast.queue_limit)
+  {
+    std::cout << "Published messages         : "
+              << broadcast.published
+              << std::endl
+              << "Dropped messages           : "
+              << broadcast.dropped
+              << std::endl
+              << "Overflowed subscribers     : "
+              << broadcast.overflowed
+              << std::endl;
+  }
+
+  const ma::memory_budget_stats& memory = stats.memory_budget;
+  if (memory.limit)
+  {
+    std::cout << "Memory budget (bytes)      : "
+              << memory.limit
+              << std::endl
+              << "Maximum of used memory     : "
+              << memory.max_used
+              << std::endl
+              << "Reads waited for memory    : "
+              << memory.denied
+              << std::endl;
+  }
+}
+
+void print_stats(const ma::kv_store_stats& stats)
+{
+  std::cout << "Key-value store's shards   : "
+            << stats.shards
+            << std::endl
+            << "Keys                       : "
+            << stats.keys
+            << std::endl
+            << "Local operations           : "
+            << stats.local_operations
+            << std::endl
+            << "Forwarded operations       : "
+            << stats.forwarded_operations
+            << std::endl
+            << "Forwarded batches          : "
+            << stats.forwarded_batches
+            << std::endl
+            << "Rejected sets              : "
+            << stats.rejected_sets
             << std::endl;
 }
 
+std::string to_percent_string(const boost::posix_time::time_duration& part,
+    const boost::posix_time::time_duration& total)
+{
+  if (total.ticks() <= 0)
+  {
+    return "n/a";
+  }
+  return boost::lexical_cast<std::string>(
+      part.ticks() * 100 / total.ticks()) + "%";
+}
+
+std::string to_average_string(boost::uint64_t total, boost::uint64_t count)
+{
+  if (!count)
+  {
+    return "n/a";
+  }
+  // Two digits after decimal point are enough
+  const boost::uint64_t hundredths = (total * 100 + count / 2) / count;
+  const boost::uint64_t fraction = hundredths % 100;
+  return boost::lexical_cast<std::string>(hundredths / 100)
+      + (fraction < 10 ? ".0" : ".")
+      + boost::lexical_cast<std::string>(fraction);
+}
+
+std::string to_rate_string(boost::uint64_t count,
+    const boost::posix_time::time_duration& time)
+{
+  const boost::int64_t milliseconds = time.total_milliseconds();
+  if (milliseconds <= 0)
+  {
+    return "n/a";
+  }
+  return to_average_string(count * 1000,
+      static_cast<boost::uint64_t>(milliseconds));
+}
+
+void print_stats(const ma::echo::server::udp_echo_stats& stats,
+    const boost::posix_time::time_duration& work_time)
+{
+  std::cout << "UDP echo sockets           : "
+            << stats.shards
+            << std::endl
+            << "Received datagrams         : "
+            << stats.received
+            << std::endl
+            << "Received bytes             : "
+            << stats.received_bytes
+            << std::endl
+            << "Echoed datagrams           : "
+            << stats.echoed
+            << std::endl
+            << "Dropped datagrams          : "
+            << stats.dropped
+            << std::endl
+            << "Received datagrams per sec : "
+            << to_rate_string(stats.received, work_time)
+            << std::endl
+            << "Max datagrams per read     : "
+            << stats.max_batch
+            << std::endl
+            << "Average datagrams per read : "
+            << to_average_string(stats.received, stats.batches)
+            << std::endl;
+}
+
+void print_loop_stats(const std::string& thread_name,
+    const io_service_loop_vector& loops)
+{
+  for (std::size_t i = 0, size = loops.size(); i != size; ++i)
+  {
+    const ma::io_service_loop_stats stats = loops[i]->stats();
+    const boost::posix_time::time_duration total_time =
+        stats.handler_time + stats.spin_time + stats.idle_time;
+    std::cout << thread_name << " #" << i << std::endl
+              << "  Executed handlers          : "
+              << stats.handler_count
+              << std::endl
+              << "  Handlers' time (ms)        : "
+              << stats.handler_time.total_milliseconds()
+              << " (" << to_percent_string(stats.handler_time, total_time)
+              << ")" << std::endl
+              << "  Spin time (ms)             : "
+              << stats.spin_time.total_milliseconds()
+              << " (" << to_percent_string(stats.spin_time, total_time)
+              << ")" << std::endl
+              << "  Idle time (ms)             : "
+              << stats.idle_time.total_milliseconds()
+              << " (" << to_percent_string(stats.idle_time, total_time)
+              << ")" << std::endl
+              << "  Blocking waits             : "
+              << stats.wait_count
+              << std::endl
+              << "  Max ready handlers         : "
+              << stats.max_batch_size
+              << std::endl
+              << "  Average ready handlers     : "
+              << to_average_string(stats.handler_count - stats.wait_count,
+                    stats.batch_count)
+              << std::endl;
+  }
+}
+
+#if defined(MA_HAS_HANDLER_TIMING)
+
+std::string to_string(const ma::duration_histogram& histogram)
+{
+  return boost::lexical_cast<std::string>(
+          histogram.percentile_microseconds(50))
+      + "/" + boost::lexical_cast<std::string>(
+          histogram.percentile_microseconds(99))
+      + "/" + boost::lexical_cast<std::string>(
+          histogram.percentile_microseconds(99.9))
+      + "/" + boost::lexical_cast<std::string>(histogram.max_microseconds());
+}
+
+void print_handler_timing()
+{
+  typedef ma::echo::server::handler_timing_tag tag;
+  typedef std::vector<ma::handler_timing_stats_vector> thread_stats_vector;
+
+  static const char* const tag_names[tag::count] =
+  {
+    "Session read  ",
+    "Session write ",
+    "Session timer ",
+    "Manager accept",
+    "Session throttle"
+  };
+
+  const thread_stats_vector threads = ma::collect_handler_timing();
+  for (std::size_t i = 0, size = threads.size(); i != size; ++i)
+  {
+    // Threads are numbered in the order of their first handler execution
+    std::cout << "Handlers' timing of thread #" << i
+              << " (50%/99%/99.9%/max, microseconds)" << std::endl;
+    for (std::size_t t = 0; t != tag::count; ++t)
+    {
+      const ma::handler_timing_stats& stats = threads[i][t];
+      if (!stats.run_time.count())
+      {
+        continue;
+      }
+      // Delay of I/O handlers isn't measured
+      std::cout << "  " << tag_names[t]
+                << ": count: " << stats.run_time.count()
+                << ", delay: " << (stats.delay.count()
+                    ? to_string(stats.delay) : std::string("n/a"))
+                << ", run time: " << to_string(stats.run_time)
+                << std::endl;
+    }
+  }
+}
+
+#endif // defined(MA_HAS_HANDLER_TIMING)
+
+#if defined(MA_HAS_EVENT_TRACE)
+
+void write_event_trace(const std::string& file_name)
+{
+  boost::system::error_code error = ma::dump_event_trace(file_name);
+  if (error)
+  {
+    std::cout << "Failed to write event trace into " << file_name << ": "
+              << error.message() << std::endl;
+  }
+  else
+  {
+    std::cout << "Event trace is written into " << file_name << std::endl;
+  }
+}
+
+#if defined(SIGUSR1)
+
+void handle_trace_signal(boost::asio::signal_set& signals,
+    const std::string& file_name, const boost::system::error_code& error,
+    int /*signal_number*/)
+{
+  if (boost::asio::error::operation_aborted == error)
+  {
+    return;
+  }
+  write_event_trace(file_name);
+  signals.async_wait(boost::bind(handle_trace_signal, boost::ref(signals),
+      file_name, _1, _2));
+}
+
+#endif // defined(SIGUSR1)
+
+#endif // defined(MA_HAS_EVENT_TRACE)
+
+// Metrics in Prometheus text exposition format. They are built from the
+// snapshots the data path already publishes so scrapes add no work there.
+
+typedef std::vector<std::pair<std::string, ma::io_service_loop_stats> >
+    labeled_loop_stats_vector;
+
+std::string to_seconds_string(boost::uint64_t microseconds)
+{
+  const std::string fraction =
+      boost::lexical_cast<std::string>(microseconds % 1000000);
+  return boost::lexical_cast<std::string>(microseconds / 1000000) + "."
+      + std::string(6 - fraction.size(), '0') + fraction;
+}
+
+std::string to_seconds_string(const boost::posix_time::time_duration& value)
+{
+  if (value.is_negative())
+  {
+    return "0.000000";
+  }
+  return to_seconds_string(
+      static_cast<boost::uint64_t>(value.total_microseconds()));
+}
+
+void write_metric_header(std::ostream& stream, const char* name,
+    const char* type, const char* help)
+{
+  stream << "# HELP " << name << " " << help << "\n"
+         << "# TYPE " << name << " " << type << "\n";
+}
+
+void write_session_manager_metrics(std::ostream& stream,
+    const ma::echo::server::session_manager_stats& stats)
+{
+  write_metric_header(stream, "echo_server_active_sessions", "gauge",
+      "Number of active sessions.");
+  stream << "echo_server_active_sessions " << stats.active << "\n";
+
+  write_metric_header(stream, "echo_server_max_active_sessions", "gauge",
+      "Maximum number of active sessions.");
+  stream << "echo_server_max_active_sessions " << stats.max_active << "\n";
+
+  write_metric_header(stream, "echo_server_recycled_sessions", "gauge",
+      "Number of recycled sessions.");
+  stream << "echo_server_recycled_sessions " << stats.recycled << "\n";
+
+  write_metric_header(stream, "echo_server_accepted_sessions_total",
+      "counter", "Number of accepted sessions.");
+  stream << "echo_server_accepted_sessions_total "
+         << stats.total_accepted.value() << "\n";
+
+  write_metric_header(stream, "echo_server_stopped_sessions_total",
+      "counter", "Number of stopped sessions by the reason of stop.");
+  stream << "echo_server_stopped_sessions_total{reason=\"active_shutdown\"} "
+         << stats.active_shutdowned.value() << "\n"
+         << "echo_server_stopped_sessions_total{reason=\"out_of_work\"} "
+         << stats.out_of_work.value() << "\n"
+         << "echo_server_stopped_sessions_total{reason=\"timed_out\"} "
+         << stats.timed_out.value() << "\n"
+         << "echo_server_stopped_sessions_total{reason=\"error\"} "
+         << stats.error_stopped.value() << "\n";
+
+  write_metric_header(stream, "echo_server_migrated_sessions_total",
+      "counter", "Number of sessions moved to another demultiplexer.");
+  stream << "echo_server_migrated_sessions_total "
+         << stats.migrated.value() << "\n";
+
+  const ma::broadcast_hub_stats& broadcast = stats.broadcast_hub;
+  if (broadcast.queue_limit)
+  {
+    write_metric_header(stream, "echo_server_broadcast_subscribers", "gauge",
+        "Number of sessions subscribed to broadcast.");
+    stream << "echo_server_broadcast_subscribers "
+           << broadcast.subscribers << "\n";
+
+    write_metric_header(stream, "echo_server_broadcast_messages_total",
+        "counter", "Number of messages published by sessions.");
+    stream << "echo_server_broadcast_messages_total "
+           << broadcast.published << "\n";
+
+    write_metric_header(stream, "echo_server_broadcast_dropped_total",
+        "counter", "Number of messages dropped from the queues of slow"
+        " sessions.");
+    stream << "echo_server_broadcast_dropped_total "
+           << broadcast.dropped << "\n";
+
+    write_metric_header(stream, "echo_server_broadcast_overflowed_total",
+        "counter", "Number of slow sessions disconnected due to overflow.");
+    stream << "echo_server_broadcast_overflowed_total "
+           << broadcast.overflowed << "\n";
+  }
+
+  const ma::echo::server::udp_echo_stats& udp = stats.udp_echo;
+  if (udp.shards)
+  {
+    write_metric_header(stream, "echo_server_udp_received_datagrams_total",
+        "counter", "Number of received datagrams.");
+    stream << "echo_server_udp_received_datagrams_total "
+           << udp.received << "\n";
+
+    write_metric_header(stream, "echo_server_udp_received_bytes_total",
+        "counter", "Total size of received datagrams.");
+    stream << "echo_server_udp_received_bytes_total "
+           << udp.received_bytes << "\n";
+
+    write_metric_header(stream, "echo_server_udp_echoed_datagrams_total",
+        "counter", "Number of echoed datagrams.");
+    stream << "echo_server_udp_echoed_datagrams_total "
+           << udp.echoed << "\n";
+
+    write_metric_header(stream, "echo_server_udp_dropped_datagrams_total",
+        "counter", "Number of truncated datagrams and datagrams failed to"
+        " be echoed.");
+    stream << "echo_server_udp_dropped_datagrams_total "
+           << udp.dropped << "\n";
+
+    write_metric_header(stream, "echo_server_udp_reads_total", "counter",
+        "Number of reads (system calls) which got datagrams.");
+    stream << "echo_server_udp_reads_total " << udp.batches << "\n";
+  }
+
+  const ma::memory_budget_stats& memory = stats.memory_budget;
+  if (!memory.limit)
+  {
+    return;
+  }
+
+  write_metric_header(stream, "echo_server_memory_budget_bytes", "gauge",
+      "Limit of the size of data read but not yet echoed.");
+  stream << "echo_server_memory_budget_bytes " << memory.limit << "\n";
+
+  write_metric_header(stream, "echo_server_memory_used_bytes", "gauge",
+      "Size of data read (or being read) but not yet echoed.");
+  stream << "echo_server_memory_used_bytes " << memory.used << "\n";
+
+  write_metric_header(stream, "echo_server_max_memory_used_bytes", "gauge",
+      "Maximum size of data read (or being read) but not yet echoed.");
+  stream << "echo_server_max_memory_used_bytes " << memory.max_used << "\n";
+
+  write_metric_header(stream, "echo_server_memory_waits_total", "counter",
+      "Number of session reads which waited for memory.");
+  stream << "echo_server_memory_waits_total " << memory.denied << "\n";
+
+  write_metric_header(stream, "echo_server_memory_waiting_reads", "gauge",
+      "Number of session reads waiting for memory.");
+  stream << "echo_server_memory_waiting_reads " << memory.waiting << "\n";
+}
+
+void add_loop_stats(labeled_loop_stats_vector& stats, const char* role,
+    const io_service_loop_vector& loops)
+{
+  for (std::size_t i = 0, size = loops.size(); i != size; ++i)
+  {
+    stats.push_back(std::make_pair(std::string("role=\"") + role
+        + "\",thread=\"" + boost::lexical_cast<std::string>(i) + "\"",
+        loops[i]->stats()));
+  }
+}
+
+void write_loop_metrics(std::ostream& stream,
+    const labeled_loop_stats_vector& stats)
+{
+  typedef labeled_loop_stats_vector::const_iterator iterator;
+
+  write_metric_header(stream, "echo_server_thread_handlers_total",
+      "counter", "Number of handlers executed by work thread.");
+  for (iterator i = stats.begin(), end = stats.end(); i != end; ++i)
+  {
+    stream << "echo_server_thread_handlers_total{" << i->first << "} "
+           << i->second.handler_count << "\n";
+  }
+
+  write_metric_header(stream, "echo_server_thread_blocking_waits_total",
+      "counter", "Number of blocking waits of work thread.");
+  for (iterator i = stats.begin(), end = stats.end(); i != end; ++i)
+  {
+    stream << "echo_server_thread_blocking_waits_total{" << i->first << "} "
+           << i->second.wait_count << "\n";
+  }
+
+  write_metric_header(stream, "echo_server_thread_max_ready_handlers",
+      "gauge", "Maximum number of handlers executed by single poll.");
+  for (iterator i = stats.begin(), end = stats.end(); i != end; ++i)
+  {
+    stream << "echo_server_thread_max_ready_handlers{" << i->first << "} "
+           << i->second.max_batch_size << "\n";
+  }
+
+  write_metric_header(stream, "echo_server_thread_seconds_total", "counter",
+      "Time of work thread spent in handlers, busy polling and blocking wait.");
+  for (iterator i = stats.begin(), end = stats.end(); i != end; ++i)
+  {
+    stream << "echo_server_thread_seconds_total{" << i->first
+           << ",state=\"handler\"} "
+           << to_seconds_string(i->second.handler_time) << "\n"
+           << "echo_server_thread_seconds_total{" << i->first
+           << ",state=\"spin\"} "
+           << to_seconds_string(i->second.spin_time) << "\n"
+           << "echo_server_thread_seconds_total{" << i->first
+           << ",state=\"idle\"} "
+           << to_seconds_string(i->second.idle_time) << "\n";
+  }
+}
+
+#if defined(MA_HAS_HANDLER_TIMING)
+
+void write_histogram(std::ostream& stream, const char* name,
+    const std::string& labels, const ma::duration_histogram& histogram)
+{
+  // Last bucket has no upper bound
+  boost::uint64_t count = 0;
+  for (std::size_t i = 0; i + 1 != ma::duration_histogram::bucket_count; ++i)
+  {
+    count += histogram.bucket(i);
+    stream << name << "_bucket{" << labels << ",le=\""
+           << to_seconds_string(boost::uint64_t(1) << i) << "\"} "
+           << count << "\n";
+  }
+  stream << name << "_bucket{" << labels << ",le=\"+Inf\"} "
+         << histogram.count() << "\n"
+         << name << "_sum{" << labels << "} "
+         << to_seconds_string(histogram.sum_microseconds()) << "\n"
+         << name << "_count{" << labels << "} "
+         << histogram.count() << "\n";
+}
+
+void write_handler_timing_metrics(std::ostream& stream)
+{
+  typedef ma::echo::server::handler_timing_tag tag;
+  typedef std::vector<ma::handler_timing_stats_vector> thread_stats_vector;
+
+  static const char* const tag_labels[tag::count] =
+  {
+    "session_read",
+    "session_write",
+    "session_timer",
+    "manager_accept",
+    "session_throttle"
+  };
+
+  const thread_stats_vector threads = ma::collect_handler_timing();
+  std::vector<std::string> labels;
+  std::vector<const ma::handler_timing_stats*> stats;
+  for (std::size_t i = 0, size = threads.size(); i != size; ++i)
+  {
+    for (std::size_t t = 0; t != tag::count; ++t)
+    {
+      if (threads[i][t].run_time.count())
+      {
+        labels.push_back("thread=\"" + boost::lexical_cast<std::string>(i)
+            + "\",handler=\"" + tag_labels[t] + "\"");
+        stats.push_back(&threads[i][t]);
+      }
+    }
+  }
+
+  write_metric_header(stream, "echo_server_handler_delay_seconds",
+      "histogram", "Delay between post of handler (expiration of timer) "
+      "and its execution. Isn't measured for I/O handlers.");
+  for (std::size_t i = 0, size = stats.size(); i != size; ++i)
+  {
+    if (stats[i]->delay.count())
+    {
+      write_histogram(stream, "echo_server_handler_delay_seconds",
+          labels[i], stats[i]->delay);
+    }
+  }
+
+  write_metric_header(stream, "echo_server_handler_run_seconds",
+      "histogram", "Execution time of handler.");
+  for (std::size_t i = 0, size = stats.size(); i != size; ++i)
+  {
+    write_histogram(stream, "echo_server_handler_run_seconds", labels[i],
+        stats[i]->run_time);
+  }
+}
+
+#endif // defined(MA_HAS_HANDLER_TIMING)
+
+std::string build_metrics(server& the_server)
+{
+  labeled_loop_stats_vector loop_stats;
+  add_loop_stats(loop_stats, "session_manager",
+      the_server.session_manager_loops());
+  add_loop_stats(loop_stats, "session", the_server.session_loops());
+
+  std::ostringstream stream;
+  write_session_manager_metrics(stream, the_server.stats());
+  write_loop_metrics(stream, loop_stats);
+#if defined(MA_HAS_HANDLER_TIMING)
+  write_handler_timing_metrics(stream);
+#endif
+  return stream.str();
+}
+
+const char* to_string(
+    ma::echo::server::session_stats::operation_state::value_t state)
+{
+  typedef ma::echo::server::session_stats::operation_state operation_state;
+  switch (state)
+  {
+  case operation_state::wait:
+    return "wait";
+  case operation_state::in_progress:
+    return "in_progress";
+  default:
+    return "stopped";
+  }
+}
+
+bool written_more(const ma::echo::server::session_snapshot& left,
+    const ma::echo::server::session_snapshot& right)
+{
+  return left.stats.bytes_written > right.stats.bytes_written;
+}
+
+// Lists sessions starting from the ones which have echoed the most
+void handle_session_snapshot(
+    const echo_server::metrics_server::content_handler& handler,
+    const ma::echo::server::session_snapshot_vector& snapshot)
+{
+  typedef ma::echo::server::session_snapshot_vector::const_iterator iterator;
+
+  ma::echo::server::session_snapshot_vector sessions(snapshot);
+  std::sort(sessions.begin(), sessions.end(), written_more);
+
+  std::ostringstream stream;
+  stream << "# remote_endpoint age_seconds bytes_read bytes_written"
+            " buffer_filled buffer_size read_state write_state timer_state"
+            " read_throttled_seconds write_throttled_seconds socket_writes"
+            " coalesced_writes zerocopy_writes zerocopy_copied"
+            " reply_bytes_read reply_bytes_written feed_bytes_written"
+            " messages messages_per_second\n";
+  for (iterator i = sessions.begin(), end = sessions.end(); i != end; ++i)
+  {
+    stream << i->remote_endpoint << " " << to_seconds_string(i->age) << " "
+           << i->stats.bytes_read << " " << i->stats.bytes_written << " "
+           << i->stats.buffer_filled << " " << i->stats.buffer_size << " "
+           << to_string(i->stats.read_state) << " "
+           << to_string(i->stats.write_state) << " "
+           << to_string(i->stats.timer_state) << " "
+           << to_seconds_string(i->stats.read_throttled_time) << " "
+           << to_seconds_string(i->stats.write_throttled_time) << " "
+           << i->stats.socket_writes << " "
+           << i->stats.coalesced_writes << " "
+           << i->stats.zerocopy_writes << " "
+           << i->stats.zerocopy_copied << " "
+           << i->stats.reply_bytes_read << " "
+           << i->stats.reply_bytes_written << " "
+           << i->stats.feed_bytes_written << " "
+           << i->stats.messages << " "
+           << to_rate_string(i->stats.messages, i->age) << "\n";
+  }
+  handler(stream.str());
+}
+
+void provide_content(server& the_server, const std::string& path,
+    const echo_server::metrics_server::content_handler& handler)
+{
+  if ("/sessions" == path)
+  {
+    the_server.async_snapshot(boost::bind(handle_session_snapshot, handler,
+        _1));
+    return;
+  }
+  handler(build_metrics(the_server));
+}
+
 } // anonymous namespace
 
 int echo_server::run_server(const echo_server::execution_config& exec_config,
-    const ma::echo::server::session_manager_config& session_manager_config)
+    const ma::echo::server::session_manager_config& session_manager_config,
+    const echo_server::optional_udp_echo_config& udp_echo_config)
 {
   server_state the_server_state;
 
-  server the_server(exec_config, session_manager_config,
+  server the_server(exec_config, session_manager_config, udp_echo_config,
       boost::bind(handle_work_thread_exception, boost::ref(the_server_state)));
 
+  const boost::posix_time::ptime start_time =
+      boost::posix_time::microsec_clock::universal_time();
   std::cout << "Server is starting." << std::endl;
   the_server.async_start(boost::bind(handle_server_start,
       boost::ref(the_server_state), boost::ref(the_server), _1));
 
+  {
+    boost::system::error_code error = the_server.start_udp_echo();
+    if (error)
+    {
+      std::cout << "Failed to start UDP echo: " << error.message()
+                << std::endl;
+    }
+  }
+
   // Lookup for app termination
   ma::console_close_guard console_close_guard(boost::bind(
       handle_app_exit, boost::ref(the_server_state), boost::ref(the_server)));
   std::cout << "Press Ctrl+C to exit." << std::endl;
 
+  if (exec_config.metrics_port)
+  {
+    echo_server::metrics_server_ptr metrics_server =
+        boost::make_shared<echo_server::metrics_server>(
+            boost::ref(the_server.session_manager_io_service()),
+            boost::bind(provide_content, boost::ref(the_server), _1, _2));
+    boost::system::error_code error = metrics_server->start(
+        boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(),
+            *exec_config.metrics_port));
+    if (error)
+    {
+      std::cout << "Failed to start metrics listener: " << error.message()
+                << std::endl;
+    }
+  }
+
+#if defined(MA_HAS_EVENT_TRACE) && defined(SIGUSR1)
+  // Event trace is written on demand too
+  boost::asio::signal_set trace_signals(
+      the_server.session_manager_io_service());
+  if (exec_config.trace_file)
+  {
+    trace_signals.add(SIGUSR1);
+    trace_signals.async_wait(boost::bind(handle_trace_signal,
+        boost::ref(trace_signals), *exec_config.trace_file, _1, _2));
+  }
+#endif
+
   int exit_code = EXIT_SUCCESS;
 
   wait_until_server_stopping(the_server_state);
@@ -655,6 +1649,29 @@ int echo_server::run_server(const echo_server::execution_config& exec_config,
   the_server.stop_threads();
   std::cout << "Work threads have stopped." << std::endl;
 
-  print_stats(the_server.stats());
+#if defined(MA_HAS_EVENT_TRACE)
+  if (exec_config.trace_file)
+  {
+    write_event_trace(*exec_config.trace_file);
+  }
+#endif
+
+  const ma::echo::server::session_manager_stats stats = the_server.stats();
+  print_stats(stats);
+  if (stats.udp_echo.shards)
+  {
+    print_stats(stats.udp_echo,
+        boost::posix_time::microsec_clock::universal_time() - start_time);
+  }
+  if (ma::kv_store* store = the_server.kv_store())
+  {
+    print_stats(store->stats());
+  }
+  print_loop_stats("Session manager's thread",
+      the_server.session_manager_loops());
+  print_loop_stats("Sessions' thread", the_server.session_loops());
+#if defined(MA_HAS_HANDLER_TIMING)
+  print_handler_timing();
+#endif
   return exit_code;
 }
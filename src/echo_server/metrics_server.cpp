@@ -0,0 +1,209 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <cstddef>
+#include <string>
+#include <istream>
+#include <boost/ref.hpp>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include "metrics_server.hpp"
+
+namespace echo_server {
+
+namespace {
+
+// Whole exchange (request and response) has to fit into the timeout
+const long session_timeout_seconds = 10;
+const long accept_retry_delay_milliseconds = 500;
+
+} // anonymous namespace
+
+// Tiny HTTP session: reads request header, writes content and closes.
+class metrics_session
+  : public boost::enable_shared_from_this<metrics_session>
+  , private boost::noncopyable
+{
+private:
+  typedef metrics_session this_type;
+
+public:
+  metrics_session(boost::asio::io_service& io_service,
+      const metrics_server::content_provider& provider)
+    : strand_(io_service)
+    , socket_(io_service)
+    , timer_(io_service)
+    , request_(max_request_size)
+    , response_()
+    , provider_(provider)
+  {
+  }
+
+  boost::asio::ip::tcp::socket& socket()
+  {
+    return socket_;
+  }
+
+  void start()
+  {
+    strand_.dispatch(boost::bind(&this_type::start_read, shared_from_this()));
+  }
+
+private:
+  static const std::size_t max_request_size = 4096;
+
+  void start_read()
+  {
+    timer_.expires_from_now(
+        boost::posix_time::seconds(session_timeout_seconds));
+    timer_.async_wait(strand_.wrap(boost::bind(&this_type::handle_timeout,
+        shared_from_this(), boost::asio::placeholders::error)));
+    boost::asio::async_read_until(socket_, request_, std::string("\r\n\r\n"),
+        strand_.wrap(boost::bind(&this_type::handle_read, shared_from_this(),
+            boost::asio::placeholders::error)));
+  }
+
+  void handle_timeout(const boost::system::error_code& error)
+  {
+    if (boost::asio::error::operation_aborted != error)
+    {
+      // Pending read or write completes with error
+      boost::system::error_code ignored;
+      socket_.close(ignored);
+    }
+  }
+
+  void handle_read(const boost::system::error_code& error)
+  {
+    if (error)
+    {
+      // Socket is closed when the last reference to session is released
+      timer_.cancel();
+      return;
+    }
+
+    // Request line is "<method> <path>[?<query>] <version>"
+    std::istream request_stream(&request_);
+    std::string method;
+    std::string path;
+    request_stream >> method >> path;
+    provider_(path.substr(0, path.find('?')), strand_.wrap(
+        boost::bind(&this_type::handle_content, shared_from_this(), _1)));
+  }
+
+  void handle_content(const std::string& body)
+  {
+    response_ = "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " + boost::lexical_cast<std::string>(body.size())
+        + "\r\nConnection: close\r\n\r\n" + body;
+
+    boost::asio::async_write(socket_, boost::asio::buffer(response_),
+        strand_.wrap(boost::bind(&this_type::handle_write, shared_from_this(),
+            boost::asio::placeholders::error)));
+  }
+
+  void handle_write(const boost::system::error_code& error)
+  {
+    timer_.cancel();
+    if (!error)
+    {
+      boost::system::error_code ignored;
+      socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+    }
+  }
+
+  boost::asio::io_service::strand strand_;
+  boost::asio::ip::tcp::socket socket_;
+  boost::asio::deadline_timer  timer_;
+  boost::asio::streambuf       request_;
+  std::string                  response_;
+  const metrics_server::content_provider provider_;
+}; // class metrics_session
+
+metrics_server::metrics_server(boost::asio::io_service& io_service,
+    const content_provider& provider)
+  : io_service_(io_service)
+  , acceptor_(io_service)
+  , accept_timer_(io_service)
+  , provider_(provider)
+{
+}
+
+boost::system::error_code metrics_server::start(
+    const boost::asio::ip::tcp::endpoint& endpoint)
+{
+  boost::system::error_code error;
+  acceptor_.open(endpoint.protocol(), error);
+  if (error)
+  {
+    return error;
+  }
+
+  acceptor_.set_option(
+      boost::asio::ip::tcp::acceptor::reuse_address(true), error);
+  if (!error)
+  {
+    acceptor_.bind(endpoint, error);
+  }
+  if (!error)
+  {
+    acceptor_.listen(boost::asio::socket_base::max_connections, error);
+  }
+  if (error)
+  {
+    boost::system::error_code ignored;
+    acceptor_.close(ignored);
+    return error;
+  }
+
+  accept_new_session();
+  return error;
+}
+
+void metrics_server::accept_new_session()
+{
+  metrics_session_ptr session = boost::make_shared<metrics_session>(
+      boost::ref(io_service_), provider_);
+  acceptor_.async_accept(session->socket(),
+      boost::bind(&this_type::handle_accept, shared_from_this(), session,
+          boost::asio::placeholders::error));
+}
+
+void metrics_server::handle_accept(const metrics_session_ptr& session,
+    const boost::system::error_code& error)
+{
+  if (boost::asio::error::operation_aborted == error)
+  {
+    return;
+  }
+  if (error)
+  {
+    // Immediate retry would spin while the error (like EMFILE) persists
+    accept_timer_.expires_from_now(
+        boost::posix_time::milliseconds(accept_retry_delay_milliseconds));
+    accept_timer_.async_wait(boost::bind(&this_type::handle_accept_delay,
+        shared_from_this(), boost::asio::placeholders::error));
+    return;
+  }
+  session->start();
+  accept_new_session();
+}
+
+void metrics_server::handle_accept_delay(
+    const boost::system::error_code& error)
+{
+  if (boost::asio::error::operation_aborted == error)
+  {
+    return;
+  }
+  accept_new_session();
+}
+
+} // namespace echo_server
@@ -0,0 +1,76 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef METRICS_SERVER_HPP
+#define METRICS_SERVER_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace echo_server {
+
+class metrics_session;
+typedef boost::shared_ptr<metrics_session> metrics_session_ptr;
+
+/// Admin listener answering each HTTP request with the text got from
+/// content provider for the request path, e.g. metrics in Prometheus text
+/// exposition format.
+/**
+ * Each connection serves the single request and is closed after the
+ * response or when the request and the response don't pass in time.
+ * Content provider is called by the threads running io_service and may
+ * complete content handler later from any thread. Accept is retried after
+ * a delay if it fails (e.g. when process is out of file descriptors).
+ *
+ * Listening lasts until io_service is stopped, so there is no need to stop
+ * metrics_server explicitly.
+ */
+class metrics_server
+  : public boost::enable_shared_from_this<metrics_server>
+  , private boost::noncopyable
+{
+private:
+  typedef metrics_server this_type;
+
+public:
+  typedef boost::function<void (const std::string&)> content_handler;
+  typedef boost::function<void (const std::string& path,
+      const content_handler& handler)> content_provider;
+
+  metrics_server(boost::asio::io_service& io_service,
+      const content_provider& provider);
+
+  /// Starts listening. Isn't thread-safe, has to be called only once.
+  boost::system::error_code start(
+      const boost::asio::ip::tcp::endpoint& endpoint);
+
+private:
+  void accept_new_session();
+  void handle_accept(const metrics_session_ptr& session,
+      const boost::system::error_code& error);
+  void handle_accept_delay(const boost::system::error_code& error);
+
+  boost::asio::io_service&       io_service_;
+  boost::asio::ip::tcp::acceptor acceptor_;
+  boost::asio::deadline_timer    accept_timer_;
+  const content_provider         provider_;
+}; // class metrics_server
+
+typedef boost::shared_ptr<metrics_server> metrics_server_ptr;
+
+} // namespace echo_server
+
+#endif // METRICS_SERVER_HPP
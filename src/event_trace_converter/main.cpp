@@ -0,0 +1,190 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Converts binary event trace (see ma/event_trace.hpp) written by echo_server
+// into JSON format of Chrome trace viewer (chrome://tracing).
+
+#include <cstdlib>
+#include <cstddef>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <exception>
+#include <boost/cstdint.hpp>
+#include <ma/event_trace.hpp>
+#include <ma/echo/server/trace_event_type.hpp>
+
+namespace {
+
+typedef std::vector<ma::event_trace_record> record_vector;
+
+const char* const event_names[ma::echo::server::trace_event_type::count] =
+{
+  "session_accept",
+  "session_start",
+  "session_read",
+  "session_write",
+  "session_timer",
+  "session_shutdown",
+  "session_stop",
+  "session_throttle"
+};
+
+// Converts values of timestamp counter into microseconds since start of trace
+class time_converter
+{
+public:
+  explicit time_converter(const ma::event_trace_file_header& header)
+    : start_timestamp_(header.start_timestamp)
+    , microseconds_per_tick_(1)
+  {
+    if (header.dump_timestamp > header.start_timestamp)
+    {
+      microseconds_per_tick_ =
+          static_cast<double>(
+              header.dump_microseconds - header.start_microseconds)
+          / static_cast<double>(
+              header.dump_timestamp - header.start_timestamp);
+    }
+  }
+
+  double microseconds(boost::uint64_t timestamp) const
+  {
+    if (timestamp < start_timestamp_)
+    {
+      return 0;
+    }
+    return static_cast<double>(timestamp - start_timestamp_)
+        * microseconds_per_tick_;
+  }
+
+private:
+  boost::uint64_t start_timestamp_;
+  double microseconds_per_tick_;
+}; // class time_converter
+
+template <typename Value>
+bool read_value(std::istream& stream, Value& value)
+{
+  return !!stream.read(reinterpret_cast<char*>(&value), sizeof(value));
+}
+
+const char* event_name(boost::uint32_t type)
+{
+  if (type < ma::echo::server::trace_event_type::count)
+  {
+    return event_names[type];
+  }
+  return "unknown";
+}
+
+void write_event(std::ostream& stream, const time_converter& converter,
+    boost::uint32_t thread_index, const ma::event_trace_record& record)
+{
+  stream << "{\"name\":\"" << event_name(record.type)
+         << "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":" << thread_index
+         << ",\"ts\":" << converter.microseconds(record.timestamp)
+         << ",\"args\":{\"object\":\"0x" << std::hex << record.object
+         << std::dec << "\",\"error\":" << record.error
+         << ",\"value\":" << record.value << "}}";
+}
+
+bool convert(std::istream& input, std::ostream& output)
+{
+  ma::event_trace_file_header header;
+  if (!read_value(input, header) || !std::equal(header.magic,
+      header.magic + sizeof(header.magic), ma::event_trace_file_magic))
+  {
+    std::cerr << "Input isn't an event trace file" << std::endl;
+    return false;
+  }
+
+  const time_converter converter(header);
+  output << std::fixed << std::setprecision(3)
+         << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first_event = true;
+  for (boost::uint32_t i = 0; i != header.thread_count; ++i)
+  {
+    ma::event_trace_thread_header thread_header;
+    if (!read_value(input, thread_header))
+    {
+      std::cerr << "Event trace file is truncated" << std::endl;
+      return false;
+    }
+    record_vector records(thread_header.record_count);
+    if (!records.empty() && !input.read(
+        reinterpret_cast<char*>(&records.front()),
+        static_cast<std::streamsize>(
+            records.size() * sizeof(ma::event_trace_record))))
+    {
+      std::cerr << "Event trace file is truncated" << std::endl;
+      return false;
+    }
+    for (record_vector::const_iterator r = records.begin(),
+        end = records.end(); r != end; ++r)
+    {
+      if (!first_event)
+      {
+        output << ",\n";
+      }
+      first_event = false;
+      write_event(output, converter, thread_header.thread_index, *r);
+    }
+  }
+  output << "]}" << std::endl;
+  return !!output;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+  if ((argc < 2) || (argc > 3))
+  {
+    std::cout << "Usage: event_trace_converter <trace file> [<json file>]"
+              << std::endl
+              << "Converts event trace into Chrome trace viewer format."
+              << " Writes to standard output if JSON file isn't specified."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  try
+  {
+    std::ifstream input(argv[1], std::ios_base::in | std::ios_base::binary);
+    if (!input)
+    {
+      std::cerr << "Failed to open " << argv[1] << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if (argc < 3)
+    {
+      return convert(input, std::cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    std::ofstream output(argv[2], std::ios_base::out | std::ios_base::trunc);
+    if (!output)
+    {
+      std::cerr << "Failed to open " << argv[2] << std::endl;
+      return EXIT_FAILURE;
+    }
+    return convert(input, output) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "Unexpected error: " << e.what() << std::endl;
+  }
+  catch (...)
+  {
+    std::cerr << "Unknown error" << std::endl;
+  }
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,147 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/assert.hpp>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <ma/echo/server/error.hpp>
+#include <ma/echo/server/broadcast_session.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+broadcast_session::broadcast_session(boost::asio::io_service& io_service,
+    const session_config& config)
+  : feed_session(io_service, config)
+  , hub_(config.broadcast_hub)
+  , subscription_()
+  , feed_notified_(false)
+  , feed_messages_()
+{
+  BOOST_ASSERT_MSG(hub_, "Hub must be not null");
+}
+
+void broadcast_session::reset()
+{
+  feed_session::reset();
+
+  feed_notified_ = false;
+  feed_messages_.clear();
+  // Subscription of not started session
+  unsubscribe();
+}
+
+void broadcast_session::start_extra_io()
+{
+  subscription_ = hub_->subscribe(boost::bind(
+      &this_type::post_notify,
+      boost::static_pointer_cast<this_type>(shared_from_this())));
+}
+
+boost::system::error_code broadcast_session::stop_extra_io()
+{
+  unsubscribe();
+  return feed_session::stop_extra_io();
+}
+
+void broadcast_session::start_socket_write(
+    const cyclic_buffer::const_buffers_type& buffers)
+{
+  // The only copy of data, it is shared by all subscribers
+  const std::size_t size = boost::asio::buffer_size(buffers);
+  boost::shared_ptr<broadcast_hub::message> message =
+      boost::make_shared<broadcast_hub::message>(size);
+  boost::asio::buffer_copy(boost::asio::buffer(*message), buffers);
+  hub_->publish(message, subscription_);
+
+  post_complete_write(size);
+  begin_socket_write();
+}
+
+boost::system::error_code broadcast_session::shutdown_socket()
+{
+  // Messages published after shutdown aren't written
+  unsubscribe();
+  return feed_session::shutdown_socket();
+}
+
+boost::system::error_code broadcast_session::update_feed()
+{
+  if (subscription_ && (feed_notified_ || feed_messages_.empty()))
+  {
+    feed_notified_ = false;
+    if (!hub_->take(subscription_, feed_messages_))
+    {
+      // Client is too slow, it lost messages and can't continue
+      return server::error::subscriber_overflow;
+    }
+  }
+  return boost::system::error_code();
+}
+
+bool broadcast_session::has_feed() const
+{
+  return !feed_messages_.empty();
+}
+
+void broadcast_session::gather_feed(std::size_t offset)
+{
+  for (broadcast_hub::message_queue::const_iterator
+      i = feed_messages_.begin(), end = feed_messages_.end(); i != end; ++i)
+  {
+    const broadcast_hub::message& message = **i;
+    if (!gather_feed_buffer(&message.front() + offset,
+        message.size() - offset))
+    {
+      break;
+    }
+    offset = 0;
+  }
+}
+
+void broadcast_session::consume_feed(std::size_t& offset)
+{
+  while (!feed_messages_.empty()
+      && (offset >= feed_messages_.front()->size()))
+  {
+    offset -= feed_messages_.front()->size();
+    feed_messages_.pop_front();
+  }
+}
+
+void broadcast_session::post_notify()
+{
+  // Called by the thread publishing message
+  strand_.post(boost::bind(&this_type::handle_notify,
+      boost::static_pointer_cast<this_type>(shared_from_this())));
+}
+
+void broadcast_session::handle_notify()
+{
+  // Session could stop (and even be reused) while notification was posted
+  if (!subscription_)
+  {
+    return;
+  }
+
+  feed_notified_ = true;
+  continue_after_io();
+}
+
+void broadcast_session::unsubscribe()
+{
+  if (subscription_)
+  {
+    hub_->unsubscribe(subscription_);
+    subscription_.reset();
+  }
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
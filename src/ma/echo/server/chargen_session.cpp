@@ -0,0 +1,100 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <algorithm>
+#include <boost/noncopyable.hpp>
+#include <ma/echo/server/chargen_session.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+namespace {
+
+// Data written by chargen session: RFC 864 pattern of lines made of
+// 72 printable ASCII characters, each line starts with the character
+// following the first character of the previous line. The pattern repeats
+// after 95 lines, it's repeated multiple times, so any write starting
+// within the first pattern is continuous.
+const std::size_t chargen_line_size      = 72;
+const std::size_t chargen_pattern_size   = 95 * (chargen_line_size + 2);
+const std::size_t chargen_data_size      = 10 * chargen_pattern_size;
+const std::size_t max_chargen_write_size =
+    chargen_data_size - chargen_pattern_size;
+
+class chargen_data : private boost::noncopyable
+{
+public:
+  chargen_data()
+  {
+    for (std::size_t i = 0; i != chargen_data_size; ++i)
+    {
+      const std::size_t line   = i / (chargen_line_size + 2);
+      const std::size_t column = i % (chargen_line_size + 2);
+      if (column < chargen_line_size)
+      {
+        data_[i] = static_cast<char>(' ' + (line + column) % 95);
+      }
+      else
+      {
+        data_[i] = (column == chargen_line_size) ? '\r' : '\n';
+      }
+    }
+  }
+
+  const char* data() const
+  {
+    return data_;
+  }
+
+private:
+  char data_[chargen_data_size];
+}; // class chargen_data
+
+// Is filled at start and is never changed (refilled) later
+const chargen_data chargen_pattern;
+
+} // anonymous namespace
+
+void chargen_session::reset()
+{
+  discard_session::reset();
+  chargen_offset_ = 0;
+}
+
+boost::system::error_code chargen_session::adopt(session& other)
+{
+  if (boost::system::error_code error = discard_session::adopt(other))
+  {
+    return error;
+  }
+  // Other session is of the same type, written data stays continuous
+  chargen_offset_ = static_cast<this_type&>(other).chargen_offset_;
+  return boost::system::error_code();
+}
+
+cyclic_buffer::const_buffers_type chargen_session::write_data() const
+{
+  // Pattern is written until shutdown
+  if (intern_state::work != intern_state_)
+  {
+    return cyclic_buffer::const_buffers_type();
+  }
+  return cyclic_buffer::const_buffers_type(boost::asio::buffer(
+      chargen_pattern.data() + chargen_offset_,
+      (std::min)(max_transfer_size_, max_chargen_write_size)));
+}
+
+void chargen_session::complete_write_data(std::size_t bytes_transferred)
+{
+  chargen_offset_ =
+      (chargen_offset_ + bytes_transferred) % chargen_pattern_size;
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
@@ -0,0 +1,25 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <ma/echo/server/discard_session.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+boost::system::error_code discard_session::parse_messages()
+{
+  // Read data isn't used, buffer_ is released right away
+  const std::size_t size = boost::asio::buffer_size(buffer_.data());
+  buffer_.commit(size);
+  release_written_memory(size);
+  return boost::system::error_code();
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
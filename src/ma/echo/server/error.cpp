@@ -35,6 +35,8 @@ public:
       return "Operation aborted";
     case error::inactivity_timeout:
       return "Inactivity timeout";
+    case error::subscriber_overflow:
+      return "Subscriber overflow";
     default:
       return "ma.echo.server error";
     }
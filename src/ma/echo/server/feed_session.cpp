@@ -0,0 +1,237 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <algorithm>
+#include <boost/assert.hpp>
+#include <boost/bind.hpp>
+#include <ma/config.hpp>
+#include <ma/event_trace.hpp>
+#include <ma/handler_timing.hpp>
+#include <ma/custom_alloc_handler.hpp>
+#include <ma/strand_wrapped_handler.hpp>
+#include <ma/echo/server/feed_session.hpp>
+#include <ma/echo/server/detail/session_handler_binder.hpp>
+#include <ma/echo/server/handler_timing_tag.hpp>
+#include <ma/echo/server/trace_event_type.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+namespace {
+
+// Limit of the number of messages (responses) gathered by single feed write
+const std::size_t max_feed_buffers = 64;
+
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR) \
+    && !(defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
+
+typedef detail::io_handler_binder<feed_session> io_handler_binder;
+
+#endif
+
+} // anonymous namespace
+
+feed_session::feed_session(boost::asio::io_service& io_service,
+    const session_config& config)
+  : managed_session(io_service, config)
+  , feed_write_state_(write_state::wait)
+  , feed_shutdown_(false)
+  , feed_offset_(0)
+  , feed_write_size_(0)
+  , feed_bytes_written_(0)
+  , feed_buffers_()
+{
+}
+
+void feed_session::reset()
+{
+  managed_session::reset();
+
+  feed_write_state_   = write_state::wait;
+  feed_shutdown_      = false;
+  feed_offset_        = 0;
+  feed_bytes_written_ = 0;
+}
+
+boost::system::error_code feed_session::adopt(session& /*other*/)
+{
+  return boost::asio::error::operation_not_supported;
+}
+
+boost::system::error_code feed_session::continue_extra_io()
+{
+  if (boost::system::error_code error = update_feed())
+  {
+    return error;
+  }
+
+  if (write_state::wait == feed_write_state_)
+  {
+    if (has_feed())
+    {
+      start_feed_write();
+    }
+    else if (feed_shutdown_ && is_feed_drained())
+    {
+      // All taken data (queued responses) is passed to client, so we can
+      // shutdown outgoing part of client connection
+      boost::system::error_code error;
+      socket_.shutdown(protocol_type::socket::shutdown_send, error);
+      feed_write_state_ = write_state::stopped;
+      return error;
+    }
+  }
+
+  return boost::system::error_code();
+}
+
+boost::system::error_code feed_session::stop_extra_io()
+{
+  if (write_state::wait == feed_write_state_)
+  {
+    feed_write_state_ = write_state::stopped;
+  }
+  return boost::system::error_code();
+}
+
+bool feed_session::is_extra_io_stopped() const
+{
+  return write_state::stopped == feed_write_state_;
+}
+
+bool feed_session::has_extra_io_activity() const
+{
+  return write_state::in_progress == feed_write_state_;
+}
+
+boost::system::error_code feed_session::shutdown_socket()
+{
+  // Outgoing part of connection is shut down by feed when all taken data
+  // (queued responses) is passed to client
+  feed_shutdown_ = true;
+  return continue_extra_io();
+}
+
+session_stats feed_session::stats() const
+{
+  session_stats stats = managed_session::stats();
+  stats.feed_bytes_written = feed_bytes_written_;
+  return stats;
+}
+
+boost::system::error_code feed_session::update_feed()
+{
+  return boost::system::error_code();
+}
+
+bool feed_session::is_feed_drained() const
+{
+  return true;
+}
+
+bool feed_session::gather_feed_buffer(const void* data, std::size_t size)
+{
+  const std::size_t buffer_size =
+      (std::min)(size, max_transfer_size_ - feed_write_size_);
+  feed_buffers_.push_back(boost::asio::const_buffer(data, buffer_size));
+  feed_write_size_ += buffer_size;
+  return (feed_write_size_ < max_transfer_size_)
+      && (feed_buffers_.size() < max_feed_buffers);
+}
+
+void feed_session::start_feed_write()
+{
+  // Gather write of the shared messages (of the same response)
+  feed_buffers_.clear();
+  feed_write_size_ = 0;
+  gather_feed(feed_offset_);
+
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+  this_ptr shared_this = boost::static_pointer_cast<this_type>(
+      shared_from_this());
+
+  socket_.async_write_some(feed_buffers_, MA_STRAND_WRAP(strand_,
+      MA_TIME_IO_HANDLER(handler_timing_tag::session_write,
+          make_custom_alloc_handler(feed_write_allocator_, [shared_this](
+          const boost::system::error_code& error,
+          std::size_t bytes_transferred)
+  {
+    shared_this->handle_feed_write(error, bytes_transferred);
+  }))));
+
+#elif defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+
+  socket_.async_write_some(feed_buffers_, MA_STRAND_WRAP(strand_,
+      MA_TIME_IO_HANDLER(handler_timing_tag::session_write,
+          make_custom_alloc_handler(feed_write_allocator_, io_handler_binder(
+              &this_type::handle_feed_write,
+              boost::static_pointer_cast<this_type>(shared_from_this()))))));
+
+#else
+
+  socket_.async_write_some(feed_buffers_, MA_STRAND_WRAP(strand_,
+      MA_TIME_IO_HANDLER(handler_timing_tag::session_write,
+          make_custom_alloc_handler(feed_write_allocator_, boost::bind(
+              &this_type::handle_feed_write,
+              boost::static_pointer_cast<this_type>(shared_from_this()),
+              _1, _2)))));
+
+#endif
+
+  add_pending_operation();
+  feed_write_state_ = write_state::in_progress;
+}
+
+void feed_session::handle_feed_write(const boost::system::error_code& error,
+    std::size_t bytes_transferred)
+{
+  BOOST_ASSERT_MSG(write_state::in_progress == feed_write_state_,
+      "Invalid feed write state");
+  MA_TRACE_EVENT(trace_event_type::session_write, this, error.value(),
+      bytes_transferred);
+
+  remove_pending_operation();
+  feed_bytes_written_ += bytes_transferred;
+
+  if (intern_state::stop == intern_state_)
+  {
+    feed_write_state_ = write_state::stopped;
+    continue_stop();
+    return;
+  }
+
+  feed_write_state_ = write_state::wait;
+
+  // Try to cancel timer if it is in progress and wasn't already canceled
+  if (boost::system::error_code error = cancel_timer_wait())
+  {
+    feed_write_state_ = write_state::stopped;
+    start_stop(error);
+    return;
+  }
+
+  if (error)
+  {
+    feed_write_state_ = write_state::stopped;
+    start_stop(error);
+    return;
+  }
+
+  // Written data isn't used by session any more
+  feed_offset_ += bytes_transferred;
+  consume_feed(feed_offset_);
+  continue_after_io();
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
@@ -0,0 +1,105 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/assert.hpp>
+#include <ma/echo/server/http_session.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+namespace {
+
+// The only response of HTTP session
+const char http_response[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 13\r\n"
+    "\r\n"
+    "Hello, World!";
+const std::size_t http_response_size = sizeof(http_response) - 1;
+
+} // anonymous namespace
+
+http_session::http_session(boost::asio::io_service& io_service,
+    const session_config& config)
+  : feed_session(io_service, config)
+  , parser_(config.buffer_size)
+  , requests_(0)
+  , responses_(0)
+{
+}
+
+void http_session::reset()
+{
+  feed_session::reset();
+
+  requests_  = 0;
+  responses_ = 0;
+}
+
+boost::system::error_code http_session::parse_messages()
+{
+  boost::system::error_code error;
+  const http_request_parser::batch batch =
+      parser_.parse(buffer_.data(), framed_size_, error);
+  framed_size_ += batch.size;
+  messages_    += batch.count;
+  requests_    += batch.count;
+  return error;
+}
+
+cyclic_buffer::const_buffers_type http_session::write_data() const
+{
+  if (!framed_size_)
+  {
+    return cyclic_buffer::const_buffers_type();
+  }
+  // Responses are counted per request, so requests are consumed at once
+  return buffer_.data(framed_size_);
+}
+
+void http_session::start_socket_write(
+    const cyclic_buffer::const_buffers_type& buffers)
+{
+  // Requests aren't used any more, the same response is written for each
+  const std::size_t size = boost::asio::buffer_size(buffers);
+  BOOST_ASSERT_MSG(size == framed_size_, "All requests have to be consumed");
+  responses_ += requests_;
+  requests_   = 0;
+
+  post_complete_write(size);
+  begin_socket_write();
+}
+
+bool http_session::has_feed() const
+{
+  return 0 != responses_;
+}
+
+void http_session::gather_feed(std::size_t offset)
+{
+  for (std::size_t i = 0; i != responses_; ++i)
+  {
+    if (!gather_feed_buffer(http_response + offset,
+        http_response_size - offset))
+    {
+      break;
+    }
+    offset = 0;
+  }
+}
+
+void http_session::consume_feed(std::size_t& offset)
+{
+  responses_ -= offset / http_response_size;
+  offset     %= http_response_size;
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
@@ -0,0 +1,352 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <cstring>
+#include <limits>
+#include <boost/assert.hpp>
+#include <boost/bind.hpp>
+#include <ma/detail/buffer_blocks.hpp>
+#include <ma/echo/server/kv_session.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+namespace {
+
+// Responses of key-value session
+const char kv_value_response[]      = "VALUE ";
+const char kv_line_end[]            = "\r\n";
+const char kv_not_found_response[]  = "NOT_FOUND\r\n";
+const char kv_stored_response[]     = "STORED\r\n";
+const char kv_not_stored_response[] = "NOT_STORED\r\n";
+const char kv_deleted_response[]    = "DELETED\r\n";
+const char kv_error_response[]      = "ERROR\r\n";
+
+// Shard of the command which isn't executed
+const std::size_t invalid_command = (std::numeric_limits<std::size_t>::max)();
+
+bool is_command_name(const detail::buffer_blocks& line, std::size_t size,
+    const char* name)
+{
+  if (std::strlen(name) != size)
+  {
+    return false;
+  }
+  for (std::size_t i = 0; i != size; ++i)
+  {
+    if (static_cast<unsigned char>(name[i]) != line.at(i))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void append_reply(std::vector<char>& replies, const char* data,
+    std::size_t size)
+{
+  replies.insert(replies.end(), data, data + size);
+}
+
+void append_reply(std::vector<char>& replies, const char* text)
+{
+  append_reply(replies, text, std::strlen(text));
+}
+
+} // anonymous namespace
+
+void kv_session::command_window::clear()
+{
+  for (batch_vector::iterator i = batches.begin(), end = batches.end();
+      i != end; ++i)
+  {
+    i->clear();
+  }
+  commands.clear();
+}
+
+void kv_session::command_window::swap(command_window& other)
+{
+  batches.swap(other.batches);
+  commands.swap(other.commands);
+}
+
+kv_session::kv_session(boost::asio::io_service& io_service,
+    const session_config& config)
+  : feed_session(io_service, config)
+  , store_(config.kv_store)
+  , parser_(config.buffer_size)
+  , max_replies_size_(config.buffer_size)
+  , staged_()
+  , executed_()
+  , forwards_(0)
+  , executed_size_(0)
+  , replies_()
+  , feed_replies_()
+{
+  BOOST_ASSERT_MSG(store_, "Store must be not null");
+
+  staged_.batches.resize(store_->shard_count());
+  executed_.batches.resize(store_->shard_count());
+}
+
+void kv_session::reset()
+{
+  feed_session::reset();
+
+  BOOST_ASSERT_MSG(!forwards_, "Commands are still executed");
+  staged_.clear();
+  executed_.clear();
+  executed_size_ = 0;
+  replies_.clear();
+  feed_replies_.clear();
+}
+
+boost::system::error_code kv_session::parse_messages()
+{
+  // Commands are staged while being parsed
+  boost::system::error_code error;
+  const line_parser::batch batch = parser_.parse(buffer_.data(),
+      framed_size_, boost::bind(&this_type::stage_command, this, _1), error);
+  framed_size_ += batch.size;
+  messages_    += batch.count;
+  return error;
+}
+
+cyclic_buffer::const_buffers_type kv_session::write_data() const
+{
+  if (!framed_size_)
+  {
+    return cyclic_buffer::const_buffers_type();
+  }
+  // Responses are staged per command, so commands are consumed at once
+  return buffer_.data(framed_size_);
+}
+
+void kv_session::discard_read_data()
+{
+  feed_session::discard_read_data();
+
+  // Drops the commands which were staged but not executed
+  staged_.clear();
+}
+
+bool kv_session::is_read_paused() const
+{
+  // Client has to read replies before it sends more commands
+  return replies_.size() + feed_replies_.size() >= max_replies_size_;
+}
+
+void kv_session::start_socket_write(
+    const cyclic_buffer::const_buffers_type& buffers)
+{
+  const std::size_t size = boost::asio::buffer_size(buffers);
+  BOOST_ASSERT_MSG(size == framed_size_, "All commands have to be consumed");
+  BOOST_ASSERT_MSG(!forwards_, "Commands are still executed");
+
+  // Commands refer to the data of buffer_ which is released by completion
+  // of write, so write completes when all commands are executed
+  executed_.swap(staged_);
+  for (std::size_t shard = 0, shard_count = executed_.batches.size();
+      shard != shard_count; ++shard)
+  {
+    kv_store::batch& batch = executed_.batches[shard];
+    if (batch.operations.empty())
+    {
+      continue;
+    }
+    if (store_->is_local(shard, io_service_))
+    {
+      // Shard belongs to the thread running session
+      store_->execute(shard, batch);
+    }
+    else
+    {
+      start_forward(shard);
+    }
+  }
+
+  begin_socket_write();
+  if (forwards_)
+  {
+    executed_size_ = size;
+    return;
+  }
+  write_replies();
+  post_complete_write(size);
+}
+
+bool kv_session::has_feed() const
+{
+  return !feed_replies_.empty() || !replies_.empty();
+}
+
+void kv_session::gather_feed(std::size_t offset)
+{
+  // Replies added while feed writes are written by the next feed write
+  if (feed_replies_.empty())
+  {
+    feed_replies_.swap(replies_);
+  }
+  gather_feed_buffer(&feed_replies_[offset], feed_replies_.size() - offset);
+}
+
+void kv_session::consume_feed(std::size_t& offset)
+{
+  if (offset >= feed_replies_.size())
+  {
+    offset -= feed_replies_.size();
+    release_made_memory(feed_replies_.size());
+    feed_replies_.clear();
+  }
+}
+
+void kv_session::stage_command(const line_parser::buffers_type& line)
+{
+  // GET key, SET key value (the rest of line), DEL key
+  const detail::buffer_blocks blocks(line);
+  const std::size_t size = blocks.size();
+  kv_store::operation operation;
+  bool valid = false;
+  const std::size_t name_end = blocks.find(' ', 0);
+  if (size != name_end)
+  {
+    const std::size_t key_start = name_end + 1;
+    const std::size_t key_end = blocks.find(' ', key_start);
+    if (size != key_end)
+    {
+      if (is_command_name(blocks, name_end, "SET"))
+      {
+        operation.type  = kv_store::operation::set;
+        operation.value = blocks.sub(key_end + 1, size - key_end - 1);
+        valid = true;
+      }
+    }
+    else if (is_command_name(blocks, name_end, "GET"))
+    {
+      operation.type = kv_store::operation::get;
+      valid = true;
+    }
+    else if (is_command_name(blocks, name_end, "DEL"))
+    {
+      operation.type = kv_store::operation::erase;
+      valid = true;
+    }
+    operation.key = blocks.sub(key_start, key_end - key_start);
+  }
+
+  command staged_command;
+  if (!valid || !boost::asio::buffer_size(operation.key))
+  {
+    staged_command.shard = invalid_command;
+    staged_command.index = 0;
+    staged_.commands.push_back(staged_command);
+    return;
+  }
+
+  const std::size_t shard = store_->shard_of(operation);
+  kv_store::operation_vector& operations = staged_.batches[shard].operations;
+  staged_command.shard = shard;
+  staged_command.index = operations.size();
+  operations.push_back(operation);
+  staged_.commands.push_back(staged_command);
+}
+
+void kv_session::start_forward(std::size_t shard)
+{
+  // Called by the thread of shard
+  store_->async_execute(shard, executed_.batches[shard], boost::bind(
+      &this_type::post_forward_complete,
+      boost::static_pointer_cast<this_type>(shared_from_this())));
+
+  ++forwards_;
+}
+
+void kv_session::post_forward_complete()
+{
+  strand_.post(boost::bind(&this_type::handle_forward,
+      boost::static_pointer_cast<this_type>(shared_from_this())));
+}
+
+void kv_session::handle_forward()
+{
+  if (--forwards_)
+  {
+    return;
+  }
+
+  if (intern_state::stop == intern_state_)
+  {
+    executed_.clear();
+  }
+  else
+  {
+    write_replies();
+  }
+
+  // Data of buffer_ isn't used by commands any more
+  const std::size_t size = executed_size_;
+  executed_size_ = 0;
+  complete_write(boost::system::error_code(), size);
+}
+
+void kv_session::write_replies()
+{
+  const std::size_t replies_size = replies_.size();
+  for (command_vector::const_iterator i = executed_.commands.begin(),
+      end = executed_.commands.end(); i != end; ++i)
+  {
+    if (invalid_command == i->shard)
+    {
+      append_reply(replies_, kv_error_response);
+      continue;
+    }
+
+    const kv_store::batch& batch = executed_.batches[i->shard];
+    const kv_store::operation& operation = batch.operations[i->index];
+    switch (operation.type)
+    {
+    case kv_store::operation::get:
+      if (operation.found)
+      {
+        append_reply(replies_, kv_value_response);
+        if (operation.value_size)
+        {
+          append_reply(replies_, &batch.values[operation.value_offset],
+              operation.value_size);
+        }
+        append_reply(replies_, kv_line_end);
+      }
+      else
+      {
+        append_reply(replies_, kv_not_found_response);
+      }
+      break;
+
+    case kv_store::operation::set:
+      append_reply(replies_, operation.found ? kv_stored_response
+          : kv_not_stored_response);
+      break;
+
+    case kv_store::operation::erase:
+      append_reply(replies_, operation.found ? kv_deleted_response
+          : kv_not_found_response);
+      break;
+
+    default:
+      BOOST_ASSERT_MSG(false, "Invalid operation type");
+      break;
+    }
+  }
+  executed_.clear();
+  acquire_made_memory(replies_.size() - replies_size);
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
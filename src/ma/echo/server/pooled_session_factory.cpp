@@ -8,79 +8,168 @@
 #include <new>
 #include <algorithm>
 #include <boost/ref.hpp>
+#include <boost/assert.hpp>
 #include <boost/make_shared.hpp>
 #include <ma/shared_ptr_factory.hpp>
+#include <ma/slab_allocator.hpp>
 #include <ma/echo/server/error.hpp>
+#include <ma/echo/server/session_type.hpp>
 #include <ma/echo/server/pooled_session_factory.hpp>
 
 namespace ma {
 namespace echo {
 namespace server {
 
+namespace {
+
+// Number of sessions allocated at once by the slab of pool item
+const std::size_t session_slab_chunk_size = 64;
+
+// Smoothed load is kept in fractions of write to not lose small rates
+const long load_scale = 16;
+// Weight of the previous load in the smoothed one is (1 - 1 / load_smoothing)
+const long load_smoothing = 4;
+
+} // anonymous namespace
+
+// Sessions of different types (see dispatch_session_type) share the list
+// of recycled sessions and the link to their pool item
+class pooled_session_factory::session_wrapper_base
+  : public sp_intrusive_list<session_wrapper_base>::base_hook
+{
+public:
+  const pool_link& back_link() const
+  {
+    return back_link_;
+  }
+
+protected:
+  explicit session_wrapper_base(const pool_link& back_link)
+    : back_link_(back_link)
+  {
+  }
+
+  virtual ~session_wrapper_base()
+  {
+  }
+
+private:
+  pool_link back_link_;
+}; // class pooled_session_factory::session_wrapper_base
+
+template <typename Session>
 class pooled_session_factory::session_wrapper
   : public session_wrapper_base
-  , public session
+  , public Session
 {
 private:
   typedef session_wrapper this_type;
 
 public:
-  static session_wrapper_ptr create(boost::asio::io_service& io_service,
-      const session_config& config, const pool_link& back_link)
+  typedef slab_allocator<this_type> allocator_type;
+  typedef session::load_counter     load_counter;
+
+  static boost::shared_ptr<this_type> create(const allocator_type& allocator,
+      boost::asio::io_service& io_service, const session_config& config,
+      const pool_link& back_link, load_counter* counter)
   {
     typedef shared_ptr_factory_helper<this_type> helper;
-    return boost::make_shared<helper>(
-        boost::ref(io_service), config, back_link);
+    return boost::allocate_shared<helper>(allocator,
+        boost::ref(io_service), config, back_link, counter);
   }
 
-  const pool_link& back_link() const
+protected:
+  session_wrapper(boost::asio::io_service& io_service,
+      const session_config& config, const pool_link& back_link,
+      load_counter* counter)
+    : session_wrapper_base(back_link)
+    , Session(io_service, config)
   {
-    return back_link_;
+    this->attach_load_counter(counter);
   }
 
-protected:
-  session_wrapper(boost::asio::io_service& io_service,
-      const session_config& config, const pool_link& back_link)
-    : session(io_service, config)
+  ~session_wrapper()
+  {
+  }
+}; // class pooled_session_factory::session_wrapper
+
+class pooled_session_factory::session_creator
+{
+public:
+  typedef managed_session_ptr   result_type;
+  typedef session::load_counter load_counter;
+
+  session_creator(const slab_allocator<session_wrapper_base>& allocator,
+      boost::asio::io_service& io_service, const session_config& config,
+      const pool_link& back_link, load_counter* counter)
+    : allocator_(allocator)
+    , io_service_(io_service)
+    , config_(config)
     , back_link_(back_link)
+    , counter_(counter)
   {
   }
 
-  ~session_wrapper()
+  template <typename Session>
+  result_type create()
   {
+    return session_wrapper<Session>::create(allocator_, io_service_,
+        config_, back_link_, counter_);
   }
 
 private:
-  pool_link back_link_;
-}; // class pooled_session_factory::session_wrapper
+  const slab_allocator<session_wrapper_base>& allocator_;
+  boost::asio::io_service& io_service_;
+  const session_config&    config_;
+  const pool_link&         back_link_;
+  load_counter*            counter_;
+}; // class pooled_session_factory::session_creator
+
+// "Creates" the size of session wrapper serving the given configuration
+class pooled_session_factory::session_sizer
+{
+public:
+  typedef std::size_t result_type;
+
+  template <typename Session>
+  result_type create() const
+  {
+    return sizeof(session_wrapper<Session>);
+  }
+}; // class pooled_session_factory::session_sizer
 
 class pooled_session_factory::pool_item
 {
 public:
-  pool_item(boost::asio::io_service& io_service, std::size_t max_recycled)
+  pool_item(boost::asio::io_service& io_service, std::size_t max_recycled,
+      bool load_tracking)
     : max_recycled_(max_recycled)
+    , load_tracking_(load_tracking)
     , io_service_(io_service)
     , size_(0)
+    , load_counter_(0)
+    , activity_(0)
+    , smoothed_load_(0)
+    , session_allocator_(boost::make_shared<slab_storage>(
+          session_slab_chunk_size))
   {
   }
 
-  session_wrapper_ptr create(const pool_link& back_link,
+  managed_session_ptr create(const pool_link& back_link,
       const session_config& config, boost::system::error_code& error)
   {
     if (!recycled_.empty())
     {
-      session_wrapper_ptr session =
-          boost::static_pointer_cast<session_wrapper>(recycled_.front());
+      session_wrapper_base_ptr session = recycled_.front();
       recycled_.erase(session);
       ++size_;
       error = boost::system::error_code();
-      return session;
+      return boost::dynamic_pointer_cast<managed_session>(session);
     }
 
     try
     {
-      session_wrapper_ptr session = session_wrapper::create(
-          io_service_, config, back_link);
+      managed_session_ptr session = create_session(back_link, config);
       ++size_;
       error = boost::system::error_code();
       return session;
@@ -89,17 +178,92 @@ public:
     {
       error = boost::system::errc::make_error_code(
           boost::system::errc::not_enough_memory);
-      return session_wrapper_ptr();
+      return managed_session_ptr();
     }
   }
 
-  void release(const session_wrapper_ptr& session)
+  void release(const managed_session_ptr& session)
   {
     --size_;
     if (max_recycled_ > recycled_.size())
     {
-      recycled_.push_front(session);
+      recycled_.push_front(
+          boost::dynamic_pointer_cast<session_wrapper_base>(session));
+    }
+  }
+
+  std::size_t recycled_count() const
+  {
+    return recycled_.size();
+  }
+
+  void add_activity(long activity)
+  {
+    activity_ += activity;
+  }
+
+  void update_load()
+  {
+    smoothed_load_ += (activity_ * load_scale - smoothed_load_)
+        / load_smoothing;
+    activity_ = 0;
+  }
+
+  long smoothed_load() const
+  {
+    return smoothed_load_;
+  }
+
+  // Migrated session brings its load at once
+  void move_load(pool_item& target, long load)
+  {
+    smoothed_load_ = (std::max)(smoothed_load_ - load, 0L);
+    target.smoothed_load_ += load;
+  }
+
+  bool serves(const boost::asio::io_service& io_service) const
+  {
+    return &io_service_ == &io_service;
+  }
+
+  std::size_t prewarm(const pool_link& back_link,
+      const session_config& config, std::size_t count,
+      boost::system::error_code& error)
+  {
+    // Prewarmed sessions have to survive their first release
+    if (max_recycled_ < count)
+    {
+      max_recycled_ = count;
+    }
+
+    std::size_t created = 0;
+    try
+    {
+      while (recycled_.size() < count)
+      {
+        managed_session_ptr session = create_session(back_link, config);
+        session->prewarm();
+        recycled_.push_front(
+            boost::dynamic_pointer_cast<session_wrapper_base>(session));
+        ++created;
+      }
+    }
+    catch (const std::bad_alloc&)
+    {
+      error = boost::system::errc::make_error_code(
+          boost::system::errc::not_enough_memory);
+      return created;
     }
+
+    error = boost::system::error_code();
+    return created;
+  }
+
+  // Sessions pay for the update of counter (shared by all sessions of
+  // io_service) on each write, so it's attached only if load is used
+  session::load_counter* attached_load_counter()
+  {
+    return load_tracking_ ? &load_counter_ : 0;
   }
 
   static bool less_loaded_pool(const pool_item_ptr& left,
@@ -108,49 +272,241 @@ public:
     return left->size_ < right->size_;
   }
 
+  static bool less_busy_pool(const pool_item_ptr& left,
+      const pool_item_ptr& right)
+  {
+    // Counters are updated by the threads of io_services so the result is
+    // approximate. Number of sessions breaks ties (e.g. idle io_services).
+    const long left_load  = left->load_counter_;
+    const long right_load = right->load_counter_;
+    if (left_load != right_load)
+    {
+      return left_load < right_load;
+    }
+    return left->size_ < right->size_;
+  }
+
+  static bool less_smoothed_load_pool(const pool_item_ptr& left,
+      const pool_item_ptr& right)
+  {
+    if (left->smoothed_load_ != right->smoothed_load_)
+    {
+      return left->smoothed_load_ < right->smoothed_load_;
+    }
+    return left->size_ < right->size_;
+  }
+
 private:
-  const std::size_t        max_recycled_;
+  managed_session_ptr create_session(const pool_link& back_link,
+      const session_config& config)
+  {
+    session_creator creator(session_allocator_, io_service_, config,
+        back_link, attached_load_counter());
+    return dispatch_session_type(creator, config);
+  }
+
+  std::size_t              max_recycled_;
+  const bool               load_tracking_;
   boost::asio::io_service& io_service_;
   std::size_t              size_;
+  session::load_counter    load_counter_;
+  // Writes completed since the previous update of smoothed load
+  long                     activity_;
+  long                     smoothed_load_;
   session_list             recycled_;
+  // Sessions (and their reference counters) of the same io_service are
+  // allocated from the same slab
+  slab_allocator<session_wrapper_base> session_allocator_;
 }; // class pooled_session_factory::pool_item
 
 pooled_session_factory::pooled_session_factory(
-    const io_service_vector& io_services, std::size_t max_recycled)
-  : pool_(create_pool(io_services, max_recycled))
+    const io_service_vector& io_services, std::size_t max_recycled,
+    balancing_policy::value_t policy)
+  : pool_(create_pool(io_services, max_recycled, uses_load(policy)))
+  , balancing_policy_(policy)
+  , next_pool_item_(0)
+  , random_generator_()
 {
+  BOOST_ASSERT_MSG(!pool_.empty(), "io_services must be not empty");
 }
 
-session_ptr pooled_session_factory::create(const session_config& config,
-    boost::system::error_code& error)
+managed_session_ptr pooled_session_factory::create(
+    const session_config& config, boost::system::error_code& error)
 {
   // Select appropriate item of pool
-  const pool::const_iterator selected_pool_item =
-      std::min_element(pool_.begin(), pool_.end(), pool_item::less_loaded_pool);
+  const pool_link selected_pool_item = select_pool_item();
 
   // Create new session by means of selected pool item
   return (*selected_pool_item)->create(selected_pool_item, config, error);
 }
 
-void pooled_session_factory::release(const session_ptr& session)
+void pooled_session_factory::release(const managed_session_ptr& session)
 {
   // Find session's pool item
-  const session_wrapper_ptr wrapped_session =
-      boost::static_pointer_cast<session_wrapper>(session);
-  pool_item& session_pool_item = **(wrapped_session->back_link());
+  pool_item& session_pool_item = **back_link(session);
   // Release session by means of its pool item
-  session_pool_item.release(wrapped_session);
+  session_pool_item.release(session);
+}
+
+std::size_t pooled_session_factory::recycled_count() const
+{
+  std::size_t count = 0;
+  for (pool::const_iterator i = pool_.begin(), end = pool_.end();
+      i != end; ++i)
+  {
+    count += (*i)->recycled_count();
+  }
+  return count;
+}
+
+void pooled_session_factory::add_activity(
+    const managed_session_ptr& session, long activity)
+{
+  (*back_link(session))->add_activity(activity);
+}
+
+void pooled_session_factory::update_load()
+{
+  for (pool::const_iterator i = pool_.begin(), end = pool_.end();
+      i != end; ++i)
+  {
+    (*i)->update_load();
+  }
+}
+
+managed_session_ptr pooled_session_factory::create_migration_target(
+    const managed_session_ptr& session, long activity,
+    const session_config& config, boost::system::error_code& error)
+{
+  const pool_link source_pool_item = back_link(session);
+  const pool_link target_pool_item = std::min_element(
+      pool_.begin(), pool_.end(), pool_item::less_smoothed_load_pool);
+
+  // Moving of session reduces the difference of loads by twice its load
+  const long session_load = activity * load_scale;
+  if ((*source_pool_item)->smoothed_load()
+      < (*target_pool_item)->smoothed_load() + 2 * session_load)
+  {
+    error = boost::system::error_code();
+    return managed_session_ptr();
+  }
+
+  managed_session_ptr target =
+      (*target_pool_item)->create(target_pool_item, config, error);
+  if (target)
+  {
+    (*source_pool_item)->move_load(**target_pool_item, session_load);
+  }
+  return target;
+}
+
+std::size_t pooled_session_factory::prewarm(const session_config& config,
+    std::size_t count, boost::system::error_code& error)
+{
+  std::size_t created = 0;
+  for (pool::const_iterator i = pool_.begin(), end = pool_.end();
+      i != end; ++i)
+  {
+    created += (*i)->prewarm(i, config, count, error);
+    if (error)
+    {
+      break;
+    }
+  }
+  session_sizer sizer;
+  return created * (dispatch_session_type(sizer, config) + config.buffer_size);
+}
+
+std::size_t pooled_session_factory::prewarm(
+    boost::asio::io_service& io_service, const session_config& config,
+    std::size_t count, boost::system::error_code& error)
+{
+  error = boost::system::error_code();
+  std::size_t created = 0;
+  for (pool::const_iterator i = pool_.begin(), end = pool_.end();
+      i != end; ++i)
+  {
+    if ((*i)->serves(io_service))
+    {
+      created = (*i)->prewarm(i, config, count, error);
+      break;
+    }
+  }
+  session_sizer sizer;
+  return created * (dispatch_session_type(sizer, config) + config.buffer_size);
+}
+
+const pooled_session_factory::pool_link& pooled_session_factory::back_link(
+    const managed_session_ptr& session)
+{
+  return boost::dynamic_pointer_cast<session_wrapper_base>(
+      session)->back_link();
+}
+
+pooled_session_factory::pool_link pooled_session_factory::select_pool_item()
+{
+  switch (balancing_policy_)
+  {
+  case balancing_policy::least_sessions:
+    return std::min_element(pool_.begin(), pool_.end(),
+        pool_item::less_loaded_pool);
+
+  case balancing_policy::least_load:
+    return std::min_element(pool_.begin(), pool_.end(),
+        pool_item::less_busy_pool);
+
+  case balancing_policy::round_robin:
+    {
+      const pool_link selected = pool_.begin() + next_pool_item_;
+      if (pool_.size() == ++next_pool_item_)
+      {
+        next_pool_item_ = 0;
+      }
+      return selected;
+    }
+
+  case balancing_policy::two_choices:
+    {
+      const std::size_t size = pool_.size();
+      if (size < 2)
+      {
+        return pool_.begin();
+      }
+      // Choose two different items of pool
+      const std::size_t first = random_generator_() % size;
+      const std::size_t second =
+          (first + 1 + random_generator_() % (size - 1)) % size;
+      const pool_link first_link  = pool_.begin() + first;
+      const pool_link second_link = pool_.begin() + second;
+      if (pool_item::less_busy_pool(*second_link, *first_link))
+      {
+        return second_link;
+      }
+      return first_link;
+    }
+
+  default:
+    BOOST_ASSERT_MSG(false, "Invalid balancing policy");
+    return pool_.begin();
+  }
+}
+
+bool pooled_session_factory::uses_load(balancing_policy::value_t policy)
+{
+  return (balancing_policy::least_load == policy)
+      || (balancing_policy::two_choices == policy);
 }
 
 pooled_session_factory::pool pooled_session_factory::create_pool(
-    const io_service_vector& io_services, std::size_t max_recycled)
+    const io_service_vector& io_services, std::size_t max_recycled,
+    bool load_tracking)
 {
   pool result;
   for (io_service_vector::const_iterator i = io_services.begin(),
       end = io_services.end(); i != end; ++i)
   {
     result.push_back(boost::make_shared<pool_item>(
-        boost::ref(**i), max_recycled));
+        boost::ref(**i), max_recycled, load_tracking));
   }
   return result;
 }
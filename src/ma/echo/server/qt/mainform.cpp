@@ -10,6 +10,7 @@ TRANSLATOR ma::echo::server::qt::MainForm
 //
 
 #include <limits>
+#include <vector>
 #include <stdexcept>
 #include <boost/optional.hpp>
 #include <boost/thread/thread.hpp>
@@ -20,6 +21,7 @@ TRANSLATOR ma::echo::server::qt::MainForm
 #include <QTimer>
 #include <QTextCursor>
 #include <QMessageBox>
+#include <ma/io_service_loop_stats.hpp>
 #include <ma/echo/server/error.hpp>
 #include <ma/echo/server/session_manager_stats.hpp>
 #include <ma/echo/server/qt/service.h>
@@ -54,6 +56,17 @@ QString format(const session_manager_stats::limited_counter& counter)
   }
 }
 
+QString formatPercent(const boost::posix_time::time_duration& part,
+    const boost::posix_time::time_duration& total)
+{
+  if (total.ticks() <= 0)
+  {
+    return QString("n/a");
+  }
+  return QString("%1%").arg(static_cast<double>(part.ticks()) * 100
+      / static_cast<double>(total.ticks()), 0, 'f', 1);
+}
+
 std::size_t calcSessionManagerThreadCount(std::size_t /*hardwareConcurrency*/)
 {
   return 1;
@@ -262,6 +275,7 @@ void MainForm::on_terminateButton_clicked()
   writeLog(tr("Terminating echo service."));
   service_.terminate();
   writeLog(tr("Echo service terminated."));
+  writeThreadStats();
 
   showStats(service_.stats());
   conditionalStopStatsTimer(service_.state());
@@ -320,6 +334,10 @@ void MainForm::on_service_stopCompleted(const boost::system::error_code& error)
   {
     writeLog(tr("Echo service stop completed successfully."));
   }
+  if (ServiceState::Stopped == service_.state())
+  {
+    writeThreadStats();
+  }
 
   showStats(service_.stats());
   conditionalStopStatsTimer(service_.state());
@@ -550,6 +568,32 @@ void MainForm::writeLog(const QString& message)
   ui_.logTextEdit->moveCursor(QTextCursor::End);
 }
 
+void MainForm::writeThreadStats()
+{
+  typedef std::vector<io_service_loop_stats> stats_vector;
+  const stats_vector threadStats = service_.threadStats();
+  std::size_t threadIndex = 0;
+  for (stats_vector::const_iterator i = threadStats.begin(),
+      end = threadStats.end(); i != end; ++i, ++threadIndex)
+  {
+    const boost::posix_time::time_duration totalTime =
+        i->handler_time + i->spin_time + i->idle_time;
+    const double avgReadyHandlers = i->batch_count
+        ? static_cast<double>(i->handler_count - i->wait_count)
+            / static_cast<double>(i->batch_count)
+        : 0;
+    writeLog(tr("Work thread #%1: executed handlers: %2," \
+        " handlers' time: %3, idle time: %4," \
+        " max ready handlers: %5, average ready handlers: %6.")
+        .arg(threadIndex)
+        .arg(static_cast<qulonglong>(i->handler_count))
+        .arg(formatPercent(i->handler_time, totalTime))
+        .arg(formatPercent(i->idle_time, totalTime))
+        .arg(i->max_batch_size)
+        .arg(avgReadyHandlers, 0, 'f', 2));
+  }
+}
+
 void MainForm::updateWidgetsStates(bool ignorePrevServiceState)
 {
   ServiceState::State serviceState = service_.state();
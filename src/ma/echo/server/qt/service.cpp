@@ -18,6 +18,7 @@ TRANSLATOR ma::echo::server::qt::Service
 #include <boost/noncopyable.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <boost/thread/thread.hpp>
+#include <ma/io_service_loop.hpp>
 #include <ma/echo/server/error.hpp>
 #include <ma/echo/server/simple_session_factory.hpp>
 #include <ma/echo/server/pooled_session_factory.hpp>
@@ -41,6 +42,8 @@ typedef boost::shared_ptr<ma::echo::server::session_factory>
     session_factory_ptr;
 typedef boost::shared_ptr<boost::asio::io_service::work> io_service_work_ptr;
 typedef std::vector<io_service_work_ptr> io_service_work_vector;
+typedef boost::shared_ptr<ma::io_service_loop> io_service_loop_ptr;
+typedef std::vector<io_service_loop_ptr>       io_service_loop_vector;
 
 class server_base_0 : private boost::noncopyable
 {
@@ -121,8 +124,11 @@ private:
   {
     if (exec_config.ios_per_work_thread)
     {
+      typedef ma::echo::server::pooled_session_factory::balancing_policy
+          balancing_policy;
       return boost::make_shared<ma::echo::server::pooled_session_factory>(
-          session_io_services, session_manager_config.recycled_session_count);
+          session_io_services, session_manager_config.recycled_session_count,
+          balancing_policy::least_sessions);
     }
     else
     {
@@ -170,6 +176,7 @@ public:
     : server_base_2(exec_config, session_manager_config)
     , session_work_(create_works(session_io_services_))
     , session_manager_work_(session_manager_io_service_)
+    , loops_()
     , threads_()
   {
     create_threads(exception_handler);
@@ -180,12 +187,25 @@ public:
     stop_threads();
   }
 
+  // Sessions' threads go first, then session manager's threads
+  std::vector<io_service_loop_stats> thread_stats() const
+  {
+    std::vector<io_service_loop_stats> stats;
+    stats.reserve(loops_.size());
+    for (io_service_loop_vector::const_iterator i = loops_.begin(),
+        end = loops_.end(); i != end; ++i)
+    {
+      stats.push_back((*i)->stats());
+    }
+    return stats;
+  }
+
 private:
   template <typename Handler>
   void create_threads(const Handler& handler)
   {
     typedef boost::tuple<Handler> wrapped_handler_type;
-    typedef void (*thread_func_type)(boost::asio::io_service&,
+    typedef void (*thread_func_type)(const io_service_loop_ptr&,
         wrapped_handler_type);
 
     wrapped_handler_type wrapped_handler = boost::make_tuple(handler);
@@ -197,7 +217,7 @@ private:
           end = session_io_services_.end(); i != end; ++i)
       {
         threads_.create_thread(
-            boost::bind(func, boost::ref(**i), wrapped_handler));
+            boost::bind(func, create_loop(**i), wrapped_handler));
       }
     }
     else
@@ -206,17 +226,26 @@ private:
       for (std::size_t i = 0; i != session_thread_count_; ++i)
       {
         threads_.create_thread(
-            boost::bind(func, boost::ref(io_service), wrapped_handler));
+            boost::bind(func, create_loop(io_service), wrapped_handler));
       }
     }
 
     for (std::size_t i = 0; i != session_manager_thread_count_; ++i)
     {
       threads_.create_thread(boost::bind(func,
-          boost::ref(session_manager_io_service_), wrapped_handler));
+          create_loop(session_manager_io_service_), wrapped_handler));
     }
   }
 
+  io_service_loop_ptr create_loop(boost::asio::io_service& io_service)
+  {
+    // No busy polling - io_service_loop is used for its statistics only
+    io_service_loop_ptr loop = boost::make_shared<ma::io_service_loop>(
+        boost::ref(io_service), ma::io_service_loop::duration_type());
+    loops_.push_back(loop);
+    return loop;
+  }
+
   void stop_threads()
   {
     session_manager_io_service_.stop();
@@ -225,12 +254,12 @@ private:
   }
 
   template <typename Handler>
-  static void thread_func(boost::asio::io_service& io_service,
+  static void thread_func(const io_service_loop_ptr& loop,
       boost::tuple<Handler> handler)
   {
     try
     {
-      io_service.run();
+      loop->run();
     }
     catch (...)
     {
@@ -262,6 +291,7 @@ private:
 
   const io_service_work_vector session_work_;
   const boost::asio::io_service::work session_manager_work_;
+  io_service_loop_vector loops_;
   boost::thread_group threads_;
 }; // class server_base_3
 
@@ -319,6 +349,7 @@ Service::Service(QObject* parent)
   : QObject(parent)
   , state_(ServiceState::Stopped)
   , stats_()
+  , threadStats_()
   , server_()
   , servantSignal_()
 {
@@ -356,6 +387,18 @@ session_manager_stats Service::stats() const
   }
 }
 
+std::vector<io_service_loop_stats> Service::threadStats() const
+{
+  if (server_)
+  {
+    return server_->thread_stats();
+  }
+  else
+  {
+    return threadStats_;
+  }
+}
+
 void Service::asyncStart(const execution_config& the_execution_config,
     const session_manager_config& the_session_manager_config)
 {
@@ -510,6 +553,7 @@ void Service::createServant(const execution_config& the_execution_config,
           servantSignal_)));
 
   stats_ = server_->stats();
+  threadStats_ = server_->thread_stats();
 }
 
 void Service::destroyServant()
@@ -520,6 +564,7 @@ void Service::destroyServant()
     servantSignal_.reset();
   }
   stats_ = server_->stats();
+  threadStats_ = server_->thread_stats();
   server_.reset();
 }
 
@@ -0,0 +1,400 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/assert.hpp>
+#include <boost/bind.hpp>
+#include <ma/config.hpp>
+#include <ma/async_connect.hpp>
+#include <ma/event_trace.hpp>
+#include <ma/handler_timing.hpp>
+#include <ma/custom_alloc_handler.hpp>
+#include <ma/strand_wrapped_handler.hpp>
+#include <ma/echo/server/relay_session.hpp>
+#include <ma/echo/server/detail/session_handler_binder.hpp>
+#include <ma/echo/server/handler_timing_tag.hpp>
+#include <ma/echo/server/trace_event_type.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+namespace {
+
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR) \
+    && !(defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
+
+typedef detail::io_handler_binder<relay_session>    io_handler_binder;
+typedef detail::timer_handler_binder<relay_session> timer_handler_binder;
+
+#endif
+
+} // anonymous namespace
+
+relay_session::relay_session(boost::asio::io_service& io_service,
+    const session_config& config)
+  : managed_session(io_service, config)
+  , relay_endpoint_(*config.relay_endpoint)
+  , reply_read_state_(read_state::wait)
+  , reply_write_state_(write_state::wait)
+  , upstream_connected_(false)
+  , reply_bytes_read_(0)
+  , reply_bytes_written_(0)
+  , upstream_socket_(io_service)
+  , reply_buffer_(config.buffer_size)
+{
+}
+
+void relay_session::reset()
+{
+  managed_session::reset();
+
+  reply_read_state_    = read_state::wait;
+  reply_write_state_   = write_state::wait;
+  upstream_connected_  = false;
+  reply_bytes_read_    = 0;
+  reply_bytes_written_ = 0;
+
+  {
+    boost::system::error_code error;
+    upstream_socket_.close(error);
+  }
+  reply_buffer_.reset();
+}
+
+boost::system::error_code relay_session::adopt(session& /*other*/)
+{
+  return boost::asio::error::operation_not_supported;
+}
+
+void relay_session::start_extra_io()
+{
+  start_upstream_connect();
+}
+
+boost::system::error_code relay_session::continue_extra_io()
+{
+  if (!upstream_connected_)
+  {
+    return boost::system::error_code();
+  }
+
+  if (read_state::wait == reply_read_state_)
+  {
+    cyclic_buffer::mutable_buffers_type read_buffers(
+        reply_buffer_.prepared(max_transfer_size_));
+    if (!read_buffers.empty())
+    {
+      start_reply_read(read_buffers);
+    }
+  }
+
+  if (write_state::wait == reply_write_state_)
+  {
+    cyclic_buffer::const_buffers_type write_buffers(
+        reply_buffer_.data(max_transfer_size_));
+    if (!write_buffers.empty())
+    {
+      start_reply_write(write_buffers);
+    }
+    else if (read_state::stopped == reply_read_state_)
+    {
+      // Upstream closed its part of connection and all its data is passed
+      // to client, so we can shutdown outgoing part of client connection
+      boost::system::error_code error;
+      socket_.shutdown(protocol_type::socket::shutdown_send, error);
+      reply_write_state_ = write_state::stopped;
+      return error;
+    }
+  }
+
+  return boost::system::error_code();
+}
+
+boost::system::error_code relay_session::stop_extra_io()
+{
+  // Connection to upstream is never kept
+  boost::system::error_code error;
+  upstream_socket_.close(error);
+
+  if (read_state::wait == reply_read_state_)
+  {
+    reply_read_state_ = read_state::stopped;
+  }
+  if (write_state::wait == reply_write_state_)
+  {
+    reply_write_state_ = write_state::stopped;
+  }
+
+  return error;
+}
+
+bool relay_session::is_extra_io_stopped() const
+{
+  return (read_state::stopped == reply_read_state_)
+      && (write_state::stopped == reply_write_state_);
+}
+
+bool relay_session::has_extra_io_activity() const
+{
+  return (read_state::in_progress == reply_read_state_)
+      || (write_state::in_progress == reply_write_state_);
+}
+
+void relay_session::start_socket_write(
+    const cyclic_buffer::const_buffers_type& buffers)
+{
+  // Data of client is written to upstream
+  start_socket_write_to(upstream_socket_, buffers);
+}
+
+boost::system::error_code relay_session::shutdown_socket()
+{
+  boost::system::error_code error;
+  upstream_socket_.shutdown(protocol_type::socket::shutdown_send, error);
+  return error;
+}
+
+session_stats relay_session::stats() const
+{
+  session_stats stats = managed_session::stats();
+  stats.reply_bytes_read    = reply_bytes_read_;
+  stats.reply_bytes_written = reply_bytes_written_;
+  return stats;
+}
+
+void relay_session::start_upstream_connect()
+{
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+  this_ptr shared_this = boost::static_pointer_cast<this_type>(
+      shared_from_this());
+
+  ma::async_connect(upstream_socket_, relay_endpoint_,
+      MA_STRAND_WRAP(strand_, make_custom_alloc_handler(write_allocator_,
+          [shared_this](const boost::system::error_code& error)
+  {
+    shared_this->handle_upstream_connect(error);
+  })));
+
+#elif defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+
+  ma::async_connect(upstream_socket_, relay_endpoint_,
+      MA_STRAND_WRAP(strand_, make_custom_alloc_handler(write_allocator_,
+          timer_handler_binder(&this_type::handle_upstream_connect,
+              boost::static_pointer_cast<this_type>(shared_from_this())))));
+
+#else
+
+  ma::async_connect(upstream_socket_, relay_endpoint_,
+      MA_STRAND_WRAP(strand_, make_custom_alloc_handler(write_allocator_,
+          boost::bind(&this_type::handle_upstream_connect,
+              boost::static_pointer_cast<this_type>(shared_from_this()),
+              _1))));
+
+#endif
+
+  // Data of client can't be written till connection is established
+  begin_socket_write();
+}
+
+void relay_session::handle_upstream_connect(
+    const boost::system::error_code& error)
+{
+  BOOST_ASSERT_MSG(write_state::in_progress == write_state_,
+      "Invalid write state");
+
+  boost::system::error_code connect_error = error;
+  if (!connect_error && (intern_state::stop != intern_state_))
+  {
+    upstream_connected_ = true;
+    if (no_delay_)
+    {
+      protocol_type::no_delay opt(*no_delay_);
+      upstream_socket_.set_option(opt, connect_error);
+    }
+  }
+
+  // Connect completes as the write of nothing
+  complete_write(connect_error, 0);
+}
+
+void relay_session::start_reply_read(
+    const cyclic_buffer::mutable_buffers_type& buffers)
+{
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+  this_ptr shared_this = boost::static_pointer_cast<this_type>(
+      shared_from_this());
+
+  upstream_socket_.async_read_some(buffers, MA_STRAND_WRAP(strand_,
+      MA_TIME_IO_HANDLER(handler_timing_tag::session_read,
+          make_custom_alloc_handler(reply_read_allocator_, [shared_this](
+          const boost::system::error_code& error,
+          std::size_t bytes_transferred)
+  {
+    shared_this->handle_reply_read(error, bytes_transferred);
+  }))));
+
+#elif defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+
+  upstream_socket_.async_read_some(buffers, MA_STRAND_WRAP(strand_,
+      MA_TIME_IO_HANDLER(handler_timing_tag::session_read,
+          make_custom_alloc_handler(reply_read_allocator_, io_handler_binder(
+              &this_type::handle_reply_read,
+              boost::static_pointer_cast<this_type>(shared_from_this()))))));
+
+#else
+
+  upstream_socket_.async_read_some(buffers, MA_STRAND_WRAP(strand_,
+      MA_TIME_IO_HANDLER(handler_timing_tag::session_read,
+          make_custom_alloc_handler(reply_read_allocator_, boost::bind(
+              &this_type::handle_reply_read,
+              boost::static_pointer_cast<this_type>(shared_from_this()),
+              _1, _2)))));
+
+#endif
+
+  add_pending_operation();
+  reply_read_state_ = read_state::in_progress;
+}
+
+void relay_session::handle_reply_read(const boost::system::error_code& error,
+    std::size_t bytes_transferred)
+{
+  BOOST_ASSERT_MSG(read_state::in_progress == reply_read_state_,
+      "Invalid reply read state");
+  MA_TRACE_EVENT(trace_event_type::session_read, this, error.value(),
+      bytes_transferred);
+
+  remove_pending_operation();
+  reply_bytes_read_ += bytes_transferred;
+
+  if (intern_state::stop == intern_state_)
+  {
+    reply_read_state_ = read_state::stopped;
+    continue_stop();
+    return;
+  }
+
+  reply_read_state_ = read_state::wait;
+
+  // Try to cancel timer if it is in progress and wasn't already canceled
+  if (boost::system::error_code error = cancel_timer_wait())
+  {
+    reply_read_state_ = read_state::stopped;
+    start_stop(error);
+    return;
+  }
+
+  if (error && (boost::asio::error::eof != error))
+  {
+    reply_read_state_ = read_state::stopped;
+    start_stop(error);
+    return;
+  }
+
+  // Handle read data
+  reply_buffer_.consume(bytes_transferred);
+
+  // If EOF is recieved then upstream has nothing to reply
+  if (boost::asio::error::eof == error)
+  {
+    reply_read_state_ = read_state::stopped;
+  }
+
+  continue_after_io();
+}
+
+void relay_session::start_reply_write(
+    const cyclic_buffer::const_buffers_type& buffers)
+{
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+  this_ptr shared_this = boost::static_pointer_cast<this_type>(
+      shared_from_this());
+
+  socket_.async_write_some(buffers, MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+      handler_timing_tag::session_write,
+      make_custom_alloc_handler(reply_write_allocator_, [shared_this](
+      const boost::system::error_code& error, std::size_t bytes_transferred)
+  {
+    shared_this->handle_reply_write(error, bytes_transferred);
+  }))));
+
+#elif defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+
+  socket_.async_write_some(buffers, MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+      handler_timing_tag::session_write,
+      make_custom_alloc_handler(reply_write_allocator_, io_handler_binder(
+          &this_type::handle_reply_write,
+          boost::static_pointer_cast<this_type>(shared_from_this()))))));
+
+#else
+
+  socket_.async_write_some(buffers, MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+      handler_timing_tag::session_write,
+      make_custom_alloc_handler(reply_write_allocator_, boost::bind(
+          &this_type::handle_reply_write,
+          boost::static_pointer_cast<this_type>(shared_from_this()),
+          _1, _2)))));
+
+#endif
+
+  add_pending_operation();
+  reply_write_state_ = write_state::in_progress;
+}
+
+void relay_session::handle_reply_write(const boost::system::error_code& error,
+    std::size_t bytes_transferred)
+{
+  BOOST_ASSERT_MSG(write_state::in_progress == reply_write_state_,
+      "Invalid reply write state");
+  MA_TRACE_EVENT(trace_event_type::session_write, this, error.value(),
+      bytes_transferred);
+
+  remove_pending_operation();
+  reply_bytes_written_ += bytes_transferred;
+
+  if (intern_state::stop == intern_state_)
+  {
+    reply_write_state_ = write_state::stopped;
+    continue_stop();
+    return;
+  }
+
+  reply_write_state_ = write_state::wait;
+
+  // Try to cancel timer if it is in progress and wasn't already canceled
+  if (boost::system::error_code error = cancel_timer_wait())
+  {
+    reply_write_state_ = write_state::stopped;
+    start_stop(error);
+    return;
+  }
+
+  if (error)
+  {
+    reply_write_state_ = write_state::stopped;
+    start_stop(error);
+    return;
+  }
+
+  // Handle written data
+  reply_buffer_.commit(bytes_transferred);
+  continue_after_io();
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
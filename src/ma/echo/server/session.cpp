@@ -5,120 +5,88 @@
 // file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 //
 
+#include <cerrno>
+#include <cstring>
+#include <utility>
 #include <boost/ref.hpp>
 #include <boost/assert.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <ma/config.hpp>
 #include <ma/shared_ptr_factory.hpp>
+#include <ma/event_trace.hpp>
+#include <ma/handler_timing.hpp>
 #include <ma/custom_alloc_handler.hpp>
 #include <ma/strand_wrapped_handler.hpp>
+#include <ma/detail/buffer_blocks.hpp>
 #include <ma/echo/server/error.hpp>
 #include <ma/echo/server/session.hpp>
+#include <ma/echo/server/detail/session_handler_binder.hpp>
+#include <ma/echo/server/handler_timing_tag.hpp>
+#include <ma/echo/server/trace_event_type.hpp>
 
-namespace ma {
-namespace echo {
-namespace server {
-
-namespace {
-
-#if defined(MA_HAS_RVALUE_REFS) \
-    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR) \
-    && !(defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
+#if !defined(BOOST_ASIO_HAS_IOCP)
+#include <unistd.h>
+#endif
 
-// Home-grown binders to support move semantic
-class io_handler_binder
-{
-private:
-  typedef io_handler_binder this_type;
+#if defined(__linux__)
+#include <fcntl.h>
+#include <poll.h>
+#include <netinet/tcp.h>
+#include <linux/errqueue.h>
+#endif
 
-public:
-  typedef void result_type;
+// Notifications are waited for by the wait for socket error
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) \
+    && defined(SO_EE_ORIGIN_ZEROCOPY) && (BOOST_ASIO_VERSION >= 101200)
+#define MA_ECHO_SERVER_SESSION_HAS_ZEROCOPY
+#endif
 
-  typedef void (session::*func_type)(const boost::system::error_code&,
-      const std::size_t);
+#if defined(__linux__) && defined(SPLICE_F_NONBLOCK) \
+    && !defined(BOOST_ASIO_HAS_IOCP)
+#define MA_ECHO_SERVER_SESSION_HAS_SPLICE
+#endif
 
-  template <typename SessionPtr>
-  io_handler_binder(func_type func, SessionPtr&& session)
-    : func_(func)
-    , session_(std::forward<SessionPtr>(session))
-  {
-  }
+namespace ma {
+namespace echo {
+namespace server {
 
-#if defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR) || !defined(NDEBUG)
+namespace {
 
-  io_handler_binder(this_type&& other)
-    : func_(other.func_)
-    , session_(std::move(other.session_))
-  {
-  }
+#if defined(MA_ECHO_SERVER_SESSION_HAS_ZEROCOPY) && defined(TCP_USER_TIMEOUT)
 
-  io_handler_binder(const this_type& other)
-    : func_(other.func_)
-    , session_(other.session_)
-  {
-  }
+// Stopped session waits for the release of zerocopy sends not longer
+const int zerocopy_stop_timeout_ms = 10000;
 
 #endif
 
-  void operator()(const boost::system::error_code& error,
-      const std::size_t bytes_transferred)
-  {
-    ((*session_).*func_)(error, bytes_transferred);
-  }
+#if defined(MA_HAS_HANDLER_TIMING)
 
-private:
-  func_type   func_;
-  session_ptr session_;
-}; // class io_handler_binder
-
-class timer_handler_binder
+// Delay of timer handler is measured since the expiration of timer
+boost::posix_time::ptime timer_expiration_time(
+    const steady_deadline_timer& timer)
 {
-private:
-  typedef timer_handler_binder this_type;
-
-public:
-  typedef void result_type;
-
-  typedef void (session::*func_type)(const boost::system::error_code&);
-
-  template <typename SessionPtr>
-  timer_handler_binder(func_type func, SessionPtr&& session)
-    : func_(func)
-    , session_(std::forward<SessionPtr>(session))
-  {
-  }
-
-#if defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR) || !defined(NDEBUG)
-
-  timer_handler_binder(this_type&& other)
-    : func_(other.func_)
-    , session_(std::move(other.session_))
-  {
-  }
-
-  timer_handler_binder(const this_type& other)
-    : func_(other.func_)
-    , session_(other.session_)
-  {
-  }
-
+#if defined(MA_HAS_STEADY_DEADLINE_TIMER)
+  const boost::posix_time::time_duration expires_from_now =
+      steady_time_traits::to_posix_duration(timer.expires_from_now());
+#else
+  const boost::posix_time::time_duration expires_from_now =
+      timer.expires_from_now();
 #endif
+  return boost::posix_time::microsec_clock::universal_time()
+      + expires_from_now;
+}
 
-  void operator()(const boost::system::error_code& error)
-  {
-    ((*session_).*func_)(error);
-  }
+#endif // defined(MA_HAS_HANDLER_TIMING)
 
-private:
-  func_type   func_;
-  session_ptr session_;
-}; // class timer_handler_binder
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR) \
+    && !(defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
 
-#endif // defined(MA_HAS_RVALUE_REFS)
-       //     && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
-       //     && !(defined(MA_HAS_LAMBDA)
-       //         && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
+typedef detail::io_handler_binder<session>    io_handler_binder;
+typedef detail::timer_handler_binder<session> timer_handler_binder;
 
+#endif
 
 } // anonymous namespace
 
@@ -132,23 +100,71 @@ session_ptr session::create(boost::asio::io_service& io_service,
 session::session(boost::asio::io_service& io_service,
     const session_config& config)
   : max_transfer_size_(config.max_transfer_size)
-  , socket_recv_buffer_size_(config.socket_recv_buffer_size)
-  , socket_send_buffer_size_(config.socket_send_buffer_size)
   , no_delay_(config.no_delay)
-  , inactivity_timeout_(to_optional_duration(config.inactivity_timeout))
-  , extern_state_(extern_state::ready)
   , intern_state_(intern_state::work)
   , read_state_(read_state::wait)
   , write_state_(write_state::wait)
+  , io_service_(io_service)
+  , strand_(io_service)
+  , socket_(io_service)
+  , buffer_(config.buffer_size)
+  , framed_size_(0)
+  , messages_(0)
+  , socket_recv_buffer_size_(config.socket_recv_buffer_size)
+  , socket_send_buffer_size_(config.socket_send_buffer_size)
+  , socket_busy_poll_(config.socket_busy_poll)
+  , inactivity_timeout_(to_optional_duration(config.inactivity_timeout))
+  , read_rate_limit_(config.read_rate_limit)
+  , write_rate_limit_(config.write_rate_limit)
+  , fairness_quantum_(config.fairness_quantum)
+  , write_coalescing_size_(config.write_coalescing_size)
+  , write_coalescing_delay_(config.write_coalescing_delay)
+  , zerocopy_threshold_(config.zerocopy_threshold)
+  , splice_(config.splice)
+  , frame_parser_(create_frame_parser(config.max_message_size))
+  , extern_state_(extern_state::ready)
   , timer_state_(timer_state::ready)
+  , throttle_state_(throttle_state::ready)
+  , yield_state_(yield_state::ready)
+  , zerocopy_wait_state_(zerocopy_wait_state::ready)
   , timer_wait_cancelled_(false)
   , timer_turned_(false)
+  , keep_connection_(false)
   , pending_operations_(0)
-  , io_service_(io_service)
-  , strand_(io_service)
-  , socket_(io_service)
+  , load_counter_(0)
+  , completed_writes_(0)
+  , bytes_read_(0)
+  , bytes_written_(0)
+  , memory_budget_(0)
+  , memory_held_(0)
+  , memory_reserved_(0)
+  , memory_made_(0)
+  , memory_wait_(false)
+  , read_bucket_()
+  , write_bucket_()
+  , throttle_expiry_()
+  , deficit_(0)
+  , write_coalescing_(false)
+  , write_coalescing_end_()
+  , socket_writes_(0)
+  , coalesced_writes_(0)
+  , zerocopy_(false)
+  , zerocopy_send_(false)
+  , written_position_(0)
+  , released_position_(0)
+  , zerocopy_sends_()
+  , zerocopy_first_(0)
+  , zerocopy_pending_(0)
+  , zerocopy_first_number_(0)
+  , zerocopy_writes_(0)
+  , zerocopy_copied_(0)
+  , pipe_read_end_(-1)
+  , pipe_write_end_(-1)
+  , pipe_full_(false)
+  , splice_read_size_(0)
+  , splice_write_size_(0)
   , timer_(io_service)
-  , buffer_(config.buffer_size)
+  , throttle_timer_(io_service)
   , extern_wait_handler_(io_service)
   , extern_stop_handler_(io_service)
 {
@@ -162,20 +178,154 @@ void session::reset()
   read_state_   = read_state::wait;
   write_state_  = write_state::wait;
   timer_state_  = timer_state::ready;
+  throttle_state_ = throttle_state::ready;
+  yield_state_  = yield_state::ready;
+  zerocopy_wait_state_ = zerocopy_wait_state::ready;
 
   timer_wait_cancelled_ = false;
   timer_turned_         = false;
+  keep_connection_      = false;
   pending_operations_   = 0;
+  bytes_read_           = 0;
+  bytes_written_        = 0;
+  write_coalescing_     = false;
+  socket_writes_        = 0;
+  coalesced_writes_     = 0;
+  zerocopy_             = false;
+  zerocopy_send_        = false;
+  written_position_     = 0;
+  released_position_    = 0;
+  zerocopy_first_       = 0;
+  zerocopy_pending_     = 0;
+  zerocopy_first_number_ = 0;
+  zerocopy_writes_      = 0;
+  zerocopy_copied_      = 0;
+  pipe_full_            = false;
+  splice_read_size_     = 0;
+  splice_write_size_    = 0;
+  framed_size_          = 0;
+  messages_             = 0;
+
+  // Memory of not adopted connection
+  release_memory(memory_held_);
+  memory_reserved_ = 0;
+  memory_made_     = 0;
+  memory_wait_     = false;
+  memory_budget_   = 0;
 
   // reset() might be called right after connection was established
   // so we need to be sure that the socket will be closed.
   close_socket();
+  // Data left in pipe doesn't belong to the next connection
+  close_pipe();
 
   // Post condition: filled sequence is empty, unfilled sequence is empty.
   buffer_.reset();
   extern_wait_error_.clear();
 }
 
+void session::prewarm()
+{
+  BOOST_ASSERT_MSG(extern_state::ready == extern_state_,
+      "Invalid external state");
+
+  // Initial nonfilled sequence covers the whole buffer
+  const cyclic_buffer::mutable_buffers_type buffers = buffer_.prepared();
+  for (cyclic_buffer::mutable_buffers_type::const_iterator
+      i = buffers.begin(), end = buffers.end(); i != end; ++i)
+  {
+    std::memset(boost::asio::buffer_cast<char*>(*i), 0,
+        boost::asio::buffer_size(*i));
+  }
+}
+
+boost::system::error_code session::adopt(session& other)
+{
+  BOOST_ASSERT_MSG(extern_state::ready == extern_state_,
+      "Invalid external state");
+
+  BOOST_ASSERT_MSG(extern_state::stopped == other.extern_state_,
+      "Invalid external state of adopted session");
+
+  if (!other.keep_connection_)
+  {
+    return server::error::invalid_state;
+  }
+
+#if defined(BOOST_ASIO_HAS_IOCP)
+
+  // Socket can't be moved to another completion port
+  return boost::asio::error::operation_not_supported;
+
+#else // defined(BOOST_ASIO_HAS_IOCP)
+
+  // Not yet echoed data has to fit into the buffer
+  if (boost::asio::buffer_size(other.buffer_.data())
+      > boost::asio::buffer_size(buffer_.prepared()))
+  {
+    return boost::asio::error::no_buffer_space;
+  }
+
+  boost::system::error_code error;
+  const protocol_type::endpoint local_endpoint =
+      other.socket_.local_endpoint(error);
+  if (error)
+  {
+    return error;
+  }
+
+  // Duplicate native socket to register it at io_service of this session
+#if BOOST_ASIO_VERSION < 100600
+  const int native_socket = ::dup(other.socket_.native());
+#else
+  const int native_socket = ::dup(other.socket_.native_handle());
+#endif
+  if (-1 == native_socket)
+  {
+    return boost::system::error_code(errno,
+        boost::system::system_category());
+  }
+  socket_.assign(local_endpoint.protocol(), native_socket, error);
+  if (error)
+  {
+    ::close(native_socket);
+    return error;
+  }
+
+  // Move not yet echoed data (it's in pipe if other session splices)
+  buffer_.consume(boost::asio::buffer_copy(
+      buffer_.prepared(), other.buffer_.data()));
+  std::swap(pipe_read_end_,  other.pipe_read_end_);
+  std::swap(pipe_write_end_, other.pipe_write_end_);
+  std::swap(pipe_full_,      other.pipe_full_);
+
+  // Kernel numbers zerocopy sends per connection, the sends of the other
+  // session are released by its stop
+  BOOST_ASSERT_MSG(!other.zerocopy_pending_, "Zerocopy sends are pending");
+  zerocopy_first_number_ = other.zerocopy_first_number_;
+
+  // Connection belongs to this session now
+  bytes_read_    = other.bytes_read_;
+  bytes_written_ = other.bytes_written_;
+  framed_size_   = other.framed_size_;
+  messages_      = other.messages_;
+  if (memory_budget_ == other.memory_budget_)
+  {
+    memory_held_ = other.memory_held_;
+    memory_made_ = other.memory_made_;
+    other.memory_held_ = 0;
+    other.memory_made_ = 0;
+  }
+  other.keep_connection_ = false;
+  other.close_socket();
+  other.buffer_.reset();
+
+  // Data read by the other session at stop isn't parsed yet
+  return parse_messages();
+
+#endif // defined(BOOST_ASIO_HAS_IOCP)
+}
+
 boost::system::error_code session::do_start_extern_start()
 {
   // Check external state consistency
@@ -184,6 +334,13 @@ boost::system::error_code session::do_start_extern_start()
     return server::error::invalid_state;
   }
 
+  // Buffer is used if splice isn't supported. Message mode needs data
+  // in buffer to parse it.
+  if (splice_ && !frame_parser_ && !is_pipe_opened())
+  {
+    open_pipe();
+  }
+
   // Set up configured socket options
   if (boost::system::error_code error = apply_socket_options())
   {
@@ -194,12 +351,23 @@ boost::system::error_code session::do_start_extern_start()
     read_state_   = read_state::stopped;
     write_state_  = write_state::stopped;
     timer_state_  = timer_state::stopped;
+    throttle_state_ = throttle_state::stopped;
+    yield_state_  = yield_state::stopped;
+    zerocopy_wait_state_ = zerocopy_wait_state::stopped;
+    stop_extra_io();
     // ... and notify start handler about error
     return error;
   }
 
+  // Rate limits start with full buckets
+  read_bucket_  = create_token_bucket(read_rate_limit_, max_transfer_size_);
+  write_bucket_ = create_token_bucket(write_rate_limit_, max_transfer_size_);
+  deficit_ = fairness_quantum_.get_value_or(0);
+
   // Internal states have right values already
   extern_state_ = extern_state::work;
+  MA_TRACE_EVENT(trace_event_type::session_start, this, 0, 0);
+  start_extra_io();
   continue_work();
 
   // Notify start handler about success
@@ -255,6 +423,35 @@ session::optional_error_code session::do_start_extern_wait()
   return optional_error_code();
 }
 
+session::optional_error_code session::do_start_extern_detach()
+{
+  // Connection can be detached only from the working session
+  if ((extern_state::work != extern_state_)
+      || (intern_state::work != intern_state_))
+  {
+    return boost::system::error_code(server::error::invalid_state);
+  }
+
+  // Switch external SM
+  extern_state_ = extern_state::stop;
+  complete_extern_wait(server::error::operation_aborted);
+
+  // Stop all activities without closing of the socket
+  keep_connection_ = true;
+  start_stop(server::error::operation_aborted);
+
+  // intern_state_ can be changed by start_stop
+  if (intern_state::stopped == intern_state_)
+  {
+    extern_state_ = extern_state::stopped;
+    // Notify detach handler about success
+    return boost::system::error_code();
+  }
+
+  // Park detach handler for the late call
+  return optional_error_code();
+}
+
 void session::complete_extern_stop(const boost::system::error_code& error)
 {
   if (extern_stop_handler_.has_target())
@@ -283,6 +480,8 @@ void session::handle_read(const boost::system::error_code& error,
 {
   BOOST_ASSERT_MSG(read_state::in_progress == read_state_,
       "Invalid read state");
+  MA_TRACE_EVENT(trace_event_type::session_read, this, error.value(),
+      bytes_transferred);
 
   // Split handler based on current internal state
   // that might change during read operation
@@ -311,6 +510,8 @@ void session::handle_write(const boost::system::error_code& error,
 {
   BOOST_ASSERT_MSG(write_state::in_progress == write_state_,
       "Invalid write state");
+  MA_TRACE_EVENT(trace_event_type::session_write, this, error.value(),
+      bytes_transferred);
 
   // Split handler based on current internal state
   // that might change during write operation
@@ -338,6 +539,7 @@ void session::handle_timer(const boost::system::error_code& error)
 {
   BOOST_ASSERT_MSG(timer_state::in_progress == timer_state_,
       "Invalid timer state");
+  MA_TRACE_EVENT(trace_event_type::session_timer, this, error.value(), 0);
 
   // Split handler based on current internal state
   // that might change during timer wait operation
@@ -358,6 +560,54 @@ void session::handle_timer(const boost::system::error_code& error)
   }
 }
 
+void session::handle_throttle_timer(const boost::system::error_code& error)
+{
+  BOOST_ASSERT_MSG(throttle_state::in_progress == throttle_state_,
+      "Invalid throttle state");
+
+  // Split handler based on current internal state
+  // that might change during timer wait operation
+  switch (intern_state_)
+  {
+  case intern_state::work:
+  case intern_state::shutdown:
+    handle_throttle_timer_at_work(error);
+    break;
+
+  case intern_state::stop:
+    handle_throttle_timer_at_stop(error);
+    break;
+
+  default:
+    BOOST_ASSERT_MSG(false, "Invalid internal state");
+    break;
+  }
+}
+
+void session::handle_yield()
+{
+  BOOST_ASSERT_MSG(yield_state::in_progress == yield_state_,
+      "Invalid yield state");
+
+  // Split handler based on current internal state
+  // that might change while waiting in the queue of io_service
+  switch (intern_state_)
+  {
+  case intern_state::work:
+  case intern_state::shutdown:
+    handle_yield_at_work();
+    break;
+
+  case intern_state::stop:
+    handle_yield_at_stop();
+    break;
+
+  default:
+    BOOST_ASSERT_MSG(false, "Invalid internal state");
+    break;
+  }
+}
+
 #endif // !(defined(MA_HAS_RVALUE_REFS)
        //     && defined(MA_HAS_LAMBDA)
        //     && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
@@ -374,6 +624,18 @@ void session::handle_read_at_work(const boost::system::error_code& error,
   // Register operation completion and switch to the right state
   --pending_operations_;
   read_state_ = read_state::wait;
+  bytes_read_ += bytes_transferred;
+  complete_read_memory(bytes_transferred);
+  if (read_bucket_)
+  {
+    read_bucket_->consume(bytes_transferred);
+  }
+  deficit_ -= (std::min)(deficit_, bytes_transferred);
+  if (write_coalescing_ && bytes_transferred)
+  {
+    // Read data joins the data waiting for write
+    ++coalesced_writes_;
+  }
 
   // Try to cancel timer if it is in progress and wasn't already canceled
   if (boost::system::error_code error = cancel_timer_wait())
@@ -395,6 +657,12 @@ void session::handle_read_at_work(const boost::system::error_code& error,
 
   // Handle read data
   buffer_.consume(bytes_transferred);
+  if (boost::system::error_code error = parse_messages())
+  {
+    read_state_ = read_state::stopped;
+    start_stop(error);
+    return;
+  }
 
   // If EOF is recieved then read activity (SM) is stopped
   if (boost::asio::error::eof == error)
@@ -419,6 +687,12 @@ void session::handle_read_at_shutdown(const boost::system::error_code& error,
   // Register operation completion and switch to the right state
   --pending_operations_;
   read_state_ = read_state::wait;
+  bytes_read_ += bytes_transferred;
+  complete_read_memory(bytes_transferred);
+  if (read_bucket_)
+  {
+    read_bucket_->consume(bytes_transferred);
+  }
 
   // Try to cancel timer if it is in progress and wasn't already canceled
   if (boost::system::error_code error = cancel_timer_wait())
@@ -437,6 +711,12 @@ void session::handle_read_at_shutdown(const boost::system::error_code& error,
 
   // Handle read data
   buffer_.consume(bytes_transferred);
+  if (boost::system::error_code error = parse_messages())
+  {
+    read_state_ = read_state::stopped;
+    start_stop(error);
+    return;
+  }
 
   // If EOF is recieved then read activity is stopped
   if (boost::asio::error::eof == error)
@@ -448,7 +728,7 @@ void session::handle_read_at_shutdown(const boost::system::error_code& error,
 }
 
 void session::handle_read_at_stop(const boost::system::error_code& /*error*/,
-    std::size_t /*bytes_transferred*/)
+    std::size_t bytes_transferred)
 {
   BOOST_ASSERT_MSG(intern_state::stop == intern_state_,
       "Invalid internal state");
@@ -458,6 +738,19 @@ void session::handle_read_at_stop(const boost::system::error_code& /*error*/,
 
   --pending_operations_;
   read_state_ = read_state::stopped;
+  bytes_read_ += bytes_transferred;
+  complete_read_memory(bytes_transferred);
+  if (read_bucket_)
+  {
+    read_bucket_->consume(bytes_transferred);
+  }
+
+  // Read data has to be passed to the session adopting connection
+  if (keep_connection_)
+  {
+    buffer_.consume(bytes_transferred);
+  }
+
   continue_stop();
 }
 
@@ -470,8 +763,15 @@ void session::handle_write_at_work(const boost::system::error_code& error,
   BOOST_ASSERT_MSG(write_state::in_progress == write_state_,
       "Invalid write state");
 
-  --pending_operations_;
+  complete_socket_write();
   write_state_ = write_state::wait;
+  bytes_written_ += bytes_transferred;
+  release_written_memory(bytes_transferred);
+  if (write_bucket_)
+  {
+    write_bucket_->consume(bytes_transferred);
+  }
+  deficit_ -= (std::min)(deficit_, bytes_transferred);
 
   if (boost::system::error_code error = cancel_timer_wait())
   {
@@ -490,7 +790,7 @@ void session::handle_write_at_work(const boost::system::error_code& error,
   }
 
   // Handle written data
-  buffer_.commit(bytes_transferred);
+  complete_write_data(bytes_transferred);
   continue_work();
 }
 
@@ -503,8 +803,14 @@ void session::handle_write_at_shutdown(const boost::system::error_code& error,
   BOOST_ASSERT_MSG(write_state::in_progress == write_state_,
       "Invalid write state");
 
-  --pending_operations_;
+  complete_socket_write();
   write_state_ = write_state::wait;
+  bytes_written_ += bytes_transferred;
+  release_written_memory(bytes_transferred);
+  if (write_bucket_)
+  {
+    write_bucket_->consume(bytes_transferred);
+  }
 
   // Try to cancel timer
   if (boost::system::error_code error = cancel_timer_wait())
@@ -523,12 +829,12 @@ void session::handle_write_at_shutdown(const boost::system::error_code& error,
   }
 
   // Handle written data
-  buffer_.commit(bytes_transferred);
+  complete_write_data(bytes_transferred);
   continue_shutdown(true);
 }
 
 void session::handle_write_at_stop(const boost::system::error_code& /*error*/,
-    std::size_t /*bytes_transferred*/)
+    std::size_t bytes_transferred)
 {
   BOOST_ASSERT_MSG(intern_state::stop == intern_state_,
       "Invalid internal state");
@@ -536,8 +842,21 @@ void session::handle_write_at_stop(const boost::system::error_code& /*error*/,
   BOOST_ASSERT_MSG(write_state::in_progress == write_state_,
       "Invalid write state");
 
-  --pending_operations_;
+  complete_socket_write();
   write_state_ = write_state::stopped;
+  bytes_written_ += bytes_transferred;
+  release_written_memory(bytes_transferred);
+  if (write_bucket_)
+  {
+    write_bucket_->consume(bytes_transferred);
+  }
+
+  // Written data mustn't be echoed again by the session adopting connection
+  if (keep_connection_)
+  {
+    complete_write_data(bytes_transferred);
+  }
+
   continue_stop();
 }
 
@@ -589,69 +908,222 @@ void session::handle_timer_at_stop(const boost::system::error_code& /*error*/)
   continue_stop();
 }
 
-void session::continue_work()
+void session::handle_throttle_timer_at_work(
+    const boost::system::error_code& error)
 {
-  BOOST_ASSERT_MSG(intern_state::work == intern_state_,
+  BOOST_ASSERT_MSG((intern_state::work == intern_state_)
+      || (intern_state::shutdown == intern_state_),
       "Invalid internal state");
 
-  BOOST_ASSERT_MSG(write_state::stopped != write_state_,
-      "Invalid write state");
+  BOOST_ASSERT_MSG(throttle_state::in_progress == throttle_state_,
+      "Invalid throttle state");
 
-  BOOST_ASSERT_MSG(timer_state::stopped != timer_state_,
-      "Invalid timer state");
+  --pending_operations_;
+  throttle_state_ = throttle_state::ready;
 
-  if (read_state::wait == read_state_)
+  if (error && (boost::asio::error::operation_aborted != error))
   {
-    cyclic_buffer::mutable_buffers_type read_buffers(
-        buffer_.prepared(max_transfer_size_));
-    if (!read_buffers.empty())
-    {
-      // We have enough resources to begin socket read
-      start_socket_read(read_buffers);
-    }
+    // Start session stop due to fatal error
+    throttle_state_ = throttle_state::stopped;
+    start_stop(error);
+    return;
   }
 
-  if (write_state::wait == write_state_)
+  // Rate limits are applied at work only. Timer is also aborted when its
+  // expiration is moved closer - continue_work restarts it.
+  if (intern_state::work == intern_state_)
   {
-    cyclic_buffer::const_buffers_type write_buffers(
-        buffer_.data(max_transfer_size_));
-    if (!write_buffers.empty())
-    {
-      // We have enough resources to begin socket write
-      start_socket_write(write_buffers);
-    }
+    continue_work();
   }
-
-  // Turn on timer if need
-  continue_timer_wait();
 }
 
-void session::continue_timer_wait()
+void session::handle_throttle_timer_at_stop(
+    const boost::system::error_code& /*error*/)
 {
-  BOOST_ASSERT_MSG(intern_state::stopped != intern_state_,
+  BOOST_ASSERT_MSG(intern_state::stop == intern_state_,
       "Invalid internal state");
 
-  if (inactivity_timeout_)
-  {
-    bool has_io_activity = (read_state::in_progress == read_state_)
-        || (write_state::in_progress == write_state_);
-    if (has_io_activity && !timer_turned_)
-    {
-      // Update timer expiry
-      boost::system::error_code error;
-      timer_.expires_from_now(*inactivity_timeout_, error);
-      if (error)
-      {
-        start_stop(error);
-        return;
-      }
+  BOOST_ASSERT_MSG(throttle_state::in_progress == throttle_state_,
+      "Invalid throttle state");
 
-      timer_wait_cancelled_ = true;
-      timer_turned_         = true;
+  --pending_operations_;
+  throttle_state_ = throttle_state::stopped;
+  continue_stop();
+}
 
-      // Start async wait if it can be done right now.
-      // Otherwise it will be done by handle_timer.
-      if (timer_state::ready == timer_state_)
+void session::handle_yield_at_work()
+{
+  BOOST_ASSERT_MSG((intern_state::work == intern_state_)
+      || (intern_state::shutdown == intern_state_),
+      "Invalid internal state");
+
+  BOOST_ASSERT_MSG(yield_state::in_progress == yield_state_,
+      "Invalid yield state");
+
+  --pending_operations_;
+  yield_state_ = yield_state::ready;
+
+  // Next round. Quantum is applied at work only.
+  deficit_ = fairness_quantum_.get_value_or(0);
+  if (intern_state::work == intern_state_)
+  {
+    continue_work();
+  }
+}
+
+void session::handle_yield_at_stop()
+{
+  BOOST_ASSERT_MSG(intern_state::stop == intern_state_,
+      "Invalid internal state");
+
+  BOOST_ASSERT_MSG(yield_state::in_progress == yield_state_,
+      "Invalid yield state");
+
+  --pending_operations_;
+  yield_state_ = yield_state::stopped;
+  continue_stop();
+}
+
+void session::continue_work()
+{
+  BOOST_ASSERT_MSG(intern_state::work == intern_state_,
+      "Invalid internal state");
+
+  BOOST_ASSERT_MSG(write_state::stopped != write_state_,
+      "Invalid write state");
+
+  BOOST_ASSERT_MSG(timer_state::stopped != timer_state_,
+      "Invalid timer state");
+
+  // Extra I/O (reply of upstream) and data of the other sessions aren't
+  // limited
+  if (boost::system::error_code error = continue_extra_io())
+  {
+    start_stop(error);
+    return;
+  }
+
+  // Session exhausted its quantum - it lets other sessions run and
+  // continues after them (in the next round). Yield is posted even if there
+  // is nobody to let run.
+  if (fairness_quantum_ && !deficit_)
+  {
+    if (yield_state::ready == yield_state_)
+    {
+      start_yield();
+    }
+    continue_timer_wait();
+    return;
+  }
+
+  // The least time throttled operations have to wait
+  optional_throttle_duration throttle_wait_time;
+
+  if ((read_state::wait == read_state_) && !memory_wait_ && !pipe_full_
+      && !is_read_paused())
+  {
+    const std::size_t buffer_size =
+        boost::asio::buffer_size(buffer_.prepared(max_transfer_size_));
+    if (buffer_size
+        && !is_throttled(read_bucket_, buffer_size, throttle_wait_time))
+    {
+      // Read size is limited by memory budget (if any)
+      const std::size_t read_size = reserve_read_memory(buffer_size);
+      if (read_size)
+      {
+        // We have enough resources to begin socket read
+        start_socket_read(buffer_.prepared(read_size));
+      }
+    }
+  }
+
+  if (write_state::wait == write_state_)
+  {
+    cyclic_buffer::const_buffers_type write_buffers(write_data());
+    const std::size_t write_size = boost::asio::buffer_size(write_buffers);
+    if (write_size
+        && !is_write_coalesced(write_size, throttle_wait_time)
+        && !is_throttled(write_bucket_, write_size, throttle_wait_time))
+    {
+      // We have enough resources to begin socket write
+      start_socket_write(write_buffers);
+    }
+  }
+
+  if (throttle_wait_time)
+  {
+    continue_throttle_wait(*throttle_wait_time);
+    if (intern_state::work != intern_state_)
+    {
+      return;
+    }
+  }
+
+  // Turn on timer if need
+  continue_timer_wait();
+}
+
+void session::continue_throttle_wait(const throttle_duration& wait_time)
+{
+  BOOST_ASSERT_MSG(intern_state::work == intern_state_,
+      "Invalid internal state");
+
+  const throttle_duration expiry = steady_now() + wait_time;
+  if ((throttle_state::in_progress == throttle_state_)
+      && (expiry >= throttle_expiry_))
+  {
+    // Already waiting for the time operations can be continued at
+    return;
+  }
+
+  // Update timer expiry. It aborts wait in progress (if any)
+  boost::system::error_code error;
+  throttle_timer_.expires_from_now(
+      to_steady_deadline_timer_duration(wait_time), error);
+  if (error)
+  {
+    start_stop(error);
+    return;
+  }
+  throttle_expiry_ = expiry;
+  MA_TRACE_EVENT(trace_event_type::session_throttle, this, 0,
+      wait_time.total_microseconds());
+
+  // Start async wait if it can be done right now.
+  // Otherwise it will be done by handle_throttle_timer.
+  if (throttle_state::ready == throttle_state_)
+  {
+    start_throttle_wait();
+  }
+}
+
+void session::continue_timer_wait()
+{
+  BOOST_ASSERT_MSG(intern_state::stopped != intern_state_,
+      "Invalid internal state");
+
+  if (inactivity_timeout_)
+  {
+    bool has_io_activity = (read_state::in_progress == read_state_)
+        || (write_state::in_progress == write_state_)
+        || has_extra_io_activity();
+    if (has_io_activity && !timer_turned_)
+    {
+      // Update timer expiry
+      boost::system::error_code error;
+      timer_.expires_from_now(*inactivity_timeout_, error);
+      if (error)
+      {
+        start_stop(error);
+        return;
+      }
+
+      timer_wait_cancelled_ = true;
+      timer_turned_         = true;
+
+      // Start async wait if it can be done right now.
+      // Otherwise it will be done by handle_timer.
+      if (timer_state::ready == timer_state_)
       {
         start_timer_wait();
       }
@@ -664,6 +1136,13 @@ void session::continue_shutdown(bool need_timer_restart)
   BOOST_ASSERT_MSG(intern_state::shutdown == intern_state_,
       "Invalid internal state");
 
+  // Upstream may still reply and the other sessions may still publish
+  if (boost::system::error_code error = continue_extra_io())
+  {
+    start_stop(error);
+    return;
+  }
+
   // Split control flow based on current state of read activity to simplify
   switch (read_state_)
   {
@@ -707,19 +1186,24 @@ void session::continue_shutdown_at_read_wait(bool need_timer_restart)
 
   if (write_state::stopped == write_state_)
   {
-    // We won't make any income data handling more
-    buffer_.reset();
+    // We won't make any income data handling more. Data used by kernel
+    // (zerocopy send) is dropped when kernel releases it.
+    if (!zerocopy_pending_)
+    {
+      discard_read_data();
+    }
     cyclic_buffer::mutable_buffers_type read_buffers(buffer_.prepared());
-    BOOST_ASSERT_MSG(!read_buffers.empty(), "buffer_ must be unfilled");
-
-    // We have enough resources to begin socket read
-    start_socket_read(read_buffers);
+    if (!read_buffers.empty())
+    {
+      // We have enough resources to begin socket read
+      start_socket_read(read_buffers);
+    }
   }
   else
   {
     // write_state::in_progress == write_state_
     cyclic_buffer::mutable_buffers_type read_buffers(buffer_.prepared());
-    if (!read_buffers.empty())
+    if (!read_buffers.empty() && !pipe_full_)
     {
       // We have enough resources to begin socket read
       start_socket_read(read_buffers);
@@ -770,9 +1254,8 @@ void session::continue_shutdown_at_read_stopped(bool need_timer_restart)
 
   if (write_state::wait == write_state_)
   {
-    // Write last read data
-    cyclic_buffer::const_buffers_type write_buffers(
-        buffer_.data(max_transfer_size_));
+    // Write last read data (incomplete frame is dropped)
+    cyclic_buffer::const_buffers_type write_buffers(write_data());
     if (!write_buffers.empty())
     {
       // We have enough resources to begin socket write
@@ -787,7 +1270,11 @@ void session::continue_shutdown_at_read_stopped(bool need_timer_restart)
     }
   }
 
-  if (write_state::stopped == write_state_)
+  // Relay (broadcast, HTTP, key-value) waits for upstream (feed) to pass
+  // all its data to client. Connection isn't closed while kernel uses
+  // the data of zerocopy sends.
+  if ((write_state::stopped == write_state_) && is_extra_io_stopped()
+      && !zerocopy_pending_)
   {
     // Read and write activities are stopped,
     // so we can begin normal (unrelated to any error) internal general stop
@@ -818,9 +1305,30 @@ void session::continue_stop()
     BOOST_ASSERT_MSG(timer_state::stopped == timer_state_,
         "Invalid timer state");
 
+    BOOST_ASSERT_MSG(throttle_state::stopped == throttle_state_,
+        "Invalid throttle state");
+
+    BOOST_ASSERT_MSG(yield_state::stopped == yield_state_,
+        "Invalid yield state");
+
+    BOOST_ASSERT_MSG(zerocopy_wait_state::stopped == zerocopy_wait_state_,
+        "Invalid zerocopy wait state");
+
+    BOOST_ASSERT_MSG(is_extra_io_stopped(), "Invalid extra I/O state");
+
     // Internal general stop completed
     intern_state_ = intern_state::stopped;
 
+    // Not yet echoed data is passed to the session adopting connection
+    // together with its memory
+    if (!keep_connection_)
+    {
+      // Socket is left opened only for zerocopy notifications
+      close_socket();
+      release_memory(memory_held_);
+      memory_made_ = 0;
+    }
+
     if (extern_state::stop == extern_state_)
     {
       extern_state_ = extern_state::stopped;
@@ -837,6 +1345,7 @@ void session::start_shutdown(const boost::system::error_code& error,
 
   // Siwtch general internal SM
   intern_state_ = intern_state::shutdown;
+  MA_TRACE_EVENT(trace_event_type::session_shutdown, this, error.value(), 0);
 
   // Notify external wait handler if need
   if (extern_state::work == extern_state_)
@@ -855,15 +1364,39 @@ void session::start_stop(boost::system::error_code error)
 
   // Siwtch general internal SM
   intern_state_ = intern_state::stop;
+  MA_TRACE_EVENT(trace_event_type::session_stop, this, error.value(), 0);
 
-  // Close the socket and register error if there was no stop error before
-  if (boost::system::error_code close_error = close_socket())
+  // Close the socket (or only cancel its operations if connection is kept)
+  // and register error if there was no stop error before. Kernel sends
+  // the data of zerocopy sends after close too, so the socket is closed
+  // (and buffer_ is reused) only after kernel releases them.
+  const bool keep_socket = keep_connection_ || zerocopy_pending_;
+  if (boost::system::error_code close_error =
+      keep_socket ? cancel_socket() : close_socket())
   {
     if (!error)
     {
       error = close_error;
     }
   }
+  if (zerocopy_pending_ && !keep_connection_)
+  {
+    if (boost::system::error_code limit_error = limit_zerocopy_wait())
+    {
+      if (!error)
+      {
+        error = limit_error;
+      }
+    }
+  }
+  // Extra I/O (connection to upstream) is never kept
+  if (boost::system::error_code extra_error = stop_extra_io())
+  {
+    if (!error)
+    {
+      error = extra_error;
+    }
+  }
 
   // Stop timer and register error if there was no stop error before
   if (boost::system::error_code timer_error = cancel_timer_wait())
@@ -873,6 +1406,13 @@ void session::start_stop(boost::system::error_code error)
       error = timer_error;
     }
   }
+  if (boost::system::error_code timer_error = cancel_throttle_wait())
+  {
+    if (!error)
+    {
+      error = timer_error;
+    }
+  }
 
   // Stop all internal SMs (activities) that are already ready to stop
   if (read_state::wait == read_state_)
@@ -887,6 +1427,19 @@ void session::start_stop(boost::system::error_code error)
   {
     timer_state_ = timer_state::stopped;
   }
+  if (throttle_state::ready == throttle_state_)
+  {
+    throttle_state_ = throttle_state::stopped;
+  }
+  if (yield_state::ready == yield_state_)
+  {
+    yield_state_ = yield_state::stopped;
+  }
+  // Zerocopy write in progress may need to wait for notifications
+  if ((zerocopy_wait_state::ready == zerocopy_wait_state_) && !zerocopy_send_)
+  {
+    zerocopy_wait_state_ = zerocopy_wait_state::stopped;
+  }
 
   // Notify wait handler if need
   if (extern_state::work == extern_state_)
@@ -900,17 +1453,27 @@ void session::start_stop(boost::system::error_code error)
 void session::start_socket_read(
     const cyclic_buffer::mutable_buffers_type& buffers)
 {
+  // Data read after the stop of write is dropped so it isn't spliced
+  if (is_pipe_opened() && (write_state::stopped != write_state_))
+  {
+    start_splice_read(boost::asio::buffer_size(buffers));
+    return;
+  }
+
 #if defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
 
   session_ptr shared_this = shared_from_this();
 
-  socket_.async_read_some(buffers, MA_STRAND_WRAP(strand_,
+  socket_.async_read_some(buffers, MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+      handler_timing_tag::session_read,
       make_custom_alloc_handler(read_allocator_, [shared_this](
       const boost::system::error_code& error, std::size_t bytes_transferred)
   {
     BOOST_ASSERT_MSG(read_state::in_progress == shared_this->read_state_,
         "Invalid read state");
+    MA_TRACE_EVENT(trace_event_type::session_read, shared_this.get(),
+        error.value(), bytes_transferred);
 
     // Split handler based on current internal state
     // that might change during read operation
@@ -932,20 +1495,22 @@ void session::start_socket_read(
       BOOST_ASSERT_MSG(false, "Invalid internal state");
       break;
     }
-  })));
+  }))));
 
 #elif defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
 
-  socket_.async_read_some(buffers, MA_STRAND_WRAP(strand_,
+  socket_.async_read_some(buffers, MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+      handler_timing_tag::session_read,
       make_custom_alloc_handler(read_allocator_, io_handler_binder(
-          &this_type::handle_read, shared_from_this()))));
+          &this_type::handle_read, shared_from_this())))));
 
 #else
 
-  socket_.async_read_some(buffers, MA_STRAND_WRAP(strand_,
+  socket_.async_read_some(buffers, MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+      handler_timing_tag::session_read,
       make_custom_alloc_handler(read_allocator_, boost::bind(
-          &this_type::handle_read, shared_from_this(), _1, _2))));
+          &this_type::handle_read, shared_from_this(), _1, _2)))));
 
 #endif
 
@@ -955,18 +1520,41 @@ void session::start_socket_read(
 
 void session::start_socket_write(
     const cyclic_buffer::const_buffers_type& buffers)
+{
+  if (is_pipe_opened())
+  {
+    start_splice_write(boost::asio::buffer_size(buffers));
+    return;
+  }
+
+  if (zerocopy_
+      && (boost::asio::buffer_size(buffers) >= *zerocopy_threshold_)
+      && (zerocopy_pending_ < zerocopy_sends_.size()))
+  {
+    start_zerocopy_send(buffers);
+    return;
+  }
+
+  start_socket_write_to(socket_, buffers);
+}
+
+void session::start_socket_write_to(protocol_type::socket& output,
+    const cyclic_buffer::const_buffers_type& buffers)
 {
 #if defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
 
   session_ptr shared_this = shared_from_this();
 
-  socket_.async_write_some(buffers, MA_STRAND_WRAP(strand_,
+  output.async_write_some(buffers, MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+      handler_timing_tag::session_write,
       make_custom_alloc_handler(write_allocator_, [shared_this](
       const boost::system::error_code& error, std::size_t bytes_transferred)
   {
     BOOST_ASSERT_MSG(write_state::in_progress == shared_this->write_state_,
         "Invalid write state");
+    MA_TRACE_EVENT(trace_event_type::session_write, shared_this.get(),
+        error.value(), bytes_transferred);
 
     // Split handler based on current internal state
     // that might change during write operation
@@ -988,97 +1576,1288 @@ void session::start_socket_write(
       BOOST_ASSERT_MSG(false, "Invalid internal state");
       break;
     }
-  })));
+  }))));
 
 #elif defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
 
-  socket_.async_write_some(buffers, MA_STRAND_WRAP(strand_,
+  output.async_write_some(buffers, MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+      handler_timing_tag::session_write,
       make_custom_alloc_handler(write_allocator_, io_handler_binder(
-          &this_type::handle_write, shared_from_this()))));
+          &this_type::handle_write, shared_from_this())))));
 
 #else
 
-  socket_.async_write_some(buffers, MA_STRAND_WRAP(strand_,
+  output.async_write_some(buffers, MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+      handler_timing_tag::session_write,
       make_custom_alloc_handler(write_allocator_, boost::bind(
-          &this_type::handle_write, shared_from_this(), _1, _2))));
+          &this_type::handle_write, shared_from_this(), _1, _2)))));
 
 #endif
 
+  begin_socket_write();
+}
+
+void session::begin_socket_write()
+{
   ++pending_operations_;
   write_state_ = write_state::in_progress;
+  ++socket_writes_;
+  if (load_counter_)
+  {
+    ++*load_counter_;
+  }
 }
 
-void session::start_timer_wait()
+void session::complete_socket_write()
 {
-  BOOST_ASSERT_MSG(timer_state::ready == timer_state_,
-      "Invalid timer state");
+  --pending_operations_;
+  // Counter of session isn't shared so its update is cheap
+  ++completed_writes_;
+  if (load_counter_)
+  {
+    --*load_counter_;
+  }
+}
+
+void session::post_complete_write(std::size_t size)
+{
+  const boost::system::error_code error;
 
 #if defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
 
   session_ptr shared_this = shared_from_this();
 
-  timer_.async_wait(MA_STRAND_WRAP(strand_,
-      make_custom_alloc_handler(timer_allocator_, [shared_this](
-      const boost::system::error_code& error)
+  strand_.post(make_custom_alloc_handler(write_allocator_,
+      [shared_this, error, size]()
   {
-    BOOST_ASSERT_MSG(timer_state::in_progress == shared_this->timer_state_,
-        "Invalid timer state");
-
-    // Split handler based on current internal state
-    // that might change during timer wait operation
-    switch (shared_this->intern_state_)
-    {
-    case intern_state::work:
-    case intern_state::shutdown:
-      shared_this->handle_timer_at_work(error);
-      break;
-
-    case intern_state::stop:
-      shared_this->handle_timer_at_stop(error);
-      break;
-
-    default:
-      BOOST_ASSERT_MSG(false, "Invalid internal state");
-      break;
-    }
-  })));
-
-#elif defined(MA_HAS_RVALUE_REFS) \
-    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
-
-  timer_.async_wait(MA_STRAND_WRAP(strand_,
-      make_custom_alloc_handler(timer_allocator_, timer_handler_binder(
-          &this_type::handle_timer, shared_from_this()))));
+    shared_this->complete_write(error, size);
+  }));
 
 #else
 
-  timer_.async_wait(MA_STRAND_WRAP(strand_,
-      make_custom_alloc_handler(timer_allocator_, boost::bind(
-          &this_type::handle_timer, shared_from_this(), _1))));
+  strand_.post(make_custom_alloc_handler(write_allocator_,
+      boost::bind(&this_type::complete_write, shared_from_this(), error,
+          size)));
 
 #endif
-
-  ++pending_operations_;
-  timer_state_ = timer_state::in_progress;
-  timer_wait_cancelled_ = false;
 }
 
-boost::system::error_code session::cancel_timer_wait()
+void session::complete_write(const boost::system::error_code& error,
+    std::size_t bytes_transferred)
 {
-  boost::system::error_code error;
-  // Cancellation of timer can be rather heavy so do it once
-  if (!timer_wait_cancelled_ && (timer_state::in_progress == timer_state_))
-  {
-    timer_.cancel(error);
-  }
-  if (!error)
+  MA_TRACE_EVENT(trace_event_type::session_write, this, error.value(),
+      bytes_transferred);
+
+  // Split handler based on current internal state
+  // that might change during write operation
+  switch (intern_state_)
   {
-    timer_wait_cancelled_ = true;
-    timer_turned_         = false;
+  case intern_state::work:
+    handle_write_at_work(error, bytes_transferred);
+    break;
+
+  case intern_state::shutdown:
+    handle_write_at_shutdown(error, bytes_transferred);
+    break;
+
+  case intern_state::stop:
+    handle_write_at_stop(error, bytes_transferred);
+    break;
+
+  default:
+    BOOST_ASSERT_MSG(false, "Invalid internal state");
+    break;
   }
-  return error;
+}
+
+void session::start_zerocopy_send(
+    const cyclic_buffer::const_buffers_type& buffers)
+{
+#if defined(MA_ECHO_SERVER_SESSION_HAS_ZEROCOPY)
+  const boost::asio::socket_base::message_flags flags = MSG_ZEROCOPY;
+#else
+  const boost::asio::socket_base::message_flags flags = 0;
+#endif
+
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+  session_ptr shared_this = shared_from_this();
+
+  socket_.async_send(buffers, flags, MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+      handler_timing_tag::session_write,
+      make_custom_alloc_handler(write_allocator_, [shared_this](
+      const boost::system::error_code& error, std::size_t bytes_transferred)
+  {
+    shared_this->handle_zerocopy_send(error, bytes_transferred);
+  }))));
+
+#elif defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+
+  socket_.async_send(buffers, flags, MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+      handler_timing_tag::session_write,
+      make_custom_alloc_handler(write_allocator_, io_handler_binder(
+          &this_type::handle_zerocopy_send, shared_from_this())))));
+
+#else
+
+  socket_.async_send(buffers, flags, MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+      handler_timing_tag::session_write,
+      make_custom_alloc_handler(write_allocator_, boost::bind(
+          &this_type::handle_zerocopy_send, shared_from_this(), _1, _2)))));
+
+#endif
+
+  // Kernel numbers sends in the order of start, so the send is queued
+  // before its completion to match the notification coming before it
+  zerocopy_send& send = zerocopy_sends_[
+      (zerocopy_first_ + zerocopy_pending_) % zerocopy_sends_.size()];
+  send.start    = written_position_;
+  send.released = false;
+  ++zerocopy_pending_;
+
+  zerocopy_send_ = true;
+  begin_socket_write();
+}
+
+void session::handle_zerocopy_send(const boost::system::error_code& error,
+    std::size_t bytes_transferred)
+{
+  BOOST_ASSERT_MSG(write_state::in_progress == write_state_,
+      "Invalid write state");
+
+  zerocopy_send_ = false;
+  boost::system::error_code write_error = error;
+  if (error || !bytes_transferred)
+  {
+    // Kernel doesn't number the send which sent nothing (sends could be
+    // already dropped by stop)
+    if (zerocopy_pending_)
+    {
+      --zerocopy_pending_;
+    }
+    if (boost::asio::error::no_buffer_space == error)
+    {
+      // Kernel can't pin more pages - data will be written by copying
+      zerocopy_ = false;
+      write_error.clear();
+    }
+  }
+  else
+  {
+    ++zerocopy_writes_;
+  }
+
+  // Kernel notifies about the sent data while connection is opened
+  if (zerocopy_pending_ && socket_.is_open())
+  {
+    if (boost::system::error_code wait_error = continue_zerocopy_wait())
+    {
+      if (!write_error)
+      {
+        write_error = wait_error;
+      }
+    }
+  }
+  else if ((intern_state::stop == intern_state_)
+      && (zerocopy_wait_state::ready == zerocopy_wait_state_))
+  {
+    zerocopy_pending_ = 0;
+    release_written_data();
+    zerocopy_wait_state_ = zerocopy_wait_state::stopped;
+  }
+
+  complete_write(write_error, bytes_transferred);
+}
+
+boost::system::error_code session::continue_zerocopy_wait()
+{
+  // Wait is started before the check of error queue to not miss
+  // the notification coming in between
+  if (zerocopy_pending_
+      && (zerocopy_wait_state::ready == zerocopy_wait_state_))
+  {
+    start_zerocopy_wait();
+  }
+  return receive_zerocopy_notifications();
+}
+
+void session::start_zerocopy_wait()
+{
+  BOOST_ASSERT_MSG(zerocopy_wait_state::ready == zerocopy_wait_state_,
+      "Invalid zerocopy wait state");
+
+#if defined(MA_ECHO_SERVER_SESSION_HAS_ZEROCOPY)
+
+  // Notification queued to socket error queue makes socket ready with error
+
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+  session_ptr shared_this = shared_from_this();
+
+  socket_.async_wait(protocol_type::socket::wait_error,
+      MA_STRAND_WRAP(strand_, make_custom_alloc_handler(zerocopy_allocator_,
+          [shared_this](const boost::system::error_code& error)
+  {
+    shared_this->handle_zerocopy_wait(error);
+  })));
+
+#elif defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+
+  socket_.async_wait(protocol_type::socket::wait_error,
+      MA_STRAND_WRAP(strand_, make_custom_alloc_handler(zerocopy_allocator_,
+          timer_handler_binder(&this_type::handle_zerocopy_wait,
+              shared_from_this()))));
+
+#else
+
+  socket_.async_wait(protocol_type::socket::wait_error,
+      MA_STRAND_WRAP(strand_, make_custom_alloc_handler(zerocopy_allocator_,
+          boost::bind(&this_type::handle_zerocopy_wait, shared_from_this(),
+              _1))));
+
+#endif
+
+  ++pending_operations_;
+  zerocopy_wait_state_ = zerocopy_wait_state::in_progress;
+
+#else // defined(MA_ECHO_SERVER_SESSION_HAS_ZEROCOPY)
+
+  BOOST_ASSERT_MSG(false, "Zerocopy send isn't supported");
+
+#endif // defined(MA_ECHO_SERVER_SESSION_HAS_ZEROCOPY)
+}
+
+void session::handle_zerocopy_wait(const boost::system::error_code& error)
+{
+  BOOST_ASSERT_MSG(zerocopy_wait_state::in_progress == zerocopy_wait_state_,
+      "Invalid zerocopy wait state");
+
+  --pending_operations_;
+  zerocopy_wait_state_ = zerocopy_wait_state::ready;
+
+  if (intern_state::stop == intern_state_)
+  {
+    // Socket stays opened at stop till kernel releases zerocopy sends
+    // (data passed to the session adopting connection mustn't be used by
+    // kernel too). Sends are dropped only if notifications are lost.
+    if (!socket_.is_open() || continue_zerocopy_wait())
+    {
+      zerocopy_pending_ = 0;
+      release_written_data();
+    }
+    if (zerocopy_wait_state::in_progress == zerocopy_wait_state_)
+    {
+      if (!zerocopy_pending_)
+      {
+        // Wait isn't needed any more
+        cancel_socket();
+      }
+      return;
+    }
+    zerocopy_wait_state_ = zerocopy_wait_state::stopped;
+    continue_stop();
+    return;
+  }
+
+  if (error)
+  {
+    start_stop(error);
+    return;
+  }
+
+  if (boost::system::error_code error = continue_zerocopy_wait())
+  {
+    start_stop(error);
+    return;
+  }
+
+  // Released data of buffer_ can be used by read
+  continue_after_io();
+}
+
+boost::system::error_code session::receive_zerocopy_notifications()
+{
+#if defined(MA_ECHO_SERVER_SESSION_HAS_ZEROCOPY)
+
+#if BOOST_ASIO_VERSION < 100600
+  const int native_socket = socket_.native();
+#else
+  const int native_socket = socket_.native_handle();
+#endif
+
+  for (;;)
+  {
+    char control[128];
+    ::msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_control    = control;
+    message.msg_controllen = sizeof(control);
+    if (-1 == ::recvmsg(native_socket, &message, MSG_ERRQUEUE | MSG_DONTWAIT))
+    {
+      if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+      {
+        release_written_data();
+        return boost::system::error_code();
+      }
+      return boost::system::error_code(errno,
+          boost::system::system_category());
+    }
+
+    for (::cmsghdr* header = CMSG_FIRSTHDR(&message); header;
+        header = CMSG_NXTHDR(&message, header))
+    {
+      if (!(((SOL_IP == header->cmsg_level)
+          && (IP_RECVERR == header->cmsg_type))
+          || ((SOL_IPV6 == header->cmsg_level)
+          && (IPV6_RECVERR == header->cmsg_type))))
+      {
+        continue;
+      }
+      ::sock_extended_err error;
+      std::memcpy(&error, CMSG_DATA(header), sizeof(error));
+      if ((SO_EE_ORIGIN_ZEROCOPY != error.ee_origin) || error.ee_errno)
+      {
+        continue;
+      }
+
+      // Notification holds the range of numbers of released sends
+      release_zerocopy_sends(error.ee_info, error.ee_data);
+      if (SO_EE_CODE_ZEROCOPY_COPIED & error.ee_code)
+      {
+        zerocopy_copied_ += error.ee_data - error.ee_info + 1;
+      }
+    }
+  }
+
+#else // defined(MA_ECHO_SERVER_SESSION_HAS_ZEROCOPY)
+
+  return boost::asio::error::operation_not_supported;
+
+#endif // defined(MA_ECHO_SERVER_SESSION_HAS_ZEROCOPY)
+}
+
+void session::release_zerocopy_sends(boost::uint32_t first,
+    boost::uint32_t last)
+{
+  // Numbers wrap around
+  const boost::uint32_t range_size = last - first;
+  for (std::size_t i = 0; i != zerocopy_pending_; ++i)
+  {
+    const boost::uint32_t number =
+        zerocopy_first_number_ + static_cast<boost::uint32_t>(i);
+    if (static_cast<boost::uint32_t>(number - first) <= range_size)
+    {
+      zerocopy_sends_[(zerocopy_first_ + i) % zerocopy_sends_.size()]
+          .released = true;
+    }
+  }
+
+  // Kernel usually releases sends in order, data of buffer_ is released
+  // only in order
+  while (zerocopy_pending_ && zerocopy_sends_[zerocopy_first_].released)
+  {
+    zerocopy_first_ = (zerocopy_first_ + 1) % zerocopy_sends_.size();
+    --zerocopy_pending_;
+    ++zerocopy_first_number_;
+  }
+}
+
+void session::release_written_data()
+{
+  // Data of the first not released zerocopy send and the data written
+  // after it stay in buffer_
+  const boost::uint64_t end = zerocopy_pending_
+      ? zerocopy_sends_[zerocopy_first_].start : written_position_;
+  const std::size_t size = static_cast<std::size_t>(end - released_position_);
+  released_position_ = end;
+  buffer_.commit(size);
+  framed_size_ -= (std::min)(framed_size_, size);
+}
+
+std::size_t session::written_data_size() const
+{
+  return static_cast<std::size_t>(written_position_ - released_position_);
+}
+
+void session::start_splice_read(std::size_t size)
+{
+  splice_read_size_ = size;
+
+  boost::system::error_code error;
+  std::size_t bytes_transferred;
+  if (try_splice_read(error, bytes_transferred))
+  {
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+    session_ptr shared_this = shared_from_this();
+
+    strand_.post(make_custom_alloc_handler(read_allocator_,
+        [shared_this, error, bytes_transferred]()
+    {
+      shared_this->complete_splice_read(error, bytes_transferred);
+    }));
+
+#else
+
+    strand_.post(make_custom_alloc_handler(read_allocator_,
+        boost::bind(&this_type::complete_splice_read, shared_from_this(),
+            error, bytes_transferred)));
+
+#endif
+  }
+  else
+  {
+    start_splice_read_wait();
+  }
+
+  ++pending_operations_;
+  read_state_ = read_state::in_progress;
+}
+
+void session::start_splice_read_wait()
+{
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+  session_ptr shared_this = shared_from_this();
+
+  socket_.async_read_some(boost::asio::null_buffers(),
+      MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+          handler_timing_tag::session_read,
+          make_custom_alloc_handler(read_allocator_, [shared_this](
+          const boost::system::error_code& error,
+          std::size_t bytes_transferred)
+  {
+    shared_this->handle_splice_read_wait(error, bytes_transferred);
+  }))));
+
+#elif defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+
+  socket_.async_read_some(boost::asio::null_buffers(),
+      MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+          handler_timing_tag::session_read,
+          make_custom_alloc_handler(read_allocator_, io_handler_binder(
+              &this_type::handle_splice_read_wait, shared_from_this())))));
+
+#else
+
+  socket_.async_read_some(boost::asio::null_buffers(),
+      MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+          handler_timing_tag::session_read,
+          make_custom_alloc_handler(read_allocator_, boost::bind(
+              &this_type::handle_splice_read_wait, shared_from_this(),
+              _1, _2)))));
+
+#endif
+}
+
+void session::handle_splice_read_wait(const boost::system::error_code& error,
+    std::size_t /*bytes_transferred*/)
+{
+  BOOST_ASSERT_MSG(read_state::in_progress == read_state_,
+      "Invalid read state");
+
+  if (error)
+  {
+    complete_splice_read(error, 0);
+    return;
+  }
+
+  // Stop doesn't need more data
+  if (intern_state::stop == intern_state_)
+  {
+    complete_splice_read(boost::asio::error::operation_aborted, 0);
+    return;
+  }
+
+  boost::system::error_code splice_error;
+  std::size_t bytes_transferred;
+  if (!try_splice_read(splice_error, bytes_transferred))
+  {
+    // Socket isn't ready in fact
+    start_splice_read_wait();
+    return;
+  }
+
+  complete_splice_read(splice_error, bytes_transferred);
+}
+
+bool session::try_splice_read(boost::system::error_code& error,
+    std::size_t& bytes_transferred)
+{
+  bytes_transferred = splice_from_socket(splice_read_size_, error);
+  if (boost::asio::error::would_block == error)
+  {
+    if (!is_pipe_full())
+    {
+      return false;
+    }
+    // Read has nothing to do until write takes data from pipe
+    pipe_full_ = true;
+    error.clear();
+  }
+  else if ((boost::asio::error::invalid_argument == error)
+      && buffer_.data().empty())
+  {
+    // Socket doesn't support splice - buffer is used instead of pipe
+    close_pipe();
+    error.clear();
+  }
+  return true;
+}
+
+void session::complete_splice_read(const boost::system::error_code& error,
+    std::size_t bytes_transferred)
+{
+  MA_TRACE_EVENT(trace_event_type::session_read, this, error.value(),
+      bytes_transferred);
+
+  // Split handler based on current internal state
+  // that might change during read operation
+  switch (intern_state_)
+  {
+  case intern_state::work:
+    handle_read_at_work(error, bytes_transferred);
+    break;
+
+  case intern_state::shutdown:
+    handle_read_at_shutdown(error, bytes_transferred);
+    break;
+
+  case intern_state::stop:
+    handle_read_at_stop(error, bytes_transferred);
+    break;
+
+  default:
+    BOOST_ASSERT_MSG(false, "Invalid internal state");
+    break;
+  }
+}
+
+void session::start_splice_write(std::size_t size)
+{
+  splice_write_size_ = size;
+
+  boost::system::error_code error;
+  std::size_t bytes_transferred;
+  if (try_splice_write(error, bytes_transferred))
+  {
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+    session_ptr shared_this = shared_from_this();
+
+    strand_.post(make_custom_alloc_handler(write_allocator_,
+        [shared_this, error, bytes_transferred]()
+    {
+      shared_this->complete_write(error, bytes_transferred);
+    }));
+
+#else
+
+    strand_.post(make_custom_alloc_handler(write_allocator_,
+        boost::bind(&this_type::complete_write, shared_from_this(),
+            error, bytes_transferred)));
+
+#endif
+  }
+  else
+  {
+    start_splice_write_wait();
+  }
+  begin_socket_write();
+}
+
+void session::start_splice_write_wait()
+{
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+  session_ptr shared_this = shared_from_this();
+
+  socket_.async_write_some(boost::asio::null_buffers(),
+      MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+          handler_timing_tag::session_write,
+          make_custom_alloc_handler(write_allocator_, [shared_this](
+          const boost::system::error_code& error,
+          std::size_t bytes_transferred)
+  {
+    shared_this->handle_splice_write_wait(error, bytes_transferred);
+  }))));
+
+#elif defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+
+  socket_.async_write_some(boost::asio::null_buffers(),
+      MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+          handler_timing_tag::session_write,
+          make_custom_alloc_handler(write_allocator_, io_handler_binder(
+              &this_type::handle_splice_write_wait, shared_from_this())))));
+
+#else
+
+  socket_.async_write_some(boost::asio::null_buffers(),
+      MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+          handler_timing_tag::session_write,
+          make_custom_alloc_handler(write_allocator_, boost::bind(
+              &this_type::handle_splice_write_wait, shared_from_this(),
+              _1, _2)))));
+
+#endif
+}
+
+void session::handle_splice_write_wait(const boost::system::error_code& error,
+    std::size_t /*bytes_transferred*/)
+{
+  BOOST_ASSERT_MSG(write_state::in_progress == write_state_,
+      "Invalid write state");
+
+  if (error)
+  {
+    complete_write(error, 0);
+    return;
+  }
+
+  // Not yet echoed data stays in pipe for the session adopting connection
+  if (intern_state::stop == intern_state_)
+  {
+    complete_write(boost::asio::error::operation_aborted, 0);
+    return;
+  }
+
+  boost::system::error_code splice_error;
+  std::size_t bytes_transferred;
+  if (!try_splice_write(splice_error, bytes_transferred))
+  {
+    // Socket isn't ready in fact
+    start_splice_write_wait();
+    return;
+  }
+
+  complete_write(splice_error, bytes_transferred);
+}
+
+bool session::try_splice_write(boost::system::error_code& error,
+    std::size_t& bytes_transferred)
+{
+  bytes_transferred = splice_to_socket(splice_write_size_, error);
+  if (boost::asio::error::would_block == error)
+  {
+    return false;
+  }
+  if (bytes_transferred)
+  {
+    pipe_full_ = false;
+  }
+  return true;
+}
+
+std::size_t session::splice_from_socket(std::size_t size,
+    boost::system::error_code& error)
+{
+#if defined(MA_ECHO_SERVER_SESSION_HAS_SPLICE)
+
+#if BOOST_ASIO_VERSION < 100600
+  const int native_socket = socket_.native();
+#else
+  const int native_socket = socket_.native_handle();
+#endif
+
+  const ssize_t result = ::splice(native_socket, 0, pipe_write_end_, 0, size,
+      SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (-1 == result)
+  {
+    error = boost::system::error_code(errno,
+        boost::system::system_category());
+    return 0;
+  }
+  if (!result)
+  {
+    error = boost::asio::error::eof;
+  }
+  return static_cast<std::size_t>(result);
+
+#else // defined(MA_ECHO_SERVER_SESSION_HAS_SPLICE)
+
+  (void) size;
+  error = boost::asio::error::operation_not_supported;
+  return 0;
+
+#endif // defined(MA_ECHO_SERVER_SESSION_HAS_SPLICE)
+}
+
+std::size_t session::splice_to_socket(std::size_t size,
+    boost::system::error_code& error)
+{
+#if defined(MA_ECHO_SERVER_SESSION_HAS_SPLICE)
+
+#if BOOST_ASIO_VERSION < 100600
+  const int native_socket = socket_.native();
+#else
+  const int native_socket = socket_.native_handle();
+#endif
+
+  const ssize_t result = ::splice(pipe_read_end_, 0, native_socket, 0, size,
+      SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (-1 == result)
+  {
+    error = boost::system::error_code(errno,
+        boost::system::system_category());
+    return 0;
+  }
+  return static_cast<std::size_t>(result);
+
+#else // defined(MA_ECHO_SERVER_SESSION_HAS_SPLICE)
+
+  (void) size;
+  error = boost::asio::error::operation_not_supported;
+  return 0;
+
+#endif // defined(MA_ECHO_SERVER_SESSION_HAS_SPLICE)
+}
+
+bool session::is_pipe_opened() const
+{
+  return -1 != pipe_read_end_;
+}
+
+bool session::is_pipe_full() const
+{
+#if defined(MA_ECHO_SERVER_SESSION_HAS_SPLICE)
+  ::pollfd descriptor = {pipe_write_end_, POLLOUT, 0};
+  return 0 == ::poll(&descriptor, 1, 0);
+#else
+  return false;
+#endif
+}
+
+boost::system::error_code session::open_pipe()
+{
+#if defined(MA_ECHO_SERVER_SESSION_HAS_SPLICE)
+
+  int pipe_ends[2];
+  if (-1 == ::pipe2(pipe_ends, O_NONBLOCK | O_CLOEXEC))
+  {
+    return boost::system::error_code(errno,
+        boost::system::system_category());
+  }
+  pipe_read_end_  = pipe_ends[0];
+  pipe_write_end_ = pipe_ends[1];
+
+#if defined(F_SETPIPE_SZ)
+  // Pipe can hold all data of buffer if it isn't fragmented. Otherwise
+  // reads wait for pipe, so the error is ignored.
+  const std::size_t buffer_size = boost::asio::buffer_size(buffer_.data())
+      + boost::asio::buffer_size(buffer_.prepared());
+  ::fcntl(pipe_write_end_, F_SETPIPE_SZ, static_cast<int>(buffer_size));
+#endif
+
+  return boost::system::error_code();
+
+#else // defined(MA_ECHO_SERVER_SESSION_HAS_SPLICE)
+
+  return boost::asio::error::operation_not_supported;
+
+#endif // defined(MA_ECHO_SERVER_SESSION_HAS_SPLICE)
+}
+
+void session::close_pipe()
+{
+#if defined(MA_ECHO_SERVER_SESSION_HAS_SPLICE)
+  if (is_pipe_opened())
+  {
+    ::close(pipe_read_end_);
+    ::close(pipe_write_end_);
+    pipe_read_end_  = -1;
+    pipe_write_end_ = -1;
+  }
+#endif
+}
+
+void session::start_extra_io()
+{
+}
+
+boost::system::error_code session::continue_extra_io()
+{
+  return boost::system::error_code();
+}
+
+boost::system::error_code session::stop_extra_io()
+{
+  return boost::system::error_code();
+}
+
+bool session::is_extra_io_stopped() const
+{
+  return true;
+}
+
+bool session::has_extra_io_activity() const
+{
+  return false;
+}
+
+bool session::is_read_paused() const
+{
+  return false;
+}
+
+void session::add_pending_operation()
+{
+  ++pending_operations_;
+}
+
+void session::remove_pending_operation()
+{
+  --pending_operations_;
+}
+
+void session::continue_after_io()
+{
+  // Split control flow based on current internal state
+  switch (intern_state_)
+  {
+  case intern_state::work:
+    continue_work();
+    break;
+
+  case intern_state::shutdown:
+    continue_shutdown(true);
+    break;
+
+  default:
+    BOOST_ASSERT_MSG(false, "Invalid internal state");
+    break;
+  }
+}
+
+boost::system::error_code session::parse_messages()
+{
+  if (!frame_parser_)
+  {
+    return boost::system::error_code();
+  }
+
+  // All the frames read by one socket read are parsed in one pass
+  boost::system::error_code error;
+  const frame_parser::batch batch =
+      frame_parser_->parse(buffer_.data(), framed_size_, error);
+  framed_size_ += batch.size;
+  messages_    += batch.count;
+  return error;
+}
+
+cyclic_buffer::const_buffers_type session::write_data() const
+{
+  // Data used by kernel (zerocopy send) is written already
+  if (const std::size_t written_size = written_data_size())
+  {
+    const ma::detail::buffer_blocks data(buffer_.data());
+    const std::size_t size = frame_parser_ ? framed_size_ : data.size();
+    if (size <= written_size)
+    {
+      return cyclic_buffer::const_buffers_type();
+    }
+    return data.sub(written_size,
+        (std::min)(max_transfer_size_, size - written_size));
+  }
+  if (!frame_parser_)
+  {
+    return buffer_.data(max_transfer_size_);
+  }
+  if (!framed_size_)
+  {
+    return cyclic_buffer::const_buffers_type();
+  }
+  return buffer_.data((std::min)(max_transfer_size_, framed_size_));
+}
+
+void session::complete_write_data(std::size_t bytes_transferred)
+{
+  written_position_ += bytes_transferred;
+  release_written_data();
+}
+
+void session::discard_read_data()
+{
+  buffer_.reset();
+  framed_size_ = 0;
+}
+
+std::size_t session::reserve_read_memory(std::size_t size)
+{
+  if (!memory_budget_ || !size)
+  {
+    return size;
+  }
+
+  // Memory can be granted already while waiting
+  if (!memory_reserved_)
+  {
+    memory_reserved_ = memory_budget_->acquire(size, boost::bind(
+        &this_type::post_memory_grant, shared_from_this(), memory_budget_,
+        _1));
+    if (!memory_reserved_)
+    {
+      // Writes go on and release memory, read waits for grant
+      memory_wait_ = true;
+      return 0;
+    }
+    memory_held_ += memory_reserved_;
+  }
+
+  if (memory_reserved_ > size)
+  {
+    release_memory(memory_reserved_ - size);
+    memory_reserved_ = size;
+  }
+  return memory_reserved_;
+}
+
+void session::complete_read_memory(std::size_t bytes_transferred)
+{
+  // Read data stays accounted till it is written, the rest is released
+  if (memory_reserved_)
+  {
+    const std::size_t unused =
+        memory_reserved_ - (std::min)(memory_reserved_, bytes_transferred);
+    memory_reserved_ = 0;
+    release_memory(unused);
+  }
+}
+
+void session::release_written_memory(std::size_t bytes_transferred)
+{
+  // Data read at shutdown isn't accounted
+  release_memory((std::min)(memory_held_ - memory_reserved_ - memory_made_,
+      bytes_transferred));
+}
+
+void session::acquire_made_memory(std::size_t size)
+{
+  // Memory of stopped session is released already
+  if (!memory_budget_ || !size || (intern_state::stopped == intern_state_))
+  {
+    return;
+  }
+  memory_budget_->force_acquire(size);
+  memory_held_ += size;
+  memory_made_ += size;
+}
+
+void session::release_made_memory(std::size_t size)
+{
+  const std::size_t released = (std::min)(memory_made_, size);
+  memory_made_ -= released;
+  release_memory(released);
+}
+
+void session::release_memory(std::size_t size)
+{
+  if (size)
+  {
+    memory_held_ -= size;
+    memory_budget_->release(size);
+  }
+}
+
+void session::post_memory_grant(memory_budget* budget, std::size_t size)
+{
+  // Called by the thread releasing memory
+  strand_.post(boost::bind(&this_type::handle_memory_grant,
+      shared_from_this(), budget, size));
+}
+
+void session::handle_memory_grant(memory_budget* budget, std::size_t size)
+{
+  // Session could stop (and even be reused) while waiting
+  if (!memory_wait_ || (budget != memory_budget_)
+      || (intern_state::work != intern_state_))
+  {
+    budget->release(size);
+    return;
+  }
+
+  memory_wait_      = false;
+  memory_held_     += size;
+  memory_reserved_ += size;
+  continue_work();
+}
+
+session_stats session::stats() const
+{
+  typedef session_stats::operation_state operation_state;
+
+  session_stats stats;
+  stats.bytes_read    = bytes_read_;
+  stats.bytes_written = bytes_written_;
+  stats.buffer_filled = boost::asio::buffer_size(buffer_.data());
+  stats.buffer_size   = stats.buffer_filled
+      + boost::asio::buffer_size(buffer_.prepared());
+  stats.socket_writes    = socket_writes_;
+  stats.coalesced_writes = coalesced_writes_;
+  stats.zerocopy_writes  = zerocopy_writes_;
+  stats.zerocopy_copied  = zerocopy_copied_;
+  stats.messages         = messages_;
+  if (read_bucket_ || write_bucket_)
+  {
+    const throttle_duration now = steady_now();
+    if (read_bucket_)
+    {
+      stats.read_throttled_time = read_bucket_->throttled_time(now);
+    }
+    if (write_bucket_)
+    {
+      stats.write_throttled_time = write_bucket_->throttled_time(now);
+    }
+  }
+
+  switch (read_state_)
+  {
+  case read_state::wait:
+    stats.read_state = operation_state::wait;
+    break;
+  case read_state::in_progress:
+    stats.read_state = operation_state::in_progress;
+    break;
+  default:
+    stats.read_state = operation_state::stopped;
+    break;
+  }
+
+  switch (write_state_)
+  {
+  case write_state::wait:
+    stats.write_state = operation_state::wait;
+    break;
+  case write_state::in_progress:
+    stats.write_state = operation_state::in_progress;
+    break;
+  default:
+    stats.write_state = operation_state::stopped;
+    break;
+  }
+
+  switch (timer_state_)
+  {
+  case timer_state::ready:
+    stats.timer_state = operation_state::wait;
+    break;
+  case timer_state::in_progress:
+    stats.timer_state = operation_state::in_progress;
+    break;
+  default:
+    stats.timer_state = operation_state::stopped;
+    break;
+  }
+
+  return stats;
+}
+
+void session::start_timer_wait()
+{
+  BOOST_ASSERT_MSG(timer_state::ready == timer_state_,
+      "Invalid timer state");
+
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+  session_ptr shared_this = shared_from_this();
+
+  timer_.async_wait(MA_STRAND_WRAP(strand_, MA_TIME_HANDLER_AT(
+      handler_timing_tag::session_timer, timer_expiration_time(timer_),
+      make_custom_alloc_handler(timer_allocator_, [shared_this](
+      const boost::system::error_code& error)
+  {
+    BOOST_ASSERT_MSG(timer_state::in_progress == shared_this->timer_state_,
+        "Invalid timer state");
+    MA_TRACE_EVENT(trace_event_type::session_timer, shared_this.get(),
+        error.value(), 0);
+
+    // Split handler based on current internal state
+    // that might change during timer wait operation
+    switch (shared_this->intern_state_)
+    {
+    case intern_state::work:
+    case intern_state::shutdown:
+      shared_this->handle_timer_at_work(error);
+      break;
+
+    case intern_state::stop:
+      shared_this->handle_timer_at_stop(error);
+      break;
+
+    default:
+      BOOST_ASSERT_MSG(false, "Invalid internal state");
+      break;
+    }
+  }))));
+
+#elif defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+
+  timer_.async_wait(MA_STRAND_WRAP(strand_, MA_TIME_HANDLER_AT(
+      handler_timing_tag::session_timer, timer_expiration_time(timer_),
+      make_custom_alloc_handler(timer_allocator_, timer_handler_binder(
+          &this_type::handle_timer, shared_from_this())))));
+
+#else
+
+  timer_.async_wait(MA_STRAND_WRAP(strand_, MA_TIME_HANDLER_AT(
+      handler_timing_tag::session_timer, timer_expiration_time(timer_),
+      make_custom_alloc_handler(timer_allocator_, boost::bind(
+          &this_type::handle_timer, shared_from_this(), _1)))));
+
+#endif
+
+  ++pending_operations_;
+  timer_state_ = timer_state::in_progress;
+  timer_wait_cancelled_ = false;
+}
+
+boost::system::error_code session::cancel_timer_wait()
+{
+  boost::system::error_code error;
+  // Cancellation of timer can be rather heavy so do it once
+  if (!timer_wait_cancelled_ && (timer_state::in_progress == timer_state_))
+  {
+    timer_.cancel(error);
+  }
+  if (!error)
+  {
+    timer_wait_cancelled_ = true;
+    timer_turned_         = false;
+  }
+  return error;
+}
+
+void session::start_throttle_wait()
+{
+  BOOST_ASSERT_MSG(throttle_state::ready == throttle_state_,
+      "Invalid throttle state");
+
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+  session_ptr shared_this = shared_from_this();
+
+  throttle_timer_.async_wait(MA_STRAND_WRAP(strand_, MA_TIME_HANDLER_AT(
+      handler_timing_tag::session_throttle,
+      timer_expiration_time(throttle_timer_),
+      make_custom_alloc_handler(throttle_allocator_, [shared_this](
+      const boost::system::error_code& error)
+  {
+    BOOST_ASSERT_MSG(
+        throttle_state::in_progress == shared_this->throttle_state_,
+        "Invalid throttle state");
+
+    // Split handler based on current internal state
+    // that might change during timer wait operation
+    switch (shared_this->intern_state_)
+    {
+    case intern_state::work:
+    case intern_state::shutdown:
+      shared_this->handle_throttle_timer_at_work(error);
+      break;
+
+    case intern_state::stop:
+      shared_this->handle_throttle_timer_at_stop(error);
+      break;
+
+    default:
+      BOOST_ASSERT_MSG(false, "Invalid internal state");
+      break;
+    }
+  }))));
+
+#elif defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+
+  throttle_timer_.async_wait(MA_STRAND_WRAP(strand_, MA_TIME_HANDLER_AT(
+      handler_timing_tag::session_throttle,
+      timer_expiration_time(throttle_timer_),
+      make_custom_alloc_handler(throttle_allocator_, timer_handler_binder(
+          &this_type::handle_throttle_timer, shared_from_this())))));
+
+#else
+
+  throttle_timer_.async_wait(MA_STRAND_WRAP(strand_, MA_TIME_HANDLER_AT(
+      handler_timing_tag::session_throttle,
+      timer_expiration_time(throttle_timer_),
+      make_custom_alloc_handler(throttle_allocator_, boost::bind(
+          &this_type::handle_throttle_timer, shared_from_this(), _1)))));
+
+#endif
+
+  ++pending_operations_;
+  throttle_state_ = throttle_state::in_progress;
+}
+
+boost::system::error_code session::cancel_throttle_wait()
+{
+  boost::system::error_code error;
+  if (throttle_state::in_progress == throttle_state_)
+  {
+    throttle_timer_.cancel(error);
+  }
+  return error;
+}
+
+void session::start_yield()
+{
+  BOOST_ASSERT_MSG(yield_state::ready == yield_state_,
+      "Invalid yield state");
+
+  // Posted handler is queued behind the handlers which are ready to run
+  // already. It can't be cancelled so stop waits for it.
+
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+  session_ptr shared_this = shared_from_this();
+
+  strand_.post(make_custom_alloc_handler(yield_allocator_, [shared_this]()
+  {
+    BOOST_ASSERT_MSG(yield_state::in_progress == shared_this->yield_state_,
+        "Invalid yield state");
+
+    // Split handler based on current internal state
+    // that might change while waiting in the queue of io_service
+    switch (shared_this->intern_state_)
+    {
+    case intern_state::work:
+    case intern_state::shutdown:
+      shared_this->handle_yield_at_work();
+      break;
+
+    case intern_state::stop:
+      shared_this->handle_yield_at_stop();
+      break;
+
+    default:
+      BOOST_ASSERT_MSG(false, "Invalid internal state");
+      break;
+    }
+  }));
+
+#else
+
+  strand_.post(make_custom_alloc_handler(yield_allocator_,
+      boost::bind(&this_type::handle_yield, shared_from_this())));
+
+#endif
+
+  ++pending_operations_;
+  yield_state_ = yield_state::in_progress;
 }
 
 boost::system::error_code session::shutdown_socket()
@@ -1088,6 +2867,13 @@ boost::system::error_code session::shutdown_socket()
   return error;
 }
 
+boost::system::error_code session::cancel_socket()
+{
+  boost::system::error_code error;
+  socket_.cancel(error);
+  return error;
+}
+
 boost::system::error_code session::close_socket()
 {
   boost::system::error_code error;
@@ -1095,6 +2881,19 @@ boost::system::error_code session::close_socket()
   return error;
 }
 
+boost::system::error_code session::limit_zerocopy_wait()
+{
+#if defined(MA_ECHO_SERVER_SESSION_HAS_ZEROCOPY) && defined(TCP_USER_TIMEOUT)
+  typedef boost::asio::detail::socket_option::integer<
+      IPPROTO_TCP, TCP_USER_TIMEOUT> user_timeout;
+  boost::system::error_code error;
+  socket_.set_option(user_timeout(zerocopy_stop_timeout_ms), error);
+  return error;
+#else
+  return boost::system::error_code();
+#endif
+}
+
 boost::system::error_code session::apply_socket_options()
 {
   typedef protocol_type::socket socket_type;
@@ -1144,9 +2943,135 @@ boost::system::error_code session::apply_socket_options()
     }
   }
 
+  if (socket_busy_poll_)
+  {
+#if defined(SO_BUSY_POLL)
+    typedef boost::asio::detail::socket_option::integer<
+        SOL_SOCKET, SO_BUSY_POLL> busy_poll;
+    boost::system::error_code error;
+    busy_poll opt(*socket_busy_poll_);
+    socket_.set_option(opt, error);
+    if (error)
+    {
+      return error;
+    }
+#else
+    return boost::system::errc::make_error_code(
+        boost::system::errc::operation_not_supported);
+#endif
+  }
+
+  if (zerocopy_threshold_)
+  {
+#if defined(MA_ECHO_SERVER_SESSION_HAS_ZEROCOPY)
+    typedef boost::asio::detail::socket_option::boolean<
+        SOL_SOCKET, SO_ZEROCOPY> zerocopy;
+    boost::system::error_code error;
+    socket_.set_option(zerocopy(true), error);
+    // Data is written by copying if zerocopy isn't supported
+    zerocopy_ = !error;
+#endif
+  }
+
+  // Splice is tried without wait for socket readiness so it mustn't block
+  if (is_pipe_opened())
+  {
+    boost::system::error_code error;
+    socket_.non_blocking(true, error);
+    if (error)
+    {
+      return error;
+    }
+  }
+
   return boost::system::error_code();
 }
 
+bool session::is_throttled(optional_token_bucket& bucket, std::size_t size,
+    optional_throttle_duration& wait_time)
+{
+  if (!bucket)
+  {
+    return false;
+  }
+  const throttle_duration bucket_wait_time = bucket->wait_time(size,
+      steady_now());
+  if (bucket_wait_time <= throttle_duration())
+  {
+    return false;
+  }
+  if (!wait_time || (bucket_wait_time < *wait_time))
+  {
+    wait_time = bucket_wait_time;
+  }
+  return true;
+}
+
+bool session::is_write_coalesced(std::size_t size,
+    optional_throttle_duration& wait_time)
+{
+  // Write starts at once if it is large enough or if there is no room for
+  // more data
+  if (!write_coalescing_size_ || (size >= *write_coalescing_size_)
+      || (size >= max_transfer_size_) || buffer_.prepared().empty())
+  {
+    write_coalescing_ = false;
+    return false;
+  }
+
+  const throttle_duration now = steady_now();
+  if (!write_coalescing_)
+  {
+    write_coalescing_     = true;
+    write_coalescing_end_ = now + *write_coalescing_delay_;
+  }
+  if (now >= write_coalescing_end_)
+  {
+    write_coalescing_ = false;
+    return false;
+  }
+
+  const throttle_duration coalescing_wait_time = write_coalescing_end_ - now;
+  if (!wait_time || (coalescing_wait_time < *wait_time))
+  {
+    wait_time = coalescing_wait_time;
+  }
+  return true;
+}
+
+session::optional_token_bucket session::create_token_bucket(
+    const session_config::optional_size& rate_limit,
+    std::size_t max_transfer_size)
+{
+  if (!rate_limit)
+  {
+    return optional_token_bucket();
+  }
+  return token_bucket(*rate_limit,
+      (std::max)(max_transfer_size, *rate_limit / 10), steady_now());
+}
+
+session::optional_frame_parser session::create_frame_parser(
+    const session_config::optional_size& max_message_size)
+{
+  if (!max_message_size)
+  {
+    return optional_frame_parser();
+  }
+  return frame_parser(*max_message_size);
+}
+
+session::throttle_duration session::steady_now()
+{
+#if defined(MA_HAS_STEADY_DEADLINE_TIMER)
+  return steady_time_traits::to_posix_duration(
+      steady_time_traits::now().time_since_epoch());
+#else
+  return boost::posix_time::microsec_clock::universal_time()
+      - boost::posix_time::ptime(boost::gregorian::date(1970, 1, 1));
+#endif
+}
+
 #if defined (MA_HAS_STEADY_DEADLINE_TIMER)
 
 session::optional_duration session::to_optional_duration(
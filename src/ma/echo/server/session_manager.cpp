@@ -6,16 +6,26 @@
 //
 
 #include <new>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
 #include <boost/ref.hpp>
 #include <boost/assert.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/smart_ptr/detail/atomic_count.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/utility/addressof.hpp>
 #include <ma/config.hpp>
+#include <ma/event_trace.hpp>
+#include <ma/handler_timing.hpp>
 #include <ma/shared_ptr_factory.hpp>
+#include <ma/broadcast_hub.hpp>
 #include <ma/custom_alloc_handler.hpp>
 #include <ma/strand_wrapped_handler.hpp>
 #include <ma/echo/server/error.hpp>
-#include <ma/echo/server/session.hpp>
+#include <ma/echo/server/handler_timing_tag.hpp>
+#include <ma/echo/server/trace_event_type.hpp>
+#include <ma/echo/server/managed_session.hpp>
 #include <ma/echo/server/session_factory.hpp>
 #include <ma/echo/server/session_manager.hpp>
 
@@ -29,7 +39,7 @@ class session_release_guard : private boost::noncopyable
 {
 public:
   explicit session_release_guard(session_factory& factory,
-      const session_ptr& session)
+      const managed_session_ptr& session)
     : factory_(factory)
     , session_(session)
   {
@@ -43,22 +53,25 @@ public:
     }
   }
 
-  session_ptr release()
+  managed_session_ptr release()
   {
 #if defined(MA_HAS_RVALUE_REFS)
     return std::move(session_);
 #else
-    session_ptr tmp;
+    managed_session_ptr tmp;
     tmp.swap(session_);
     return tmp;
 #endif
   }
 
 private:
-  session_factory& factory_;
-  session_ptr      session_;
+  session_factory&    factory_;
+  managed_session_ptr session_;
 }; // class session_release_guard
 
+// Number of the most active sessions considered for moving at once
+const std::size_t max_migration_candidates = 4;
+
 } // anonymous namespace
 
 #if defined(MA_HAS_RVALUE_REFS) \
@@ -75,15 +88,15 @@ public:
   typedef void result_type;
 
   typedef void (session_manager::*func_type)(
-      const session_manager::session_wrapper_ptr&,
+      const managed_session_ptr&,
       const boost::system::error_code&);
 
-  template <typename SessionManagerPtr, typename SessionWrapperPtr>
+  template <typename SessionManagerPtr, typename SessionPtr>
   accept_handler_binder(func_type func, SessionManagerPtr&& session_manager,
-      SessionWrapperPtr&& session)
+      SessionPtr&& session)
     : func_(func)
     , session_manager_(std::forward<SessionManagerPtr>(session_manager))
-    , session_(std::forward<SessionWrapperPtr>(session))
+    , session_(std::forward<SessionPtr>(session))
   {
   }
 
@@ -113,7 +126,7 @@ public:
 private:
   func_type func_;
   session_manager_ptr session_manager_;
-  session_manager::session_wrapper_ptr session_;
+  managed_session_ptr session_;
 }; // class session_manager::accept_handler_binder
 
 class session_manager::session_dispatch_binder
@@ -125,15 +138,15 @@ public:
   typedef void result_type;
 
   typedef void (*func_type)(const session_manager_weak_ptr&,
-    const session_manager::session_wrapper_ptr&,
+    const managed_session_ptr&,
     const boost::system::error_code&);
 
-  template <typename SessionManagerPtr, typename SessionWrapperPtr>
+  template <typename SessionManagerPtr, typename SessionPtr>
   session_dispatch_binder(func_type func, SessionManagerPtr&& session_manager,
-      SessionWrapperPtr&& session)
+      SessionPtr&& session)
     : func_(func)
     , session_manager_(std::forward<SessionManagerPtr>(session_manager))
-    , session_(std::forward<SessionWrapperPtr>(session))
+    , session_(std::forward<SessionPtr>(session))
   {
   }
 
@@ -163,7 +176,7 @@ public:
 private:
   func_type func_;
   session_manager_weak_ptr session_manager_;
-  session_manager::session_wrapper_ptr session_;
+  managed_session_ptr session_;
 }; // class session_manager::session_dispatch_binder
 
 class session_manager::session_handler_binder
@@ -175,15 +188,15 @@ public:
   typedef void result_type;
 
   typedef void (session_manager::*func_type)(
-      const session_manager::session_wrapper_ptr&,
+      const managed_session_ptr&,
       const boost::system::error_code&);
 
-  template <typename SessionManagerPtr, typename SessionWrapperPtr>
+  template <typename SessionManagerPtr, typename SessionPtr>
   session_handler_binder(func_type func, SessionManagerPtr&& session_manager,
-      SessionWrapperPtr&& session, const boost::system::error_code& error)
+      SessionPtr&& session, const boost::system::error_code& error)
     : func_(func)
     , session_manager_(std::forward<SessionManagerPtr>(session_manager))
-    , session_(std::forward<SessionWrapperPtr>(session))
+    , session_(std::forward<SessionPtr>(session))
     , error_(error)
   {
   }
@@ -216,7 +229,7 @@ public:
 private:
   func_type func_;
   session_manager_ptr session_manager_;
-  session_manager::session_wrapper_ptr session_;
+  managed_session_ptr session_;
   boost::system::error_code error_;
 }; // class session_manager::session_handler_binder
 
@@ -293,6 +306,12 @@ void session_manager::stats_collector::session_stopped(
   ++stats_.error_stopped;
 }
 
+void session_manager::stats_collector::session_migrated()
+{
+  lock_guard_type lock_guard(mutex_);
+  ++stats_.migrated;
+}
+
 void session_manager::stats_collector::reset()
 {
   lock_guard_type lock_guard(mutex_);
@@ -302,203 +321,95 @@ void session_manager::stats_collector::reset()
   stats_.out_of_work       = 0;
   stats_.timed_out         = 0;
   stats_.error_stopped     = 0;
+  stats_.migrated          = 0;
 }
 
-class session_manager::session_wrapper : public session_wrapper_base
+// Requests statistics of sessions in chunks, so the strands of sessions
+// (and the threads running them) aren't flooded by requests
+class session_manager::snapshot_collector
+  : public boost::enable_shared_from_this<snapshot_collector>
+  , private boost::noncopyable
 {
 private:
-  typedef session_wrapper this_type;
-
-  struct state_type
-  {
-    enum value_t {ready, start, work, stop, stopped};
-  };
-
-  typedef in_place_handler_allocator<144> start_wait_allocator_type;
+  typedef snapshot_collector this_type;
 
 public:
-  typedef protocol_type::endpoint         endpoint_type;
-  typedef protocol_type::socket           socket_type;
-  typedef start_wait_allocator_type       start_allocator_type;
-  typedef start_wait_allocator_type       wait_allocator_type;
-  typedef in_place_handler_allocator<144> stop_allocator_type;
-
-  explicit session_wrapper(const session_ptr& session)
-    : session_(session)
-    , state_(state_type::ready)
-    , pending_operations_(0)
-  {
-  }
-
-#if !defined(NDEBUG)
-  ~session_wrapper()
-  {
-  }
-#endif
-
-  void attach(const session_ptr& session)
-  {
-    session_ = session;
-    state_ = state_type::ready;
-    pending_operations_ = 0;
-  }
-
-  session_ptr detach()
-  {
-#if defined(MA_HAS_RVALUE_REFS)
-    return std::move(session_);
-#else
-    session_ptr tmp;
-    tmp.swap(session_);
-    return tmp;
-#endif
-  }
-
-  socket_type& socket()
-  {
-    return session_->socket();
-  }
-
-  endpoint_type& remote_endpoint()
-  {
-    return remote_endpoint_;
-  }
-
-  const endpoint_type& remote_endpoint() const
-  {
-    return remote_endpoint_;
-  }
-
-  start_allocator_type& start_allocator()
-  {
-    return start_wait_allocator_;
-  }
-
-  wait_allocator_type& wait_allocator()
-  {
-    return start_wait_allocator_;
-  }
-
-  stop_allocator_type& stop_allocator()
-  {
-    return stop_allocator_;
-  }
-
-  bool has_pending_operations() const
-  {
-    return 0 != pending_operations_;
-  }
-
-  bool starting() const
+  snapshot_collector(boost::asio::io_service& io_service,
+      const snapshot_handler& handler, std::size_t session_count)
+    : io_service_(io_service)
+    , handler_(handler)
+    , next_(0)
+    , pending_(0)
   {
-    return state_type::start == state_;
+    sessions_.reserve(session_count);
+    snapshots_.reserve(session_count);
   }
 
-  bool stopping() const
+  void add(const managed_session_ptr& session,
+      const session_snapshot::time_duration_type& age)
   {
-    return state_type::stop == state_;
+    session_snapshot snapshot;
+    snapshot.remote_endpoint = session->remote_endpoint();
+    snapshot.age = age;
+    snapshots_.push_back(snapshot);
+    sessions_.push_back(session);
   }
 
-  bool working() const
+  void continue_collection()
   {
-    return state_type::work == state_;
-  }
-
-  void operation_completed()
-  {
-    --pending_operations_;
-  }
-
-  void mark_stopped()
-  {
-    state_ = state_type::stopped;
-  }
-
-  void mark_working()
-  {
-    state_ = state_type::work;
-  }
-
-#if defined(MA_HAS_RVALUE_REFS)
-
-  template <typename Handler>
-  void async_start(Handler&& handler)
-  {
-    session_->async_start(make_custom_alloc_handler(
-        start_wait_allocator_, std::forward<Handler>(handler)));
-    start_started();
-  }
-
-  template <typename Handler>
-  void async_stop(Handler&& handler)
-  {
-    session_->async_stop(make_custom_alloc_handler(
-        stop_allocator_, std::forward<Handler>(handler)));
-    stop_started();
-  }
-
-  template <typename Handler>
-  void async_wait(Handler&& handler)
-  {
-    session_->async_wait(make_custom_alloc_handler(
-        start_wait_allocator_, std::forward<Handler>(handler)));
-    wait_started();
-  }
-
-#else // defined(MA_HAS_RVALUE_REFS)
+    if (sessions_.size() == next_)
+    {
+      sessions_.clear();
+      io_service_.post(boost::bind(&this_type::complete, shared_from_this()));
+      return;
+    }
 
-  template <typename Handler>
-  void async_start(const Handler& handler)
-  {
-    session_->async_start(make_custom_alloc_handler(
-        start_wait_allocator_, handler));
-    start_started();
-  }
+    const std::size_t begin = next_;
+    next_ = (std::min)(next_ + chunk_size, sessions_.size());
 
-  template <typename Handler>
-  void async_stop(const Handler& handler)
-  {
-    session_->async_stop(make_custom_alloc_handler(
-        stop_allocator_, handler));
-    stop_started();
+    // Extra pending request guards against completion of the chunk
+    // before all its requests are started
+    ++pending_;
+    for (std::size_t i = begin; i != next_; ++i)
+    {
+      ++pending_;
+      sessions_[i]->async_stats(boost::bind(&this_type::handle_stats,
+          shared_from_this(), i, _1));
+    }
+    complete_request();
   }
 
-  template <typename Handler>
-  void async_wait(const Handler& handler)
-  {
-    session_->async_wait(make_custom_alloc_handler(
-        start_wait_allocator_, handler));
-    wait_started();
-  }
+private:
+  typedef std::vector<managed_session_ptr> session_vector;
 
-#endif // defined(MA_HAS_RVALUE_REFS)
+  static const std::size_t chunk_size = 64;
 
-private:
-  void start_started()
+  void handle_stats(std::size_t index, const session_stats& stats)
   {
-    state_ = state_type::start;
-    ++pending_operations_;
+    snapshots_[index].stats = stats;
+    complete_request();
   }
 
-  void stop_started()
+  void complete_request()
   {
-    state_ = state_type::stop;
-    ++pending_operations_;
+    if (!--pending_)
+    {
+      continue_collection();
+    }
   }
 
-  void wait_started()
+  void complete()
   {
-    ++pending_operations_;
+    handler_(snapshots_);
   }
 
-  endpoint_type       remote_endpoint_;
-  session_ptr         session_;
-  state_type::value_t state_;
-  std::size_t         pending_operations_;
-
-  start_wait_allocator_type start_wait_allocator_;
-  stop_allocator_type       stop_allocator_;
-}; // class session_manager::session_wrapper
+  boost::asio::io_service&    io_service_;
+  const snapshot_handler      handler_;
+  session_vector              sessions_;
+  session_snapshot_vector     snapshots_;
+  std::size_t                 next_;
+  boost::detail::atomic_count pending_;
+}; // class session_manager::snapshot_collector
 
 session_manager_ptr session_manager::create(
     boost::asio::io_service& io_service,
@@ -516,36 +427,49 @@ session_manager::session_manager(boost::asio::io_service& io_service,
   : accepting_endpoint_(config.accepting_endpoint)
   , listen_backlog_(config.listen_backlog)
   , max_session_count_(config.max_session_count)
-  , recycled_session_count_(config.recycled_session_count)
   , max_stopping_sessions_(config.max_stopping_sessions)
   , managed_session_config_(config.managed_session_config)
+  // Connection to upstream of relay session, subscription of broadcast
+  // session and responses queued by HTTP (key-value) session can't be moved
+  , rebalance_period_((config.managed_session_config.relay_endpoint
+        || config.managed_session_config.http
+        || config.managed_session_config.broadcast_hub
+        || config.managed_session_config.kv_store)
+        ? optional_duration() : to_optional_duration(config.rebalance_period))
   , extern_state_(extern_state::ready)
   , intern_state_(intern_state::work)
   , accept_state_(accept_state::ready)
+  , rebalance_state_(rebalance_period_
+        ? rebalance_state::ready : rebalance_state::stopped)
   , pending_operations_(0)
   , io_service_(io_service)
   , session_factory_(managed_session_factory)
   , strand_(io_service)
   , acceptor_(io_service)
+  , rebalance_timer_(io_service)
+  , memory_budget_(config.memory_budget
+        ? new memory_budget(*config.memory_budget) : 0)
   , extern_wait_handler_(io_service)
   , extern_stop_handler_(io_service)
 {
 }
 
-void session_manager::reset(bool free_recycled_sessions)
+session_manager::~session_manager()
+{
+}
+
+void session_manager::reset()
 {
   extern_state_ = extern_state::ready;
   intern_state_ = intern_state::work;
   accept_state_ = accept_state::ready;
+  rebalance_state_ = rebalance_period_
+      ? rebalance_state::ready : rebalance_state::stopped;
   pending_operations_ = 0;
 
   close_acceptor();
 
   active_sessions_.clear();
-  if (free_recycled_sessions)
-  {
-    recycled_sessions_.clear();
-  }
 
   stats_collector_.reset();
   extern_wait_error_.clear();
@@ -553,7 +477,32 @@ void session_manager::reset(bool free_recycled_sessions)
 
 session_manager_stats session_manager::stats()
 {
-  return stats_collector_.stats();
+  session_manager_stats stats = stats_collector_.stats();
+  if (memory_budget_)
+  {
+    stats.memory_budget = memory_budget_->stats();
+  }
+  if (broadcast_hub* hub = managed_session_config_.broadcast_hub)
+  {
+    stats.broadcast_hub = hub->stats();
+  }
+  return stats;
+}
+
+void session_manager::start_snapshot(const snapshot_handler& handler)
+{
+  typedef boost::shared_ptr<snapshot_collector> snapshot_collector_ptr;
+
+  const boost::posix_time::ptime now =
+      boost::posix_time::microsec_clock::universal_time();
+  snapshot_collector_ptr collector = boost::make_shared<snapshot_collector>(
+      boost::ref(io_service_), handler, active_sessions_.size());
+  for (managed_session_ptr session = active_sessions_.front(); session;
+      session = session_list::next(session))
+  {
+    collector->add(session, now - session->accept_time());
+  }
+  collector->continue_collection();
 }
 
 boost::system::error_code session_manager::do_start_extern_start()
@@ -568,6 +517,13 @@ boost::system::error_code session_manager::do_start_extern_start()
   extern_state_ = extern_state::work;
   continue_work();
 
+  // Start periodic rebalancing of sessions if need
+  if ((intern_state::work == intern_state_)
+      && (rebalance_state::ready == rebalance_state_))
+  {
+    start_rebalance_timer();
+  }
+
   if (intern_state_ == intern_state::stopped)
   {
     extern_state_ = extern_state::stopped;
@@ -692,7 +648,7 @@ void session_manager::continue_work()
   }
 
   // Get new, ready to start session
-  session_wrapper_ptr session = create_session(accept_error_);
+  managed_session_ptr session = create_session(accept_error_);
   if (accept_error_)
   {
     if (!active_sessions_.empty())
@@ -714,11 +670,13 @@ void session_manager::continue_work()
 #if !(defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
 
-void session_manager::handle_accept(const session_wrapper_ptr& session,
+void session_manager::handle_accept(const managed_session_ptr& session,
     const boost::system::error_code& error)
 {
   BOOST_ASSERT_MSG(accept_state::in_progress == accept_state_,
       "Invalid accept state");
+  MA_TRACE_EVENT(trace_event_type::session_accept, this, error.value(),
+      reinterpret_cast<std::size_t>(session.get()));
 
   // Split handler based on current internal state
   // that might change during accept operation
@@ -738,7 +696,7 @@ void session_manager::handle_accept(const session_wrapper_ptr& session,
   }
 }
 
-void session_manager::handle_session_start(const session_wrapper_ptr& session,
+void session_manager::handle_session_start(const managed_session_ptr& session,
     const boost::system::error_code& error)
 {
   // Split handler based on current internal state
@@ -759,7 +717,7 @@ void session_manager::handle_session_start(const session_wrapper_ptr& session,
   }
 }
 
-void session_manager::handle_session_wait(const session_wrapper_ptr& session,
+void session_manager::handle_session_wait(const managed_session_ptr& session,
     const boost::system::error_code& error)
 {
   // Split handler based on current internal state
@@ -780,7 +738,7 @@ void session_manager::handle_session_wait(const session_wrapper_ptr& session,
   }
 }
 
-void session_manager::handle_session_stop(const session_wrapper_ptr& session,
+void session_manager::handle_session_stop(const managed_session_ptr& session,
     const boost::system::error_code& error)
 {
   // Split handler based on current internal state
@@ -801,11 +759,56 @@ void session_manager::handle_session_stop(const session_wrapper_ptr& session,
   }
 }
 
+void session_manager::handle_session_detach(
+    const managed_session_ptr& session, const boost::system::error_code& error)
+{
+  // Split handler based on current internal state
+  // that might change during session detach
+  switch (intern_state_)
+  {
+  case intern_state::work:
+    handle_session_detach_at_work(session, error);
+    break;
+
+  case intern_state::stop:
+    handle_session_detach_at_stop(session, error);
+    break;
+
+  default:
+    BOOST_ASSERT_MSG(false, "Invalid internal state");
+    break;
+  }
+}
+
+void session_manager::handle_rebalance_timer(
+    const boost::system::error_code& error)
+{
+  BOOST_ASSERT_MSG(rebalance_state::in_progress == rebalance_state_,
+      "Invalid rebalance state");
+
+  // Split handler based on current internal state
+  // that might change during timer wait
+  switch (intern_state_)
+  {
+  case intern_state::work:
+    handle_rebalance_timer_at_work(error);
+    break;
+
+  case intern_state::stop:
+    handle_rebalance_timer_at_stop(error);
+    break;
+
+  default:
+    BOOST_ASSERT_MSG(false, "Invalid internal state");
+    break;
+  }
+}
+
 #endif // !(defined(MA_HAS_RVALUE_REFS)
        //     && defined(MA_HAS_LAMBDA)
        //     && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
 
-void session_manager::handle_accept_at_work(const session_wrapper_ptr& session,
+void session_manager::handle_accept_at_work(const managed_session_ptr& session,
     const boost::system::error_code& error)
 {
   BOOST_ASSERT_MSG(intern_state::work == intern_state_,
@@ -840,12 +843,13 @@ void session_manager::handle_accept_at_work(const session_wrapper_ptr& session,
     return;
   }
 
+  session->accept_time() = boost::posix_time::microsec_clock::universal_time();
   add_to_active(session);
   start_session_start(session);
   continue_work();
 }
 
-void session_manager::handle_accept_at_stop(const session_wrapper_ptr& session,
+void session_manager::handle_accept_at_stop(const managed_session_ptr& session,
     const boost::system::error_code& error)
 {
   BOOST_ASSERT_MSG(intern_state::stop == intern_state_,
@@ -875,7 +879,7 @@ void session_manager::handle_accept_at_stop(const session_wrapper_ptr& session,
 }
 
 void session_manager::handle_session_start_at_work(
-    const session_wrapper_ptr& session, const boost::system::error_code& error)
+    const managed_session_ptr& session, const boost::system::error_code& error)
 {
   BOOST_ASSERT_MSG(intern_state::work == intern_state_,
       "Invalid internal state");
@@ -912,7 +916,7 @@ void session_manager::handle_session_start_at_work(
 }
 
 void session_manager::handle_session_start_at_stop(
-    const session_wrapper_ptr& session, const boost::system::error_code& error)
+    const managed_session_ptr& session, const boost::system::error_code& error)
 {
   BOOST_ASSERT_MSG(intern_state::stop == intern_state_,
       "Invalid internal state");
@@ -948,7 +952,7 @@ void session_manager::handle_session_start_at_stop(
 }
 
 void session_manager::handle_session_wait_at_work(
-    const session_wrapper_ptr& session,
+    const managed_session_ptr& session,
     const boost::system::error_code& error)
 {
   BOOST_ASSERT_MSG(intern_state::work == intern_state_,
@@ -959,8 +963,16 @@ void session_manager::handle_session_wait_at_work(
 
   if (!session->working())
   {
-    // Collect statistics
-    stats_collector_.session_stopped(server::error::operation_aborted);
+    // Collect statistics. Moved session isn't stopped but it could run out
+    // of work before it was detached.
+    if (!session->migrating())
+    {
+      stats_collector_.session_stopped(server::error::operation_aborted);
+    }
+    else if (server::error::operation_aborted != error)
+    {
+      stats_collector_.session_stopped(error);
+    }
     // Handler is called too late
     recycle(session);
     continue_work();
@@ -975,7 +987,7 @@ void session_manager::handle_session_wait_at_work(
 }
 
 void session_manager::handle_session_wait_at_stop(
-    const session_wrapper_ptr& session,
+    const managed_session_ptr& session,
     const boost::system::error_code& error)
 {
   BOOST_ASSERT_MSG(intern_state::stop == intern_state_,
@@ -986,8 +998,16 @@ void session_manager::handle_session_wait_at_stop(
 
   if (!session->working())
   {
-    // Collect statistics
-    stats_collector_.session_stopped(server::error::operation_aborted);
+    // Collect statistics. Moved session isn't stopped but it could run out
+    // of work before it was detached.
+    if (!session->migrating())
+    {
+      stats_collector_.session_stopped(server::error::operation_aborted);
+    }
+    else if (server::error::operation_aborted != error)
+    {
+      stats_collector_.session_stopped(error);
+    }
     // Handler is called too late
     recycle(session);
     continue_stop();
@@ -1002,7 +1022,7 @@ void session_manager::handle_session_wait_at_stop(
 }
 
 void session_manager::handle_session_stop_at_work(
-    const session_wrapper_ptr& session, const boost::system::error_code& error)
+    const managed_session_ptr& session, const boost::system::error_code& error)
 {
   BOOST_ASSERT_MSG(intern_state::work == intern_state_,
       "Invalid internal state");
@@ -1020,7 +1040,7 @@ void session_manager::handle_session_stop_at_work(
 
   // Failed to stop working session.
   // The only reason is "double stop operations".
-  // It is prevented by usage of session_wrapper::state.
+  // It is prevented by usage of managed_session::state.
   BOOST_ASSERT_MSG(!error, "session::async_stop failed");
   // Prevent warning at release build
   (void) error;
@@ -1033,7 +1053,7 @@ void session_manager::handle_session_stop_at_work(
 }
 
 void session_manager::handle_session_stop_at_stop(
-    const session_wrapper_ptr& session, const boost::system::error_code& error)
+    const managed_session_ptr& session, const boost::system::error_code& error)
 {
   BOOST_ASSERT_MSG(intern_state::stop == intern_state_,
       "Invalid internal state");
@@ -1051,7 +1071,7 @@ void session_manager::handle_session_stop_at_stop(
 
   // Failed to stop working session.
   // The only reason is "double stop operations".
-  // It is prevented by usage of session_wrapper::state.
+  // It is prevented by usage of managed_session::state.
   BOOST_ASSERT_MSG(!error, "session::async_stop failed");
   // Prevent warning at release build
   (void) error;
@@ -1062,6 +1082,114 @@ void session_manager::handle_session_stop_at_stop(
   continue_stop();
 }
 
+void session_manager::handle_session_detach_at_work(
+    const managed_session_ptr& session, const boost::system::error_code& error)
+{
+  BOOST_ASSERT_MSG(intern_state::work == intern_state_,
+      "Invalid internal state");
+
+  BOOST_ASSERT_MSG(session->migrating(), "Invalid session state");
+
+  --pending_operations_;
+  session->operation_completed();
+
+  managed_session_ptr target = session->release_migration_target();
+
+  if (error)
+  {
+    // Session can't be detached because it is shutting down already,
+    // so stop it as usual
+    recycle(target);
+    start_session_stop(session);
+    continue_work();
+    return;
+  }
+
+  // Session has stopped but its connection is still opened
+  session->mark_stopped();
+  remove_from_active(session);
+  boost::system::error_code adopt_error = target->adopt(*session);
+  recycle(session);
+
+  if (adopt_error)
+  {
+    // Collect statistics
+    stats_collector_.session_stopped(adopt_error);
+    // Connection is lost
+    recycle(target);
+    continue_work();
+    return;
+  }
+
+  // Collect statistics
+  stats_collector_.session_migrated();
+  // Continue to serve the same connection at the other io_service
+  add_to_active(target);
+  start_session_start(target);
+  continue_work();
+}
+
+void session_manager::handle_session_detach_at_stop(
+    const managed_session_ptr& session, const boost::system::error_code& error)
+{
+  BOOST_ASSERT_MSG(intern_state::stop == intern_state_,
+      "Invalid internal state");
+
+  BOOST_ASSERT_MSG(session->migrating(), "Invalid session state");
+
+  --pending_operations_;
+  session->operation_completed();
+
+  recycle(session->release_migration_target());
+
+  if (error)
+  {
+    // Session can't be detached because it is shutting down already
+    start_session_stop(session);
+    continue_stop();
+    return;
+  }
+
+  // Collect statistics
+  stats_collector_.session_stopped(server::error::operation_aborted);
+  // Connection is closed by the recycling of session
+  session->mark_stopped();
+  remove_from_active(session);
+  recycle(session);
+  continue_stop();
+}
+
+void session_manager::handle_rebalance_timer_at_work(
+    const boost::system::error_code& error)
+{
+  BOOST_ASSERT_MSG(intern_state::work == intern_state_,
+      "Invalid internal state");
+
+  --pending_operations_;
+  rebalance_state_ = rebalance_state::ready;
+
+  if (error && (boost::asio::error::operation_aborted != error))
+  {
+    // Rebalancing is optional so just turn it off
+    rebalance_state_ = rebalance_state::stopped;
+    return;
+  }
+
+  rebalance();
+  start_rebalance_timer();
+}
+
+void session_manager::handle_rebalance_timer_at_stop(
+    const boost::system::error_code& /*error*/)
+{
+  BOOST_ASSERT_MSG(intern_state::stop == intern_state_,
+      "Invalid internal state");
+
+  --pending_operations_;
+  rebalance_state_ = rebalance_state::stopped;
+  continue_stop();
+}
+
 void session_manager::start_stop(const boost::system::error_code& error)
 {
   // Switch general internal SM
@@ -1078,6 +1206,14 @@ void session_manager::start_stop(const boost::system::error_code& error)
   {
     accept_state_ = accept_state::stopped;
   }
+  if (rebalance_state::in_progress == rebalance_state_)
+  {
+    cancel_rebalance_timer();
+  }
+  else
+  {
+    rebalance_state_ = rebalance_state::stopped;
+  }
 
   // Notify external wait handler if need
   if (extern_state::work == extern_state_)
@@ -1087,8 +1223,7 @@ void session_manager::start_stop(const boost::system::error_code& error)
 
   // Stop active sessions (not more than max_stopping_sessions_)
   stopping_sessions_end_ = start_active_session_stop(
-      boost::static_pointer_cast<session_wrapper>(active_sessions_.front()),
-      max_stopping_sessions_);
+      active_sessions_.front(), max_stopping_sessions_);
   if (stopping_sessions_end_)
   {
     schedule_active_session_stop();
@@ -1122,18 +1257,18 @@ void session_manager::continue_stop()
   }
 }
 
-session_manager::session_wrapper_ptr session_manager::start_active_session_stop(
-    session_wrapper_ptr begin, std::size_t max_count)
+managed_session_ptr session_manager::start_active_session_stop(
+    managed_session_ptr begin, std::size_t max_count)
 {
   while (max_count && begin)
   {
-    if (!begin->stopping())
+    // Moving session is stopped by handle_session_detach
+    if (!begin->stopping() && !begin->migrating())
     {
       start_session_stop(begin);
     }
     --max_count;
-    begin = boost::static_pointer_cast<session_wrapper>(
-        session_list::next(begin));
+    begin = session_list::next(begin);
   }
   return begin;
 }
@@ -1196,7 +1331,7 @@ void session_manager::handle_scheduled_active_session_stop()
        //     && defined(MA_HAS_LAMBDA)
        //     && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
 
-void session_manager::start_accept_session(const session_wrapper_ptr& session)
+void session_manager::start_accept_session(const managed_session_ptr& session)
 {
 #if defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
@@ -1204,11 +1339,15 @@ void session_manager::start_accept_session(const session_wrapper_ptr& session)
   session_manager_ptr shared_this = shared_from_this();
 
   acceptor_.async_accept(session->socket(), session->remote_endpoint(),
-      MA_STRAND_WRAP(strand_, make_custom_alloc_handler(accept_allocator_,
+      MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+          handler_timing_tag::manager_accept,
+          make_custom_alloc_handler(accept_allocator_,
           [shared_this, session](const boost::system::error_code& error)
   {
     BOOST_ASSERT_MSG(accept_state::in_progress == shared_this->accept_state_,
         "Invalid accept state");
+    MA_TRACE_EVENT(trace_event_type::session_accept, shared_this.get(),
+        error.value(), reinterpret_cast<std::size_t>(session.get()));
 
     // Split handler based on current internal state
     // that might change during accept operation
@@ -1226,22 +1365,26 @@ void session_manager::start_accept_session(const session_wrapper_ptr& session)
       BOOST_ASSERT_MSG(false, "Invalid internal state");
       break;
     }
-  })));
+  }))));
 
 #elif defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
 
   acceptor_.async_accept(session->socket(), session->remote_endpoint(),
-      MA_STRAND_WRAP(strand_, make_custom_alloc_handler(accept_allocator_,
-          accept_handler_binder(&this_type::handle_accept, shared_from_this(),
-              session))));
+      MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+          handler_timing_tag::manager_accept,
+          make_custom_alloc_handler(accept_allocator_,
+              accept_handler_binder(&this_type::handle_accept,
+                  shared_from_this(), session)))));
 
 #else
 
   acceptor_.async_accept(session->socket(), session->remote_endpoint(),
-      MA_STRAND_WRAP(strand_, make_custom_alloc_handler(accept_allocator_,
-          boost::bind(&this_type::handle_accept, shared_from_this(),
-              session, _1))));
+      MA_STRAND_WRAP(strand_, MA_TIME_IO_HANDLER(
+          handler_timing_tag::manager_accept,
+          make_custom_alloc_handler(accept_allocator_,
+              boost::bind(&this_type::handle_accept, shared_from_this(),
+                  session, _1)))));
 
 #endif
 
@@ -1249,16 +1392,16 @@ void session_manager::start_accept_session(const session_wrapper_ptr& session)
   ++pending_operations_;
 }
 
-void session_manager::start_session_start(const session_wrapper_ptr& session)
+void session_manager::start_session_start(const managed_session_ptr& session)
 {
-  // Asynchronously start wrapped session
+  // Asynchronously start managed session
 
 #if defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
 
   session_manager_weak_ptr weak_this = shared_from_this();
 
-  session->async_start(
+  session->async_start(make_custom_alloc_handler(session->start_allocator(),
       [weak_this, session](const boost::system::error_code& error)
   {
     if (session_manager_ptr this_ptr = weak_this.lock())
@@ -1284,34 +1427,37 @@ void session_manager::start_session_start(const session_wrapper_ptr& session)
         }
       }));
     }
-  });
+  }));
 
 #elif defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
 
-  session->async_start(session_dispatch_binder(
-      &this_type::dispatch_handle_session_start, shared_from_this(), session));
+  session->async_start(make_custom_alloc_handler(session->start_allocator(),
+      session_dispatch_binder(&this_type::dispatch_handle_session_start,
+          shared_from_this(), session)));
 
 #else
 
-  session->async_start(boost::bind(&this_type::dispatch_handle_session_start,
-      session_manager_weak_ptr(shared_from_this()), session, _1));
+  session->async_start(make_custom_alloc_handler(session->start_allocator(),
+      boost::bind(&this_type::dispatch_handle_session_start,
+          session_manager_weak_ptr(shared_from_this()), session, _1)));
 
 #endif
 
+  session->start_started();
   ++pending_operations_;
 }
 
-void session_manager::start_session_stop(const session_wrapper_ptr& session)
+void session_manager::start_session_stop(const managed_session_ptr& session)
 {
-  // Asynchronously stop wrapped session
+  // Asynchronously stop managed session
 
 #if defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
 
   session_manager_weak_ptr weak_this = shared_from_this();
 
-  session->async_stop(
+  session->async_stop(make_custom_alloc_handler(session->stop_allocator(),
       [weak_this, session](const boost::system::error_code& error)
   {
     if (session_manager_ptr this_ptr = weak_this.lock())
@@ -1337,34 +1483,37 @@ void session_manager::start_session_stop(const session_wrapper_ptr& session)
         }
       }));
     }
-  });
+  }));
 
 #elif defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
 
-  session->async_stop(session_dispatch_binder(
-      &this_type::dispatch_handle_session_stop, shared_from_this(), session));
+  session->async_stop(make_custom_alloc_handler(session->stop_allocator(),
+      session_dispatch_binder(&this_type::dispatch_handle_session_stop,
+          shared_from_this(), session)));
 
 #else
 
-  session->async_stop(boost::bind(&this_type::dispatch_handle_session_stop,
-      session_manager_weak_ptr(shared_from_this()), session, _1));
+  session->async_stop(make_custom_alloc_handler(session->stop_allocator(),
+      boost::bind(&this_type::dispatch_handle_session_stop,
+          session_manager_weak_ptr(shared_from_this()), session, _1)));
 
 #endif
 
+  session->stop_started();
   ++pending_operations_;
 }
 
-void session_manager::start_session_wait(const session_wrapper_ptr& session)
+void session_manager::start_session_wait(const managed_session_ptr& session)
 {
-  // Asynchronously wait on wrapped session
+  // Asynchronously wait on managed session
 
 #if defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
 
   session_manager_weak_ptr weak_this = shared_from_this();
 
-  session->async_wait(
+  session->async_wait(make_custom_alloc_handler(session->wait_allocator(),
       [weak_this, session](const boost::system::error_code& error)
   {
     if (session_manager_ptr this_ptr = weak_this.lock())
@@ -1390,123 +1539,268 @@ void session_manager::start_session_wait(const session_wrapper_ptr& session)
         }
       }));
     }
-  });
+  }));
 
 #elif defined(MA_HAS_RVALUE_REFS) \
     && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
 
-  session->async_wait(session_dispatch_binder(
-      &this_type::dispatch_handle_session_wait, shared_from_this(), session));
+  session->async_wait(make_custom_alloc_handler(session->wait_allocator(),
+      session_dispatch_binder(&this_type::dispatch_handle_session_wait,
+          shared_from_this(), session)));
 
 #else
 
-  session->async_wait(boost::bind(&this_type::dispatch_handle_session_wait,
-      session_manager_weak_ptr(shared_from_this()), session, _1));
+  session->async_wait(make_custom_alloc_handler(session->wait_allocator(),
+      boost::bind(&this_type::dispatch_handle_session_wait,
+          session_manager_weak_ptr(shared_from_this()), session, _1)));
 
 #endif
 
+  session->wait_started();
   ++pending_operations_;
 }
 
-void session_manager::recycle(const session_wrapper_ptr& session)
+void session_manager::start_session_migration(
+    const managed_session_ptr& session, const managed_session_ptr& target)
 {
-  BOOST_ASSERT_MSG(session, "Session must be not null");
+  target->mark_ready();
+  target->remote_endpoint() = session->remote_endpoint();
+  target->accept_time() = session->accept_time();
 
-  if (session->has_pending_operations())
-  {
-    return;
-  }
+  // Collect statistics
+  stats_collector_.set_recycled_session_count(
+      session_factory_.recycled_count());
 
-  // Detach session from wrapper
-  session_ptr detached_session = session->detach();
-  session_release_guard session_guard(session_factory_, detached_session);
-  // Reset internal state of session
-  detached_session->reset();
-  // Return session to its factory
-  session_factory_.release(detached_session);
-  session_guard.release();
+  // Asynchronously detach connection from managed session
+
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+  session_manager_weak_ptr weak_this = shared_from_this();
 
-  // Cache session wrapper if can
-  if (recycled_sessions_.size() < recycled_session_count_)
+  session->async_detach(make_custom_alloc_handler(session->stop_allocator(),
+      [weak_this, session](const boost::system::error_code& error)
   {
-    add_to_recycled(session);
-  }
+    if (session_manager_ptr this_ptr = weak_this.lock())
+    {
+      this_ptr->strand_.dispatch(make_custom_alloc_handler(
+          session->stop_allocator(), [this_ptr, session, error]()
+      {
+        // Split handler based on current internal state
+        // that might change during session detach
+        switch (this_ptr->intern_state_)
+        {
+        case intern_state::work:
+          this_ptr->handle_session_detach_at_work(session, error);
+          break;
+
+        case intern_state::stop:
+          this_ptr->handle_session_detach_at_stop(session, error);
+          break;
+
+        default:
+          BOOST_ASSERT_MSG(false, "Invalid internal state");
+          break;
+        }
+      }));
+    }
+  }));
+
+#elif defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+
+  session->async_detach(make_custom_alloc_handler(session->stop_allocator(),
+      session_dispatch_binder(&this_type::dispatch_handle_session_detach,
+          shared_from_this(), session)));
+
+#else
+
+  session->async_detach(make_custom_alloc_handler(session->stop_allocator(),
+      boost::bind(&this_type::dispatch_handle_session_detach,
+          session_manager_weak_ptr(shared_from_this()), session, _1)));
+
+#endif
+
+  session->migrate_started(target);
+  ++pending_operations_;
 }
 
-session_manager::session_wrapper_ptr session_manager::create_session(
-    boost::system::error_code& error)
+void session_manager::start_rebalance_timer()
 {
-  session_ptr session = session_factory_.create(managed_session_config_, error);
+  BOOST_ASSERT_MSG(rebalance_state::ready == rebalance_state_,
+      "Invalid rebalance state");
+
+  boost::system::error_code error;
+  rebalance_timer_.expires_from_now(*rebalance_period_, error);
   if (error)
   {
-    return session_wrapper_ptr();
+    // Rebalancing is optional so just turn it off
+    rebalance_state_ = rebalance_state::stopped;
+    return;
   }
 
-  session_release_guard session_guard(session_factory_, session);
+#if defined(MA_HAS_RVALUE_REFS) \
+    && defined(MA_HAS_LAMBDA) && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR)
+
+  session_manager_ptr shared_this = shared_from_this();
 
-  if (!recycled_sessions_.empty())
+  rebalance_timer_.async_wait(MA_STRAND_WRAP(strand_,
+      make_custom_alloc_handler(rebalance_allocator_, [shared_this](
+      const boost::system::error_code& error)
   {
-    session_wrapper_ptr wrapper =
-        boost::static_pointer_cast<session_wrapper>(recycled_sessions_.front());
-    remove_from_recycled(wrapper);
+    BOOST_ASSERT_MSG(
+        rebalance_state::in_progress == shared_this->rebalance_state_,
+        "Invalid rebalance state");
 
-    wrapper->attach(session);
-    error = boost::system::error_code();
+    // Split handler based on current internal state
+    // that might change during timer wait
+    switch (shared_this->intern_state_)
+    {
+    case intern_state::work:
+      shared_this->handle_rebalance_timer_at_work(error);
+      break;
+
+    case intern_state::stop:
+      shared_this->handle_rebalance_timer_at_stop(error);
+      break;
+
+    default:
+      BOOST_ASSERT_MSG(false, "Invalid internal state");
+      break;
+    }
+  })));
+
+#else
 
-    session_guard.release();
-    return wrapper;
+  rebalance_timer_.async_wait(MA_STRAND_WRAP(strand_,
+      make_custom_alloc_handler(rebalance_allocator_, boost::bind(
+          &this_type::handle_rebalance_timer, shared_from_this(), _1))));
+
+#endif
+
+  ++pending_operations_;
+  rebalance_state_ = rebalance_state::in_progress;
+}
+
+boost::system::error_code session_manager::cancel_rebalance_timer()
+{
+  boost::system::error_code error;
+  rebalance_timer_.cancel(error);
+  return error;
+}
+
+void session_manager::rebalance()
+{
+  // Find the working sessions which were the most active since
+  // the previous rebalancing
+  managed_session_ptr candidates[max_migration_candidates];
+  long activities[max_migration_candidates] = {};
+
+  for (managed_session_ptr session = active_sessions_.front(); session;
+      session = session_list::next(session))
+  {
+    const long activity = session->update_activity();
+    session_factory_.add_activity(session, activity);
+    if (!session->working()
+        || (activity <= activities[max_migration_candidates - 1]))
+    {
+      continue;
+    }
+    // Keep candidates sorted by activity
+    std::size_t i = max_migration_candidates - 1;
+    for (; (i != 0) && (activities[i - 1] < activity); --i)
+    {
+      activities[i] = activities[i - 1];
+      candidates[i] = candidates[i - 1];
+    }
+    activities[i] = activity;
+    candidates[i] = session;
   }
 
-  try
-  {
-    session_wrapper_ptr wrapper =
-        boost::make_shared<session_wrapper>(session);
-    error = boost::system::error_code();
+  session_factory_.update_load();
 
-    session_guard.release();
-    return wrapper;
+  // Move (at most one per rebalancing) the most active session
+  // which session_factory has a less loaded place for
+  for (std::size_t i = 0; (i != max_migration_candidates) && candidates[i];
+      ++i)
+  {
+    boost::system::error_code error;
+    managed_session_ptr target = session_factory_.create_migration_target(
+        candidates[i], activities[i], managed_session_config_, error);
+    if (error)
+    {
+      // Try next time
+      return;
+    }
+    if (target)
+    {
+      target->set_memory_budget(memory_budget_.get());
+      start_session_migration(candidates[i], target);
+      return;
+    }
   }
-  catch (const std::bad_alloc&)
+}
+
+void session_manager::recycle(const managed_session_ptr& session)
+{
+  BOOST_ASSERT_MSG(session, "Session must be not null");
+
+  if (session->has_pending_operations())
   {
-    error = boost::system::errc::make_error_code(
-        boost::system::errc::not_enough_memory);
-    return session_wrapper_ptr();
+    return;
   }
+
+  session_release_guard session_guard(session_factory_, session);
+  // Reset internal state of session
+  session->reset();
+  // Return session to its factory
+  session_factory_.release(session);
+  session_guard.release();
+
+  // Collect statistics
+  stats_collector_.set_recycled_session_count(
+      session_factory_.recycled_count());
 }
 
-void session_manager::add_to_active(const session_wrapper_ptr& session)
+managed_session_ptr session_manager::create_session(
+    boost::system::error_code& error)
 {
-  active_sessions_.push_front(session);
+  managed_session_ptr session =
+      session_factory_.create(managed_session_config_, error);
+  if (error)
+  {
+    return managed_session_ptr();
+  }
+
+  // Recycled session keeps the state it was stopped with
+  session->mark_ready();
+  session->set_memory_budget(memory_budget_.get());
+
   // Collect statistics
-  stats_collector_.set_active_session_count(active_sessions_.size());
+  stats_collector_.set_recycled_session_count(
+      session_factory_.recycled_count());
+
+  return session;
 }
 
-void session_manager::add_to_recycled(const session_wrapper_ptr& session)
+void session_manager::add_to_active(const managed_session_ptr& session)
 {
-  recycled_sessions_.push_front(session);
+  active_sessions_.push_front(session);
   // Collect statistics
-  stats_collector_.set_recycled_session_count(recycled_sessions_.size());
+  stats_collector_.set_active_session_count(active_sessions_.size());
 }
 
-void session_manager::remove_from_active(const session_wrapper_ptr& session)
+void session_manager::remove_from_active(const managed_session_ptr& session)
 {
   if (session == stopping_sessions_end_)
   {
-    stopping_sessions_end_ = boost::static_pointer_cast<session_wrapper>(
-        session_list::next(session));
+    stopping_sessions_end_ = session_list::next(session);
   }
   active_sessions_.erase(session);
   // Collect statistics
   stats_collector_.set_active_session_count(active_sessions_.size());
 }
 
-void session_manager::remove_from_recycled(const session_wrapper_ptr& session)
-{
-  recycled_sessions_.erase(session);
-  // Collect statistics
-  stats_collector_.set_recycled_session_count(recycled_sessions_.size());
-}
-
 boost::system::error_code session_manager::open_acceptor()
 {
   boost::system::error_code error;
@@ -1526,7 +1820,7 @@ boost::system::error_code session_manager::close_acceptor()
 
 void session_manager::dispatch_handle_session_start(
     const session_manager_weak_ptr& this_weak_ptr,
-    const session_wrapper_ptr& session,
+    const managed_session_ptr& session,
     const boost::system::error_code& error)
 {
   // Try to lock the session manager
@@ -1553,7 +1847,7 @@ void session_manager::dispatch_handle_session_start(
 
 void session_manager::dispatch_handle_session_wait(
     const session_manager_weak_ptr& this_weak_ptr,
-    const session_wrapper_ptr& session,
+    const managed_session_ptr& session,
     const boost::system::error_code& error)
 {
   if (session_manager_ptr this_ptr = this_weak_ptr.lock())
@@ -1577,7 +1871,7 @@ void session_manager::dispatch_handle_session_wait(
 
 void session_manager::dispatch_handle_session_stop(
     const session_manager_weak_ptr& this_weak_ptr,
-    const session_wrapper_ptr& session,
+    const managed_session_ptr& session,
     const boost::system::error_code& error)
 {
   if (session_manager_ptr this_ptr = this_weak_ptr.lock())
@@ -1599,6 +1893,32 @@ void session_manager::dispatch_handle_session_stop(
   }
 }
 
+void session_manager::dispatch_handle_session_detach(
+    const session_manager_weak_ptr& this_weak_ptr,
+    const managed_session_ptr& session,
+    const boost::system::error_code& error)
+{
+  if (session_manager_ptr this_ptr = this_weak_ptr.lock())
+  {
+    // Forward completion
+#if defined(MA_HAS_RVALUE_REFS) && defined(MA_BOOST_BIND_HAS_NO_MOVE_CONTRUCTOR)
+
+    this_ptr->strand_.dispatch(make_custom_alloc_handler(
+        session->stop_allocator(), session_handler_binder(
+            &session_manager::handle_session_detach, this_ptr, session,
+            error)));
+
+#else
+
+    this_ptr->strand_.dispatch(make_custom_alloc_handler(
+        session->stop_allocator(), boost::bind(
+            &session_manager::handle_session_detach, this_ptr, session,
+            error)));
+
+#endif
+  }
+}
+
 #endif // !(defined(MA_HAS_RVALUE_REFS)
        //     && defined(MA_HAS_LAMBDA)
       //      && !defined(MA_NO_IMPLICIT_MOVE_CONSTRUCTOR))
@@ -1669,6 +1989,28 @@ void session_manager::open(protocol_type::acceptor& acceptor,
   }
 }
 
+#if defined (MA_HAS_STEADY_DEADLINE_TIMER)
+
+session_manager::optional_duration session_manager::to_optional_duration(
+    const session_manager_config::optional_time_duration& duration)
+{
+  if (duration)
+  {
+    return to_steady_deadline_timer_duration(duration.get());
+  }
+  return optional_duration();
+}
+
+#else // defined (MA_HAS_STEADY_DEADLINE_TIMER)
+
+session_manager::optional_duration session_manager::to_optional_duration(
+    const session_manager_config::optional_time_duration& duration)
+{
+  return duration;
+}
+
+#endif // defined (MA_HAS_STEADY_DEADLINE_TIMER)
+
 } // namespace server
 } // namespace echo
 } // namespace ma
@@ -10,31 +10,43 @@
 #include <boost/make_shared.hpp>
 #include <ma/shared_ptr_factory.hpp>
 #include <ma/echo/server/error.hpp>
+#include <ma/echo/server/session_type.hpp>
 #include <ma/echo/server/simple_session_factory.hpp>
 
 namespace ma {
 namespace echo {
 namespace server {
 
+namespace {
+
+// Number of sessions allocated at once by the slab of factory
+const std::size_t session_slab_chunk_size = 64;
+
+} // anonymous namespace
+
+template <typename Session>
 class simple_session_factory::session_wrapper
   : public session_wrapper_base
-  , public session
+  , public Session
 {
 private:
   typedef session_wrapper this_type;
 
 public:
-  static session_wrapper_ptr create(boost::asio::io_service& io_service,
-      const session_config& config)
+  typedef slab_allocator<this_type> allocator_type;
+
+  static boost::shared_ptr<this_type> create(const allocator_type& allocator,
+      boost::asio::io_service& io_service, const session_config& config)
   {
     typedef shared_ptr_factory_helper<this_type> helper;
-    return boost::make_shared<helper>(boost::ref(io_service), config);
+    return boost::allocate_shared<helper>(allocator,
+        boost::ref(io_service), config);
   }
 
 protected:
   session_wrapper(boost::asio::io_service& io_service,
       const session_config& config)
-    : session(io_service, config)
+    : Session(io_service, config)
   {
   }
 
@@ -43,21 +55,68 @@ protected:
   }
 }; // class simple_session_factory::session_wrapper
 
-session_ptr simple_session_factory::create(const session_config& config,
-    boost::system::error_code& error)
+class simple_session_factory::session_creator
+{
+public:
+  typedef managed_session_ptr result_type;
+
+  session_creator(const slab_allocator<session_wrapper_base>& allocator,
+      boost::asio::io_service& io_service, const session_config& config)
+    : allocator_(allocator)
+    , io_service_(io_service)
+    , config_(config)
+  {
+  }
+
+  template <typename Session>
+  result_type create()
+  {
+    return session_wrapper<Session>::create(allocator_, io_service_,
+        config_);
+  }
+
+private:
+  const slab_allocator<session_wrapper_base>& allocator_;
+  boost::asio::io_service& io_service_;
+  const session_config&    config_;
+}; // class simple_session_factory::session_creator
+
+// "Creates" the size of session wrapper serving the given configuration
+class simple_session_factory::session_sizer
+{
+public:
+  typedef std::size_t result_type;
+
+  template <typename Session>
+  result_type create() const
+  {
+    return sizeof(session_wrapper<Session>);
+  }
+}; // class simple_session_factory::session_sizer
+
+simple_session_factory::simple_session_factory(
+    boost::asio::io_service& io_service, std::size_t max_recycled)
+  : max_recycled_(max_recycled)
+  , io_service_(io_service)
+  , session_allocator_(boost::make_shared<slab_storage>(
+        session_slab_chunk_size))
+{
+}
+
+managed_session_ptr simple_session_factory::create(
+    const session_config& config, boost::system::error_code& error)
 {
   if (!recycled_.empty())
   {
-    session_wrapper_ptr session =
-        boost::static_pointer_cast<session_wrapper>(recycled_.front());
+    session_wrapper_base_ptr session = recycled_.front();
     recycled_.erase(session);
     error = boost::system::error_code();
-    return session;
+    return boost::dynamic_pointer_cast<managed_session>(session);
   }
 
   try
   {
-    session_wrapper_ptr session = session_wrapper::create(io_service_, config);
+    managed_session_ptr session = create_session(config);
     error = boost::system::error_code();
     return session;
   }
@@ -65,16 +124,81 @@ session_ptr simple_session_factory::create(const session_config& config,
   {
     error = boost::system::errc::make_error_code(
         boost::system::errc::not_enough_memory);
-    return session_ptr();
+    return managed_session_ptr();
   }
 }
 
-void simple_session_factory::release(const session_ptr& session)
+void simple_session_factory::release(const managed_session_ptr& session)
 {
   if (max_recycled_ > recycled_.size())
   {
-    recycled_.push_front(boost::static_pointer_cast<session_wrapper>(session));
+    recycled_.push_front(
+        boost::dynamic_pointer_cast<session_wrapper_base>(session));
+  }
+}
+
+std::size_t simple_session_factory::recycled_count() const
+{
+  return recycled_.size();
+}
+
+void simple_session_factory::add_activity(
+    const managed_session_ptr& /*session*/, long /*activity*/)
+{
+}
+
+void simple_session_factory::update_load()
+{
+}
+
+managed_session_ptr simple_session_factory::create_migration_target(
+    const managed_session_ptr& /*session*/, long /*activity*/,
+    const session_config& /*config*/, boost::system::error_code& error)
+{
+  // There is the only io_service
+  error = boost::system::error_code();
+  return managed_session_ptr();
+}
+
+std::size_t simple_session_factory::prewarm(const session_config& config,
+    std::size_t count, boost::system::error_code& error)
+{
+  // Prewarmed sessions have to survive their first release
+  if (max_recycled_ < count)
+  {
+    max_recycled_ = count;
+  }
+
+  session_sizer sizer;
+  const std::size_t session_size = dispatch_session_type(sizer, config);
+  std::size_t created = 0;
+  try
+  {
+    while (recycled_.size() < count)
+    {
+      managed_session_ptr session = create_session(config);
+      session->prewarm();
+      recycled_.push_front(
+          boost::dynamic_pointer_cast<session_wrapper_base>(session));
+      ++created;
+    }
+  }
+  catch (const std::bad_alloc&)
+  {
+    error = boost::system::errc::make_error_code(
+        boost::system::errc::not_enough_memory);
+    return created * (session_size + config.buffer_size);
   }
+
+  error = boost::system::error_code();
+  return created * (session_size + config.buffer_size);
+}
+
+managed_session_ptr simple_session_factory::create_session(
+    const session_config& config)
+{
+  session_creator creator(session_allocator_, io_service_, config);
+  return dispatch_session_type(creator, config);
 }
 
 } // namespace server
@@ -0,0 +1,337 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <cerrno>
+#include <utility>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <ma/custom_alloc_handler.hpp>
+#include <ma/echo/server/udp_echo_service.hpp>
+
+namespace ma {
+namespace echo {
+namespace server {
+
+namespace {
+
+// Number of batches echoed by single handler before it lets the other
+// handlers of io_service (e.g. TCP sessions) run
+const std::size_t max_batches_per_handler = 16;
+
+} // anonymous namespace
+
+udp_echo_service::udp_echo_service(boost::asio::io_service& io_service,
+    const udp_echo_config& config)
+  : io_service_(io_service)
+  , socket_(io_service)
+  , endpoint_(config.endpoint)
+  , reuse_port_(config.reuse_port)
+  , batch_size_(config.batch_size)
+  , max_datagram_size_(config.max_datagram_size)
+  , slab_(new char[config.batch_size * config.max_datagram_size])
+  , first_pending_(0)
+  , last_pending_(0)
+#if defined(MA_ECHO_SERVER_UDP_ECHO_HAS_MMSG)
+  , headers_(config.batch_size)
+  , iovecs_(config.batch_size)
+  , addresses_(config.batch_size)
+#else
+  , endpoints_(config.batch_size)
+  , sizes_(config.batch_size)
+#endif
+  , local_stats_()
+  , stats_mutex_()
+  , stats_()
+{
+  local_stats_.shards = 1;
+  stats_.shards = 1;
+
+#if defined(MA_ECHO_SERVER_UDP_ECHO_HAS_MMSG)
+  // Each header refers to its own buffer of slab and source address
+  for (std::size_t i = 0; i != batch_size_; ++i)
+  {
+    iovecs_[i].iov_base = slab_.get() + i * max_datagram_size_;
+    headers_[i].msg_hdr.msg_name = &addresses_[i];
+    headers_[i].msg_hdr.msg_iov = &iovecs_[i];
+    headers_[i].msg_hdr.msg_iovlen = 1;
+  }
+#endif
+}
+
+boost::system::error_code udp_echo_service::start()
+{
+  boost::system::error_code error;
+  socket_.open(endpoint_.protocol(), error);
+  if (error)
+  {
+    return error;
+  }
+
+  if (reuse_port_)
+  {
+#if defined(SO_REUSEPORT)
+    typedef boost::asio::detail::socket_option::boolean<
+        SOL_SOCKET, SO_REUSEPORT> reuse_port;
+    socket_.set_option(reuse_port(true), error);
+#else
+    error = boost::system::errc::make_error_code(
+        boost::system::errc::operation_not_supported);
+#endif
+  }
+  // Socket is read and written without wait for its readiness
+  if (!error)
+  {
+    socket_.non_blocking(true, error);
+  }
+  if (!error)
+  {
+    socket_.bind(endpoint_, error);
+  }
+  if (error)
+  {
+    boost::system::error_code ignored;
+    socket_.close(ignored);
+    return error;
+  }
+
+  start_wait_read();
+  return error;
+}
+
+udp_echo_stats udp_echo_service::stats() const
+{
+  lock_guard_type lock_guard(stats_mutex_);
+  return stats_;
+}
+
+void udp_echo_service::start_wait_read()
+{
+  socket_.async_receive(boost::asio::null_buffers(),
+      make_custom_alloc_handler(read_allocator_, boost::bind(
+          &this_type::handle_wait_read, shared_from_this(),
+          boost::asio::placeholders::error)));
+}
+
+void udp_echo_service::start_wait_write()
+{
+  socket_.async_send(boost::asio::null_buffers(),
+      make_custom_alloc_handler(write_allocator_, boost::bind(
+          &this_type::handle_wait_write, shared_from_this(),
+          boost::asio::placeholders::error)));
+}
+
+void udp_echo_service::handle_wait_read(
+    const boost::system::error_code& error)
+{
+  if (boost::asio::error::operation_aborted == error)
+  {
+    return;
+  }
+  // Error of the socket (if any) is reported by the next read
+  echo();
+}
+
+void udp_echo_service::handle_wait_write(
+    const boost::system::error_code& error)
+{
+  if (boost::asio::error::operation_aborted == error)
+  {
+    return;
+  }
+  echo();
+}
+
+void udp_echo_service::handle_yield()
+{
+  echo();
+}
+
+void udp_echo_service::echo()
+{
+  for (std::size_t i = 0; i != max_batches_per_handler; ++i)
+  {
+    if (first_pending_ == last_pending_)
+    {
+      boost::system::error_code error;
+      read_batch(error);
+      if (boost::asio::error::would_block == error)
+      {
+        update_stats();
+        start_wait_read();
+        return;
+      }
+      if (error)
+      {
+        // Transient error (like ICMP error caused by one of the previous
+        // echoes) - socket is read again after yield
+        break;
+      }
+    }
+    if (!write_batch())
+    {
+      update_stats();
+      start_wait_write();
+      return;
+    }
+  }
+
+  update_stats();
+  // Socket isn't drained yet but the other handlers have to run too
+  io_service_.post(make_custom_alloc_handler(read_allocator_,
+      boost::bind(&this_type::handle_yield, shared_from_this())));
+}
+
+#if defined(MA_ECHO_SERVER_UDP_ECHO_HAS_MMSG)
+
+void udp_echo_service::read_batch(boost::system::error_code& error)
+{
+  // Kernel updates lengths of addresses, we update lengths of buffers
+  for (std::size_t i = 0; i != batch_size_; ++i)
+  {
+    headers_[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+    headers_[i].msg_hdr.msg_iov->iov_len = max_datagram_size_;
+  }
+
+  const int received = ::recvmmsg(socket_.native_handle(), &headers_[0],
+      static_cast<unsigned int>(batch_size_), MSG_DONTWAIT, 0);
+  if (received < 0)
+  {
+    error = boost::system::error_code(errno,
+        boost::asio::error::get_system_category());
+    return;
+  }
+
+  const std::size_t size = static_cast<std::size_t>(received);
+  ++local_stats_.batches;
+  local_stats_.received += size;
+  local_stats_.max_batch = (std::max)(local_stats_.max_batch, size);
+
+  // Truncated datagrams are dropped, the rest ones are moved to the head
+  // of batch (with their buffers and addresses)
+  first_pending_ = 0;
+  last_pending_ = 0;
+  for (std::size_t i = 0; i != size; ++i)
+  {
+    mmsghdr& header = headers_[i];
+    local_stats_.received_bytes += header.msg_len;
+    if (header.msg_hdr.msg_flags & MSG_TRUNC)
+    {
+      ++local_stats_.dropped;
+      continue;
+    }
+    header.msg_hdr.msg_iov->iov_len = header.msg_len;
+    if (i != last_pending_)
+    {
+      std::swap(header, headers_[last_pending_]);
+    }
+    ++last_pending_;
+  }
+}
+
+bool udp_echo_service::write_batch()
+{
+  while (first_pending_ != last_pending_)
+  {
+    const int sent = ::sendmmsg(socket_.native_handle(),
+        &headers_[first_pending_],
+        static_cast<unsigned int>(last_pending_ - first_pending_),
+        MSG_DONTWAIT);
+    if (sent >= 0)
+    {
+      local_stats_.echoed += static_cast<std::size_t>(sent);
+      first_pending_ += static_cast<std::size_t>(sent);
+      continue;
+    }
+
+    const int error = errno;
+    if ((EAGAIN == error) || (EWOULDBLOCK == error))
+    {
+      return false;
+    }
+    if (EINTR != error)
+    {
+      // First datagram can't be sent (e.g. to unreachable source) - skip it
+      ++local_stats_.dropped;
+      ++first_pending_;
+    }
+  }
+  return true;
+}
+
+#else // defined(MA_ECHO_SERVER_UDP_ECHO_HAS_MMSG)
+
+void udp_echo_service::read_batch(boost::system::error_code& error)
+{
+  first_pending_ = 0;
+  last_pending_ = 0;
+  while (last_pending_ != batch_size_)
+  {
+    const std::size_t size = socket_.receive_from(boost::asio::buffer(
+        slab_.get() + last_pending_ * max_datagram_size_, max_datagram_size_),
+        endpoints_[last_pending_], 0, error);
+    if (boost::asio::error::message_size == error)
+    {
+      // Datagram is truncated
+      ++local_stats_.received;
+      ++local_stats_.dropped;
+      continue;
+    }
+    if (error)
+    {
+      break;
+    }
+    ++local_stats_.received;
+    local_stats_.received_bytes += size;
+    sizes_[last_pending_] = size;
+    ++last_pending_;
+  }
+
+  if (last_pending_)
+  {
+    // Error is reported by the next read
+    error = boost::system::error_code();
+    ++local_stats_.batches;
+    local_stats_.max_batch = (std::max)(local_stats_.max_batch,
+        last_pending_);
+  }
+}
+
+bool udp_echo_service::write_batch()
+{
+  for (; first_pending_ != last_pending_; ++first_pending_)
+  {
+    boost::system::error_code error;
+    socket_.send_to(boost::asio::buffer(
+        slab_.get() + first_pending_ * max_datagram_size_,
+        sizes_[first_pending_]), endpoints_[first_pending_], 0, error);
+    if (boost::asio::error::would_block == error)
+    {
+      return false;
+    }
+    if (error)
+    {
+      ++local_stats_.dropped;
+    }
+    else
+    {
+      ++local_stats_.echoed;
+    }
+  }
+  return true;
+}
+
+#endif // defined(MA_ECHO_SERVER_UDP_ECHO_HAS_MMSG)
+
+void udp_echo_service::update_stats()
+{
+  lock_guard_type lock_guard(stats_mutex_);
+  stats_ = local_stats_;
+}
+
+} // namespace server
+} // namespace echo
+} // namespace ma
@@ -0,0 +1,208 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <ma/event_trace.hpp>
+
+#if defined(MA_HAS_EVENT_TRACE)
+
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace ma {
+
+namespace {
+
+typedef boost::mutex                    mutex_type;
+typedef boost::lock_guard<mutex_type>   lock_guard_type;
+typedef std::vector<event_trace_record> record_vector;
+
+boost::uint64_t microseconds_since_epoch()
+{
+  const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+  return static_cast<boost::uint64_t>((
+      boost::posix_time::microsec_clock::universal_time() - epoch)
+          .total_microseconds());
+}
+
+// Ring buffer with the single writer - the owning thread. Readers don't
+// block the writer but check if the records were overwritten during read.
+class trace_ring : private boost::noncopyable
+{
+public:
+  trace_ring()
+    : position_(0)
+    , records_(event_trace_capacity)
+  {
+  }
+
+  void push(const event_trace_record& record)
+  {
+    const boost::uint64_t position =
+        position_.load(boost::memory_order_relaxed);
+    records_[static_cast<std::size_t>(position % event_trace_capacity)] =
+        record;
+    position_.store(position + 1, boost::memory_order_release);
+  }
+
+  record_vector records() const
+  {
+    const boost::uint64_t end = position_.load(boost::memory_order_acquire);
+    const boost::uint64_t begin = first_kept(end);
+    record_vector result;
+    result.reserve(static_cast<std::size_t>(end - begin));
+    for (boost::uint64_t i = begin; i != end; ++i)
+    {
+      result.push_back(
+          records_[static_cast<std::size_t>(i % event_trace_capacity)]);
+    }
+
+    // Drop the records that could be overwritten during copying
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    const boost::uint64_t overwritten = (std::min)(end,
+        first_kept(position_.load(boost::memory_order_relaxed) + 1));
+    result.erase(result.begin(),
+        result.begin() + static_cast<std::ptrdiff_t>(overwritten - begin));
+    return result;
+  }
+
+private:
+  static boost::uint64_t first_kept(boost::uint64_t end)
+  {
+    return end > event_trace_capacity ? end - event_trace_capacity : 0;
+  }
+
+  boost::atomic<boost::uint64_t> position_;
+  record_vector records_;
+}; // class trace_ring
+
+typedef boost::shared_ptr<trace_ring> trace_ring_ptr;
+typedef std::vector<trace_ring_ptr>   trace_ring_vector;
+
+// Rings are owned by registry and outlive their threads
+void keep_trace_ring(trace_ring*)
+{
+}
+
+class trace_registry : private boost::noncopyable
+{
+public:
+  trace_registry()
+    : start_timestamp_(read_timestamp_counter())
+    , start_microseconds_(microseconds_since_epoch())
+    , mutex_()
+    , rings_()
+    , this_thread_(&keep_trace_ring)
+  {
+  }
+
+  trace_ring& this_thread()
+  {
+    if (trace_ring* ring = this_thread_.get())
+    {
+      return *ring;
+    }
+    trace_ring_ptr ring = boost::make_shared<trace_ring>();
+    {
+      lock_guard_type lock_guard(mutex_);
+      rings_.push_back(ring);
+    }
+    this_thread_.reset(ring.get());
+    return *ring;
+  }
+
+  boost::system::error_code dump(const std::string& file_name) const
+  {
+    trace_ring_vector rings;
+    {
+      lock_guard_type lock_guard(mutex_);
+      rings = rings_;
+    }
+
+    std::ofstream file(file_name.c_str(),
+        std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+
+    event_trace_file_header header;
+    std::copy(event_trace_file_magic,
+        event_trace_file_magic + sizeof(event_trace_file_magic),
+        header.magic);
+    header.start_timestamp    = start_timestamp_;
+    header.start_microseconds = start_microseconds_;
+    header.dump_timestamp     = read_timestamp_counter();
+    header.dump_microseconds  = microseconds_since_epoch();
+    header.thread_count       = static_cast<boost::uint32_t>(rings.size());
+    header.reserved           = 0;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (std::size_t i = 0, size = rings.size(); i != size; ++i)
+    {
+      const record_vector records = rings[i]->records();
+      event_trace_thread_header thread_header;
+      thread_header.thread_index = static_cast<boost::uint32_t>(i);
+      thread_header.record_count =
+          static_cast<boost::uint32_t>(records.size());
+      file.write(reinterpret_cast<const char*>(&thread_header),
+          sizeof(thread_header));
+      if (!records.empty())
+      {
+        file.write(reinterpret_cast<const char*>(&records.front()),
+            static_cast<std::streamsize>(
+                records.size() * sizeof(event_trace_record)));
+      }
+    }
+
+    file.close();
+    if (!file)
+    {
+      return boost::system::errc::make_error_code(
+          boost::system::errc::io_error);
+    }
+    return boost::system::error_code();
+  }
+
+private:
+  const boost::uint64_t start_timestamp_;
+  const boost::uint64_t start_microseconds_;
+  mutable mutex_type                     mutex_;
+  trace_ring_vector                      rings_;
+  boost::thread_specific_ptr<trace_ring> this_thread_;
+}; // class trace_registry
+
+// Is constructed before main so there is no need in thread-safe
+// initialization
+trace_registry registry;
+
+} // anonymous namespace
+
+void trace_event(boost::uint32_t type, const void* object, int error,
+    boost::uint64_t value)
+{
+  event_trace_record record;
+  record.timestamp = read_timestamp_counter();
+  record.object    = reinterpret_cast<std::size_t>(object);
+  record.value     = value;
+  record.type      = type;
+  record.error     = error;
+  registry.this_thread().push(record);
+}
+
+boost::system::error_code dump_event_trace(const std::string& file_name)
+{
+  return registry.dump(file_name);
+}
+
+} // namespace ma
+
+#endif // defined(MA_HAS_EVENT_TRACE)
@@ -0,0 +1,146 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <ma/handler_timing.hpp>
+
+#if defined(MA_HAS_HANDLER_TIMING)
+
+#include <boost/assert.hpp>
+#include <boost/optional.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace ma {
+
+namespace {
+
+typedef boost::mutex                  mutex_type;
+typedef boost::lock_guard<mutex_type> lock_guard_type;
+
+// Statistics of single thread. The mutex is locked by the owning thread
+// and by collect_handler_timing only so it is (almost) never contended.
+class thread_timing : private boost::noncopyable
+{
+public:
+  thread_timing()
+    : stats_(max_handler_timing_tag_count)
+  {
+  }
+
+  void record(std::size_t tag,
+      const boost::optional<duration_histogram::duration_type>& delay,
+      const duration_histogram::duration_type& run_time)
+  {
+    lock_guard_type lock_guard(mutex_);
+    handler_timing_stats& stats = stats_[tag];
+    if (delay)
+    {
+      stats.delay.add(*delay);
+    }
+    stats.run_time.add(run_time);
+  }
+
+  handler_timing_stats_vector stats() const
+  {
+    lock_guard_type lock_guard(mutex_);
+    return stats_;
+  }
+
+private:
+  mutable mutex_type          mutex_;
+  handler_timing_stats_vector stats_;
+}; // class thread_timing
+
+typedef boost::shared_ptr<thread_timing> thread_timing_ptr;
+typedef std::vector<thread_timing_ptr>   thread_timing_vector;
+
+// Statistics are owned by registry and outlive their threads
+void keep_thread_timing(thread_timing*)
+{
+}
+
+class timing_registry : private boost::noncopyable
+{
+public:
+  timing_registry()
+    : mutex_()
+    , threads_()
+    , this_thread_(&keep_thread_timing)
+  {
+  }
+
+  thread_timing& this_thread()
+  {
+    if (thread_timing* timing = this_thread_.get())
+    {
+      return *timing;
+    }
+    thread_timing_ptr timing = boost::make_shared<thread_timing>();
+    {
+      lock_guard_type lock_guard(mutex_);
+      threads_.push_back(timing);
+    }
+    this_thread_.reset(timing.get());
+    return *timing;
+  }
+
+  std::vector<handler_timing_stats_vector> collect() const
+  {
+    thread_timing_vector threads;
+    {
+      lock_guard_type lock_guard(mutex_);
+      threads = threads_;
+    }
+    std::vector<handler_timing_stats_vector> stats;
+    stats.reserve(threads.size());
+    for (thread_timing_vector::const_iterator i = threads.begin(),
+        end = threads.end(); i != end; ++i)
+    {
+      stats.push_back((*i)->stats());
+    }
+    return stats;
+  }
+
+private:
+  mutable mutex_type                        mutex_;
+  thread_timing_vector                      threads_;
+  boost::thread_specific_ptr<thread_timing> this_thread_;
+}; // class timing_registry
+
+// Is constructed before main so there is no need in thread-safe
+// initialization
+timing_registry registry;
+
+} // anonymous namespace
+
+void record_handler_timing(std::size_t tag,
+    const boost::posix_time::ptime& post_time,
+    const boost::posix_time::ptime& start_time,
+    const boost::posix_time::ptime& end_time)
+{
+  BOOST_ASSERT_MSG(tag < max_handler_timing_tag_count, "Invalid tag");
+  // Post time of I/O handler isn't known
+  boost::optional<duration_histogram::duration_type> delay;
+  if (!post_time.is_not_a_date_time())
+  {
+    delay = start_time - post_time;
+  }
+  registry.this_thread().record(tag, delay, end_time - start_time);
+}
+
+std::vector<handler_timing_stats_vector> collect_handler_timing()
+{
+  return registry.collect();
+}
+
+} // namespace ma
+
+#endif // defined(MA_HAS_HANDLER_TIMING)
@@ -0,0 +1,486 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#if defined(WIN32)
+#include <tchar.h>
+#endif
+
+#include <cstdlib>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <exception>
+#include <boost/assert.hpp>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/system/error_code.hpp>
+#include <ma/config.hpp>
+#include <ma/cyclic_buffer.hpp>
+#include <ma/frame_parser.hpp>
+#include <ma/line_parser.hpp>
+#include <ma/http_request_parser.hpp>
+#include <ma/open_hash_map.hpp>
+
+namespace ma {
+namespace test {
+
+namespace frame_parsing {
+
+void run_test();
+
+} // namespace frame_parsing
+
+namespace line_parsing {
+
+void run_test();
+
+} // namespace line_parsing
+
+namespace http_request_parsing {
+
+void run_test();
+
+} // namespace http_request_parsing
+
+namespace open_hash_map_probing {
+
+void run_test();
+
+} // namespace open_hash_map_probing
+
+} // namespace test
+} // namespace ma
+
+#if defined(WIN32)
+int _tmain(int /*argc*/, _TCHAR* /*argv*/[])
+#else
+int main(int /*argc*/, char* /*argv*/[])
+#endif
+{
+  try
+  {
+    ma::test::frame_parsing::run_test();
+    ma::test::line_parsing::run_test();
+    ma::test::http_request_parsing::run_test();
+    ma::test::open_hash_map_probing::run_test();
+    return EXIT_SUCCESS;
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "Unexpected exception: " << e.what() << std::endl;
+  }
+  catch (...)
+  {
+    std::cerr << "Unknown exception" << std::endl;
+  }
+  return EXIT_FAILURE;
+}
+
+namespace ma {
+namespace test {
+
+typedef cyclic_buffer::const_buffers_type buffers_type;
+typedef std::vector<std::string> string_vector;
+
+// Moves both sequences of (empty) buffer, so the following data starts
+// at the given offset and can wrap the end of buffer
+void shift_buffer(cyclic_buffer& buffer, std::size_t offset)
+{
+  buffer.reset();
+  buffer.consume(offset);
+  buffer.commit(offset);
+}
+
+void append_buffer(cyclic_buffer& buffer, const std::string& data)
+{
+  const std::size_t size = boost::asio::buffer_copy(buffer.prepared(),
+      boost::asio::buffer(data));
+  BOOST_ASSERT_MSG(data.size() == size, "Buffer is too small");
+  buffer.consume(size);
+}
+
+std::string to_string(const buffers_type& buffers)
+{
+  std::string data(boost::asio::buffer_size(buffers), '\0');
+  if (!data.empty())
+  {
+    boost::asio::buffer_copy(boost::asio::buffer(&data[0], data.size()),
+        buffers);
+  }
+  return data;
+}
+
+bool is_wrapped(const buffers_type& buffers)
+{
+  return 2 == static_cast<std::size_t>(buffers.end() - buffers.begin());
+}
+
+void append_message(string_vector& messages, const buffers_type& message)
+{
+  messages.push_back(to_string(message));
+}
+
+namespace frame_parsing {
+
+std::string make_frame(const std::string& payload)
+{
+  std::string frame(frame_parser::header_size, '\0');
+  const std::size_t size = payload.size();
+  frame[0] = static_cast<char>((size >> 24) & 0xff);
+  frame[1] = static_cast<char>((size >> 16) & 0xff);
+  frame[2] = static_cast<char>((size >> 8) & 0xff);
+  frame[3] = static_cast<char>(size & 0xff);
+  return frame + payload;
+}
+
+void run_test()
+{
+  std::cout << "*** ma::test::frame_parsing ***" << std::endl;
+
+  const ma::frame_parser parser(8);
+  cyclic_buffer buffer(16);
+
+  // Payload wraps the end of buffer
+  {
+    shift_buffer(buffer, 10);
+    append_buffer(buffer, make_frame("abcdefgh"));
+    BOOST_ASSERT_MSG(is_wrapped(buffer.data()), "Data isn't wrapped");
+
+    string_vector frames;
+    boost::system::error_code error;
+    const ma::frame_parser::batch batch = parser.parse(buffer.data(), 0,
+        boost::bind(&append_message, boost::ref(frames), _1), error);
+    BOOST_ASSERT_MSG(!error, "Unexpected error");
+    BOOST_ASSERT_MSG(1 == batch.count, "Invalid number of frames");
+    BOOST_ASSERT_MSG(12 == batch.size, "Invalid size of frames");
+    BOOST_ASSERT_MSG("abcdefgh" == frames.front(), "Invalid payload");
+  }
+
+  // Header wraps the end of buffer
+  {
+    shift_buffer(buffer, 14);
+    append_buffer(buffer, make_frame("xyz"));
+
+    string_vector frames;
+    boost::system::error_code error;
+    const ma::frame_parser::batch batch = parser.parse(buffer.data(), 0,
+        boost::bind(&append_message, boost::ref(frames), _1), error);
+    BOOST_ASSERT_MSG(!error, "Unexpected error");
+    BOOST_ASSERT_MSG(1 == batch.count, "Invalid number of frames");
+    BOOST_ASSERT_MSG("xyz" == frames.front(), "Invalid payload");
+  }
+
+  // Incomplete frame is left for the next parse
+  {
+    shift_buffer(buffer, 12);
+    append_buffer(buffer,
+        make_frame("") + make_frame("abcdefgh").substr(0, 7));
+
+    boost::system::error_code error;
+    ma::frame_parser::batch batch = parser.parse(buffer.data(), 0, error);
+    BOOST_ASSERT_MSG(!error, "Unexpected error");
+    BOOST_ASSERT_MSG(1 == batch.count, "Invalid number of frames");
+    BOOST_ASSERT_MSG(4 == batch.size, "Invalid size of frames");
+
+    buffer.commit(batch.size);
+    append_buffer(buffer, "defgh");
+    batch = parser.parse(buffer.data(), 0, error);
+    BOOST_ASSERT_MSG(!error, "Unexpected error");
+    BOOST_ASSERT_MSG(1 == batch.count, "Invalid number of frames");
+    BOOST_ASSERT_MSG(12 == batch.size, "Invalid size of frames");
+  }
+
+  // Payload of maximum size is accepted, the larger one isn't
+  {
+    shift_buffer(buffer, 0);
+    append_buffer(buffer, make_frame("12345678"));
+    append_buffer(buffer, make_frame("").substr(0, 3) + "\x09");
+
+    boost::system::error_code error;
+    const ma::frame_parser::batch batch = parser.parse(buffer.data(), 0,
+        error);
+    BOOST_ASSERT_MSG(boost::asio::error::message_size == error,
+        "Oversized frame isn't detected");
+    BOOST_ASSERT_MSG(1 == batch.count, "Invalid number of frames");
+    BOOST_ASSERT_MSG(12 == batch.size, "Invalid size of frames");
+  }
+
+  // Parse continues from the given offset
+  {
+    shift_buffer(buffer, 6);
+    append_buffer(buffer, make_frame("ab") + make_frame("cd"));
+
+    string_vector frames;
+    boost::system::error_code error;
+    const ma::frame_parser::batch batch = parser.parse(buffer.data(), 6,
+        boost::bind(&append_message, boost::ref(frames), _1), error);
+    BOOST_ASSERT_MSG(!error, "Unexpected error");
+    BOOST_ASSERT_MSG(1 == batch.count, "Invalid number of frames");
+    BOOST_ASSERT_MSG("cd" == frames.front(), "Invalid payload");
+  }
+}
+
+} // namespace frame_parsing
+
+namespace line_parsing {
+
+void run_test()
+{
+  std::cout << "*** ma::test::line_parsing ***" << std::endl;
+
+  const ma::line_parser parser(8);
+  cyclic_buffer buffer(16);
+
+  // Line wraps the end of buffer
+  {
+    shift_buffer(buffer, 12);
+    append_buffer(buffer, "GET key\r\n");
+    BOOST_ASSERT_MSG(is_wrapped(buffer.data()), "Data isn't wrapped");
+
+    string_vector lines;
+    boost::system::error_code error;
+    const ma::line_parser::batch batch = parser.parse(buffer.data(), 0,
+        boost::bind(&append_message, boost::ref(lines), _1), error);
+    BOOST_ASSERT_MSG(!error, "Unexpected error");
+    BOOST_ASSERT_MSG(1 == batch.count, "Invalid number of lines");
+    BOOST_ASSERT_MSG(9 == batch.size, "Invalid size of lines");
+    BOOST_ASSERT_MSG("GET key" == lines.front(), "Invalid line");
+  }
+
+  // CR is the last byte of buffer and LF is the first one
+  {
+    shift_buffer(buffer, 12);
+    append_buffer(buffer, "abc\r");
+
+    string_vector lines;
+    boost::system::error_code error;
+    ma::line_parser::batch batch = parser.parse(buffer.data(), 0,
+        boost::bind(&append_message, boost::ref(lines), _1), error);
+    BOOST_ASSERT_MSG(!error, "Unexpected error");
+    BOOST_ASSERT_MSG(!batch.count, "Line without LF is parsed");
+
+    append_buffer(buffer, "\n\n");
+    batch = parser.parse(buffer.data(), 0,
+        boost::bind(&append_message, boost::ref(lines), _1), error);
+    BOOST_ASSERT_MSG(!error, "Unexpected error");
+    BOOST_ASSERT_MSG(2 == batch.count, "Invalid number of lines");
+    BOOST_ASSERT_MSG(6 == batch.size, "Invalid size of lines");
+    BOOST_ASSERT_MSG("abc" == lines[0], "CR isn't removed");
+    BOOST_ASSERT_MSG(lines[1].empty(), "Invalid empty line");
+  }
+
+  // Incomplete line of maximum size is an error, the shorter one isn't
+  {
+    shift_buffer(buffer, 4);
+    append_buffer(buffer, "1234567");
+
+    string_vector lines;
+    boost::system::error_code error;
+    ma::line_parser::batch batch = parser.parse(buffer.data(), 0,
+        boost::bind(&append_message, boost::ref(lines), _1), error);
+    BOOST_ASSERT_MSG(!error, "Unexpected error");
+    BOOST_ASSERT_MSG(!batch.count, "Incomplete line is parsed");
+
+    append_buffer(buffer, "8");
+    batch = parser.parse(buffer.data(), 0,
+        boost::bind(&append_message, boost::ref(lines), _1), error);
+    BOOST_ASSERT_MSG(boost::asio::error::message_size == error,
+        "Oversized line isn't detected");
+
+    // Line completed in the same data is accepted
+    append_buffer(buffer, "\r\n");
+    batch = parser.parse(buffer.data(), 0,
+        boost::bind(&append_message, boost::ref(lines), _1), error);
+    BOOST_ASSERT_MSG(!error, "Unexpected error");
+    BOOST_ASSERT_MSG(1 == batch.count, "Invalid number of lines");
+    BOOST_ASSERT_MSG("12345678" == lines.front(), "Invalid line");
+  }
+}
+
+} // namespace line_parsing
+
+namespace http_request_parsing {
+
+void run_test()
+{
+  std::cout << "*** ma::test::http_request_parsing ***" << std::endl;
+
+  const std::string request = "GET / HTTP/1.1\r\nHost: a\r\n\r\n";
+  const ma::http_request_parser parser(request.size() + 1);
+  cyclic_buffer buffer(64);
+
+  // Request wraps the end of buffer
+  {
+    shift_buffer(buffer, 50);
+    append_buffer(buffer, request + request);
+    BOOST_ASSERT_MSG(is_wrapped(buffer.data()), "Data isn't wrapped");
+
+    boost::system::error_code error;
+    const ma::http_request_parser::batch batch =
+        parser.parse(buffer.data(), 0, error);
+    BOOST_ASSERT_MSG(!error, "Unexpected error");
+    BOOST_ASSERT_MSG(2 == batch.count, "Invalid number of requests");
+    BOOST_ASSERT_MSG(2 * request.size() == batch.size,
+        "Invalid size of requests");
+  }
+
+  // Empty line is split by the end of buffer and by the end of data
+  {
+    const std::size_t split = request.size() - 1;
+    shift_buffer(buffer, 64 - request.size() + 2);
+    append_buffer(buffer, request.substr(0, split));
+
+    boost::system::error_code error;
+    ma::http_request_parser::batch batch =
+        parser.parse(buffer.data(), 0, error);
+    BOOST_ASSERT_MSG(!error, "Unexpected error");
+    BOOST_ASSERT_MSG(!batch.count, "Incomplete request is parsed");
+
+    append_buffer(buffer, request.substr(split));
+    batch = parser.parse(buffer.data(), 0, error);
+    BOOST_ASSERT_MSG(!error, "Unexpected error");
+    BOOST_ASSERT_MSG(1 == batch.count, "Invalid number of requests");
+    BOOST_ASSERT_MSG(request.size() == batch.size, "Invalid size of request");
+  }
+
+  // Incomplete request of maximum size is an error, the shorter one isn't
+  {
+    shift_buffer(buffer, 0);
+    append_buffer(buffer, std::string(request.size(), 'x'));
+
+    boost::system::error_code error;
+    ma::http_request_parser::batch batch =
+        parser.parse(buffer.data(), 0, error);
+    BOOST_ASSERT_MSG(!error, "Unexpected error");
+
+    append_buffer(buffer, "x");
+    batch = parser.parse(buffer.data(), 0, error);
+    BOOST_ASSERT_MSG(boost::asio::error::message_size == error,
+        "Oversized request isn't detected");
+  }
+
+  // Only GET requests are supported
+  {
+    shift_buffer(buffer, 0);
+    append_buffer(buffer, request + "PUT / HTTP/1.1\r\n\r\n");
+
+    boost::system::error_code error;
+    const ma::http_request_parser::batch batch =
+        parser.parse(buffer.data(), 0, error);
+    BOOST_ASSERT_MSG(boost::asio::error::operation_not_supported == error,
+        "Unsupported request isn't detected");
+    BOOST_ASSERT_MSG(1 == batch.count, "Invalid number of requests");
+  }
+}
+
+} // namespace http_request_parsing
+
+namespace open_hash_map_probing {
+
+typedef ma::open_hash_map::hash_type hash_type;
+
+bool has_value(const ma::open_hash_map& map, const std::string& key,
+    hash_type key_hash, const std::string& value)
+{
+  const std::string* found = map.find(boost::asio::buffer(key), key_hash);
+  return found && (value == *found);
+}
+
+void run_test()
+{
+  std::cout << "*** ma::test::open_hash_map_probing ***" << std::endl;
+
+  // Hashes are chosen by test, so probe sequences wrap the end of table
+  {
+    ma::open_hash_map map(8, 8);
+    BOOST_ASSERT_MSG(8 == map.capacity(), "Invalid capacity");
+    map.insert(boost::asio::buffer(std::string("a")),
+        boost::asio::buffer(std::string("1")), 7);
+    map.insert(boost::asio::buffer(std::string("b")),
+        boost::asio::buffer(std::string("2")), 7);
+    map.insert(boost::asio::buffer(std::string("c")),
+        boost::asio::buffer(std::string("3")), 15);
+    map.insert(boost::asio::buffer(std::string("d")),
+        boost::asio::buffer(std::string("4")), 0);
+
+    // Erase of "a" shifts back "b" and "c" across the end of table and "d"
+    // after them
+    BOOST_ASSERT_MSG(map.erase(boost::asio::buffer(std::string("a")), 7),
+        "Key isn't erased");
+    BOOST_ASSERT_MSG(!map.find(boost::asio::buffer(std::string("a")), 7),
+        "Erased key is found");
+    BOOST_ASSERT_MSG(has_value(map, "b", 7, "2"), "Shifted key is lost");
+    BOOST_ASSERT_MSG(has_value(map, "c", 15, "3"), "Shifted key is lost");
+    BOOST_ASSERT_MSG(has_value(map, "d", 0, "4"), "Shifted key is lost");
+
+    // Erase of "c" shifts "d" back to its home slot
+    BOOST_ASSERT_MSG(map.erase(boost::asio::buffer(std::string("c")), 15),
+        "Key isn't erased");
+    BOOST_ASSERT_MSG(has_value(map, "b", 7, "2"), "Key is lost");
+    BOOST_ASSERT_MSG(has_value(map, "d", 0, "4"), "Key is lost");
+    BOOST_ASSERT_MSG(2 == map.size(), "Invalid size");
+    BOOST_ASSERT_MSG(!map.erase(boost::asio::buffer(std::string("c")), 15),
+        "Erased key is erased again");
+  }
+
+  // Insert grows the table filled by 3/4 and keeps colliding keys
+  {
+    ma::open_hash_map map(8, 100);
+    for (char key = 'a'; key != 'g'; ++key)
+    {
+      map.insert(boost::asio::buffer(std::string(1, key)),
+          boost::asio::buffer(std::string(1, key)), 7 + (key & 1) * 8);
+    }
+    BOOST_ASSERT_MSG(8 == map.capacity(), "Table grows too early");
+
+    map.insert(boost::asio::buffer(std::string("g")),
+        boost::asio::buffer(std::string("g")), 15);
+    BOOST_ASSERT_MSG(16 == map.capacity(), "Table doesn't grow");
+    BOOST_ASSERT_MSG(7 == map.size(), "Invalid size");
+    for (char key = 'a'; key != 'h'; ++key)
+    {
+      const std::string value(1, key);
+      BOOST_ASSERT_MSG(has_value(map, value, 7 + (key & 1) * 8, value),
+          "Key is lost by growth");
+    }
+  }
+
+  // Keys wrapping the end of cyclic buffer, map of limited size
+  {
+    cyclic_buffer buffer(8);
+    shift_buffer(buffer, 6);
+    append_buffer(buffer, "key1");
+    const buffers_type key = buffer.data();
+    BOOST_ASSERT_MSG(is_wrapped(key), "Key isn't wrapped");
+    const hash_type key_hash = ma::open_hash_map::hash(key);
+    BOOST_ASSERT_MSG(
+        ma::open_hash_map::hash(boost::asio::buffer(std::string("key1")))
+            == key_hash, "Hash depends on the blocks of key");
+
+    ma::open_hash_map map(8, 1);
+    BOOST_ASSERT_MSG(map.insert(key, boost::asio::buffer(std::string("x")),
+        key_hash), "Key isn't inserted");
+    BOOST_ASSERT_MSG(has_value(map, "key1", key_hash, "x"), "Key isn't found");
+
+    // Full map replaces values of existing keys only
+    BOOST_ASSERT_MSG(map.insert(boost::asio::buffer(std::string("key1")),
+        buffer.data(), key_hash), "Value isn't replaced");
+    BOOST_ASSERT_MSG(has_value(map, "key1", key_hash, "key1"),
+        "Value isn't replaced");
+    BOOST_ASSERT_MSG(!map.insert(boost::asio::buffer(std::string("key2")),
+        boost::asio::buffer(std::string("y")), key_hash + 1),
+        "Key is inserted into full map");
+    BOOST_ASSERT_MSG(1 == map.size(), "Invalid size");
+  }
+}
+
+} // namespace open_hash_map_probing
+
+} // namespace test
+} // namespace ma
@@ -0,0 +1,400 @@
+//
+// Copyright (c) 2010-2013 Marat Abrarov (abrarov@mail.ru)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#if defined(WIN32)
+#include <tchar.h>
+#endif
+
+#include <cstdlib>
+#include <cstddef>
+#include <vector>
+#include <iostream>
+#include <exception>
+#include <limits>
+#include <boost/assert.hpp>
+#include <boost/ref.hpp>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/optional.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/utility/in_place_factory.hpp>
+#include <ma/config.hpp>
+#include <ma/echo/server/error.hpp>
+#include <ma/echo/server/session.hpp>
+#include <ma/echo/server/session_config.hpp>
+#include <ma/echo/server/session_stats.hpp>
+
+namespace ma {
+namespace test {
+
+namespace zerocopy_migration {
+
+void run_test();
+
+} // namespace zerocopy_migration
+
+namespace zerocopy_stop {
+
+void run_test();
+
+} // namespace zerocopy_stop
+
+} // namespace test
+} // namespace ma
+
+#if defined(WIN32)
+int _tmain(int /*argc*/, _TCHAR* /*argv*/[])
+#else
+int main(int /*argc*/, char* /*argv*/[])
+#endif
+{
+  try
+  {
+    ma::test::zerocopy_migration::run_test();
+    ma::test::zerocopy_stop::run_test();
+    return EXIT_SUCCESS;
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "Unexpected exception: " << e.what() << std::endl;
+  }
+  catch (...)
+  {
+    std::cerr << "Unknown exception" << std::endl;
+  }
+  return EXIT_FAILURE;
+}
+
+namespace ma {
+namespace test {
+
+class io_service_pool : private boost::noncopyable
+{
+public:
+  io_service_pool(boost::asio::io_service& io_service, std::size_t size)
+    : work_guard_(boost::in_place(boost::ref(io_service)))
+  {
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      threads_.create_thread(
+          boost::bind(&boost::asio::io_service::run, &io_service));
+    }
+  }
+
+  ~io_service_pool()
+  {
+    boost::asio::io_service& io_service = work_guard_->get_io_service();
+    work_guard_ = boost::none;
+    io_service.stop();
+    threads_.join_all();
+  }
+
+private:
+  typedef boost::optional<boost::asio::io_service::work> optional_io_work;
+
+  optional_io_work    work_guard_;
+  boost::thread_group threads_;
+}; // class io_service_pool
+
+class threshold : boost::noncopyable
+{
+private:
+  typedef threshold this_type;
+  typedef boost::mutex mutex_type;
+  typedef boost::unique_lock<mutex_type> lock_type;
+  typedef boost::condition_variable condition_variable_type;
+
+public:
+  typedef std::size_t value_type;
+
+  explicit threshold(value_type value = 0)
+    : value_(value)
+  {
+  }
+
+  void wait()
+  {
+    lock_type lock(mutex_);
+    while (value_)
+    {
+      condition_variable_.wait(lock);
+    }
+  }
+
+  // Returns false if value doesn't become zero in time
+  bool wait(const boost::posix_time::time_duration& timeout)
+  {
+    const boost::system_time deadline = boost::get_system_time() + timeout;
+    lock_type lock(mutex_);
+    while (value_)
+    {
+      if (!condition_variable_.timed_wait(lock, deadline))
+      {
+        return !value_;
+      }
+    }
+    return true;
+  }
+
+  void inc()
+  {
+    lock_type lock(mutex_);
+    BOOST_ASSERT_MSG(value_ != (std::numeric_limits<value_type>::max)(),
+        "Value is too large. Overflow");
+    ++value_;
+  }
+
+  void dec()
+  {
+    lock_type lock(mutex_);
+    BOOST_ASSERT_MSG(value_, "Value is too small. Underflow");
+    --value_;
+    if (!value_)
+    {
+      condition_variable_.notify_one();
+    }
+  }
+
+private:
+  mutex_type mutex_;
+  condition_variable_type condition_variable_;
+  value_type value_;
+}; // class threshold
+
+typedef boost::asio::ip::tcp protocol_type;
+typedef std::vector<char>    data_type;
+
+void handle_session_operation(threshold& done,
+    boost::system::error_code& result, const boost::system::error_code& error)
+{
+  result = error;
+  done.dec();
+}
+
+void start_session(const echo::server::session_ptr& session)
+{
+  boost::system::error_code error;
+  threshold done(1);
+  session->async_start(boost::bind(handle_session_operation,
+      boost::ref(done), boost::ref(error), _1));
+  done.wait();
+  BOOST_ASSERT_MSG(!error, "Session has to start");
+}
+
+namespace zerocopy_migration {
+
+const std::size_t buffer_size   = 65536;
+const std::size_t message_size  = 16384;
+// Enough to make more zerocopy sends than session keeps outstanding
+const std::size_t message_count = 64;
+
+void handle_client_write(threshold& done, boost::system::error_code& result,
+    const boost::system::error_code& error, std::size_t /*bytes_transferred*/)
+{
+  result = error;
+  done.dec();
+}
+
+void handle_client_read(threshold& done, boost::asio::deadline_timer& timer,
+    boost::system::error_code& result, const boost::system::error_code& error,
+    std::size_t /*bytes_transferred*/)
+{
+  result = error;
+  timer.cancel();
+  done.dec();
+}
+
+void handle_timeout(threshold& done, protocol_type::socket& socket,
+    const boost::system::error_code& error)
+{
+  if (!error)
+  {
+    // Echo is stuck
+    socket.cancel();
+  }
+  done.dec();
+}
+
+// Writes message and reads its echo, returns false if echo doesn't come
+// in time
+bool echo_message(boost::asio::io_service& io_service,
+    protocol_type::socket& socket, char fill)
+{
+  const data_type message(message_size, fill);
+  data_type echo(message_size);
+  boost::system::error_code write_error;
+  boost::system::error_code read_error;
+  boost::asio::deadline_timer timer(io_service,
+      boost::posix_time::seconds(10));
+
+  // Timer wait is started first because read completion cancels it
+  threshold done(3);
+  timer.async_wait(boost::bind(handle_timeout, boost::ref(done),
+      boost::ref(socket), _1));
+  boost::asio::async_write(socket, boost::asio::buffer(message),
+      boost::bind(handle_client_write, boost::ref(done),
+          boost::ref(write_error), _1, _2));
+  boost::asio::async_read(socket, boost::asio::buffer(echo),
+      boost::bind(handle_client_read, boost::ref(done), boost::ref(timer),
+          boost::ref(read_error), _1, _2));
+  done.wait();
+
+  return !write_error && !read_error && (message == echo);
+}
+
+void run_test()
+{
+  std::cout << "*** ma::test::zerocopy_migration ***" << std::endl;
+
+  boost::asio::io_service io_service;
+  io_service_pool work_threads(io_service, 1);
+
+  // All the writes of session are zerocopy ones
+  const echo::server::session_config config(buffer_size, buffer_size,
+      echo::server::session_config::optional_int(),
+      echo::server::session_config::optional_int(),
+      echo::server::session_config::optional_bool(),
+      echo::server::session_config::optional_time_duration(),
+      echo::server::session_config::optional_int(),
+      echo::server::session_config::optional_size(),
+      echo::server::session_config::optional_size(),
+      echo::server::session_config::optional_size(),
+      echo::server::session_config::optional_size(),
+      echo::server::session_config::optional_time_duration(),
+      echo::server::session_config::optional_size(1024));
+
+  protocol_type::acceptor acceptor(io_service, protocol_type::endpoint(
+      boost::asio::ip::address_v4::loopback(), 0));
+  protocol_type::socket client(io_service);
+  client.connect(acceptor.local_endpoint());
+
+  echo::server::session_ptr source =
+      echo::server::session::create(io_service, config);
+  acceptor.accept(source->socket());
+  start_session(source);
+
+  // Kernel numbers zerocopy sends of the connection
+  for (std::size_t i = 0; i != message_count; ++i)
+  {
+    const bool echoed = echo_message(io_service, client, 'a');
+    BOOST_ASSERT_MSG(echoed, "Echo before migration has to come");
+  }
+
+  boost::system::error_code error;
+  {
+    threshold done(1);
+    source->async_detach(boost::bind(handle_session_operation,
+        boost::ref(done), boost::ref(error), _1));
+    done.wait();
+  }
+
+  echo::server::session_ptr target =
+      echo::server::session::create(io_service, config);
+  error = target->adopt(*source);
+  BOOST_ASSERT_MSG(!error, "Session has to adopt connection");
+  start_session(target);
+
+  // Notifications of the sends done after migration continue numbering
+  // of the sends done before it
+  for (std::size_t i = 0; i != message_count; ++i)
+  {
+    const bool echoed = echo_message(io_service, client, 'b');
+    BOOST_ASSERT_MSG(echoed, "Echo after migration has to come");
+  }
+
+  // Session shuts connection down gracefully so client closes it first
+  client.close();
+  {
+    threshold done(1);
+    target->async_stop(boost::bind(handle_session_operation,
+        boost::ref(done), boost::ref(error), _1));
+    done.wait();
+  }
+}
+
+} // namespace zerocopy_migration
+
+namespace zerocopy_stop {
+
+const std::size_t buffer_size  = 65536;
+// Session keeps reading (is active) while echo is in its send queue
+const std::size_t message_size = 16384;
+
+void run_test()
+{
+  std::cout << "*** ma::test::zerocopy_stop ***" << std::endl;
+
+  boost::asio::io_service io_service;
+  io_service_pool work_threads(io_service, 1);
+
+  // Session stops by itself when client doesn't read echo
+  const echo::server::session_config config(buffer_size, buffer_size,
+      echo::server::session_config::optional_int(),
+      echo::server::session_config::optional_int(),
+      echo::server::session_config::optional_bool(),
+      echo::server::session_config::optional_time_duration(
+          boost::posix_time::milliseconds(200)),
+      echo::server::session_config::optional_int(),
+      echo::server::session_config::optional_size(),
+      echo::server::session_config::optional_size(),
+      echo::server::session_config::optional_size(),
+      echo::server::session_config::optional_size(),
+      echo::server::session_config::optional_time_duration(),
+      echo::server::session_config::optional_size(1024));
+
+  protocol_type::acceptor acceptor(io_service, protocol_type::endpoint(
+      boost::asio::ip::address_v4::loopback(), 0));
+  protocol_type::socket client(io_service);
+  // Echo stays in the send queue of session
+  client.open(protocol_type::v4());
+  client.set_option(protocol_type::socket::receive_buffer_size(8192));
+  client.connect(acceptor.local_endpoint());
+
+  echo::server::session_ptr session =
+      echo::server::session::create(io_service, config);
+  acceptor.accept(session->socket());
+  start_session(session);
+
+  const data_type message(message_size, 'a');
+  boost::system::error_code error;
+  {
+    threshold done(1);
+    session->async_wait(boost::bind(handle_session_operation,
+        boost::ref(done), boost::ref(error), _1));
+    boost::asio::write(client, boost::asio::buffer(message));
+    done.wait();
+  }
+  BOOST_ASSERT_MSG(error == echo::server::error::inactivity_timeout,
+      "Session has to stop by inactivity timeout");
+
+  threshold done(1);
+  session->async_stop(boost::bind(handle_session_operation,
+      boost::ref(done), boost::ref(error), _1));
+
+  // Stopped session (and its buffer) is reused so the stop waits till
+  // kernel releases zerocopy sends
+  const bool stopped = done.wait(boost::posix_time::milliseconds(500));
+  BOOST_ASSERT_MSG(!stopped, "Stop has to wait for zerocopy sends");
+
+  data_type echo(message_size);
+  boost::asio::read(client, boost::asio::buffer(echo));
+  BOOST_ASSERT_MSG(message == echo, "Echo has to come");
+  done.wait();
+  client.close();
+}
+
+} // namespace zerocopy_stop
+
+} // namespace test
+} // namespace ma